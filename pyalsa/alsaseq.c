@@ -21,6 +21,20 @@
 #include "common.h"
 #include <alsa/asoundlib.h>
 #include <stdio.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <ctype.h>
+#include <regex.h>
+
+/* the buffer, slice and UTF-8 string calls need Python 3.6; setup.py
+   skips this module for older versions */
+#if PY_VERSION_HEX < 0x03060000
+#error "pyalsa.alsaseq requires Python 3.6 or newer"
+#endif
 
 /*
  *
@@ -194,16 +208,13 @@
   }
 
 /* sets ext info dict (used by SeqEvent_get_data) */
-#define SETDICT_EXT {					\
-    snd_seq_ev_ext_t *data = &(event->data.ext);	\
-    PyObject *list = PyList_New(data->len);		\
-    unsigned i = 0;					\
-    unsigned char *t = (unsigned char *) data->ptr;	\
-    for (i = 0; i < data->len; i++) {			\
-      PyList_SetItem(list, i, PyInt_FromLong(t[i]));	\
-    }							\
-    SETDICTOBJ("ext", list);				\
-    Py_DECREF(list);					\
+#define SETDICT_EXT {						\
+    snd_seq_ev_ext_t *data = &(event->data.ext);		\
+    PyObject *bytes =						\
+      PyBytes_FromStringAndSize((const char *)data->ptr,	\
+				data->len);			\
+    SETDICTOBJ("ext", bytes);					\
+    Py_XDECREF(bytes);						\
   }
 
 /* gets integer from python param */
@@ -238,43 +249,12 @@
     }								\
   }
 
-/* gets ext data from python list */
-#define GETDICTEXT(name) {						\
-    PyObject *list = PyDict_GetItemString(dict, name);			\
-    if (list != NULL) {							\
-      if (!PyList_Check(list)) {					\
-	PyErr_SetString(PyExc_TypeError,				\
-			name " must be a list of integers");		\
-	return NULL;							\
-      }									\
-      FREECHECKED("buff", self->buff);					\
-      int len = PyList_Size(list);					\
-      self->event->data.ext.len = len;					\
-      if (len > 0) {							\
-	self->buff = malloc(len);					\
-	if (self->buff == NULL) {					\
-	  PyErr_SetString(PyExc_TypeError,				\
-			name " no memory");				\
-	  self->event->data.ext.len = 0;				\
-	  return NULL;							\
-	}								\
-	int i;								\
-	long val;							\
-	for (i = 0; i < len; i++) {					\
-	  PyObject *item = PyList_GetItem(list, i);			\
-	  if (get_long1(item, &val)) {					\
-	    PyErr_SetString(PyExc_TypeError,				\
-			    name " must be a list of integers");	\
-	    self->event->data.ext.len = 0;				\
-	    free(self->buff);                   			\
-	    self->buff = NULL;                   			\
-	    return NULL;						\
-	  }								\
-	  self->buff[i] = val;						\
-	}								\
-	self->event->data.ext.ptr = self->buff;				\
-      }									\
-    }									\
+/* gets ext data from python buffer object or list */
+#define GETDICTEXT(name) {					\
+    PyObject *value = PyDict_GetItemString(dict, name);		\
+    if (value != NULL && _SeqEvent_set_ext(self, value) < 0) {	\
+      return NULL;						\
+    }								\
   }
 
 
@@ -291,6 +271,9 @@
 TCONSTDICT(STREAMS);
 TCONSTDICT(MODE);
 TCONSTDICT(QUEUE);
+TCONSTDICT(QUEUE_TIMER);
+TCONSTDICT(TIMER_GLOBAL);
+TCONSTDICT(MIDI_VERSION);
 TCONSTDICT(CLIENT_TYPE);
 TCONSTDICT(PORT_CAP);
 TCONSTDICT(PORT_TYPE);
@@ -467,6 +450,13 @@ PyDoc_STRVAR(SeqEvent__doc__,
   "get_data() methods; both use a dictionary. The rest of properties of\n"
   "a SeqEvent can be accesed and changed using the SeqEvent attributes.\n"
   "\n"
+  "The event data is also available as typed attributes, valid only for\n"
+  "the event types carrying them (AttributeError is raised otherwise):\n"
+  "channel, note, velocity, off_velocity, duration, param, value,\n"
+  "queue_id, queue_param, addr, connect_sender, connect_dest, result and\n"
+  "ext. The class methods note_on(), note_off(), note_with_duration(),\n"
+  "controller(), pgmchange() and pitchbend() create ready to send events.\n"
+  "\n"
   "The attributes and defaults values are:\n"
   "type -- event type.\n"
   "timestamp -- tick(midi) or real(nanoseconds). Default: SEQ_TIME_STAMP_TICK.\n"
@@ -486,25 +476,113 @@ PyDoc_STRVAR(SeqEvent__doc__,
   "_dport -- port address (for source an dest).\n"
 );
 
+/* size of the inline storage for short variable length data */
+#define SEQEVENT_INLINE_EXT 32
+
+/* max number of dead SeqEvent objects kept for reuse */
+#define SEQEVENT_MAXFREELIST 256
+
 /** alsaseq.SeqEvent object structure type */
 typedef struct {
   PyObject_HEAD
   ;
 
-  /* alsa event */
+  /* alsa event; points to ev, or into the storage of owner for views */
   snd_seq_event_t *event;
 
-  /* pointer copied/created from/for variable length events */
+  /* pointer created for variable length data not fitting in ibuff */
   unsigned char *buff;
+
+  /* SeqEventBuffer owning the event storage (views only) */
+  PyObject *owner;
+
+  /* inline event storage */
+  snd_seq_event_t ev;
+
+  /* inline storage for short variable length data */
+  unsigned char ibuff[SEQEVENT_INLINE_EXT];
+
+  /* number of buffer exports of the variable length data */
+  int exports;
 } SeqEventObject;
 
 /** alsaseq.SeqEvent type (initialized later...) */
 static PyTypeObject SeqEventType;
 
+/** internal use: (un)lock the storage of a SeqEventBuffer while the data
+    of one of its events is exported (defined later...) */
+static void _SeqEventBuffer_export(PyObject *owner, int delta);
+
+/** internal use: count the live SeqEvent views of a SeqEventBuffer
+    (defined later...) */
+static void _SeqEventBuffer_view(PyObject *owner, int delta);
+
+/* dead alsaseq.SeqEvent objects (exact type only), protected by the GIL */
+static SeqEventObject *seqevent_freelist[SEQEVENT_MAXFREELIST];
+static int seqevent_numfree = 0;
+
+/** internal use: allocate a cleared SeqEvent, reusing a dead one if
+    possible */
+static SeqEventObject *
+_SeqEvent_alloc(PyTypeObject *type) {
+  SeqEventObject *self;
+
+  if (type == &SeqEventType && seqevent_numfree > 0) {
+    self = seqevent_freelist[--seqevent_numfree];
+    PyObject_Init((PyObject *)self, type);
+  } else {
+    self = (SeqEventObject *)type->tp_alloc(type, 0);
+    if (self == NULL) {
+      return NULL;
+    }
+  }
+
+  self->event = &(self->ev);
+  self->buff = NULL;
+  self->owner = NULL;
+  self->exports = 0;
+  snd_seq_ev_clear(&(self->ev));
+
+  return self;
+}
+
+/** internal use: (re)allocate storage for len bytes of variable length
+    data and point the event to it; the previous data is dropped */
+static int
+_SeqEvent_alloc_ext(SeqEventObject *self,
+		    size_t len,
+		    unsigned char **data) {
+  FREECHECKED("buff", self->buff);
+
+  if (len <= SEQEVENT_INLINE_EXT) {
+    *data = self->ibuff;
+  } else {
+    self->buff = malloc(len);
+    if (self->buff == NULL) {
+      self->event->data.ext.len = 0;
+      self->event->data.ext.ptr = NULL;
+      PyErr_NoMemory();
+      return -1;
+    }
+    *data = self->buff;
+  }
+
+  self->event->data.ext.len = len;
+  self->event->data.ext.ptr = len > 0 ? *data : NULL;
+
+  return 0;
+}
+
 /** internal use: set type and update flags based on event type */
 static int
 _SeqEvent_set_type(SeqEventObject *self,
 			      long type) {
+  if (self->exports > 0) {
+    PyErr_SetString(PyExc_BufferError,
+		    "can't change the type while the data is exported");
+    return -1;
+  }
+
   self->event->type = type;
 
   /* clean previous buff... */
@@ -607,59 +685,69 @@ SeqEvent_init(SeqEventObject *self,
 /** internal use: create a alsaseq.SeqEvent from a snd_seq_event_t structure */
 static PyObject *
 SeqEvent_create(snd_seq_event_t *event) {
-  SeqEventObject *self = PyObject_New(SeqEventObject, &SeqEventType);
+  SeqEventObject *self = _SeqEvent_alloc(&SeqEventType);
+  unsigned char *data;
 
   if (self == NULL) {
     return NULL;
   }
 
-  self->event = malloc(sizeof(snd_seq_event_t));
-  if (self->event == NULL) {
-    PyObject_Del(self);
-    return PyErr_NoMemory();
-  }
-
   memcpy(self->event, event, sizeof(snd_seq_event_t));
   if (snd_seq_ev_is_variable_type(self->event)) {
-    self->buff = malloc(self->event->data.ext.len);
-    if (self->buff == NULL) {
-      PyObject_Del(self);
-      return PyErr_NoMemory();
+    if (_SeqEvent_alloc_ext(self, event->data.ext.len, &data) < 0) {
+      Py_DECREF(self);
+      return NULL;
+    }
+    if (event->data.ext.len > 0) {
+      memcpy(data, event->data.ext.ptr, event->data.ext.len);
     }
-    memcpy(self->buff, self->event->data.ext.ptr, self->event->data.ext.len);
-    self->event->data.ext.ptr = self->buff;
-  } else {
-    self->buff = NULL;
   }
 
   return (PyObject *) self;
 }
 
-/** alsaseq.SeqEvent tp_new */
+/** internal use: create a alsaseq.SeqEvent sharing the event storage of
+    owner (a SeqEventBuffer); no copy of event is made */
 static PyObject *
-SeqEvent_new(PyTypeObject *type,
-	     PyObject *args,
-	     PyObject *kwds) {
-  SeqEventObject *self;
-
-  self = (SeqEventObject *)type->tp_alloc(type, 0);
+SeqEvent_view(snd_seq_event_t *event,
+	      PyObject *owner) {
+  SeqEventObject *self = _SeqEvent_alloc(&SeqEventType);
 
-  self->event = malloc(sizeof(snd_seq_event_t));
-  if (self->event == NULL) {
-    type->tp_free(self);
-    return PyErr_NoMemory();
+  if (self == NULL) {
+    return NULL;
   }
-  snd_seq_ev_clear(self->event);
-  self->buff = NULL;
+
+  self->event = event;
+  Py_INCREF(owner);
+  self->owner = owner;
+  _SeqEventBuffer_view(owner, 1);
 
   return (PyObject *) self;
 }
 
+/** alsaseq.SeqEvent tp_new */
+static PyObject *
+SeqEvent_new(PyTypeObject *type,
+	     PyObject *args,
+	     PyObject *kwds) {
+  return (PyObject *) _SeqEvent_alloc(type);
+}
+
 /** alsaseq.SeqEvent tp_dealloc */
 static void
 SeqEvent_dealloc(SeqEventObject *self) {
-  FREECHECKED("event", self->event);
+  if (self->owner != NULL) {
+    _SeqEventBuffer_view(self->owner, -1);
+  }
+  Py_CLEAR(self->owner);
+  self->event = NULL;
   FREECHECKED("buff", self->buff);
+
+  if (Py_TYPE(self) == &SeqEventType &&
+      seqevent_numfree < SEQEVENT_MAXFREELIST) {
+    seqevent_freelist[seqevent_numfree++] = self;
+    return;
+  }
   Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
@@ -841,10 +929,10 @@ SeqEvent_get_time(SeqEventObject *self) {
   return NULL;
 }
 
-/** alsaseq.SeqEvent time attribute: tp_getset setter() */
+/** internal use: store a time (int or float, see the time attribute) */
 static int
-SeqEvent_set_time(SeqEventObject *self,
-		  PyObject *val) {
+_SeqEvent_store_time(snd_seq_event_t *event,
+		     PyObject *val) {
   long lval = 0;
   const int is_float = PyFloat_Check(val);
   const int is_int = is_float ? 0 : !get_long1(val, &lval);
@@ -855,22 +943,22 @@ SeqEvent_set_time(SeqEventObject *self,
     return -1;
   }
 
-  if (snd_seq_ev_is_real(self->event)) {
+  if (snd_seq_ev_is_real(event)) {
     if (is_int) {
       double time = lval;
-      self->event->time.time.tv_sec = time;
-      self->event->time.time.tv_nsec = 0;
+      event->time.time.tv_sec = time;
+      event->time.time.tv_nsec = 0;
     } else {
       double time = PyFloat_AsDouble(val);
-      self->event->time.time.tv_sec = (unsigned int)time;
-      time -= self->event->time.time.tv_sec;
-      self->event->time.time.tv_nsec = time * 1000000000;
+      event->time.time.tv_sec = (unsigned int)time;
+      time -= event->time.time.tv_sec;
+      event->time.time.tv_nsec = time * 1000000000;
     }
-  } else if (snd_seq_ev_is_tick(self->event)) {
+  } else if (snd_seq_ev_is_tick(event)) {
     if (is_int) {
-      self->event->time.tick = lval;
+      event->time.tick = lval;
     } else {
-      self->event->time.tick = PyFloat_AsDouble(val);
+      event->time.tick = PyFloat_AsDouble(val);
     }
   } else {
     /* should never get here... */
@@ -879,6 +967,13 @@ SeqEvent_set_time(SeqEventObject *self,
   return 0;
 }
 
+/** alsaseq.SeqEvent time attribute: tp_getset setter() */
+static int
+SeqEvent_set_time(SeqEventObject *self,
+		  PyObject *val) {
+  return _SeqEvent_store_time(self->event, val);
+}
+
 /** alsaseq.SeqEvent source attribute: __doc __ */
 PyDoc_STRVAR(SeqEvent_source__doc__,
   "source -> tuple (client_id, port_id)\n"
@@ -977,143 +1072,673 @@ SeqEvent_set_dest(SeqEventObject *self,
   return 0;
 }
 
-/** alsaseq.SeqEvent is_result_type attribute: __doc__ */
-PyDoc_STRVAR(SeqEvent_is_result_type__doc__,
-  "is_result_type -> boolean\n"
-  "\n"
-  "Indicates if this alsaseq.SeqEvent is of type result (True) or not\n"
-  "(False). Note: read-only attribute."
-);
+/* typed data attributes of alsaseq.SeqEvent; the id is the getset
+   closure and indexes seqevent_data[] */
+enum {
+  SEQEVENT_DATA_CHANNEL,
+  SEQEVENT_DATA_NOTE,
+  SEQEVENT_DATA_VELOCITY,
+  SEQEVENT_DATA_OFF_VELOCITY,
+  SEQEVENT_DATA_DURATION,
+  SEQEVENT_DATA_PARAM,
+  SEQEVENT_DATA_VALUE,
+  SEQEVENT_DATA_QUEUE_ID,
+  SEQEVENT_DATA_QUEUE_PARAM,
+  SEQEVENT_DATA_ADDR,
+  SEQEVENT_DATA_CONNECT_SENDER,
+  SEQEVENT_DATA_CONNECT_DEST,
+  SEQEVENT_DATA_RESULT,
+  SEQEVENT_DATA_EXT,
+};
 
+/* name and allowed range of the typed data attributes */
+static const struct {
+  const char *name;
+  PY_LONG_LONG min;
+  PY_LONG_LONG max;
+} seqevent_data[] = {
+  {"channel", 0, 255},
+  {"note", 0, 255},
+  {"velocity", 0, 255},
+  {"off_velocity", 0, 255},
+  {"duration", 0, 0xffffffffLL},
+  {"param", 0, 0xffffffffLL},
+  {"value", -0x80000000LL, 0x7fffffffLL},
+  {"queue_id", 0, 255},
+  {"queue_param", -0x80000000LL, 0x7fffffffLL},
+  {"addr", 0, 255},
+  {"connect_sender", 0, 255},
+  {"connect_dest", 0, 255},
+  {"result", -0x80000000LL, 0x7fffffffLL},
+  {"ext", 0, 0},
+};
 
-/** alsaseq.SeqEvent is_result_type attribute: tp_getset getter() */
-static PyObject *
-SeqEvent_is_result_type(SeqEventObject *self) {
-  if (snd_seq_ev_is_result_type(self->event)) {
-    Py_RETURN_TRUE;
-  } else {
-    Py_RETURN_FALSE;
+/** internal use: check that the data attribute id is valid for the
+    event type; raises AttributeError if not */
+static int
+_SeqEvent_check_data(snd_seq_event_t *event,
+		     int id) {
+  int valid = 0;
+
+  switch (id) {
+  case SEQEVENT_DATA_CHANNEL:
+    valid = snd_seq_ev_is_note_type(event) ||
+      snd_seq_ev_is_control_type(event);
+    break;
+  case SEQEVENT_DATA_NOTE:
+  case SEQEVENT_DATA_VELOCITY:
+  case SEQEVENT_DATA_OFF_VELOCITY:
+    valid = snd_seq_ev_is_note_type(event);
+    break;
+  case SEQEVENT_DATA_DURATION:
+    valid = event->type == SND_SEQ_EVENT_NOTE;
+    break;
+  case SEQEVENT_DATA_PARAM:
+    valid = snd_seq_ev_is_control_type(event);
+    break;
+  case SEQEVENT_DATA_VALUE:
+    valid = snd_seq_ev_is_control_type(event) ||
+      (event->type >= SND_SEQ_EVENT_SONGPOS &&
+       event->type <= SND_SEQ_EVENT_KEYSIGN);
+    break;
+  case SEQEVENT_DATA_QUEUE_ID:
+  case SEQEVENT_DATA_QUEUE_PARAM:
+    valid = snd_seq_ev_is_queue_type(event);
+    break;
+  case SEQEVENT_DATA_ADDR:
+    valid = event->type >= SND_SEQ_EVENT_CLIENT_START &&
+      event->type <= SND_SEQ_EVENT_PORT_CHANGE;
+    break;
+  case SEQEVENT_DATA_CONNECT_SENDER:
+  case SEQEVENT_DATA_CONNECT_DEST:
+    valid = event->type == SND_SEQ_EVENT_PORT_SUBSCRIBED ||
+      event->type == SND_SEQ_EVENT_PORT_UNSUBSCRIBED;
+    break;
+  case SEQEVENT_DATA_RESULT:
+    valid = event->type == SND_SEQ_EVENT_SYSTEM ||
+      event->type == SND_SEQ_EVENT_RESULT;
+    break;
+  case SEQEVENT_DATA_EXT:
+    valid = snd_seq_ev_is_variable_type(event);
+    break;
   }
-}
-
-/** alsaseq.SeqEvent is_note_type attribute: __doc__ */
-PyDoc_STRVAR(SeqEvent_is_note_type__doc__,
-  "is_note_type -> boolean\n"
-  "\n"
-  "Indicates if this alsaseq.SeqEvent is of type note (True) or not\n"
-  "(False). Note: read-only attribute."
-);
 
-/** alsaseq.SeqEvent is_note_type attribute: tp_getset getter() */
-static PyObject *
-SeqEvent_is_note_type(SeqEventObject *self) {
-  if (snd_seq_ev_is_note_type(self->event)) {
-    Py_RETURN_TRUE;
-  } else {
-    Py_RETURN_FALSE;
+  if (!valid) {
+    PyErr_Format(PyExc_AttributeError,
+		 "'%s' is not available for events of type %d",
+		 seqevent_data[id].name, event->type);
+    return -1;
   }
+  return 0;
 }
 
-/** alsaseq.SeqEvent is_control_type attribute: __doc__ */
-PyDoc_STRVAR(SeqEvent_is_control_type__doc__,
-  "is_control_type -> boolean\n"
-  "\n"
-  "Indicates if this alsaseq.SeqEvent is of type control (True) or not\n"
-  "(False). Note: read-only attribute."
-);
+/** internal use: check v against the range of the data attribute id
+    for events of type evtype */
+static int
+_SeqEvent_data_range(int evtype,
+		     int id,
+		     PY_LONG_LONG v) {
+  PY_LONG_LONG min = seqevent_data[id].min;
+  PY_LONG_LONG max = seqevent_data[id].max;
+
+  /* 14-bit signed MIDI value */
+  if (evtype == SND_SEQ_EVENT_PITCHBEND && id == SEQEVENT_DATA_VALUE) {
+    min = -8192;
+    max = 8191;
+  }
+  if (v < min || v > max) {
+    PyErr_Format(PyExc_ValueError,
+		 "invalid value '%lld' for '%s'; allowed range: %lld - %lld",
+		 v, seqevent_data[id].name, min, max);
+    return -1;
+  }
+  return 0;
+}
 
-/** alsaseq.SeqEvent is_note_type attribute: tp_getset getter() */
-static PyObject *
-SeqEvent_is_control_type(SeqEventObject *self) {
-  if (snd_seq_ev_is_control_type(self->event)) {
-    Py_RETURN_TRUE;
-  } else {
-    Py_RETURN_FALSE;
+/** internal use: convert val to an integer in the range of the data
+    attribute id for events of type evtype */
+static int
+_SeqEvent_data_long(PyObject *val,
+		    int evtype,
+		    int id,
+		    PY_LONG_LONG *v) {
+  if (val == NULL) {
+    PyErr_Format(PyExc_TypeError, "can't delete '%s'",
+		 seqevent_data[id].name);
+    return -1;
+  }
+  if (!PyLong_Check(val)) {
+    PyErr_Format(PyExc_TypeError, "'%s' must be an integer",
+		 seqevent_data[id].name);
+    return -1;
+  }
+  *v = PyLong_AsLongLong(val);
+  if (*v == -1 && PyErr_Occurred()) {
+    return -1;
   }
+  return _SeqEvent_data_range(evtype, id, *v);
 }
 
-/** alsaseq.SeqEvent is_channel_type attribute: __doc__ */
-PyDoc_STRVAR(SeqEvent_is_channel_type__doc__,
-  "is_channel_type -> boolean\n"
-  "\n"
-  "Indicates if this alsaseq.SeqEvent is of type channel (True) or not\n"
-  "(False). Note: read-only attribute."
-);
+/** internal use: store an integer data attribute (already range checked) */
+static void
+_SeqEvent_store_data(snd_seq_event_t *event,
+		     int id,
+		     PY_LONG_LONG v) {
+  switch (id) {
+  case SEQEVENT_DATA_CHANNEL:
+    if (snd_seq_ev_is_note_type(event)) {
+      event->data.note.channel = v;
+    } else {
+      event->data.control.channel = v;
+    }
+    break;
+  case SEQEVENT_DATA_NOTE:
+    event->data.note.note = v;
+    break;
+  case SEQEVENT_DATA_VELOCITY:
+    event->data.note.velocity = v;
+    break;
+  case SEQEVENT_DATA_OFF_VELOCITY:
+    event->data.note.off_velocity = v;
+    break;
+  case SEQEVENT_DATA_DURATION:
+    event->data.note.duration = v;
+    break;
+  case SEQEVENT_DATA_PARAM:
+    event->data.control.param = v;
+    break;
+  case SEQEVENT_DATA_VALUE:
+    event->data.control.value = v;
+    break;
+  case SEQEVENT_DATA_QUEUE_ID:
+    event->data.queue.queue = v;
+    break;
+  case SEQEVENT_DATA_QUEUE_PARAM:
+    event->data.queue.param.value = v;
+    break;
+  }
+}
 
-/** alsaseq.SeqEvent is_channel_type attribute: tp_getset getter() */
+/** alsaseq.SeqEvent integer data attributes: tp_getset getter() */
 static PyObject *
-SeqEvent_is_channel_type(SeqEventObject *self) {
-  if (snd_seq_ev_is_channel_type(self->event)) {
-    Py_RETURN_TRUE;
-  } else {
-    Py_RETURN_FALSE;
+SeqEvent_get_data_long(SeqEventObject *self,
+		       void *closure) {
+  int id = (int)(intptr_t)closure;
+  snd_seq_event_t *event = self->event;
+
+  if (_SeqEvent_check_data(self->event, id)) {
+    return NULL;
+  }
+
+  switch (id) {
+  case SEQEVENT_DATA_CHANNEL:
+    if (snd_seq_ev_is_note_type(event)) {
+      return PyInt_FromLong(event->data.note.channel);
+    }
+    return PyInt_FromLong(event->data.control.channel);
+  case SEQEVENT_DATA_NOTE:
+    return PyInt_FromLong(event->data.note.note);
+  case SEQEVENT_DATA_VELOCITY:
+    return PyInt_FromLong(event->data.note.velocity);
+  case SEQEVENT_DATA_OFF_VELOCITY:
+    return PyInt_FromLong(event->data.note.off_velocity);
+  case SEQEVENT_DATA_DURATION:
+    return PyLong_FromUnsignedLong(event->data.note.duration);
+  case SEQEVENT_DATA_PARAM:
+    return PyLong_FromUnsignedLong(event->data.control.param);
+  case SEQEVENT_DATA_VALUE:
+    return PyInt_FromLong(event->data.control.value);
+  case SEQEVENT_DATA_QUEUE_ID:
+    return PyInt_FromLong(event->data.queue.queue);
+  case SEQEVENT_DATA_QUEUE_PARAM:
+    return PyInt_FromLong(event->data.queue.param.value);
   }
+  Py_RETURN_NONE;
 }
 
-/** alsaseq.SeqEvent is_queue_type attribute: __doc__ */
-PyDoc_STRVAR(SeqEvent_is_queue_type__doc__,
-  "is_queue_type -> boolean\n"
-  "\n"
-  "Indicates if this alsaseq.SeqEvent is a queue event (True) or not\n"
-  "(False). Note: read-only attribute."
-);
+/** alsaseq.SeqEvent integer data attributes: tp_getset setter() */
+static int
+SeqEvent_set_data_long(SeqEventObject *self,
+		       PyObject *val,
+		       void *closure) {
+  int id = (int)(intptr_t)closure;
+  PY_LONG_LONG v;
 
-/** alsaseq.SeqEvent is_queue_type attribute: tp_getset getter() */
-static PyObject *
-SeqEvent_is_queue_type(SeqEventObject *self) {
-  if (snd_seq_ev_is_queue_type(self->event)) {
-    Py_RETURN_TRUE;
-  } else {
-    Py_RETURN_FALSE;
+  if (_SeqEvent_check_data(self->event, id)) {
+    return -1;
+  }
+  if (_SeqEvent_data_long(val, self->event->type, id, &v)) {
+    return -1;
   }
+  _SeqEvent_store_data(self->event, id, v);
+  return 0;
 }
 
-/** alsaseq.SeqEvent is_message_type attribute: __doc__ */
-PyDoc_STRVAR(SeqEvent_is_message_type__doc__,
-  "is_message_type -> boolean\n"
-  "\n"
-  "Indicates if this alsaseq.SeqEvent is of type message (True) or not\n"
-  "(False). Note: read-only attribute."
-);
-
-/** alsaseq.SeqEvent is_message_type attribute: tp_getset getter() */
+/** alsaseq.SeqEvent pair data attributes: tp_getset getter() */
 static PyObject *
-SeqEvent_is_message_type(SeqEventObject *self) {
-  if (snd_seq_ev_is_message_type(self->event)) {
-    Py_RETURN_TRUE;
-  } else {
-    Py_RETURN_FALSE;
+SeqEvent_get_data_pair(SeqEventObject *self,
+		       void *closure) {
+  int id = (int)(intptr_t)closure;
+  snd_seq_event_t *event = self->event;
+  snd_seq_addr_t *addr = NULL;
+  PyObject *first, *second;
+  PyObject *tuple;
+
+  if (_SeqEvent_check_data(self->event, id)) {
+    return NULL;
   }
-}
 
-/** alsaseq.SeqEvent is_subscribe_type attribute: __doc__ */
-PyDoc_STRVAR(SeqEvent_is_subscribe_type__doc__,
-  "is_subscribe_type -> boolean\n"
-  "\n"
-  "Indicates if this alsaseq.SeqEvent is of type subscribe (True) or not\n"
-  "(False). Note: read-only attribute."
-);
+  switch (id) {
+  case SEQEVENT_DATA_ADDR:
+    addr = &(event->data.addr);
+    break;
+  case SEQEVENT_DATA_CONNECT_SENDER:
+    addr = &(event->data.connect.sender);
+    break;
+  case SEQEVENT_DATA_CONNECT_DEST:
+    addr = &(event->data.connect.dest);
+    break;
+  }
 
-/** alsaseq.SeqEvent is_subscribe_type attribute: tp_getset getter() */
-static PyObject *
-SeqEvent_is_subscribe_type(SeqEventObject *self) {
-  if (snd_seq_ev_is_subscribe_type(self->event)) {
-    Py_RETURN_TRUE;
+  tuple = PyTuple_New(2);
+  if (tuple == NULL) {
+    return NULL;
+  }
+  if (addr != NULL) {
+    TCONSTASSIGN(ADDR_CLIENT, addr->client, first);
+    TCONSTASSIGN(ADDR_PORT, addr->port, second);
   } else {
-    Py_RETURN_FALSE;
+    first = PyInt_FromLong(event->data.result.event);
+    second = PyInt_FromLong(event->data.result.result);
   }
+  PyTuple_SetItem(tuple, 0, first);
+  PyTuple_SetItem(tuple, 1, second);
+
+  return tuple;
 }
 
-/** alsaseq.SeqEvent is_sample_type attribute: __doc__ */
-PyDoc_STRVAR(SeqEvent_is_sample_type__doc__,
-  "is_sample_type -> boolean\n"
-  "\n"
-  "Indicates if this alsaseq.SeqEvent is of type sample (True) or not\n"
-  "(False). Note: read-only attribute."
-);
+/** alsaseq.SeqEvent pair data attributes: tp_getset setter() */
+static int
+SeqEvent_set_data_pair(SeqEventObject *self,
+		       PyObject *val,
+		       void *closure) {
+  int id = (int)(intptr_t)closure;
+  snd_seq_event_t *event = self->event;
+  snd_seq_addr_t *addr = NULL;
+  PY_LONG_LONG first, second;
 
-/** alsaseq.SeqEvent is_sample_type attribute: tp_getset getter() */
-static PyObject *
+  if (_SeqEvent_check_data(self->event, id)) {
+    return -1;
+  }
+  if (val == NULL || !PyTuple_Check(val) || PyTuple_Size(val) != 2) {
+    PyErr_SetString(PyExc_TypeError,
+		    id == SEQEVENT_DATA_RESULT ?
+		    "expected tuple (event,result)" :
+		    "expected tuple (client,port)");
+    return -1;
+  }
+  if (_SeqEvent_data_long(PyTuple_GetItem(val, 0), self->event->type, id,
+			  &first) ||
+      _SeqEvent_data_long(PyTuple_GetItem(val, 1), self->event->type, id,
+			  &second)) {
+    return -1;
+  }
+
+  switch (id) {
+  case SEQEVENT_DATA_ADDR:
+    addr = &(event->data.addr);
+    break;
+  case SEQEVENT_DATA_CONNECT_SENDER:
+    addr = &(event->data.connect.sender);
+    break;
+  case SEQEVENT_DATA_CONNECT_DEST:
+    addr = &(event->data.connect.dest);
+    break;
+  }
+
+  if (addr != NULL) {
+    addr->client = first;
+    addr->port = second;
+  } else {
+    event->data.result.event = first;
+    event->data.result.result = second;
+  }
+  return 0;
+}
+
+/** internal use: replace the variable length data of this event with
+    the contents of obj (any buffer object or a list of integers) */
+static int
+_SeqEvent_set_ext(SeqEventObject *self,
+		  PyObject *obj) {
+  unsigned char *buff;
+  Py_ssize_t len, i;
+  long val;
+
+  if (self->owner != NULL) {
+    PyErr_SetString(PyExc_ValueError,
+		    "ext of a SeqEventBuffer view is read-only");
+    return -1;
+  }
+  if (self->exports > 0) {
+    PyErr_SetString(PyExc_BufferError,
+		    "can't change ext while it is exported");
+    return -1;
+  }
+
+  if (PyObject_CheckBuffer(obj)) {
+    Py_buffer view;
+    int ret;
+
+    if (PyObject_GetBuffer(obj, &view, PyBUF_SIMPLE) < 0) {
+      return -1;
+    }
+    ret = _SeqEvent_alloc_ext(self, view.len, &buff);
+    if (ret == 0) {
+      memcpy(buff, view.buf, view.len);
+    }
+    PyBuffer_Release(&view);
+    return ret;
+  }
+
+  if (!PyList_Check(obj)) {
+    PyErr_SetString(PyExc_TypeError,
+		    "ext must be a bytes-like object or a list of integers");
+    return -1;
+  }
+
+  len = PyList_Size(obj);
+  if (_SeqEvent_alloc_ext(self, len, &buff) < 0) {
+    return -1;
+  }
+  for (i = 0; i < len; i++) {
+    if (get_long1(PyList_GetItem(obj, i), &val)) {
+      PyErr_SetString(PyExc_TypeError,
+		      "ext must be a bytes-like object or a list of integers");
+      _SeqEvent_alloc_ext(self, 0, &buff);
+      return -1;
+    }
+    buff[i] = val;
+  }
+  return 0;
+}
+
+/** alsaseq.SeqEvent ext attribute: tp_getset getter() */
+static PyObject *
+SeqEvent_get_ext(SeqEventObject *self,
+		 void *closure) {
+  snd_seq_ev_ext_t *data = &(self->event->data.ext);
+
+  if (_SeqEvent_check_data(self->event, SEQEVENT_DATA_EXT)) {
+    return NULL;
+  }
+  return PyBytes_FromStringAndSize((const char *)data->ptr, data->len);
+}
+
+/** alsaseq.SeqEvent ext attribute: tp_getset setter() */
+static int
+SeqEvent_set_ext(SeqEventObject *self,
+		 PyObject *val,
+		 void *closure) {
+  if (_SeqEvent_check_data(self->event, SEQEVENT_DATA_EXT)) {
+    return -1;
+  }
+  if (val == NULL) {
+    PyErr_SetString(PyExc_TypeError, "can't delete 'ext'");
+    return -1;
+  }
+  return _SeqEvent_set_ext(self, val);
+}
+
+/** alsaseq.SeqEvent channel attribute: __doc__ */
+PyDoc_STRVAR(SeqEvent_channel__doc__,
+  "channel -> int\n"
+  "\n"
+  "The MIDI channel of a note or control event (range:0-255)."
+);
+
+/** alsaseq.SeqEvent note attribute: __doc__ */
+PyDoc_STRVAR(SeqEvent_note__doc__,
+  "note -> int\n"
+  "\n"
+  "The note number of a note event (range:0-255)."
+);
+
+/** alsaseq.SeqEvent velocity attribute: __doc__ */
+PyDoc_STRVAR(SeqEvent_velocity__doc__,
+  "velocity -> int\n"
+  "\n"
+  "The velocity of a note event (range:0-255)."
+);
+
+/** alsaseq.SeqEvent off_velocity attribute: __doc__ */
+PyDoc_STRVAR(SeqEvent_off_velocity__doc__,
+  "off_velocity -> int\n"
+  "\n"
+  "The note off velocity of a note event (range:0-255)."
+);
+
+/** alsaseq.SeqEvent duration attribute: __doc__ */
+PyDoc_STRVAR(SeqEvent_duration__doc__,
+  "duration -> int\n"
+  "\n"
+  "The duration of a SEQ_EVENT_NOTE event, in ticks or milliseconds\n"
+  "depending on the time stamp mode."
+);
+
+/** alsaseq.SeqEvent param attribute: __doc__ */
+PyDoc_STRVAR(SeqEvent_param__doc__,
+  "param -> int\n"
+  "\n"
+  "The parameter of a control event (e.g. the controller number)."
+);
+
+/** alsaseq.SeqEvent value attribute: __doc__ */
+PyDoc_STRVAR(SeqEvent_value__doc__,
+  "value -> int\n"
+  "\n"
+  "The value of a control event (controller value, program, pitch\n"
+  "bend...) or of a song position, song select, quarter frame, time\n"
+  "signature or key signature event. Pitch bend values are in the\n"
+  "range -8192 - 8191."
+);
+
+/** alsaseq.SeqEvent queue_id attribute: __doc__ */
+PyDoc_STRVAR(SeqEvent_queue_id__doc__,
+  "queue_id -> int\n"
+  "\n"
+  "The queue affected by a queue control event (START, STOP, TEMPO...).\n"
+  "Not to be confused with the queue attribute, the queue this event\n"
+  "is scheduled on."
+);
+
+/** alsaseq.SeqEvent queue_param attribute: __doc__ */
+PyDoc_STRVAR(SeqEvent_queue_param__doc__,
+  "queue_param -> int\n"
+  "\n"
+  "The parameter of a queue control event (tempo, tick position...)."
+);
+
+/** alsaseq.SeqEvent addr attribute: __doc__ */
+PyDoc_STRVAR(SeqEvent_addr__doc__,
+  "addr -> tuple (client_id, port_id)\n"
+  "\n"
+  "The address of a client or port announce event\n"
+  "(SEQ_EVENT_CLIENT_* and SEQ_EVENT_PORT_START/EXIT/CHANGE)."
+);
+
+/** alsaseq.SeqEvent connect_sender attribute: __doc__ */
+PyDoc_STRVAR(SeqEvent_connect_sender__doc__,
+  "connect_sender -> tuple (client_id, port_id)\n"
+  "\n"
+  "The sender address of a SEQ_EVENT_PORT_SUBSCRIBED or\n"
+  "SEQ_EVENT_PORT_UNSUBSCRIBED event."
+);
+
+/** alsaseq.SeqEvent connect_dest attribute: __doc__ */
+PyDoc_STRVAR(SeqEvent_connect_dest__doc__,
+  "connect_dest -> tuple (client_id, port_id)\n"
+  "\n"
+  "The destination address of a SEQ_EVENT_PORT_SUBSCRIBED or\n"
+  "SEQ_EVENT_PORT_UNSUBSCRIBED event."
+);
+
+/** alsaseq.SeqEvent result attribute: __doc__ */
+PyDoc_STRVAR(SeqEvent_result__doc__,
+  "result -> tuple (event, result)\n"
+  "\n"
+  "The data of a SEQ_EVENT_SYSTEM or SEQ_EVENT_RESULT event."
+);
+
+/** alsaseq.SeqEvent ext attribute: __doc__ */
+PyDoc_STRVAR(SeqEvent_ext__doc__,
+  "ext -> bytes\n"
+  "\n"
+  "The data of a variable length event (SYSEX...). May be set from\n"
+  "any bytes-like object (bytes, bytearray, memoryview, array...) or a\n"
+  "list of integers. Read-only for the events of a SeqEventBuffer.\n"
+  "\n"
+  "Reading ext returns a copy; memoryview(event) gives direct access to\n"
+  "the data without copying it."
+);
+
+/** alsaseq.SeqEvent is_result_type attribute: __doc__ */
+PyDoc_STRVAR(SeqEvent_is_result_type__doc__,
+  "is_result_type -> boolean\n"
+  "\n"
+  "Indicates if this alsaseq.SeqEvent is of type result (True) or not\n"
+  "(False). Note: read-only attribute."
+);
+
+
+/** alsaseq.SeqEvent is_result_type attribute: tp_getset getter() */
+static PyObject *
+SeqEvent_is_result_type(SeqEventObject *self) {
+  if (snd_seq_ev_is_result_type(self->event)) {
+    Py_RETURN_TRUE;
+  } else {
+    Py_RETURN_FALSE;
+  }
+}
+
+/** alsaseq.SeqEvent is_note_type attribute: __doc__ */
+PyDoc_STRVAR(SeqEvent_is_note_type__doc__,
+  "is_note_type -> boolean\n"
+  "\n"
+  "Indicates if this alsaseq.SeqEvent is of type note (True) or not\n"
+  "(False). Note: read-only attribute."
+);
+
+/** alsaseq.SeqEvent is_note_type attribute: tp_getset getter() */
+static PyObject *
+SeqEvent_is_note_type(SeqEventObject *self) {
+  if (snd_seq_ev_is_note_type(self->event)) {
+    Py_RETURN_TRUE;
+  } else {
+    Py_RETURN_FALSE;
+  }
+}
+
+/** alsaseq.SeqEvent is_control_type attribute: __doc__ */
+PyDoc_STRVAR(SeqEvent_is_control_type__doc__,
+  "is_control_type -> boolean\n"
+  "\n"
+  "Indicates if this alsaseq.SeqEvent is of type control (True) or not\n"
+  "(False). Note: read-only attribute."
+);
+
+/** alsaseq.SeqEvent is_note_type attribute: tp_getset getter() */
+static PyObject *
+SeqEvent_is_control_type(SeqEventObject *self) {
+  if (snd_seq_ev_is_control_type(self->event)) {
+    Py_RETURN_TRUE;
+  } else {
+    Py_RETURN_FALSE;
+  }
+}
+
+/** alsaseq.SeqEvent is_channel_type attribute: __doc__ */
+PyDoc_STRVAR(SeqEvent_is_channel_type__doc__,
+  "is_channel_type -> boolean\n"
+  "\n"
+  "Indicates if this alsaseq.SeqEvent is of type channel (True) or not\n"
+  "(False). Note: read-only attribute."
+);
+
+/** alsaseq.SeqEvent is_channel_type attribute: tp_getset getter() */
+static PyObject *
+SeqEvent_is_channel_type(SeqEventObject *self) {
+  if (snd_seq_ev_is_channel_type(self->event)) {
+    Py_RETURN_TRUE;
+  } else {
+    Py_RETURN_FALSE;
+  }
+}
+
+/** alsaseq.SeqEvent is_queue_type attribute: __doc__ */
+PyDoc_STRVAR(SeqEvent_is_queue_type__doc__,
+  "is_queue_type -> boolean\n"
+  "\n"
+  "Indicates if this alsaseq.SeqEvent is a queue event (True) or not\n"
+  "(False). Note: read-only attribute."
+);
+
+/** alsaseq.SeqEvent is_queue_type attribute: tp_getset getter() */
+static PyObject *
+SeqEvent_is_queue_type(SeqEventObject *self) {
+  if (snd_seq_ev_is_queue_type(self->event)) {
+    Py_RETURN_TRUE;
+  } else {
+    Py_RETURN_FALSE;
+  }
+}
+
+/** alsaseq.SeqEvent is_message_type attribute: __doc__ */
+PyDoc_STRVAR(SeqEvent_is_message_type__doc__,
+  "is_message_type -> boolean\n"
+  "\n"
+  "Indicates if this alsaseq.SeqEvent is of type message (True) or not\n"
+  "(False). Note: read-only attribute."
+);
+
+/** alsaseq.SeqEvent is_message_type attribute: tp_getset getter() */
+static PyObject *
+SeqEvent_is_message_type(SeqEventObject *self) {
+  if (snd_seq_ev_is_message_type(self->event)) {
+    Py_RETURN_TRUE;
+  } else {
+    Py_RETURN_FALSE;
+  }
+}
+
+/** alsaseq.SeqEvent is_subscribe_type attribute: __doc__ */
+PyDoc_STRVAR(SeqEvent_is_subscribe_type__doc__,
+  "is_subscribe_type -> boolean\n"
+  "\n"
+  "Indicates if this alsaseq.SeqEvent is of type subscribe (True) or not\n"
+  "(False). Note: read-only attribute."
+);
+
+/** alsaseq.SeqEvent is_subscribe_type attribute: tp_getset getter() */
+static PyObject *
+SeqEvent_is_subscribe_type(SeqEventObject *self) {
+  if (snd_seq_ev_is_subscribe_type(self->event)) {
+    Py_RETURN_TRUE;
+  } else {
+    Py_RETURN_FALSE;
+  }
+}
+
+/** alsaseq.SeqEvent is_sample_type attribute: __doc__ */
+PyDoc_STRVAR(SeqEvent_is_sample_type__doc__,
+  "is_sample_type -> boolean\n"
+  "\n"
+  "Indicates if this alsaseq.SeqEvent is of type sample (True) or not\n"
+  "(False). Note: read-only attribute."
+);
+
+/** alsaseq.SeqEvent is_sample_type attribute: tp_getset getter() */
+static PyObject *
 SeqEvent_is_sample_type(SeqEventObject *self) {
   if (snd_seq_ev_is_sample_type(self->event)) {
     Py_RETURN_TRUE;
@@ -1519,6 +2144,76 @@ static PyGetSetDef SeqEvent_getset[] = {
    (setter) SeqEvent_set_dest,
    (char *) SeqEvent_dest__doc__,
    NULL},
+  {"channel",
+   (getter) SeqEvent_get_data_long,
+   (setter) SeqEvent_set_data_long,
+   (char *) SeqEvent_channel__doc__,
+   (void *) SEQEVENT_DATA_CHANNEL},
+  {"note",
+   (getter) SeqEvent_get_data_long,
+   (setter) SeqEvent_set_data_long,
+   (char *) SeqEvent_note__doc__,
+   (void *) SEQEVENT_DATA_NOTE},
+  {"velocity",
+   (getter) SeqEvent_get_data_long,
+   (setter) SeqEvent_set_data_long,
+   (char *) SeqEvent_velocity__doc__,
+   (void *) SEQEVENT_DATA_VELOCITY},
+  {"off_velocity",
+   (getter) SeqEvent_get_data_long,
+   (setter) SeqEvent_set_data_long,
+   (char *) SeqEvent_off_velocity__doc__,
+   (void *) SEQEVENT_DATA_OFF_VELOCITY},
+  {"duration",
+   (getter) SeqEvent_get_data_long,
+   (setter) SeqEvent_set_data_long,
+   (char *) SeqEvent_duration__doc__,
+   (void *) SEQEVENT_DATA_DURATION},
+  {"param",
+   (getter) SeqEvent_get_data_long,
+   (setter) SeqEvent_set_data_long,
+   (char *) SeqEvent_param__doc__,
+   (void *) SEQEVENT_DATA_PARAM},
+  {"value",
+   (getter) SeqEvent_get_data_long,
+   (setter) SeqEvent_set_data_long,
+   (char *) SeqEvent_value__doc__,
+   (void *) SEQEVENT_DATA_VALUE},
+  {"queue_id",
+   (getter) SeqEvent_get_data_long,
+   (setter) SeqEvent_set_data_long,
+   (char *) SeqEvent_queue_id__doc__,
+   (void *) SEQEVENT_DATA_QUEUE_ID},
+  {"queue_param",
+   (getter) SeqEvent_get_data_long,
+   (setter) SeqEvent_set_data_long,
+   (char *) SeqEvent_queue_param__doc__,
+   (void *) SEQEVENT_DATA_QUEUE_PARAM},
+  {"addr",
+   (getter) SeqEvent_get_data_pair,
+   (setter) SeqEvent_set_data_pair,
+   (char *) SeqEvent_addr__doc__,
+   (void *) SEQEVENT_DATA_ADDR},
+  {"connect_sender",
+   (getter) SeqEvent_get_data_pair,
+   (setter) SeqEvent_set_data_pair,
+   (char *) SeqEvent_connect_sender__doc__,
+   (void *) SEQEVENT_DATA_CONNECT_SENDER},
+  {"connect_dest",
+   (getter) SeqEvent_get_data_pair,
+   (setter) SeqEvent_set_data_pair,
+   (char *) SeqEvent_connect_dest__doc__,
+   (void *) SEQEVENT_DATA_CONNECT_DEST},
+  {"result",
+   (getter) SeqEvent_get_data_pair,
+   (setter) SeqEvent_set_data_pair,
+   (char *) SeqEvent_result__doc__,
+   (void *) SEQEVENT_DATA_RESULT},
+  {"ext",
+   (getter) SeqEvent_get_ext,
+   (setter) SeqEvent_set_ext,
+   (char *) SeqEvent_ext__doc__,
+   NULL},
   {"is_result_type",
    (getter) SeqEvent_is_result_type,
    NULL,
@@ -1709,7 +2404,7 @@ PyDoc_STRVAR(SeqEvent_get_data__doc__,
   "for changing an event data use the set_data() method.\n"
   "\n"
   "The dictionary items are key: value; where key is the name of the\n"
-  "data structure from alsa API and value is an integer or a list of them.\n"
+  "data structure from alsa API and value is an integer (bytes for ext).\n"
   "\n"
   "The following name of structures are available:\n"
   "  'note.channel' -> int\n"
@@ -1729,7 +2424,7 @@ PyDoc_STRVAR(SeqEvent_get_data__doc__,
   "  'connect.dest.port' -> int\n"
   "  'result.event' -> int\n"
   "  'result.result' -> int\n"
-  "  'ext' -> list of int with sysex or variable data\n"
+  "  'ext' -> bytes with sysex or variable data\n"
   "\n"
   "The exact items returned dependens on the event type of this SeqEvent.\n"
   "For a control event, only 'control.*' may be returned; for a sysex \n"
@@ -1893,25 +2588,319 @@ SeqEvent_set_data(SeqEventObject *self,
 }
 
 
-/** alsaseq.SeqEvent tp_methods */
-static PyMethodDef SeqEvent_methods[] = {
-  {"get_data",
-   (PyCFunction) SeqEvent_get_data,
-   METH_VARARGS,
-   SeqEvent_get_data__doc__},
-  {"set_data",
-   (PyCFunction) SeqEvent_set_data,
-   METH_VARARGS,
-   SeqEvent_set_data__doc__},
-  {NULL}
-};
+/** internal use: create an event of type evtype for the class
+    constructors and store the n data attributes ids with values v */
+static PyObject *
+_SeqEvent_new_data(PyTypeObject *type,
+		   int evtype,
+		   const int *ids,
+		   const PY_LONG_LONG *v,
+		   int n) {
+  SeqEventObject *self;
+  int i;
 
-/** alsaseq.SeEvent type */
-static PyTypeObject SeqEventType = {
-  PyVarObject_HEAD_INIT(NULL, 0)
-  tp_name: "alsaseq.SeqEvent",
-  tp_basicsize: sizeof(SeqEventObject),
-  tp_dealloc: (destructor) SeqEvent_dealloc,
+  for (i = 0; i < n; i++) {
+    if (_SeqEvent_data_range(evtype, ids[i], v[i])) {
+      return NULL;
+    }
+  }
+
+  if (type == &SeqEventType) {
+    self = _SeqEvent_alloc(type);
+    if (self == NULL) {
+      return NULL;
+    }
+    self->event->type = evtype;
+    snd_seq_ev_set_fixed(self->event);
+    snd_seq_ev_set_direct(self->event);
+    snd_seq_ev_set_subs(self->event);
+  } else {
+    /* let subclasses run their own __init__ */
+    self = (SeqEventObject *)PyObject_CallFunction((PyObject *)type,
+						    "i", evtype);
+    if (self == NULL) {
+      return NULL;
+    }
+  }
+
+  for (i = 0; i < n; i++) {
+    _SeqEvent_store_data(self->event, ids[i], v[i]);
+  }
+
+  return (PyObject *)self;
+}
+
+/** alsaseq.SeqEvent note_on() class method: __doc__ */
+PyDoc_STRVAR(SeqEvent_note_on__doc__,
+  "note_on(channel, note, velocity) -> SeqEvent\n"
+  "\n"
+  "Creates a SEQ_EVENT_NOTEON event.\n"
+  "The event is sent directly (no queue) to the subscribers of the\n"
+  "source port, like a new SeqEvent."
+);
+
+/** alsaseq.SeqEvent note_on() class method */
+static PyObject *
+SeqEvent_note_on(PyTypeObject *type,
+		 PyObject *args,
+		 PyObject *kwds) {
+  static const int ids[] = {
+    SEQEVENT_DATA_CHANNEL,
+    SEQEVENT_DATA_NOTE,
+    SEQEVENT_DATA_VELOCITY
+  };
+  PY_LONG_LONG v[3] = {0};
+  char *kwlist[] = {"channel", "note", "velocity", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "LLL", kwlist,
+				   &v[0], &v[1], &v[2])) {
+    return NULL;
+  }
+
+  return _SeqEvent_new_data(type, SND_SEQ_EVENT_NOTEON, ids, v, 3);
+}
+
+/** alsaseq.SeqEvent note_off() class method: __doc__ */
+PyDoc_STRVAR(SeqEvent_note_off__doc__,
+  "note_off(channel, note, velocity = 0) -> SeqEvent\n"
+  "\n"
+  "Creates a SEQ_EVENT_NOTEOFF event.\n"
+  "The event is sent directly (no queue) to the subscribers of the\n"
+  "source port, like a new SeqEvent."
+);
+
+/** alsaseq.SeqEvent note_off() class method */
+static PyObject *
+SeqEvent_note_off(PyTypeObject *type,
+		  PyObject *args,
+		  PyObject *kwds) {
+  static const int ids[] = {
+    SEQEVENT_DATA_CHANNEL,
+    SEQEVENT_DATA_NOTE,
+    SEQEVENT_DATA_VELOCITY
+  };
+  PY_LONG_LONG v[3] = {0};
+  char *kwlist[] = {"channel", "note", "velocity", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "LL|L", kwlist,
+				   &v[0], &v[1], &v[2])) {
+    return NULL;
+  }
+
+  return _SeqEvent_new_data(type, SND_SEQ_EVENT_NOTEOFF, ids, v, 3);
+}
+
+/** alsaseq.SeqEvent note_with_duration() class method: __doc__ */
+PyDoc_STRVAR(SeqEvent_note_with_duration__doc__,
+  "note_with_duration(channel, note, velocity, duration,\n"
+  "                   off_velocity = 0) -> SeqEvent\n"
+  "\n"
+  "Creates a SEQ_EVENT_NOTE event; the sequencer sends the note off\n"
+  "after duration.\n"
+  "The event is sent directly (no queue) to the subscribers of the\n"
+  "source port, like a new SeqEvent."
+);
+
+/** alsaseq.SeqEvent note_with_duration() class method */
+static PyObject *
+SeqEvent_note_with_duration(PyTypeObject *type,
+			    PyObject *args,
+			    PyObject *kwds) {
+  static const int ids[] = {
+    SEQEVENT_DATA_CHANNEL,
+    SEQEVENT_DATA_NOTE,
+    SEQEVENT_DATA_VELOCITY,
+    SEQEVENT_DATA_DURATION,
+    SEQEVENT_DATA_OFF_VELOCITY
+  };
+  PY_LONG_LONG v[5] = {0};
+  char *kwlist[] = {"channel", "note", "velocity", "duration",
+		    "off_velocity", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "LLLL|L", kwlist,
+				   &v[0], &v[1], &v[2], &v[3], &v[4])) {
+    return NULL;
+  }
+
+  return _SeqEvent_new_data(type, SND_SEQ_EVENT_NOTE, ids, v, 5);
+}
+
+/** alsaseq.SeqEvent controller() class method: __doc__ */
+PyDoc_STRVAR(SeqEvent_controller__doc__,
+  "controller(channel, param, value) -> SeqEvent\n"
+  "\n"
+  "Creates a SEQ_EVENT_CONTROLLER event; param is the controller number.\n"
+  "The event is sent directly (no queue) to the subscribers of the\n"
+  "source port, like a new SeqEvent."
+);
+
+/** alsaseq.SeqEvent controller() class method */
+static PyObject *
+SeqEvent_controller(PyTypeObject *type,
+		    PyObject *args,
+		    PyObject *kwds) {
+  static const int ids[] = {
+    SEQEVENT_DATA_CHANNEL,
+    SEQEVENT_DATA_PARAM,
+    SEQEVENT_DATA_VALUE
+  };
+  PY_LONG_LONG v[3] = {0};
+  char *kwlist[] = {"channel", "param", "value", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "LLL", kwlist,
+				   &v[0], &v[1], &v[2])) {
+    return NULL;
+  }
+
+  return _SeqEvent_new_data(type, SND_SEQ_EVENT_CONTROLLER, ids, v, 3);
+}
+
+/** alsaseq.SeqEvent pgmchange() class method: __doc__ */
+PyDoc_STRVAR(SeqEvent_pgmchange__doc__,
+  "pgmchange(channel, value) -> SeqEvent\n"
+  "\n"
+  "Creates a SEQ_EVENT_PGMCHANGE event; value is the program number.\n"
+  "The event is sent directly (no queue) to the subscribers of the\n"
+  "source port, like a new SeqEvent."
+);
+
+/** alsaseq.SeqEvent pgmchange() class method */
+static PyObject *
+SeqEvent_pgmchange(PyTypeObject *type,
+		   PyObject *args,
+		   PyObject *kwds) {
+  static const int ids[] = {
+    SEQEVENT_DATA_CHANNEL,
+    SEQEVENT_DATA_VALUE
+  };
+  PY_LONG_LONG v[2] = {0};
+  char *kwlist[] = {"channel", "value", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "LL", kwlist,
+				   &v[0], &v[1])) {
+    return NULL;
+  }
+
+  return _SeqEvent_new_data(type, SND_SEQ_EVENT_PGMCHANGE, ids, v, 2);
+}
+
+/** alsaseq.SeqEvent pitchbend() class method: __doc__ */
+PyDoc_STRVAR(SeqEvent_pitchbend__doc__,
+  "pitchbend(channel, value) -> SeqEvent\n"
+  "\n"
+  "Creates a SEQ_EVENT_PITCHBEND event; value is in the range\n"
+  "-8192 - 8191 (0 is the center).\n"
+  "The event is sent directly (no queue) to the subscribers of the\n"
+  "source port, like a new SeqEvent."
+);
+
+/** alsaseq.SeqEvent pitchbend() class method */
+static PyObject *
+SeqEvent_pitchbend(PyTypeObject *type,
+		   PyObject *args,
+		   PyObject *kwds) {
+  static const int ids[] = {
+    SEQEVENT_DATA_CHANNEL,
+    SEQEVENT_DATA_VALUE
+  };
+  PY_LONG_LONG v[2] = {0};
+  char *kwlist[] = {"channel", "value", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "LL", kwlist,
+				   &v[0], &v[1])) {
+    return NULL;
+  }
+
+  return _SeqEvent_new_data(type, SND_SEQ_EVENT_PITCHBEND, ids, v, 2);
+}
+
+/** alsaseq.SeqEvent tp_methods */
+static PyMethodDef SeqEvent_methods[] = {
+  {"get_data",
+   (PyCFunction) SeqEvent_get_data,
+   METH_VARARGS,
+   SeqEvent_get_data__doc__},
+  {"set_data",
+   (PyCFunction) SeqEvent_set_data,
+   METH_VARARGS,
+   SeqEvent_set_data__doc__},
+  {"note_on",
+   (PyCFunction) SeqEvent_note_on,
+   METH_VARARGS | METH_KEYWORDS | METH_CLASS,
+   SeqEvent_note_on__doc__},
+  {"note_off",
+   (PyCFunction) SeqEvent_note_off,
+   METH_VARARGS | METH_KEYWORDS | METH_CLASS,
+   SeqEvent_note_off__doc__},
+  {"note_with_duration",
+   (PyCFunction) SeqEvent_note_with_duration,
+   METH_VARARGS | METH_KEYWORDS | METH_CLASS,
+   SeqEvent_note_with_duration__doc__},
+  {"controller",
+   (PyCFunction) SeqEvent_controller,
+   METH_VARARGS | METH_KEYWORDS | METH_CLASS,
+   SeqEvent_controller__doc__},
+  {"pgmchange",
+   (PyCFunction) SeqEvent_pgmchange,
+   METH_VARARGS | METH_KEYWORDS | METH_CLASS,
+   SeqEvent_pgmchange__doc__},
+  {"pitchbend",
+   (PyCFunction) SeqEvent_pitchbend,
+   METH_VARARGS | METH_KEYWORDS | METH_CLASS,
+   SeqEvent_pitchbend__doc__},
+  {NULL}
+};
+
+/** alsaseq.SeqEvent bf_getbuffer: exports the variable length data */
+static int
+SeqEvent_getbuffer(SeqEventObject *self,
+		   Py_buffer *view,
+		   int flags) {
+  snd_seq_ev_ext_t *data = &(self->event->data.ext);
+  void *ptr;
+
+  if (!snd_seq_ev_is_variable_type(self->event)) {
+    PyErr_SetString(PyExc_BufferError,
+		    "only variable length events export their data");
+    view->obj = NULL;
+    return -1;
+  }
+
+  ptr = data->len > 0 ? data->ptr : self->ibuff;
+  if (PyBuffer_FillInfo(view, (PyObject *)self, ptr, data->len,
+			self->owner != NULL, flags) < 0) {
+    return -1;
+  }
+
+  self->exports++;
+  if (self->owner != NULL) {
+    _SeqEventBuffer_export(self->owner, 1);
+  }
+  return 0;
+}
+
+/** alsaseq.SeqEvent bf_releasebuffer */
+static void
+SeqEvent_releasebuffer(SeqEventObject *self,
+		       Py_buffer *view) {
+  self->exports--;
+  if (self->owner != NULL) {
+    _SeqEventBuffer_export(self->owner, -1);
+  }
+}
+
+/** alsaseq.SeqEvent tp_as_buffer */
+static PyBufferProcs SeqEvent_as_buffer = {
+  bf_getbuffer: (getbufferproc) SeqEvent_getbuffer,
+  bf_releasebuffer: (releasebufferproc) SeqEvent_releasebuffer,
+};
+
+/** alsaseq.SeEvent type */
+static PyTypeObject SeqEventType = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  tp_name: "alsaseq.SeqEvent",
+  tp_basicsize: sizeof(SeqEventObject),
+  tp_dealloc: (destructor) SeqEvent_dealloc,
   tp_flags: Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
   tp_doc: SeqEvent__doc__,
   tp_init: (initproc)SeqEvent_init,
@@ -1921,1348 +2910,11626 @@ static PyTypeObject SeqEventType = {
   tp_methods: SeqEvent_methods,
   tp_getset: SeqEvent_getset,
   tp_repr: (reprfunc)SeqEvent_repr,
+  tp_as_buffer: &SeqEvent_as_buffer,
 };
 
 
 
 //////////////////////////////////////////////////////////////////////////////
-// alsaseq.Sequencer implementation
+// alsaseq.SeqEventBuffer implementation
 //////////////////////////////////////////////////////////////////////////////
 
-/** alsaseq.Sequencer __doc__ */
-PyDoc_STRVAR(Sequencer__doc__,
-  "Sequencer([name, clientname, streams, mode, maxreceiveevents]) "
-  "-> Sequencer object\n"
-  "\n"
-  "Creates and opens an ALSA sequencer. The features of the Sequencer are:\n"
-  "- send/receive events (as SeqEvent objects)\n"
-  "- create ports\n"
-  "- list all ALSA clients and their port connections\n"
-  "- connect/disconnect arbitrary ports\n"
-  "- create and control queues\n"
-  "- get info about a port or a client\n"
-  "\n"
-  "The name must correspond to the special ALSA name (for example: 'hw'); \n"
-  "if not specified, 'default' is used. The clientname is the name of this \n"
-  "client; if not specified, 'pyalsa-PID' is used.\n"
-  "\n"
-  "The streams specifies if you want to receive, send or both; use \n"
-  "SEQ_OPEN_INPUT, SEQ_OPEN_OUTPUT or SEQ_OPEN_DUPLEX. If not specified, \n"
-  "SEQ_OPEN_DUPLEX is used."
+/** alsaseq.SeqEventBuffer __doc__ */
+PyDoc_STRVAR(SeqEventBuffer__doc__,
+  "SeqEventBuffer(size=64, extsize=4096) -> SeqEventBuffer object\n"
   "\n"
-  "The mode specifies if this client should block or not, use SEQ_BLOCK or \n"
-  "SEQ_NONBLOCK. If not specified, SEQ_NONBLOCK is used."
+  "Creates a reusable buffer for receiving events with the\n"
+  "Sequencer.receive_into() method. The buffer holds a contiguous array\n"
+  "of up to size events plus a slab of extsize bytes for the data of\n"
+  "variable length events (SYSEX); the slab grows when needed.\n"
   "\n"
-  "The maxreceiveevents is a number that represents how many SeqEvent \n"
-  "objects are returned by the receive() method. If not specified, the \n"
-  "default is 4. \n"
+  "The buffer is refilled in place on each receive_into() call, so\n"
+  "receiving does not allocate once the slab reached its working size.\n"
   "\n"
-  "There is no method for closing the sequencer, it will remain open as \n"
-  "long as the Sequencer object exists. For closing the sequencer you \n"
-  "must explicitly del() the returned object."
+  "len(buffer) is the number of events received by the last call;\n"
+  "buffer[i] returns a SeqEvent view of the i-th event. Views share the\n"
+  "storage of the buffer: they show the i-th event of the last\n"
+  "receive_into() call (their contents change on the next call), and\n"
+  "the variable length data of a view cannot be changed. The storage\n"
+  "is kept while views exist: the buffer can't be re-initialized then."
 );
 
-/** alsaseq.Sequencer object structure type */
+/** alsaseq.SeqEventBuffer object structure type */
 typedef struct {
   PyObject_HEAD
+  ;
 
-  /* streams */
-  int streams;
-  /* mode */
-  int mode;
+  /* contiguous event storage */
+  snd_seq_event_t *events;
+  /* capacity of events */
+  int size;
+  /* number of valid events */
+  int count;
+
+  /* storage for data of variable length events */
+  unsigned char *slab;
+  /* allocated bytes of slab */
+  size_t slab_size;
+  /* used bytes of slab */
+  size_t slab_used;
+
+  /* number of users of the storage: operations running without the GIL
+     and exported event data */
+  int in_use;
+
+  /* number of live SeqEvent views of the events */
+  int views;
+  /* slabs replaced while views existed; a view of an event beyond count
+     may still point into them, they are freed once there is no view */
+  unsigned char **retired;
+  int nretired;
+} SeqEventBufferObject;
+
+/** alsaseq.SeqEventBuffer type (initialized later...) */
+static PyTypeObject SeqEventBufferType;
+
+/** internal use: append a copy of event (including its variable length
+    data) to the buffer; the caller must check there is room */
+static int
+_SeqEventBuffer_append(SeqEventBufferObject *self,
+		       const snd_seq_event_t *event) {
+  snd_seq_event_t *dst = &(self->events[self->count]);
+  size_t len = 0;
 
-  /* alsa handler */
-  snd_seq_t *handle;
-  /* max fd's */
-  int receive_max;
-  /* receive poll fd's */
-  struct pollfd *receive_fds;
-  /* max events for returning in receive_events() */
-  int receive_max_events;
-  /* remaining bytes from input */
-  int receive_bytes;
-} SequencerObject;
+  if (snd_seq_ev_is_variable(event)) {
+    len = event->data.ext.len;
+  }
 
-/** alsaseq.Sequencer type (initialized later...) */
-static PyTypeObject SequencerType;
+  if (self->slab_used + len > self->slab_size) {
+    size_t size = self->slab_size ? self->slab_size : 256;
+    unsigned char *slab;
+    int i;
 
-/** alsaseq.Sequencer: tp_init */
+    while (size < self->slab_used + len) {
+      size *= 2;
+    }
+    if (self->views > 0 && self->slab != NULL) {
+      /* views may point into the old slab: keep it until they are gone */
+      unsigned char **retired = realloc(self->retired,
+					(self->nretired + 1) *
+					sizeof(unsigned char *));
+      if (retired == NULL) {
+	PyErr_NoMemory();
+	return -1;
+      }
+      self->retired = retired;
+      slab = malloc(size);
+      if (slab == NULL) {
+	PyErr_NoMemory();
+	return -1;
+      }
+      memcpy(slab, self->slab, self->slab_used);
+      self->retired[self->nretired++] = self->slab;
+    } else {
+      slab = realloc(self->slab, size);
+    }
+    if (slab == NULL) {
+      PyErr_NoMemory();
+      return -1;
+    }
+    /* rebase the data pointers of the events already stored */
+    if (slab != self->slab) {
+      for (i = 0; i < self->count; i++) {
+	snd_seq_event_t *ev = &(self->events[i]);
+	if (snd_seq_ev_is_variable(ev) && ev->data.ext.len > 0) {
+	  ev->data.ext.ptr = slab +
+	    ((unsigned char *)ev->data.ext.ptr - self->slab);
+	}
+      }
+    }
+    self->slab = slab;
+    self->slab_size = size;
+  }
+
+  memcpy(dst, event, sizeof(snd_seq_event_t));
+  if (snd_seq_ev_is_variable(event)) {
+    if (len > 0) {
+      memcpy(self->slab + self->slab_used, event->data.ext.ptr, len);
+      dst->data.ext.ptr = self->slab + self->slab_used;
+      self->slab_used += len;
+    } else {
+      dst->data.ext.ptr = NULL;
+    }
+  }
+  self->count++;
+
+  return 0;
+}
+
+/** internal use: free the retired slabs if no view may use them */
+static void
+_SeqEventBuffer_free_retired(SeqEventBufferObject *self) {
+  if (self->views > 0) {
+    return;
+  }
+  while (self->nretired > 0) {
+    free(self->retired[--self->nretired]);
+  }
+  FREECHECKED("retired", self->retired);
+}
+
+/** internal use: forget the stored events, keeping the allocated memory */
+static void
+_SeqEventBuffer_reset(SeqEventBufferObject *self) {
+  self->count = 0;
+  self->slab_used = 0;
+  _SeqEventBuffer_free_retired(self);
+}
+
+/** internal use: check the storage may be changed */
 static int
-Sequencer_init(SequencerObject *self,
-			  PyObject *args, PyObject *kwds) {
-  int ret;
-  /* defaults */
-  char *name = "default";
-  char *clientname = NULL;
-  char tmpclientname[1024];
+_SeqEventBuffer_check_busy(SeqEventBufferObject *self) {
+  if (self->in_use > 0) {
+    PyErr_SetString(PyExc_BufferError,
+		    "SeqEventBuffer is in use (exported event data or "
+		    "another thread)");
+    return -1;
+  }
+  return 0;
+}
 
-  self->streams = SND_SEQ_OPEN_DUPLEX;
-  self->mode = SND_SEQ_NONBLOCK;
-  int maxreceiveevents = 4;
+/** internal use: see the declaration above SeqEvent */
+static void
+_SeqEventBuffer_export(PyObject *owner,
+		       int delta) {
+  ((SeqEventBufferObject *)owner)->in_use += delta;
+}
 
-  char *kwlist[] = { "name", "clientname", "streams", "mode",
-		     "maxreceiveevents", NULL };
+/** internal use: see the declaration above SeqEvent */
+static void
+_SeqEventBuffer_view(PyObject *owner,
+		     int delta) {
+  ((SeqEventBufferObject *)owner)->views += delta;
+}
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|ssiii", kwlist, &name,
-				   &clientname, &self->streams,
-				   &self->mode, &maxreceiveevents)) {
+/** alsaseq.SeqEventBuffer tp_init */
+static int
+SeqEventBuffer_init(SeqEventBufferObject *self,
+		    PyObject *args,
+		    PyObject *kwds) {
+  int size = 64;
+  Py_ssize_t extsize = 4096;
+  char *kwlist[] = {"size", "extsize", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|in", kwlist, &size,
+				   &extsize)) {
     return -1;
   }
 
-  if (clientname == NULL) {
-    tmpclientname[0] = 0;
-    sprintf(tmpclientname, "pyalsa-%d", getpid());
-    clientname = tmpclientname;
+  if (size <= 0 || extsize < 0) {
+    PyErr_SetString(PyExc_ValueError, "size must be > 0 and extsize >= 0");
+    return -1;
   }
 
-  self->receive_fds = NULL;
-  self->receive_max = 0;
-  self->receive_bytes = 0;
-  self->receive_max_events = maxreceiveevents;
+  if (_SeqEventBuffer_check_busy(self) < 0) {
+    return -1;
+  }
+  if (self->views > 0) {
+    PyErr_Format(PyExc_BufferError,
+		 "SeqEventBuffer has %d live event views", self->views);
+    return -1;
+  }
 
+  FREECHECKED("events", self->events);
+  FREECHECKED("slab", self->slab);
+  self->size = 0;
+  self->slab_size = 0;
+  _SeqEventBuffer_reset(self);
 
-  ret = snd_seq_open(&(self->handle), name, self->streams,
-		     self->mode);
-  if (ret < 0) {
-    RAISESND(ret, "Failed to create sequencer");
+  self->events = calloc(size, sizeof(snd_seq_event_t));
+  if (self->events == NULL) {
+    PyErr_NoMemory();
     return -1;
   }
-  ret = snd_seq_set_client_name(self->handle, clientname);
-  if (ret < 0) {
-    RAISESND(ret, "Failed to set client name");
-    return -1;
+  self->size = size;
+
+  if (extsize > 0) {
+    self->slab = malloc(extsize);
+    if (self->slab == NULL) {
+      PyErr_NoMemory();
+      return -1;
+    }
+    self->slab_size = extsize;
   }
 
   return 0;
 }
 
-/** alsaseq.Sequencer: tp_dealloc */
+/** alsaseq.SeqEventBuffer tp_dealloc */
 static void
-Sequencer_dealloc(SequencerObject *self) {
-  FREECHECKED("receive_fds", self->receive_fds);
+SeqEventBuffer_dealloc(SeqEventBufferObject *self) {
+  FREECHECKED("events", self->events);
+  FREECHECKED("slab", self->slab);
+  _SeqEventBuffer_free_retired(self);
+  Py_TYPE(self)->tp_free((PyObject*)self);
+}
 
-  if (self->handle) {
-    snd_seq_close(self->handle);
-    self->handle = NULL;
+/** alsaseq.SeqEventBuffer sq_length */
+static Py_ssize_t
+SeqEventBuffer_length(SeqEventBufferObject *self) {
+  return self->count;
+}
+
+/** alsaseq.SeqEventBuffer sq_item */
+static PyObject *
+SeqEventBuffer_item(SeqEventBufferObject *self,
+		    Py_ssize_t index) {
+  if (index < 0 || index >= self->count) {
+    PyErr_SetString(PyExc_IndexError, "SeqEventBuffer index out of range");
+    return NULL;
   }
-  Py_TYPE(self)->tp_free((PyObject*)self);
+
+  return SeqEvent_view(&(self->events[index]), (PyObject *)self);
 }
 
-/** alsaseq.Sequencer name attribute: __doc__ */
-PyDoc_STRVAR(Sequencer_name__doc__,
-  "name -> string\n"
+/** alsaseq.SeqEventBuffer size attribute: __doc__ */
+PyDoc_STRVAR(SeqEventBuffer_size__doc__,
+  "size -> int\n"
   "\n"
-  "The alsa device name of this alsaseq.Sequencer.\n"
+  "The maximum number of events this buffer can hold.\n"
   "Note: read-only attribute."
 );
 
-/** alsaseq.Sequencer name attribute: tp_getset getter() */
+/** alsaseq.SeqEventBuffer size attribute: tp_getset getter() */
 static PyObject *
-Sequencer_get_name(SequencerObject *self) {
-  return PyUnicode_FromString(snd_seq_name(self->handle));
+SeqEventBuffer_get_size(SeqEventBufferObject *self) {
+  return PyInt_FromLong(self->size);
 }
 
-/** alsaseq.Sequencer clientname attribute: __doc__ */
-PyDoc_STRVAR(Sequencer_clientname__doc__,
-  "clientname -> string\n"
+/** alsaseq.SeqEventBuffer extsize attribute: __doc__ */
+PyDoc_STRVAR(SeqEventBuffer_extsize__doc__,
+  "extsize -> int\n"
   "\n"
-  "The client name of this alsaseq.Sequencer\n"
+  "The currently allocated size of the variable length data slab.\n"
+  "Note: read-only attribute."
 );
 
-/** alsaseq.Sequencer clientname attribute: tp_getset getter() */
+/** alsaseq.SeqEventBuffer extsize attribute: tp_getset getter() */
 static PyObject *
-Sequencer_get_clientname(SequencerObject *self) {
-  snd_seq_client_info_t *cinfo;
-
-  snd_seq_client_info_alloca(&cinfo);
-  snd_seq_get_client_info(self->handle, cinfo);
+SeqEventBuffer_get_extsize(SeqEventBufferObject *self) {
+  return PyLong_FromSize_t(self->slab_size);
+}
+
+/** alsaseq.SeqEventBuffer tp_getset list */
+static PyGetSetDef SeqEventBuffer_getset[] = {
+  {"size",
+   (getter) SeqEventBuffer_get_size,
+   NULL,
+   (char *) SeqEventBuffer_size__doc__,
+   NULL},
+  {"extsize",
+   (getter) SeqEventBuffer_get_extsize,
+   NULL,
+   (char *) SeqEventBuffer_extsize__doc__,
+   NULL},
+  {NULL}
+};
+
+/** alsaseq.SeqEventBuffer clear() method: __doc__ */
+PyDoc_STRVAR(SeqEventBuffer_clear__doc__,
+  "clear()\n"
+  "\n"
+  "Removes all events from this buffer. The allocated memory is kept."
+);
+
+/** alsaseq.SeqEventBuffer clear() method */
+static PyObject *
+SeqEventBuffer_clear(SeqEventBufferObject *self,
+		     PyObject *args) {
+  if (_SeqEventBuffer_check_busy(self) < 0) {
+    return NULL;
+  }
+
+  _SeqEventBuffer_reset(self);
+
+  Py_RETURN_NONE;
+}
+
+/** alsaseq.SeqEventBuffer tp_methods */
+static PyMethodDef SeqEventBuffer_methods[] = {
+  {"clear",
+   (PyCFunction) SeqEventBuffer_clear,
+   METH_NOARGS,
+   SeqEventBuffer_clear__doc__},
+  {NULL}
+};
+
+/** alsaseq.SeqEventBuffer tp_as_sequence */
+static PySequenceMethods SeqEventBuffer_as_sequence = {
+  sq_length: (lenfunc) SeqEventBuffer_length,
+  sq_item: (ssizeargfunc) SeqEventBuffer_item,
+};
+
+/** alsaseq.SeqEventBuffer tp_repr */
+static PyObject *
+SeqEventBuffer_repr(SeqEventBufferObject *self) {
+  return PyUnicode_FromFormat("<alsaseq.SeqEventBuffer count=%d size=%d "
+			     "at %p>",
+			     self->count, self->size, self);
+}
+
+/** alsaseq.SeqEventBuffer type */
+static PyTypeObject SeqEventBufferType = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  tp_name: "alsaseq.SeqEventBuffer",
+  tp_basicsize: sizeof(SeqEventBufferObject),
+  tp_dealloc: (destructor) SeqEventBuffer_dealloc,
+  tp_flags: Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+  tp_doc: SeqEventBuffer__doc__,
+  tp_init: (initproc) SeqEventBuffer_init,
+  tp_new: PyType_GenericNew,
+  tp_alloc: PyType_GenericAlloc,
+  tp_free: PyObject_Del,
+  tp_as_sequence: &SeqEventBuffer_as_sequence,
+  tp_methods: SeqEventBuffer_methods,
+  tp_getset: SeqEventBuffer_getset,
+  tp_repr: (reprfunc) SeqEventBuffer_repr,
+};
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// native reader thread
+//////////////////////////////////////////////////////////////////////////////
+
+/* interpreter used by the callbacks called from native threads */
+static PyInterpreterState *main_interpreter;
+
+/** a source accepted by a receive filter */
+typedef struct {
+  int client;
+  /* -1: any port of the client */
+  int port;
+} seq_filter_source_t;
+
+/** receive filter of a Sequencer; the events not matching are dropped
+    before any object is created for them */
+typedef struct {
+  int active;
+  /* accepted event types (bitmap), if has_types */
+  int has_types;
+  unsigned char types[32];
+  /* accepted channels (bitmask) of the note and control events, if
+     has_channels; the other events have no channel */
+  int has_channels;
+  unsigned int channels;
+  /* accepted sources, if has_sources */
+  int has_sources;
+  seq_filter_source_t *sources;
+  int nsources;
+  /* events dropped */
+  unsigned long dropped;
+} seq_filter_t;
+
+/** internal use: check an event against a filter (may be NULL); the
+    dropped events are counted */
+static int
+_seq_filter_match(seq_filter_t *filter,
+		  const snd_seq_event_t *event) {
+  int channel = -1;
+  int i;
+
+  if (filter == NULL || !filter->active) {
+    return 1;
+  }
+
+  if (filter->has_types &&
+      !(filter->types[event->type >> 3] & (1 << (event->type & 7)))) {
+    goto __drop;
+  }
+  if (snd_seq_ev_is_note_type(event)) {
+    channel = event->data.note.channel;
+  } else if (snd_seq_ev_is_control_type(event)) {
+    channel = event->data.control.channel;
+  }
+  if (filter->has_channels && channel >= 0 &&
+      !(filter->channels & (1U << (channel & 0x0f)))) {
+    goto __drop;
+  }
+  if (filter->has_sources) {
+    for (i = 0; i < filter->nsources; i++) {
+      if (filter->sources[i].client == event->source.client &&
+	  (filter->sources[i].port < 0 ||
+	   filter->sources[i].port == event->source.port)) {
+	return 1;
+      }
+    }
+    goto __drop;
+  }
+  return 1;
+
+ __drop:
+  __atomic_add_fetch(&filter->dropped, 1, __ATOMIC_RELAXED);
+  return 0;
+}
+
+/** internal use: reset a receive filter */
+static void
+_seq_filter_clear(seq_filter_t *filter) {
+  FREECHECKED("sources", filter->sources);
+  memset(filter, 0, sizeof(*filter));
+}
+
+typedef struct seq_reader seq_reader_t;
+
+/* called on the reader thread, without the GIL, for each event read */
+typedef void (*seq_reader_sink_t)(seq_reader_t *reader,
+				  const snd_seq_event_t *event);
+
+/* called on the reader thread, without the GIL, after each burst */
+typedef void (*seq_reader_flush_t)(seq_reader_t *reader);
+
+/** a thread reading a sequencer input and passing the events to a sink;
+    the handle input must not be used by anyone else meanwhile, and the
+    handle is non-blocking while the thread runs */
+struct seq_reader {
+  snd_seq_t *handle;
+  /* blocking mode of the handle, restored when the thread stops */
+  int mode;
+  seq_reader_sink_t sink;
+  seq_reader_flush_t flush;
+  /* data of the sink */
+  void *data;
+  /* receive filter of the Sequencer, or NULL */
+  seq_filter_t *filter;
+
+  pthread_t thread;
+  /* pipe used to wake up the thread for stopping it */
+  int wakeup[2];
+  int stop;
+
+  /* counters: events read and input overruns (events lost in the
+     kernel); error is the ALSA error which ended the thread */
+  unsigned long events;
+  unsigned long overruns;
+  int error;
+};
+
+/** internal use: the reader thread */
+static void *
+_seq_reader_run(void *arg) {
+  seq_reader_t *reader = arg;
+  snd_seq_event_t *event;
+  struct pollfd *fds;
+  int count, ret;
+
+  count = snd_seq_poll_descriptors_count(reader->handle, POLLIN);
+  fds = alloca(sizeof(struct pollfd) * (count + 1));
+  count = snd_seq_poll_descriptors(reader->handle, fds, count, POLLIN);
+  fds[count].fd = reader->wakeup[0];
+  fds[count].events = POLLIN;
+
+  while (!__atomic_load_n(&reader->stop, __ATOMIC_ACQUIRE)) {
+    if (snd_seq_event_input_pending(reader->handle, 0) == 0) {
+      ret = poll(fds, count + 1, -1);
+      if (ret < 0) {
+	if (errno == EINTR) {
+	  continue;
+	}
+	reader->error = -errno;
+	break;
+      }
+      if (fds[count].revents) {
+	break;
+      }
+    }
+
+    /* the handle is non-blocking: a spurious POLLIN only gives EAGAIN
+       and can't keep the thread from seeing the wakeup pipe */
+    do {
+      ret = snd_seq_event_input(reader->handle, &event);
+      if (ret == -EAGAIN) {
+	break;
+      } else if (ret == -ENOSPC) {
+	__atomic_add_fetch(&reader->overruns, 1, __ATOMIC_RELAXED);
+	continue;
+      } else if (ret < 0) {
+	reader->error = ret;
+	goto __end;
+      }
+      __atomic_add_fetch(&reader->events, 1, __ATOMIC_RELAXED);
+      if (_seq_filter_match(reader->filter, event)) {
+	reader->sink(reader, event);
+      }
+    } while (snd_seq_event_input_pending(reader->handle, 0) > 0);
+
+    if (reader->flush != NULL) {
+      reader->flush(reader);
+    }
+  }
+
+ __end:
+  if (reader->flush != NULL) {
+    reader->flush(reader);
+  }
+  return NULL;
+}
+
+/** internal use: start the reader thread; returns 0 or a negative
+    error */
+static int
+_seq_reader_start(seq_reader_t *reader) {
+  int ret;
+
+  reader->stop = 0;
+  reader->events = 0;
+  reader->overruns = 0;
+  reader->error = 0;
+
+  if (snd_seq_poll_descriptors_count(reader->handle, POLLIN) <= 0) {
+    return -EINVAL;
+  }
+  if (reader->mode != SND_SEQ_NONBLOCK) {
+    ret = snd_seq_nonblock(reader->handle, SND_SEQ_NONBLOCK);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+  if (pipe(reader->wakeup) < 0) {
+    ret = -errno;
+    snd_seq_nonblock(reader->handle, reader->mode);
+    return ret;
+  }
+  fcntl(reader->wakeup[1], F_SETFL, O_NONBLOCK);
+
+  ret = pthread_create(&reader->thread, NULL, _seq_reader_run, reader);
+  if (ret != 0) {
+    close(reader->wakeup[0]);
+    close(reader->wakeup[1]);
+    snd_seq_nonblock(reader->handle, reader->mode);
+    return -ret;
+  }
+  return 0;
+}
+
+/** internal use: stop the reader thread and wait for it; must be called
+    without the GIL if the sink may need it */
+static void
+_seq_reader_stop(seq_reader_t *reader) {
+  __atomic_store_n(&reader->stop, 1, __ATOMIC_RELEASE);
+  if (write(reader->wakeup[1], "", 1) < 0) {
+    /* the pipe is full: the thread is being woken up anyway */
+  }
+  pthread_join(reader->thread, NULL);
+  close(reader->wakeup[0]);
+  close(reader->wakeup[1]);
+  if (reader->mode != SND_SEQ_NONBLOCK) {
+    snd_seq_nonblock(reader->handle, reader->mode);
+  }
+}
+
+/** lock-free single producer/single consumer ring of events; the
+    variable length data of the events is malloc'ed by the producer and
+    freed by the consumer */
+typedef struct {
+  snd_seq_event_t *events;
+  unsigned int mask;
+  /* written by the producer only */
+  unsigned int head;
+  /* written by the consumer only */
+  unsigned int tail;
+} seq_ring_t;
+
+/** internal use: allocate a ring for at least size events */
+static int
+_seq_ring_init(seq_ring_t *ring,
+	       unsigned int size) {
+  unsigned int n = 16;
+
+  while (n < size) {
+    n <<= 1;
+  }
+  ring->events = malloc(sizeof(snd_seq_event_t) * n);
+  if (ring->events == NULL) {
+    return -ENOMEM;
+  }
+  ring->mask = n - 1;
+  ring->head = 0;
+  ring->tail = 0;
+  return 0;
+}
+
+/** internal use: number of events in the ring */
+static unsigned int
+_seq_ring_count(seq_ring_t *ring) {
+  return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) -
+    __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+/** internal use: producer side; copy event into the ring; returns 0, or
+    -EAGAIN if the ring is full */
+static int
+_seq_ring_push(seq_ring_t *ring,
+	       const snd_seq_event_t *event) {
+  unsigned int head = ring->head;
+  snd_seq_event_t *slot;
+
+  if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > ring->mask) {
+    return -EAGAIN;
+  }
+
+  slot = &(ring->events[head & ring->mask]);
+  memcpy(slot, event, sizeof(snd_seq_event_t));
+  if (snd_seq_ev_is_variable(event)) {
+    slot->data.ext.ptr = NULL;
+    if (event->data.ext.len > 0) {
+      slot->data.ext.ptr = malloc(event->data.ext.len);
+      if (slot->data.ext.ptr == NULL) {
+	return -ENOMEM;
+      }
+      memcpy(slot->data.ext.ptr, event->data.ext.ptr, event->data.ext.len);
+    }
+  }
+
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+/** internal use: consumer side; the oldest event, or NULL if the ring
+    is empty; it is valid until _seq_ring_pop() */
+static snd_seq_event_t *
+_seq_ring_peek(seq_ring_t *ring) {
+  unsigned int tail = ring->tail;
+
+  if (tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+    return NULL;
+  }
+  return &(ring->events[tail & ring->mask]);
+}
+
+/** internal use: consumer side; drop the oldest event */
+static void
+_seq_ring_pop(seq_ring_t *ring) {
+  snd_seq_event_t *slot = &(ring->events[ring->tail & ring->mask]);
+
+  if (snd_seq_ev_is_variable(slot)) {
+    free(slot->data.ext.ptr);
+  }
+  __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+/** internal use: free a ring and the events left in it */
+static void
+_seq_ring_free(seq_ring_t *ring) {
+  while (_seq_ring_peek(ring) != NULL) {
+    _seq_ring_pop(ring);
+  }
+  FREECHECKED("events", ring->events);
+}
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// alsaseq.Sequencer implementation
+//////////////////////////////////////////////////////////////////////////////
+
+/** alsaseq.Sequencer __doc__ */
+PyDoc_STRVAR(Sequencer__doc__,
+  "Sequencer([name, clientname, streams, mode, maxreceiveevents]) "
+  "-> Sequencer object\n"
+  "\n"
+  "Creates and opens an ALSA sequencer. The features of the Sequencer are:\n"
+  "- send/receive events (as SeqEvent objects)\n"
+  "- create ports\n"
+  "- list all ALSA clients and their port connections\n"
+  "- connect/disconnect arbitrary ports\n"
+  "- create and control queues\n"
+  "- get info about a port or a client\n"
+  "- receive and send events from asyncio coroutines\n"
+  "\n"
+  "The name must correspond to the special ALSA name (for example: 'hw'); \n"
+  "if not specified, 'default' is used. The clientname is the name of this \n"
+  "client; if not specified, 'pyalsa-PID' is used.\n"
+  "\n"
+  "The streams specifies if you want to receive, send or both; use \n"
+  "SEQ_OPEN_INPUT, SEQ_OPEN_OUTPUT or SEQ_OPEN_DUPLEX. If not specified, \n"
+  "SEQ_OPEN_DUPLEX is used."
+  "\n"
+  "The mode specifies if this client should block or not, use SEQ_BLOCK or \n"
+  "SEQ_NONBLOCK. If not specified, SEQ_NONBLOCK is used."
+  "\n"
+  "The maxreceiveevents is a number that represents how many SeqEvent \n"
+  "objects are returned by the receive() method. If not specified, the \n"
+  "default is 4. \n"
+  "\n"
+  "The output_buffer_size and input_buffer_size are the sizes in bytes\n"
+  "of the alsa-lib buffers; output_pool, input_pool and output_room set\n"
+  "the kernel client pool (in events). When not specified, the ALSA\n"
+  "defaults are kept. They are also available as attributes; see\n"
+  "pool_status() for the pool usage.\n"
+  "\n"
+  "There is no method for closing the sequencer, it will remain open as \n"
+  "long as the Sequencer object exists. For closing the sequencer you \n"
+  "must explicitly del() the returned object.\n"
+  "\n"
+  "Raises:\n"
+  "  RuntimeError: on re-initialization while a reader thread, an event\n"
+  "                loop or another thread uses the sequencer."
+);
+
+/** alsaseq.Sequencer object structure type */
+typedef struct {
+  PyObject_HEAD
+
+  /* streams */
+  int streams;
+  /* mode */
+  int mode;
+
+  /* alsa handler */
+  snd_seq_t *handle;
+  /* max fd's */
+  int receive_max;
+  /* receive poll fd's */
+  struct pollfd *receive_fds;
+  /* max events for returning in receive_events() */
+  int receive_max_events;
+  /* input poll counters: polls, wakeups and wakeups without input */
+  unsigned long receive_polls;
+  unsigned long receive_wakeups;
+  unsigned long receive_empty_wakeups;
+  /* max output fd's */
+  int output_max;
+  /* output poll fd's */
+  struct pollfd *output_fds;
+  /* set while the output buffer is used with the GIL released */
+  int output_busy;
+  /* set while the input is polled or read with the GIL released */
+  int input_busy;
+
+  /* asyncio: event loop watching the descriptors */
+  PyObject *aloop;
+  /* asyncio: list of (future, maxevents) waiting for input */
+  PyObject *areaders;
+  /* asyncio: events received but not yet delivered */
+  PyObject *apending;
+  /* asyncio: list of (future, event or None) waiting for output */
+  PyObject *awriters;
+  /* asyncio: descriptors registered with aloop for input/output */
+  int areading;
+  int awriting;
+  /* asyncio: weak reference to this Sequencer, bound to the callbacks
+     given to the loop and to the futures */
+  PyObject *aref;
+  /* weak references to this Sequencer */
+  PyObject *weakreflist;
+
+  /* name of the native reader owning the input (NULL: none) */
+  const char *input_owner;
+  /* state of start_dispatch() */
+  struct seq_dispatch *dispatch;
+  /* set_receive_filter() */
+  seq_filter_t filter;
+  /* number of receive calls using the filter with the GIL released */
+  int filter_busy;
+} SequencerObject;
+
+/** alsaseq.Sequencer type (initialized later...) */
+static PyTypeObject SequencerType;
+
+/* buffer and pool sizes of a Sequencer; the id is the getset closure */
+enum {
+  SEQUENCER_OUTPUT_BUFFER_SIZE,
+  SEQUENCER_INPUT_BUFFER_SIZE,
+  SEQUENCER_OUTPUT_POOL,
+  SEQUENCER_INPUT_POOL,
+  SEQUENCER_OUTPUT_ROOM,
+};
+
+/** internal use: check that the input is not owned by a native reader
+    thread nor used by another thread (defined later...) */
+static int _Sequencer_check_input(SequencerObject *self);
+
+/** internal use: check that no other thread is using the output buffer
+    with the GIL released; alsa-lib handles are not thread-safe */
+static int
+_Sequencer_check_output(SequencerObject *self) {
+  if (self->output_busy) {
+    RAISESTR("The output is in use by another thread");
+    return -1;
+  }
+  return 0;
+}
+
+/** internal use: reserve the output buffer before using it with the
+    GIL released; _Sequencer_release_output() ends the reservation */
+static int
+_Sequencer_acquire_output(SequencerObject *self) {
+  if (_Sequencer_check_output(self) < 0) {
+    return -1;
+  }
+  self->output_busy = 1;
+  return 0;
+}
+
+/** internal use: see _Sequencer_acquire_output() */
+static inline void
+_Sequencer_release_output(SequencerObject *self) {
+  self->output_busy = 0;
+}
+
+/** internal use: set a buffer or pool size */
+static int
+_Sequencer_set_size(SequencerObject *self,
+		    int id,
+		    size_t size) {
+  int ret = 0;
+
+  switch (id) {
+  case SEQUENCER_OUTPUT_BUFFER_SIZE:
+    /* the output buffer is reallocated */
+    if (_Sequencer_check_output(self) < 0) {
+      return -1;
+    }
+    ret = snd_seq_set_output_buffer_size(self->handle, size);
+    break;
+  case SEQUENCER_INPUT_BUFFER_SIZE:
+    /* the input buffer is reallocated */
+    if (_Sequencer_check_input(self) < 0) {
+      return -1;
+    }
+    ret = snd_seq_set_input_buffer_size(self->handle, size);
+    break;
+  case SEQUENCER_OUTPUT_POOL:
+    if (_Sequencer_check_output(self) < 0) {
+      return -1;
+    }
+    ret = snd_seq_set_client_pool_output(self->handle, size);
+    break;
+  case SEQUENCER_INPUT_POOL:
+    ret = snd_seq_set_client_pool_input(self->handle, size);
+    break;
+  case SEQUENCER_OUTPUT_ROOM:
+    if (_Sequencer_check_output(self) < 0) {
+      return -1;
+    }
+    ret = snd_seq_set_client_pool_output_room(self->handle, size);
+    break;
+  }
+  if (ret < 0) {
+    RAISESND(ret, "Failed to set the size to %zu", size);
+    return -1;
+  }
+  return 0;
+}
+
+/** alsaseq.Sequencer: tp_init */
+static int
+Sequencer_init(SequencerObject *self,
+			  PyObject *args, PyObject *kwds) {
+  int ret;
+  /* defaults */
+  char *name = "default";
+  char *clientname = NULL;
+  char tmpclientname[1024];
+
+  /* the handle is replaced below */
+  if (self->handle != NULL &&
+      (self->input_owner != NULL || self->dispatch != NULL ||
+       self->output_busy || self->input_busy || self->filter_busy ||
+       self->areading || self->awriting)) {
+    PyErr_SetString(PyExc_RuntimeError,
+		    "Sequencer is in use by another thread");
+    return -1;
+  }
+
+  self->streams = SND_SEQ_OPEN_DUPLEX;
+  self->mode = SND_SEQ_NONBLOCK;
+  int maxreceiveevents = 4;
+
+  Py_ssize_t output_buffer_size = -1;
+  Py_ssize_t input_buffer_size = -1;
+  Py_ssize_t output_pool = -1;
+  Py_ssize_t input_pool = -1;
+  Py_ssize_t output_room = -1;
+
+  char *kwlist[] = { "name", "clientname", "streams", "mode",
+		     "maxreceiveevents", "output_buffer_size",
+		     "input_buffer_size", "output_pool", "input_pool",
+		     "output_room", NULL };
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|ssiiinnnnn", kwlist, &name,
+				   &clientname, &self->streams,
+				   &self->mode, &maxreceiveevents,
+				   &output_buffer_size, &input_buffer_size,
+				   &output_pool, &input_pool,
+				   &output_room)) {
+    return -1;
+  }
+
+  if (clientname == NULL) {
+    tmpclientname[0] = 0;
+    sprintf(tmpclientname, "pyalsa-%d", getpid());
+    clientname = tmpclientname;
+  }
+
+  self->receive_fds = NULL;
+  self->receive_max = 0;
+  self->receive_polls = 0;
+  self->receive_wakeups = 0;
+  self->receive_empty_wakeups = 0;
+  self->receive_max_events = maxreceiveevents;
+  self->output_fds = NULL;
+  self->output_max = 0;
+
+
+  ret = snd_seq_open(&(self->handle), name, self->streams,
+		     self->mode);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to create sequencer");
+    return -1;
+  }
+  ret = snd_seq_set_client_name(self->handle, clientname);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to set client name");
+    return -1;
+  }
+
+  if (output_buffer_size >= 0 &&
+      _Sequencer_set_size(self, SEQUENCER_OUTPUT_BUFFER_SIZE,
+			  output_buffer_size) < 0) {
+    return -1;
+  }
+  if (input_buffer_size >= 0 &&
+      _Sequencer_set_size(self, SEQUENCER_INPUT_BUFFER_SIZE,
+			  input_buffer_size) < 0) {
+    return -1;
+  }
+  if (output_pool >= 0 &&
+      _Sequencer_set_size(self, SEQUENCER_OUTPUT_POOL, output_pool) < 0) {
+    return -1;
+  }
+  if (input_pool >= 0 &&
+      _Sequencer_set_size(self, SEQUENCER_INPUT_POOL, input_pool) < 0) {
+    return -1;
+  }
+  if (output_room >= 0 &&
+      _Sequencer_set_size(self, SEQUENCER_OUTPUT_ROOM, output_room) < 0) {
+    return -1;
+  }
+
+  return 0;
+}
+
+#if PY_VERSION_HEX >= 0x03070000
+/** internal use: stop the asyncio support of a Sequencer being
+    deallocated (defined later...) */
+static void _Sequencer_async_close(SequencerObject *self);
+#endif
+
+/** alsaseq.Sequencer: tp_dealloc */
+static void
+Sequencer_dealloc(SequencerObject *self) {
+  if (self->weakreflist != NULL) {
+    PyObject_ClearWeakRefs((PyObject *)self);
+  }
+#if PY_VERSION_HEX >= 0x03070000
+  _Sequencer_async_close(self);
+#endif
+  FREECHECKED("receive_fds", self->receive_fds);
+  FREECHECKED("output_fds", self->output_fds);
+  Py_CLEAR(self->aref);
+  Py_CLEAR(self->aloop);
+  Py_CLEAR(self->areaders);
+  Py_CLEAR(self->apending);
+  Py_CLEAR(self->awriters);
+  _seq_filter_clear(&self->filter);
+
+  if (self->handle) {
+    snd_seq_close(self->handle);
+    self->handle = NULL;
+  }
+  Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+/** alsaseq.Sequencer name attribute: __doc__ */
+PyDoc_STRVAR(Sequencer_name__doc__,
+  "name -> string\n"
+  "\n"
+  "The alsa device name of this alsaseq.Sequencer.\n"
+  "Note: read-only attribute."
+);
+
+/** alsaseq.Sequencer name attribute: tp_getset getter() */
+static PyObject *
+Sequencer_get_name(SequencerObject *self) {
+  return PyUnicode_FromString(snd_seq_name(self->handle));
+}
+
+/** alsaseq.Sequencer clientname attribute: __doc__ */
+PyDoc_STRVAR(Sequencer_clientname__doc__,
+  "clientname -> string\n"
+  "\n"
+  "The client name of this alsaseq.Sequencer\n"
+);
+
+/** alsaseq.Sequencer clientname attribute: tp_getset getter() */
+static PyObject *
+Sequencer_get_clientname(SequencerObject *self) {
+  snd_seq_client_info_t *cinfo;
+
+  snd_seq_client_info_alloca(&cinfo);
+  snd_seq_get_client_info(self->handle, cinfo);
 
   return PyUnicode_FromString(snd_seq_client_info_get_name(cinfo));
 }
 
-/** alsaseq.Sequencer clientname attribute: tp_getset setter() */
+/** alsaseq.Sequencer clientname attribute: tp_getset setter() */
+static int
+Sequencer_set_clientname(SequencerObject *self,
+			 PyObject *val) {
+  char *s;
+
+  if (get_utf8_string(val, &s))
+    return -1;
+
+  snd_seq_set_client_name(self->handle, s);
+  free(s);
+
+  return 0;
+}
+
+/** alsaseq.Sequencer streams attribute: __doc__ */
+PyDoc_STRVAR(Sequencer_streams__doc__,
+  "streams -> Constant object\n"
+  "\n"
+  "The streams of this alsaseq.Sequencer. Posible values:\n"
+  "alsaseq.SEQ_OPEN_OUTPUT, alsaseq.SEQ_OPEN_INPUT, \n"
+  "alsaseq.SEQ_OPEN_DUPLEX.\n"
+  "Note: read-only attribute."
+);
+
+/** alsaseq.Sequencer streams attribute: tp_getset getter() */
+static PyObject *
+Sequencer_get_streams(SequencerObject *self) {
+  TCONSTRETURN(STREAMS, self->streams);
+}
+
+/** alsaseq.Sequencer mode attribute: __doc__ */
+PyDoc_STRVAR(Sequencer_mode__doc__,
+  "mode -> Constant object\n"
+  "\n"
+  "The blocking mode of this alsaseq.Sequencer. Use\n"
+  "alsaseq.SEQ_BLOCK, alsaseq.SEQ_NONBLOCK."
+);
+
+/** alsaseq.Sequencer mode attribute: tp_getset getter() */
+static PyObject *Sequencer_get_mode(SequencerObject *self) {
+  TCONSTRETURN(MODE, self->mode);
+}
+
+/** alsaseq.Sequencer mode attribute: tp_getset setter() */
+static int
+Sequencer_set_mode(SequencerObject *self,
+		   PyObject *val) {
+  int ret;
+  long mode;
+
+  if (get_long(val, &mode))
+    return -1;
+
+  if (mode != 0 && mode != SND_SEQ_NONBLOCK) {
+    PyErr_SetString(PyExc_ValueError, "Invalid value for mode.");
+    return -1;
+  }
+  /* a native reader thread needs the handle non-blocking */
+  if (_Sequencer_check_input(self) < 0) {
+    return -1;
+  }
+
+  ret = snd_seq_nonblock(self->handle, mode);
+  if (ret == 0) {
+    self->mode = mode;
+  } else {
+    RAISESND(ret, "Failed to set mode");
+    return -1;
+  }
+  return 0;
+}
+
+/** alsaseq.Sequencer buffer and pool size attributes: tp_getset getter() */
+static PyObject *
+Sequencer_get_size(SequencerObject *self,
+		   void *closure) {
+  snd_seq_client_pool_t *pool;
+  int id = (int)(intptr_t)closure;
+  size_t size = 0;
+  int ret;
+
+  switch (id) {
+  case SEQUENCER_OUTPUT_BUFFER_SIZE:
+    size = snd_seq_get_output_buffer_size(self->handle);
+    break;
+  case SEQUENCER_INPUT_BUFFER_SIZE:
+    size = snd_seq_get_input_buffer_size(self->handle);
+    break;
+  default:
+    snd_seq_client_pool_alloca(&pool);
+    ret = snd_seq_get_client_pool(self->handle, pool);
+    if (ret < 0) {
+      RAISESND(ret, "Failed to get client pool");
+      return NULL;
+    }
+    if (id == SEQUENCER_OUTPUT_POOL) {
+      size = snd_seq_client_pool_get_output_pool(pool);
+    } else if (id == SEQUENCER_INPUT_POOL) {
+      size = snd_seq_client_pool_get_input_pool(pool);
+    } else {
+      size = snd_seq_client_pool_get_output_room(pool);
+    }
+    break;
+  }
+
+  return PyLong_FromSize_t(size);
+}
+
+/** alsaseq.Sequencer buffer and pool size attributes: tp_getset setter() */
+static int
+Sequencer_set_size(SequencerObject *self,
+		   PyObject *val,
+		   void *closure) {
+  long size;
+
+  if (val == NULL) {
+    PyErr_SetString(PyExc_TypeError, "can't delete a size");
+    return -1;
+  }
+  if (get_long(val, &size))
+    return -1;
+  if (size < 0) {
+    PyErr_SetString(PyExc_ValueError, "size must be >= 0");
+    return -1;
+  }
+
+  return _Sequencer_set_size(self, (int)(intptr_t)closure, size);
+}
+
+/** alsaseq.Sequencer output_buffer_size attribute: __doc__ */
+PyDoc_STRVAR(Sequencer_output_buffer_size__doc__,
+  "output_buffer_size -> int\n"
+  "\n"
+  "The size in bytes of the alsa-lib output buffer of this\n"
+  "alsaseq.Sequencer; events are kept there until drained."
+);
+
+/** alsaseq.Sequencer input_buffer_size attribute: __doc__ */
+PyDoc_STRVAR(Sequencer_input_buffer_size__doc__,
+  "input_buffer_size -> int\n"
+  "\n"
+  "The size in bytes of the alsa-lib input buffer of this\n"
+  "alsaseq.Sequencer; bigger buffers read more events per system call."
+);
+
+/** alsaseq.Sequencer output_pool attribute: __doc__ */
+PyDoc_STRVAR(Sequencer_output_pool__doc__,
+  "output_pool -> int\n"
+  "\n"
+  "The size (in events) of the kernel output pool of this client; it\n"
+  "limits the events scheduled on queues and not yet delivered."
+);
+
+/** alsaseq.Sequencer input_pool attribute: __doc__ */
+PyDoc_STRVAR(Sequencer_input_pool__doc__,
+  "input_pool -> int\n"
+  "\n"
+  "The size (in events) of the kernel input pool of this client."
+);
+
+/** alsaseq.Sequencer output_room attribute: __doc__ */
+PyDoc_STRVAR(Sequencer_output_room__doc__,
+  "output_room -> int\n"
+  "\n"
+  "The free room (in events) of the kernel output pool needed before a\n"
+  "blocked writer is woken up (POLLOUT)."
+);
+
+/** alsaseq.Sequencer client_id attribute: __doc__ */
+PyDoc_STRVAR(Sequencer_client_id__doc__,
+  "client_id -> int\n"
+  "\n"
+  "The client id of this alsaseq.Sequencer.\n"
+  "Note: read-only attribute."
+);
+
+/** alsaseq.Sequencer client_id attribute: tp_getset getter() */
+static PyObject *
+Sequencer_get_client_id(SequencerObject *self) {
+  snd_seq_client_info_t *cinfo;
+
+  snd_seq_client_info_alloca(&cinfo);
+  snd_seq_get_client_info(self->handle, cinfo);
+  return PyInt_FromLong(snd_seq_client_info_get_client(cinfo));
+}
+
+/** alsaseq.Sequencer: tp_getset list*/
+static PyGetSetDef Sequencer_getset[] = {
+  {"name",
+   (getter) Sequencer_get_name,
+   NULL,
+   (char *) Sequencer_name__doc__,
+   NULL},
+  {"clientname",
+   (getter) Sequencer_get_clientname,
+   (setter) Sequencer_set_clientname,
+   (char *) Sequencer_clientname__doc__,
+   NULL},
+  {"streams",
+   (getter) Sequencer_get_streams,
+   NULL,
+   (char *) Sequencer_streams__doc__,
+   NULL},
+  {"mode",
+   (getter) Sequencer_get_mode,
+   (setter) Sequencer_set_mode,
+   (char *) Sequencer_mode__doc__,
+   NULL},
+  {"client_id",
+   (getter) Sequencer_get_client_id,
+   NULL,
+   (char *) Sequencer_client_id__doc__,
+   NULL},
+  {"output_buffer_size",
+   (getter) Sequencer_get_size,
+   (setter) Sequencer_set_size,
+   (char *) Sequencer_output_buffer_size__doc__,
+   (void *) SEQUENCER_OUTPUT_BUFFER_SIZE},
+  {"input_buffer_size",
+   (getter) Sequencer_get_size,
+   (setter) Sequencer_set_size,
+   (char *) Sequencer_input_buffer_size__doc__,
+   (void *) SEQUENCER_INPUT_BUFFER_SIZE},
+  {"output_pool",
+   (getter) Sequencer_get_size,
+   (setter) Sequencer_set_size,
+   (char *) Sequencer_output_pool__doc__,
+   (void *) SEQUENCER_OUTPUT_POOL},
+  {"input_pool",
+   (getter) Sequencer_get_size,
+   (setter) Sequencer_set_size,
+   (char *) Sequencer_input_pool__doc__,
+   (void *) SEQUENCER_INPUT_POOL},
+  {"output_room",
+   (getter) Sequencer_get_size,
+   (setter) Sequencer_set_size,
+   (char *) Sequencer_output_room__doc__,
+   (void *) SEQUENCER_OUTPUT_ROOM},
+  {NULL}
+};
+
+/** alsaseq.Sequencer: tp_repr */
+static PyObject *
+Sequencer_repr(SequencerObject *self) {
+  snd_seq_client_info_t *cinfo;
+
+  snd_seq_client_info_alloca(&cinfo);
+  snd_seq_get_client_info(self->handle, cinfo);
+
+  return PyUnicode_FromFormat("<alsaseq.Sequencer name=%s client_id=%d "
+			     "clientname=%s streams=%d mode=%d at 0x%p>",
+			     snd_seq_name(self->handle),
+			     snd_seq_client_info_get_client(cinfo),
+			     snd_seq_client_info_get_name(cinfo),
+			     self->streams,
+			     self->mode,
+			     self
+			     );
+}
+
+/** alsaseq.Sequencer create_simple_port() method: __doc__ */
+PyDoc_STRVAR(Sequencer_create_simple_port__doc__,
+  "create_simple_port(name, type, caps=0) -> int"
+  "\n"
+  "Creates a port for receiving or sending events.\n"
+  "\n"
+  "Parameters:\n"
+  "    name -- name of the port\n"
+  "    type -- type of port (use one of the alsaseq.SEQ_PORT_TYPE_*\n"
+  "            constants)\n"
+  "    caps -- capabilites of the port (use bitwise alsaseq.SEQ_PORT_CAP_*\n"
+  "            constants). Default=0\n"
+  "Returns:\n"
+  "  the port id.\n"
+  "Raises:\n"
+  "  TypeError: if an invalid type was used in a parameter\n"
+  "  ValueError: if an invalid value was used in a parameter\n"
+  "  SequencerError: if ALSA can't create the port"
+);
+	
+
+/** alsaseq.Sequencer create_simple_port() method */
+static PyObject *
+Sequencer_create_simple_port(SequencerObject *self,
+			     PyObject *args,
+			     PyObject *kwds) {
+  char *name;
+  unsigned int type;
+  unsigned int caps=0;
+  char *kwlist[] = { "name", "type", "caps", NULL };
+  int port;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "sI|I", kwlist,
+				   &name, &type, &caps)) {
+    return NULL;
+  }
+
+  port = snd_seq_create_simple_port(self->handle, name, caps, type);
+  if (port < 0) {
+    RAISESND(port, "Failed to create simple port");
+    return NULL;
+  }
+
+  return PyInt_FromLong(port);
+}
+
+/** internal use: keys of a create_ports() specification */
+static const char * const port_spec_keys[] = {
+  "name", "type", "caps", "port", "midi_channels", "midi_voices",
+  "synth_voices", "timestamping", "timestamp_real", "timestamp_queue",
+  NULL
+};
+
+/** internal use: build a port info from a create_ports() specification */
+static int
+_Sequencer_parse_port_spec(PyObject *spec,
+			   snd_seq_port_info_t *pinfo) {
+  PyObject *key, *value;
+  Py_ssize_t pos = 0;
+  const char *name;
+  long v;
+  int i;
+
+  if (!PyDict_Check(spec)) {
+    PyErr_SetString(PyExc_TypeError, "port specification must be a dict");
+    return -1;
+  }
+
+  snd_seq_port_info_set_type(pinfo, SND_SEQ_PORT_TYPE_MIDI_GENERIC |
+			     SND_SEQ_PORT_TYPE_APPLICATION);
+  while (PyDict_Next(spec, &pos, &key, &value)) {
+    name = PyUnicode_Check(key) ? PyUnicode_AsUTF8(key) : NULL;
+    for (i = 0; name != NULL && port_spec_keys[i] != NULL; i++) {
+      if (!strcmp(name, port_spec_keys[i])) {
+	break;
+      }
+    }
+    if (name == NULL || port_spec_keys[i] == NULL) {
+      PyErr_Format(PyExc_ValueError, "unknown port specification key %R",
+		   key);
+      return -1;
+    }
+
+    if (i == 0) {
+      name = PyUnicode_Check(value) ? PyUnicode_AsUTF8(value) : NULL;
+      if (name == NULL) {
+	if (!PyErr_Occurred()) {
+	  PyErr_SetString(PyExc_TypeError, "port name must be a string");
+	}
+	return -1;
+      }
+      snd_seq_port_info_set_name(pinfo, name);
+      continue;
+    }
+    if (get_long(value, &v)) {
+      return -1;
+    }
+    switch (i) {
+    case 1: snd_seq_port_info_set_type(pinfo, v); break;
+    case 2: snd_seq_port_info_set_capability(pinfo, v); break;
+    case 3:
+      snd_seq_port_info_set_port(pinfo, v);
+      snd_seq_port_info_set_port_specified(pinfo, 1);
+      break;
+    case 4: snd_seq_port_info_set_midi_channels(pinfo, v); break;
+    case 5: snd_seq_port_info_set_midi_voices(pinfo, v); break;
+    case 6: snd_seq_port_info_set_synth_voices(pinfo, v); break;
+    case 7: snd_seq_port_info_set_timestamping(pinfo, v != 0); break;
+    case 8: snd_seq_port_info_set_timestamp_real(pinfo, v != 0); break;
+    case 9: snd_seq_port_info_set_timestamp_queue(pinfo, v); break;
+    }
+  }
+
+  if (PyDict_GetItemString(spec, "name") == NULL) {
+    PyErr_SetString(PyExc_ValueError, "port specification without name");
+    return -1;
+  }
+  return 0;
+}
+
+/** alsaseq.Sequencer create_ports() method: __doc__ */
+PyDoc_STRVAR(Sequencer_create_ports__doc__,
+  "create_ports(specs) -> list\n"
+  "\n"
+  "Creates many ports in one call. The specifications are converted\n"
+  "to port infos first, then the ports are created with the GIL\n"
+  "released. If a port can't be created, the ports already created by\n"
+  "the call are deleted: either all the ports are created, or none.\n"
+  "\n"
+  "Each specification is a dict with the keys:\n"
+  "    name -- name of the port (required)\n"
+  "    type -- type of the port (alsaseq.SEQ_PORT_TYPE_* constants).\n"
+  "            Default=SEQ_PORT_TYPE_MIDI_GENERIC|SEQ_PORT_TYPE_APPLICATION\n"
+  "    caps -- capabilities of the port (alsaseq.SEQ_PORT_CAP_*\n"
+  "            constants). Default=0\n"
+  "    port -- the port number to use, instead of the first free one\n"
+  "    midi_channels, midi_voices, synth_voices -- (int) port info\n"
+  "    timestamping -- (bool) time-stamp the events delivered to the\n"
+  "                    port with the queue timestamp_queue\n"
+  "    timestamp_real -- (bool) real time stamps instead of ticks\n"
+  "    timestamp_queue -- (int) the queue used for time-stamping\n"
+  "\n"
+  "Parameters:\n"
+  "    specs -- a sequence of port specifications\n"
+  "Returns:\n"
+  "  (list) the port ids, in the order of specs.\n"
+  "Raises:\n"
+  "  TypeError: if an invalid type was used in a specification\n"
+  "  ValueError: if a specification has an unknown key or no name\n"
+  "  SequencerError: if ALSA can't create a port"
+);
+
+/** alsaseq.Sequencer create_ports() method */
+static PyObject *
+Sequencer_create_ports(SequencerObject *self,
+		       PyObject *args) {
+  snd_seq_port_info_t **pinfos;
+  PyObject *specs, *seq, *list = NULL;
+  Py_ssize_t i, n, created = 0;
+  int ret = 0;
+
+  if (!PyArg_ParseTuple(args, "O", &specs)) {
+    return NULL;
+  }
+  seq = PySequence_Fast(specs, "specs must be a sequence");
+  if (seq == NULL) {
+    return NULL;
+  }
+  n = PySequence_Fast_GET_SIZE(seq);
+
+  pinfos = calloc(n ? n : 1, sizeof(snd_seq_port_info_t *));
+  if (pinfos == NULL) {
+    Py_DECREF(seq);
+    return PyErr_NoMemory();
+  }
+  for (i = 0; i < n; i++) {
+    if (snd_seq_port_info_malloc(&pinfos[i]) < 0) {
+      PyErr_NoMemory();
+      goto __end;
+    }
+    if (_Sequencer_parse_port_spec(PySequence_Fast_GET_ITEM(seq, i),
+				   pinfos[i]) < 0) {
+      goto __end;
+    }
+  }
+
+  Py_BEGIN_ALLOW_THREADS;
+  for (created = 0; created < n; created++) {
+    ret = snd_seq_create_port(self->handle, pinfos[created]);
+    if (ret < 0) {
+      break;
+    }
+  }
+  if (ret < 0) {
+    /* all or nothing */
+    for (i = 0; i < created; i++) {
+      snd_seq_delete_port(self->handle,
+			  snd_seq_port_info_get_port(pinfos[i]));
+    }
+  }
+  Py_END_ALLOW_THREADS;
+
+  if (ret < 0) {
+    RAISESND(ret, "Failed to create port %zd (%s)", created,
+	     snd_seq_port_info_get_name(pinfos[created]));
+    goto __end;
+  }
+
+  list = PyList_New(n);
+  for (i = 0; list != NULL && i < n; i++) {
+    PyObject *port = PyInt_FromLong(snd_seq_port_info_get_port(pinfos[i]));
+    if (port == NULL) {
+      Py_CLEAR(list);
+      break;
+    }
+    PyList_SET_ITEM(list, i, port);
+  }
+  if (list == NULL) {
+    /* all or nothing, even when the result can't be built */
+    for (i = 0; i < n; i++) {
+      snd_seq_delete_port(self->handle,
+			  snd_seq_port_info_get_port(pinfos[i]));
+    }
+  }
+
+ __end:
+  for (i = 0; i < n; i++) {
+    if (pinfos[i] != NULL) {
+      snd_seq_port_info_free(pinfos[i]);
+    }
+  }
+  free(pinfos);
+  Py_DECREF(seq);
+  return list;
+}
+
+/** alsaseq.Sequencer connection_list() method: __doc__ */
+PyDoc_STRVAR(Sequencer_connection_list__doc__,
+  "connection_list() -> list\n"
+  "\n"
+  "List all clients and their ports connections.\n"
+  "\n"
+  "Returns:\n"
+  "  (list) a list of tuples: client_name, client_id, port_list:.\n"
+  "    client_name -- the client's name.\n"
+  "    client_id -- the client's id.\n"
+  "    port_list -- a list of tuples: port_name, port_id, connection_list:\n"
+  "      port_name -- the name of the port.\n"
+  "      port_id -- the port id.\n"
+  "      connection_list -- a list of tuples: read_conn, write_conn:\n"
+  "        read_conn -- a list of (client_id, port_id, info) tuples this\n"
+  "                     port is connected to (sends events);\n"
+  "                     info is the same of the get_connect_info() method.\n"
+  "        write_conn -- a list of (client_id, port_id, info) tuples this\n"
+  "                      port is connected from (receives events);\n"
+  "                      info is the same of the get_connect_info() method.\n"
+);
+
+
+static PyObject *
+_query_connections_list(snd_seq_t *handle,
+			snd_seq_query_subscribe_t *query,
+			int type) {
+
+  PyObject *list = PyList_New(0);
+  int index = 0;
+  snd_seq_query_subscribe_set_type(query, type);
+  snd_seq_query_subscribe_set_index(query, index);
+  while (snd_seq_query_port_subscribers(handle, query) >= 0) {
+    const snd_seq_addr_t *addr =
+      snd_seq_query_subscribe_get_addr(query);
+
+    PyObject *tuple = Py_BuildValue(
+        "(ii{sisisisi})",
+        (int)addr->client,
+        (int)addr->port,
+        "queue", (int)snd_seq_query_subscribe_get_queue(query),
+        "exclusive", (int)snd_seq_query_subscribe_get_exclusive(query),
+        "time_update", (int)snd_seq_query_subscribe_get_time_update(query),
+        "time_real", (int)snd_seq_query_subscribe_get_time_real(query));
+
+    PyList_Append(list, tuple);
+    Py_DECREF(tuple);
+    snd_seq_query_subscribe_set_index(query, ++index);
+  }
+  return list;
+}
+
+static PyObject *
+_query_connections(snd_seq_t *handle,
+		   const snd_seq_addr_t *addr) {
+  snd_seq_query_subscribe_t *query;
+  snd_seq_query_subscribe_alloca(&query);
+  snd_seq_query_subscribe_set_root(query, addr);
+
+  // create tuple for read,write lists
+  PyObject *tuple = PyTuple_New(2);
+  PyObject *readlist = _query_connections_list(handle, query,
+					       SND_SEQ_QUERY_SUBS_READ);
+  PyObject *writelist = _query_connections_list(handle, query,
+						SND_SEQ_QUERY_SUBS_WRITE);
+  PyTuple_SetItem(tuple, 0, readlist);
+  PyTuple_SetItem(tuple, 1, writelist);
+
+  return tuple;
+}
+
+/** alsaseq.Sequencer connection_list() method */
+static PyObject *
+Sequencer_connection_list(SequencerObject *self,
+			  PyObject *args) {
+  snd_seq_client_info_t *cinfo;
+  snd_seq_port_info_t *pinfo;
+  PyObject *client, *port, *name;
+  PyObject *list = PyList_New(0);
+
+  if (list == NULL) {
+    return NULL;
+  }
+
+  snd_seq_client_info_alloca(&cinfo);
+  snd_seq_port_info_alloca(&pinfo);
+  snd_seq_client_info_set_client(cinfo, -1);
+  while (snd_seq_query_next_client(self->handle, cinfo) >= 0) {
+    /* reset query info */
+    snd_seq_port_info_set_client(pinfo,
+				 snd_seq_client_info_get_client(cinfo));
+    snd_seq_port_info_set_port(pinfo, -1);
+
+    /* create tuple for client info */
+    PyObject *tuple = PyTuple_New(3);
+    PyObject *portlist = PyList_New(0);
+
+    name = PyUnicode_FromFormat("%s", snd_seq_client_info_get_name(cinfo));
+    client = PyInt_FromLong(snd_seq_client_info_get_client(cinfo));
+    PyTuple_SetItem(tuple, 0, name);
+    PyTuple_SetItem(tuple, 1, client);
+
+    while (snd_seq_query_next_port(self->handle, pinfo) >= 0) {
+      /* create tuple for port info */
+      PyObject *porttuple = PyTuple_New(3);
+
+      name = PyUnicode_FromFormat("%s", snd_seq_port_info_get_name(pinfo));
+      port = PyInt_FromLong(snd_seq_port_info_get_port(pinfo));
+
+      PyTuple_SetItem(porttuple, 0, name);
+      PyTuple_SetItem(porttuple, 1, port);
+
+      /* create tuple for read,write connections */
+      PyObject *conntuple =
+	_query_connections(self->handle, snd_seq_port_info_get_addr(pinfo));
+      PyTuple_SetItem(porttuple, 2, conntuple);
+
+      PyList_Append(portlist, porttuple);
+      Py_DECREF(porttuple);
+    }
+    PyTuple_SetItem(tuple, 2, portlist);
+
+    /* append list of port tuples */
+    PyList_Append(list, tuple);
+    Py_DECREF(tuple);
+  }
+
+  return list;
+}
+
+/** alsaseq.Sequencer get_client_info() method: __doc__ */
+PyDoc_STRVAR(Sequencer_get_client_info__doc__,
+  "get_client_info(client_id = self.client_id) -> dictionary\n"
+  "\n"
+  "Retrieve info about an existing client.\n"
+  "\n"
+  "Parameters:\n"
+  "  client_id -- the client id (defaults to: self.client_id)\n"
+  "Returns:\n"
+  "  (dict) a dictionary with the following values:\n"
+  "    id  -- id of client.\n"
+  "    type -- type of client (SEQ_USER_CLIENT or SEQ_KERNEL_CLIENT).\n"
+  "    name -- name of client.\n"
+  "    broadcast_filter -- broadcast filter flag of client as int.\n"
+  "    error_bounce -- error bounce of client as int.\n"
+  "    event_filter -- event filter of client as string.\n"
+  "    num_ports -- number of opened ports of client.\n"
+  "    event_lost -- number of lost events of client.\n"
+  "    midi_version -- MIDI version of client (SEQ_CLIENT_LEGACY_MIDI,\n"
+  "                    SEQ_CLIENT_UMP_MIDI_1_0 or SEQ_CLIENT_UMP_MIDI_2_0),\n"
+  "                    if supported by alsa-lib.\n"
+  "Raises:\n"
+  " SequencerError: ALSA error occurred."
+);
+
+/** alsaseq.Sequencer get_client_info() method */
+static PyObject *
+Sequencer_get_client_info(SequencerObject *self,
+			  PyObject *args,
+			  PyObject *kwds) {
+  snd_seq_client_info_t *cinfo;
+  int client_id = -1;
+  int ret;
+  char *kwlist[] = { "client_id", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist,
+				   &client_id)) {
+    return NULL;
+  }
+
+  snd_seq_client_info_alloca(&cinfo);
+  if (client_id == -1) {
+    ret = snd_seq_get_client_info(self->handle, cinfo);
+    if (ret < 0) {
+      RAISESND(ret, "Failed to retrieve client info for self.client_id");
+      return NULL;
+    }
+    client_id = snd_seq_client_info_get_client(cinfo);
+  } else {
+    ret = snd_seq_get_any_client_info(self->handle, client_id, cinfo);
+    if (ret < 0) {
+      RAISESND(ret, "Failed to retrieve client info for '%d'", client_id);
+      return NULL;
+    }
+  }
+
+  PyObject *d_id, *d_type;
+  TCONSTASSIGN(ADDR_CLIENT, client_id, d_id);
+  TCONSTASSIGN(CLIENT_TYPE, snd_seq_client_info_get_type(cinfo), d_type);
+  const char *d_name = snd_seq_client_info_get_name(cinfo);
+
+  PyObject *dict = Py_BuildValue(
+      "{sNsNsssisiss#sisi}",
+      "id", d_id,
+      "type", d_type,
+      "name", d_name == NULL ? "" : d_name,
+      "broadcast_filter", (int)snd_seq_client_info_get_broadcast_filter(cinfo),
+      "error_bounce", (int)snd_seq_client_info_get_error_bounce(cinfo),
+      "event_filter", snd_seq_client_info_get_event_filter(cinfo), 32,
+      "num_ports", (int)snd_seq_client_info_get_num_ports(cinfo),
+      "event_lost", (int)snd_seq_client_info_get_event_lost(cinfo));
+
+#if SND_LIB_VERSION >= 0x01020a
+  if (dict != NULL) {
+    PyObject *d_version;
+    TCONSTASSIGN(MIDI_VERSION,
+		 snd_seq_client_info_get_midi_version(cinfo), d_version);
+    if (PyDict_SetItemString(dict, "midi_version", d_version) < 0) {
+      Py_CLEAR(dict);
+    }
+    Py_DECREF(d_version);
+  }
+#endif
+
+  return dict;
+}
+
+/** alsaseq.Sequencer get_port_info() method: __doc__ */
+PyDoc_STRVAR(Sequencer_get_port_info__doc__,
+  "get_port_info(port_id, client_id = self.client_id) -> dictionary\n"
+  "\n"
+  "Retrieve info about an existing client's port.\n"
+  "\n"
+  "Parameters:\n"
+  "  port_id -- the port id\n"
+  "  client_id -- the client id (defaults to: self.client_id)\n"
+  "Returns:\n"
+  "  (dict) a dictionary with the following values:\n"
+  "    name -- the port name\n"
+  "    type -- the port type bit flags\n"
+  "    capability -- the port capability bit flags as integer\n"
+  "Raises:\n"
+  "  SequencerError: ALSA error occurred."
+);
+
+/** alsaseq.Sequencer get_port_info() method */
+static PyObject *
+Sequencer_get_port_info(SequencerObject *self,
+			PyObject *args,
+			PyObject *kwds) {
+  snd_seq_port_info_t *pinfo;
+  snd_seq_client_info_t *cinfo;
+  int port_id;
+  int client_id;
+  int ret;
+  char *kwlist[] = { "port_id", "client_id", NULL };
+
+  snd_seq_client_info_alloca(&cinfo);
+  ret = snd_seq_get_client_info(self->handle, cinfo);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to determine self.client_id");
+    return NULL;
+  }
+  client_id = snd_seq_client_info_get_client(cinfo);
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "i|i", kwlist,
+				   &port_id, &client_id)) {
+    return NULL;
+  }
+
+  snd_seq_port_info_alloca(&pinfo);
+  ret = snd_seq_get_any_port_info(self->handle, client_id,
+				  port_id, pinfo);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to get port info for %d:%d", client_id, port_id);
+    return NULL;
+  }
+
+  return Py_BuildValue(
+      "{sssIsI}",
+      "name", snd_seq_port_info_get_name(pinfo),
+      "capability", (unsigned int)snd_seq_port_info_get_capability(pinfo),
+      "type", (unsigned int)snd_seq_port_info_get_type(pinfo));
+}
+
+/** alsaseq.Sequencer connect_ports() method: __doc__ */
+PyDoc_STRVAR(Sequencer_connect_ports__doc__,
+  "connect_ports(srcaddr,dstaddr,queue,exclusive,time_update,time_real)\n"
+  "\n"
+  "Connect the ports specified by srcaddr and dstaddr.\n"
+  "\n"
+  "Parameters:\n"
+  "  srcaddr -- (tuple) the (client_id, port_id) tuple for the source\n"
+  "              port (the port sending events)\n"
+  "  dstaddr -- (tuple) the (client_id, port_id) tuple for the destination\n"
+  "              port (the port receiveng events)\n"
+  "  queue   -- the queue of the connection.\n"
+  "             If not specified, defaults to 0.\n"
+  "  exclusive -- 1 if the connection is exclusive, 0 otherwise.\n"
+  "               If not specified, defaults to 0.\n"
+  "  time_update -- 1 if the connection should update time, 0 otherwise.\n"
+  "                 If not specified, defaults to 0.\n"
+  "  time_real -- 1 if the update time is in real, 0 if is in tick.\n"
+  "                 If not specified, defaults to 0.\n"
+  "Raises:\n"
+  "  SequenceError: if ALSA can't connect the ports"
+);
+
+/** alsaseq.Sequencer connect_ports() method */
+static PyObject *
+Sequencer_connect_ports(SequencerObject *self,
+			PyObject *args) {
+  snd_seq_addr_t sender, dest;
+  snd_seq_port_subscribe_t *sinfo;
+  int ret;
+  int queue = 0;
+  int exclusive = 0;
+  int time_update = 0;
+  int time_real = 0;
+
+  if (!PyArg_ParseTuple(args, "(BB)(BB)|iiii", &(sender.client),
+	                &(sender.port), &(dest.client), &(dest.port),
+			&queue, &exclusive, &time_update, &time_real)) {
+    return NULL;
+  }
+
+  snd_seq_port_subscribe_alloca(&sinfo);
+  snd_seq_port_subscribe_set_sender(sinfo, &sender);
+  snd_seq_port_subscribe_set_dest(sinfo, &dest);
+  snd_seq_port_subscribe_set_queue(sinfo, queue);
+  snd_seq_port_subscribe_set_exclusive(sinfo, exclusive);
+  snd_seq_port_subscribe_set_time_update(sinfo, time_update);
+  snd_seq_port_subscribe_set_time_real(sinfo, time_real);
+
+  ret = snd_seq_subscribe_port(self->handle, sinfo);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to connect ports %d:%d -> %d:%d",
+	     sender.client, sender.port, dest.client, dest.port);
+    return NULL;
+  }
+
+  Py_RETURN_NONE;
+}
+
+/** alsaseq.Sequencer disconnect_ports() method: __doc__ */
+PyDoc_STRVAR(Sequencer_disconnect_ports__doc__,
+  "disconnect_ports(srcaddr, destaddr)\n"
+  "\n"
+  "Disconnect the ports specified by srcaddr and dstaddr.\n"
+  "\n"
+  "Parameters:\n"
+  "  srcaddr -- (tuple) the client_id, port_id tuple for the source\n"
+  "             port (the port sending events)\n"
+  "  dstaddr -- (tuple) the client_id, port_id tuple for the destination\n"
+  "             port (the port receiveng events)\n"
+  "Raises:\n"
+  "  SequenceError: if ALSA can't disconnect the port"
+);
+
+/** alsaseq.Sequencer disconnect_ports() method */
+static PyObject *
+Sequencer_disconnect_ports(SequencerObject *self,
+			   PyObject *args) {
+  snd_seq_addr_t sender, dest;
+  snd_seq_port_subscribe_t *sinfo;
+  int ret;
+
+  if (!PyArg_ParseTuple(args, "(BB)(BB)", &(sender.client),
+	                &(sender.port), &(dest.client), &(dest.port))) {
+    return NULL;
+  }
+
+  snd_seq_port_subscribe_alloca(&sinfo);
+  snd_seq_port_subscribe_set_sender(sinfo, &sender);
+  snd_seq_port_subscribe_set_dest(sinfo, &dest);
+
+  ret = snd_seq_unsubscribe_port(self->handle, sinfo);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to disconnect ports: %d:%d --> %d:%d",
+	     sender.client, sender.port, dest.client, dest.port);
+    return NULL;
+  }
+
+  Py_RETURN_NONE;
+}
+
+/** internal use: one operation of apply_subscriptions() */
+typedef struct {
+  snd_seq_addr_t sender;
+  snd_seq_addr_t dest;
+  int queue;
+  int exclusive;
+  int time_update;
+  int time_real;
+  int add;			/* subscribe, else unsubscribe */
+  int result;			/* 0 applied, 1 no-op, else -errno */
+} seq_sub_op_t;
+
+/** internal use: fill a port_subscribe from an operation */
+static void
+_seq_sub_op_info(const seq_sub_op_t *op,
+		 snd_seq_port_subscribe_t *sinfo) {
+  snd_seq_port_subscribe_set_sender(sinfo, &op->sender);
+  snd_seq_port_subscribe_set_dest(sinfo, &op->dest);
+  snd_seq_port_subscribe_set_queue(sinfo, op->queue);
+  snd_seq_port_subscribe_set_exclusive(sinfo, op->exclusive);
+  snd_seq_port_subscribe_set_time_update(sinfo, op->time_update);
+  snd_seq_port_subscribe_set_time_real(sinfo, op->time_real);
+}
+
+/** internal use: parse a (srcaddr, dstaddr[, options]) item */
+static int
+_seq_parse_sub_op(PyObject *item,
+		  seq_sub_op_t *op,
+		  int add) {
+  PyObject *tuple, *options = NULL, *value;
+  const char *keys[4] = {"queue", "exclusive", "time_update", "time_real"};
+  int *fields[4] = {&op->queue, &op->exclusive, &op->time_update,
+		    &op->time_real};
+  int i, ret;
+
+  memset(op, 0, sizeof(*op));
+  op->add = add;
+  tuple = PySequence_Tuple(item);
+  if (tuple == NULL) {
+    return -1;
+  }
+  ret = PyArg_ParseTuple(tuple, add ? "(BB)(BB)|O" : "(BB)(BB)",
+			 &op->sender.client, &op->sender.port,
+			 &op->dest.client, &op->dest.port, &options);
+  Py_DECREF(tuple);
+  if (!ret) {
+    return -1;
+  }
+  if (options == NULL || options == Py_None) {
+    return 0;
+  }
+  if (!PyDict_Check(options)) {
+    PyErr_SetString(PyExc_TypeError,
+		    "subscription options must be a dict");
+    return -1;
+  }
+  for (i = 0; i < 4; i++) {
+    value = PyDict_GetItemString(options, keys[i]);
+    if (value == NULL) {
+      continue;
+    }
+    *fields[i] = PyLong_AsLong(value);
+    if (*fields[i] == -1 && PyErr_Occurred()) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/** internal use: undo the applied operations, last first */
+static void
+_seq_sub_ops_rollback(snd_seq_t *handle,
+		      seq_sub_op_t *ops,
+		      Py_ssize_t count) {
+  snd_seq_port_subscribe_t *sinfo;
+  Py_ssize_t i;
+
+  snd_seq_port_subscribe_alloca(&sinfo);
+  for (i = count - 1; i >= 0; i--) {
+    if (ops[i].result != 0) {
+      continue;
+    }
+    _seq_sub_op_info(&ops[i], sinfo);
+    if (ops[i].add) {
+      snd_seq_unsubscribe_port(handle, sinfo);
+    } else {
+      snd_seq_subscribe_port(handle, sinfo);
+    }
+  }
+}
+
+/** internal use: apply the operations; returns the index of the failed
+    one when stopping at the first error, else -1 */
+static Py_ssize_t
+_seq_sub_ops_apply(snd_seq_t *handle,
+		   seq_sub_op_t *ops,
+		   Py_ssize_t count,
+		   int atomic) {
+  snd_seq_port_subscribe_t *sinfo;
+  snd_seq_port_info_t *pinfo;
+  Py_ssize_t i;
+  int exists;
+
+  snd_seq_port_subscribe_alloca(&sinfo);
+  snd_seq_port_info_alloca(&pinfo);
+
+  /* check the new connections before changing anything */
+  for (i = 0; atomic && i < count; i++) {
+    if (!ops[i].add) {
+      continue;
+    }
+    ops[i].result = snd_seq_get_any_port_info(handle, ops[i].sender.client,
+					      ops[i].sender.port, pinfo);
+    if (ops[i].result >= 0) {
+      ops[i].result = snd_seq_get_any_port_info(handle, ops[i].dest.client,
+						ops[i].dest.port, pinfo);
+    }
+    if (ops[i].result < 0) {
+      return i;
+    }
+  }
+
+  for (i = 0; i < count; i++) {
+    _seq_sub_op_info(&ops[i], sinfo);
+    exists = snd_seq_get_port_subscription(handle, sinfo) >= 0;
+    if (ops[i].add == exists) {
+      /* already in the requested state */
+      ops[i].result = 1;
+      continue;
+    }
+    if (ops[i].add) {
+      ops[i].result = snd_seq_subscribe_port(handle, sinfo);
+    } else {
+      /* keep the options of the connection for a rollback */
+      ops[i].queue = snd_seq_port_subscribe_get_queue(sinfo);
+      ops[i].exclusive = snd_seq_port_subscribe_get_exclusive(sinfo);
+      ops[i].time_update = snd_seq_port_subscribe_get_time_update(sinfo);
+      ops[i].time_real = snd_seq_port_subscribe_get_time_real(sinfo);
+      ops[i].result = snd_seq_unsubscribe_port(handle, sinfo);
+    }
+    if (ops[i].result > 0) {
+      ops[i].result = 0;
+    } else if (ops[i].result < 0 && atomic) {
+      _seq_sub_ops_rollback(handle, ops, i);
+      return i;
+    }
+  }
+  return -1;
+}
+
+/** alsaseq.Sequencer apply_subscriptions() method: __doc__ */
+PyDoc_STRVAR(Sequencer_apply_subscriptions__doc__,
+  "apply_subscriptions(add=None, remove=None, atomic=True) -> tuple\n"
+  "\n"
+  "Connects and disconnects many ports in one call, e.g. to switch a\n"
+  "patchbay preset. All the items are parsed before any change; the\n"
+  "disconnections are done first, so that exclusive connections can be\n"
+  "replaced. A connection already in the requested state is skipped.\n"
+  "\n"
+  "If atomic, the ports to connect are checked first, and on the first\n"
+  "failure the changes already done are undone, last first, before\n"
+  "raising. Else all the items are tried and their results returned.\n"
+  "\n"
+  "Parameters:\n"
+  "  add -- list of (srcaddr, dstaddr) or (srcaddr, dstaddr, options)\n"
+  "         to connect; options is a dict with the optional keys\n"
+  "         queue, exclusive, time_update and time_real (see\n"
+  "         connect_ports())\n"
+  "  remove -- list of (srcaddr, dstaddr) to disconnect\n"
+  "  atomic -- (bool) all or nothing\n"
+  "Returns:\n"
+  "  the tuple (add_results, remove_results): lists of the result of\n"
+  "  each item, in the given order: 0 if done, 1 if already in the\n"
+  "  requested state, else the negative errno.\n"
+  "Raises:\n"
+  "  SequencerError: if atomic and an item fails; nothing is changed."
+);
+
+/** alsaseq.Sequencer apply_subscriptions() method */
+static PyObject *
+Sequencer_apply_subscriptions(SequencerObject *self,
+			      PyObject *args,
+			      PyObject *kwds) {
+  PyObject *add = Py_None, *remove = Py_None;
+  PyObject *addseq = NULL, *remseq = NULL;
+  PyObject *addres = NULL, *remres = NULL, *ret = NULL;
+  seq_sub_op_t *ops = NULL, *op;
+  Py_ssize_t nadd = 0, nrem = 0, count, i, failed;
+  int atomic = 1;
+
+  char *kwlist[] = {"add", "remove", "atomic", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OOi", kwlist, &add,
+				   &remove, &atomic)) {
+    return NULL;
+  }
+  if (add != Py_None) {
+    addseq = PySequence_Fast(add, "add must be a sequence");
+    if (addseq == NULL) {
+      goto __end;
+    }
+    nadd = PySequence_Fast_GET_SIZE(addseq);
+  }
+  if (remove != Py_None) {
+    remseq = PySequence_Fast(remove, "remove must be a sequence");
+    if (remseq == NULL) {
+      goto __end;
+    }
+    nrem = PySequence_Fast_GET_SIZE(remseq);
+  }
+
+  /* the removals first */
+  count = nadd + nrem;
+  ops = PyMem_Malloc((count + 1) * sizeof(seq_sub_op_t));
+  if (ops == NULL) {
+    PyErr_NoMemory();
+    goto __end;
+  }
+  for (i = 0; i < nrem; i++) {
+    if (_seq_parse_sub_op(PySequence_Fast_GET_ITEM(remseq, i),
+			  &ops[i], 0) < 0) {
+      goto __end;
+    }
+  }
+  for (i = 0; i < nadd; i++) {
+    if (_seq_parse_sub_op(PySequence_Fast_GET_ITEM(addseq, i),
+			  &ops[nrem + i], 1) < 0) {
+      goto __end;
+    }
+  }
+
+  Py_BEGIN_ALLOW_THREADS;
+  failed = _seq_sub_ops_apply(self->handle, ops, count, atomic);
+  Py_END_ALLOW_THREADS;
+
+  if (failed >= 0) {
+    op = &ops[failed];
+    RAISESND(op->result, "Failed to %s ports %d:%d -> %d:%d (%s item %zd),"
+	     " changes undone", op->add ? "connect" : "disconnect",
+	     op->sender.client, op->sender.port, op->dest.client,
+	     op->dest.port, op->add ? "add" : "remove",
+	     op->add ? failed - nrem : failed);
+    goto __end;
+  }
+
+  addres = PyList_New(nadd);
+  remres = PyList_New(nrem);
+  if (addres == NULL || remres == NULL) {
+    goto __end;
+  }
+  for (i = 0; i < nrem; i++) {
+    PyList_SET_ITEM(remres, i, PyInt_FromLong(ops[i].result));
+  }
+  for (i = 0; i < nadd; i++) {
+    PyList_SET_ITEM(addres, i, PyInt_FromLong(ops[nrem + i].result));
+  }
+  ret = Py_BuildValue("(OO)", addres, remres);
+
+ __end:
+  PyMem_Free(ops);
+  Py_XDECREF(addseq);
+  Py_XDECREF(remseq);
+  Py_XDECREF(addres);
+  Py_XDECREF(remres);
+  return ret;
+}
+
+/** alsaseq.Sequencer get_connect_info() method: __doc__ */
+PyDoc_STRVAR(Sequencer_get_connect_info__doc__,
+  "get_connect_info(srcaddr, dstaddr) -> dictionary\n"
+  "\n"
+  "Retrieve the subscribe info of the specified connection.\n"
+  "\n"
+  "Parameters:\n"
+  "  srcaddr -- (tuple) the client_id, port_id tuple for the source\n"
+  "             port (the port sending events)\n"
+  "  dstaddr -- (tuple) the client_id, port_id tuple for the destination\n"
+  "             port (the port receiveng events)\n"
+  "Returns:\n"
+  "  (dict) a dictionary with the following values:\n"
+  "    queue -- \n"
+  "    exclusive -- \n"
+  "    time_update -- \n"
+  "    time_real --- \n"
+  "Raises:\n"
+  "  SequenceError: if ALSA can't retrieve the connection or the\n"
+  "                 connection doesn't exists."
+);
+
+
+static PyObject*
+Sequencer_get_connect_info(SequencerObject *self,
+			  PyObject *args) {
+  snd_seq_addr_t sender, dest;
+  snd_seq_port_subscribe_t *sinfo;
+  int ret;
+
+  if (!PyArg_ParseTuple(args, "(BB)(BB)", &(sender.client),
+	                &(sender.port), &(dest.client), &(dest.port))) {
+    return NULL;
+  }
+
+  snd_seq_port_subscribe_alloca(&sinfo);
+  snd_seq_port_subscribe_set_sender(sinfo, &sender);
+  snd_seq_port_subscribe_set_dest(sinfo, &dest);
+
+  ret = snd_seq_get_port_subscription(self->handle, sinfo);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to get port subscript: %d:%d --> %d:%d",
+	     sender.client, sender.port, dest.client, dest.port);
+    return NULL;
+  }
+
+  return Py_BuildValue(
+      "{sisisisi}",
+      "queue", (int)snd_seq_port_subscribe_get_queue(sinfo),
+      "exclusive", (int)snd_seq_port_subscribe_get_exclusive(sinfo),
+      "time_update", (int)snd_seq_port_subscribe_get_time_update(sinfo),
+      "time_real", (int)snd_seq_port_subscribe_get_time_real(sinfo));
+}
+
+/** internal use: check that the input is not owned by a native reader
+    thread (start_dispatch()...) nor used by another thread with the GIL
+    released; alsa-lib handles are not thread-safe */
+static int
+_Sequencer_check_input(SequencerObject *self) {
+  if (self->input_owner != NULL) {
+    RAISESTR("The input is owned by %s", self->input_owner);
+    return -1;
+  }
+  if (self->input_busy) {
+    PyErr_SetString(PyExc_RuntimeError,
+		    "The input is in use by another thread");
+    return -1;
+  }
+  return 0;
+}
+
+/** internal use: prepare the poll descriptors used for waiting for
+    input; they are computed once */
+static int
+_Sequencer_init_input_fds(SequencerObject *self) {
+  if (self->receive_fds == NULL) {
+    self->receive_max = snd_seq_poll_descriptors_count(self->handle, POLLIN);
+    if (self->receive_max <= 0) {
+      RAISESTR("Sequencer has no input stream");
+      return -1;
+    }
+    self->receive_fds = malloc(sizeof(struct pollfd) * self->receive_max);
+    if (self->receive_fds == NULL) {
+      PyErr_NoMemory();
+      return -1;
+    }
+    self->receive_max = snd_seq_poll_descriptors(self->handle,
+						 self->receive_fds,
+						 self->receive_max, POLLIN);
+  }
+  return 0;
+}
+
+/** internal use: wait up to timeout ms (< 0: forever) for input events;
+    returns 1 when events may be read, 0 on timeout and -1 on error
+    (exception set) */
+static int
+_Sequencer_wait_input(SequencerObject *self,
+		      int timeout) {
+  struct timespec now, deadline;
+  unsigned short revents;
+  int ret;
+
+  if (_Sequencer_check_input(self) < 0 ||
+      _Sequencer_init_input_fds(self) < 0) {
+    return -1;
+  }
+
+  /* events already read by alsa-lib need no poll */
+  if (timeout == 0 || snd_seq_event_input_pending(self->handle, 0) > 0) {
+    return 1;
+  }
+
+  if (timeout > 0) {
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+  }
+
+  for (;;) {
+    self->receive_polls++;
+    self->input_busy = 1;
+    Py_BEGIN_ALLOW_THREADS;
+    ret = poll(self->receive_fds, self->receive_max, timeout);
+    Py_END_ALLOW_THREADS;
+    self->input_busy = 0;
+    if (ret < 0) {
+      if (errno != EINTR) {
+	RAISESTR("Failed to poll from receive: %s", strerror(errno));
+	return -1;
+      }
+      if (PyErr_CheckSignals() < 0) {
+	return -1;
+      }
+    } else if (ret == 0) {
+      return 0;
+    } else {
+      self->receive_wakeups++;
+      ret = snd_seq_poll_descriptors_revents(self->handle,
+					     self->receive_fds,
+					     self->receive_max, &revents);
+      if (ret < 0) {
+	RAISESND(ret, "Failed to get poll events from receive");
+	return -1;
+      }
+      if (revents & (POLLERR | POLLNVAL)) {
+	RAISESTR("Failed to poll from receive: device error");
+	return -1;
+      }
+      if (revents & POLLIN) {
+	return 1;
+      }
+      self->receive_empty_wakeups++;
+    }
+
+    /* spurious wakeup or signal: poll again for the remaining time */
+    if (timeout > 0) {
+      long ms;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      ms = (deadline.tv_sec - now.tv_sec) * 1000 +
+	(deadline.tv_nsec - now.tv_nsec) / 1000000;
+      if (ms <= 0) {
+	return 0;
+      }
+      timeout = ms;
+    }
+  }
+}
+
+/** alsaseq.Sequencer poll_stats() method: __doc__ */
+PyDoc_STRVAR(Sequencer_poll_stats__doc__,
+  "poll_stats(reset = False) -> dict\n"
+  "\n"
+  "Returns the counters of the input waits done by the receive methods:\n"
+  "  'polls' -> number of poll() calls\n"
+  "  'wakeups' -> number of poll() calls returning ready descriptors\n"
+  "  'empty_wakeups' -> wakeups without input events (spurious)\n"
+  "Receive calls finding events already read by alsa-lib don't poll.\n"
+  "\n"
+  "Parameters:\n"
+  "  reset -- if True, the counters are set to 0 after reading them"
+);
+
+/** alsaseq.Sequencer poll_stats() method */
+static PyObject *
+Sequencer_poll_stats(SequencerObject *self,
+		     PyObject *args,
+		     PyObject *kwds) {
+  PyObject *dict;
+  int reset = 0;
+  char *kwlist[] = {"reset", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist, &reset)) {
+    return NULL;
+  }
+
+  dict = Py_BuildValue("{sksksk}",
+		       "polls", self->receive_polls,
+		       "wakeups", self->receive_wakeups,
+		       "empty_wakeups", self->receive_empty_wakeups);
+  if (dict != NULL && reset) {
+    self->receive_polls = 0;
+    self->receive_wakeups = 0;
+    self->receive_empty_wakeups = 0;
+  }
+
+  return dict;
+}
+
+/** alsaseq.Sequencer receive_events() method: __doc__ */
+PyDoc_STRVAR(Sequencer_receive_events__doc__,
+  "receive_events(timeout = 0, maxevents = self.receive_maxevents) -> list\n"
+  "\n"
+  "Receive events.\n"
+  "\n"
+  "Parameters:\n"
+  "  timeout -- (int) time for waiting for events in milliseconds;\n"
+  "             0 doesn't wait, a negative value waits forever\n"
+  "  maxevents -- (int) max events to be returned\n"
+  "Returns:\n"
+  "  (list) a list of alsaseq.SeqEvent objects\n"
+  "Raises:\n"
+  "  TypeError: if an invalid type was used in a parameter\n"
+  "  SequencerError: if ALSA error occurs."
+);
+
+/** alsaseq.Sequencer receive_events() method */
+static PyObject *
+Sequencer_receive_events(SequencerObject *self,
+			 PyObject *args,
+			 PyObject *kwds) {
+  int maxevents = self->receive_max_events;
+  snd_seq_event_t *event = NULL;
+  int timeout = 0;
+  int ret;
+
+  char *kwlist[] = {"timeout", "maxevents", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|ii", kwlist, &timeout,
+				   &maxevents)) {
+    return NULL;
+  }
+
+  PyObject *list = PyList_New(0);
+  if (list == NULL) {
+    return NULL;
+  }
+
+  ret = _Sequencer_wait_input(self, timeout);
+  if (ret == 0) {
+    return list;
+  } else if (ret < 0) {
+    Py_DECREF(list);
+    return NULL;
+  }
+
+  do {
+    ret = snd_seq_event_input(self->handle, &event);
+    if (ret < 0) {
+      if (ret != -EAGAIN) {
+      }
+      break;
+    }
+    if (!_seq_filter_match(&self->filter, event)) {
+      continue;
+    }
+
+    PyObject *SeqEventObject = SeqEvent_create(event);
+    if (SeqEventObject == NULL) {
+      RAISESTR("Error creating event!");
+      return NULL;
+    }
+
+    PyList_Append(list, SeqEventObject);
+    Py_DECREF(SeqEventObject);
+
+    maxevents --;
+
+  } while (maxevents > 0 && ret > 0);
+
+  return list;
+}
+
+/** alsaseq.Sequencer receive_into() method: __doc__ */
+PyDoc_STRVAR(Sequencer_receive_into__doc__,
+  "receive_into(buffer, timeout = 0) -> int\n"
+  "\n"
+  "Receive events into a SeqEventBuffer, replacing its previous\n"
+  "contents. Unlike receive_events(), no SeqEvent objects are created;\n"
+  "the events are copied into the preallocated storage of the buffer.\n"
+  "\n"
+  "Parameters:\n"
+  "  buffer -- a SeqEventBuffer object; at most buffer.size events\n"
+  "            are received\n"
+  "  timeout -- (int) time for waiting for events in milliseconds\n"
+  "Returns:\n"
+  "  (int) the number of events stored in the buffer\n"
+  "Raises:\n"
+  "  TypeError: if an invalid type was used in a parameter\n"
+  "  SequencerError: if ALSA error occurs, e.g. an input overrun\n"
+  "                  (ENOSPC) before the first event."
+);
+
+/** alsaseq.Sequencer receive_into() method */
+static PyObject *
+Sequencer_receive_into(SequencerObject *self,
+		       PyObject *args,
+		       PyObject *kwds) {
+  SeqEventBufferObject *buffer;
+  snd_seq_event_t *event = NULL;
+  int timeout = 0;
+  int ret;
+
+  char *kwlist[] = {"buffer", "timeout", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!|i", kwlist,
+				   &SeqEventBufferType, &buffer, &timeout)) {
+    return NULL;
+  }
+
+  if (_SeqEventBuffer_check_busy(buffer) < 0) {
+    return NULL;
+  }
+
+  _SeqEventBuffer_reset(buffer);
+
+  ret = _Sequencer_wait_input(self, timeout);
+  if (ret == 0) {
+    return PyInt_FromLong(0);
+  } else if (ret < 0) {
+    return NULL;
+  }
+
+  do {
+    ret = snd_seq_event_input(self->handle, &event);
+    if (ret < 0) {
+      break;
+    }
+    if (!_seq_filter_match(&self->filter, event)) {
+      continue;
+    }
+
+    if (_SeqEventBuffer_append(buffer, event) < 0) {
+      return NULL;
+    }
+  } while (buffer->count < buffer->size && ret > 0);
+
+  /* an overrun after some events ends the batch, keeping them */
+  if (ret < 0 && ret != -EAGAIN && !(ret == -ENOSPC && buffer->count > 0)) {
+    RAISESND(ret, "Failed to receive event %d", buffer->count);
+    return NULL;
+  }
+
+  return PyInt_FromLong(buffer->count);
+}
+
+/** packed event record written by receive_records(); the layout is
+    published as SEQ_RECORD_FORMAT and must stay in sync with it */
+typedef struct {
+  unsigned char type;
+  unsigned char flags;
+  unsigned char tag;
+  unsigned char queue;
+  unsigned int tick;
+  unsigned int sec;
+  unsigned int nsec;
+  unsigned char source_client;
+  unsigned char source_port;
+  unsigned char dest_client;
+  unsigned char dest_port;
+  unsigned char channel;
+  unsigned char note;
+  unsigned char velocity;
+  unsigned char off_velocity;
+  unsigned int param;
+  signed int value;
+  unsigned int duration;
+} __attribute__((packed)) seq_record_t;
+
+#define SEQ_RECORD_FORMAT "=BBBBIIIBBBBBBBBIiI"
+
+/** internal use: pack the fixed part of event into a record */
+static void
+_seq_record_pack(seq_record_t *rec,
+		 const snd_seq_event_t *event) {
+  memset(rec, 0, sizeof(*rec));
+  rec->type = event->type;
+  rec->flags = event->flags;
+  rec->tag = event->tag;
+  rec->queue = event->queue;
+  if (snd_seq_ev_is_real(event)) {
+    rec->sec = event->time.time.tv_sec;
+    rec->nsec = event->time.time.tv_nsec;
+  } else {
+    rec->tick = event->time.tick;
+  }
+  rec->source_client = event->source.client;
+  rec->source_port = event->source.port;
+  rec->dest_client = event->dest.client;
+  rec->dest_port = event->dest.port;
+
+  if (snd_seq_ev_is_note_type(event)) {
+    rec->channel = event->data.note.channel;
+    rec->note = event->data.note.note;
+    rec->velocity = event->data.note.velocity;
+    rec->off_velocity = event->data.note.off_velocity;
+    rec->duration = event->data.note.duration;
+  } else if (snd_seq_ev_is_control_type(event)) {
+    rec->channel = event->data.control.channel;
+    rec->param = event->data.control.param;
+    rec->value = event->data.control.value;
+  } else if (snd_seq_ev_is_queue_type(event)) {
+    rec->param = event->data.queue.queue;
+    rec->value = event->data.queue.param.value;
+  } else if (snd_seq_ev_is_variable(event)) {
+    rec->param = event->data.ext.len;
+  } else {
+    rec->param = event->data.raw32.d[0];
+    rec->value = event->data.raw32.d[1];
+    rec->duration = event->data.raw32.d[2];
+  }
+}
+
+/** alsaseq.Sequencer receive_records() method: __doc__ */
+PyDoc_STRVAR(Sequencer_receive_records__doc__,
+  "receive_records(buffer, timeout = 0) -> int\n"
+  "\n"
+  "Receive events as packed records into a writable buffer (any object\n"
+  "supporting the buffer protocol: bytearray, array, numpy array...).\n"
+  "No Python object is created per event and the records are written\n"
+  "with the GIL released.\n"
+  "\n"
+  "Each record has SEQ_RECORD_SIZE bytes, native byte order and no\n"
+  "padding; its struct module format is SEQ_RECORD_FORMAT. The\n"
+  "equivalent numpy dtype is:\n"
+  "  numpy.dtype([('type', 'u1'), ('flags', 'u1'), ('tag', 'u1'),\n"
+  "               ('queue', 'u1'), ('tick', 'u4'), ('sec', 'u4'),\n"
+  "               ('nsec', 'u4'), ('source_client', 'u1'),\n"
+  "               ('source_port', 'u1'), ('dest_client', 'u1'),\n"
+  "               ('dest_port', 'u1'), ('channel', 'u1'), ('note', 'u1'),\n"
+  "               ('velocity', 'u1'), ('off_velocity', 'u1'),\n"
+  "               ('param', 'u4'), ('value', 'i4'), ('duration', 'u4')])\n"
+  "\n"
+  "tick is set for tick timestamps, sec and nsec for real timestamps.\n"
+  "The data fields depend on the event type:\n"
+  "  note events -- channel, note, velocity, off_velocity, duration\n"
+  "  control events -- channel, param, value\n"
+  "  queue events -- param is the queue id, value the queue parameter\n"
+  "  variable length events -- param is the data length; the data\n"
+  "                            itself is not stored\n"
+  "  other events -- param, value and duration hold the raw data words\n"
+  "\n"
+  "Parameters:\n"
+  "  buffer -- a writable buffer; at most len(buffer) // SEQ_RECORD_SIZE\n"
+  "            records are written from its start\n"
+  "  timeout -- (int) time for waiting for events in milliseconds\n"
+  "Returns:\n"
+  "  (int) the number of records written\n"
+  "Raises:\n"
+  "  TypeError: if buffer is not a writable buffer\n"
+  "  ValueError: if buffer can't hold a single record\n"
+  "  RuntimeError: if another thread is receiving from the sequencer\n"
+  "  SequencerError: if ALSA error occurs, e.g. an input overrun\n"
+  "                  (ENOSPC) before the first event."
+);
+
+/** alsaseq.Sequencer receive_records() method */
+static PyObject *
+Sequencer_receive_records(SequencerObject *self,
+			  PyObject *args,
+			  PyObject *kwds) {
+  Py_buffer view;
+  seq_record_t *records;
+  snd_seq_event_t *event = NULL;
+  Py_ssize_t max;
+  Py_ssize_t count = 0;
+  int timeout = 0;
+  int ret;
+
+  char *kwlist[] = {"buffer", "timeout", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "w*|i", kwlist, &view,
+				   &timeout)) {
+    return NULL;
+  }
+
+  records = view.buf;
+  max = view.len / sizeof(seq_record_t);
+  if (max <= 0) {
+    PyBuffer_Release(&view);
+    PyErr_Format(PyExc_ValueError, "buffer too small (record size %d)",
+		 (int)sizeof(seq_record_t));
+    return NULL;
+  }
+
+  ret = _Sequencer_wait_input(self, timeout);
+  if (ret <= 0) {
+    PyBuffer_Release(&view);
+    return ret < 0 ? NULL : PyInt_FromLong(0);
+  }
+
+  self->input_busy = 1;
+  self->filter_busy++;
+  Py_BEGIN_ALLOW_THREADS;
+  do {
+    ret = snd_seq_event_input(self->handle, &event);
+    if (ret < 0) {
+      break;
+    }
+    if (!_seq_filter_match(&self->filter, event)) {
+      continue;
+    }
+    _seq_record_pack(&records[count++], event);
+  } while (count < max && ret > 0);
+  Py_END_ALLOW_THREADS;
+  self->filter_busy--;
+  self->input_busy = 0;
+
+  PyBuffer_Release(&view);
+
+  /* an overrun after some events ends the batch, keeping them */
+  if (ret < 0 && ret != -EAGAIN && !(ret == -ENOSPC && count > 0)) {
+    RAISESND(ret, "Failed to receive event %zd", count);
+    return NULL;
+  }
+
+  return PyLong_FromSsize_t(count);
+}
+
+/** alsaseq.Sequencer output_event() method: __doc__ */
+PyDoc_STRVAR(Sequencer_output_event__doc__,
+  "output_event(event)\n"
+  "\n"
+  "Put the the given event in the outputbuffer. This actually will enqueue\n"
+  "the event, to make sure it's sent, use the drain_output() method.\n"
+  "\n"
+  "Parameters:\n"
+  "  event -- a SeqEvent object\n"
+  "Raises:\n"
+  "  SequencerError: if ALSA can't send the event (in SEQ_NONBLOCK mode\n"
+  "                  also when the output pool is full)"
+);
+
+/** alsaseq.Sequencer output_event() method */
+static PyObject *
+Sequencer_output_event(SequencerObject *self,
+		       PyObject *args,
+		       PyObject *kwds) {
+  SeqEventObject *seqevent;
+  int ret;
+  char *kwlist[] = {"event", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist,
+				   &seqevent)) {
+    return NULL;
+  }
+
+  if (!PyObject_TypeCheck(seqevent, &SeqEventType)) {
+    PyErr_SetString(PyExc_TypeError, "alsaseq.SeqEvent expected");
+    return NULL;
+  }
+
+  if (_Sequencer_check_output(self) < 0) {
+    return NULL;
+  }
+  ret = snd_seq_event_output(self->handle, seqevent->event);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to output event");
+    return NULL;
+  }
+
+  Py_RETURN_NONE;
+}
+
+/* events collected per GIL release by output_events() */
+#define OUTPUT_CHUNK 64
+
+/** internal use: prepare the poll descriptors used for waiting until
+    the output can be written; they are computed once */
+static int
+_Sequencer_init_output_fds(SequencerObject *self) {
+  if (self->output_fds == NULL) {
+    self->output_max = snd_seq_poll_descriptors_count(self->handle, POLLOUT);
+    if (self->output_max <= 0) {
+      RAISESTR("Sequencer has no output stream");
+      return -1;
+    }
+    self->output_fds = malloc(sizeof(struct pollfd) * self->output_max);
+    if (self->output_fds == NULL) {
+      PyErr_NoMemory();
+      return -1;
+    }
+    self->output_max = snd_seq_poll_descriptors(self->handle,
+						self->output_fds,
+						self->output_max, POLLOUT);
+  }
+  return 0;
+}
+
+/** internal use: wait until the output can be written; called without
+    the GIL; returns 0 or a negative error */
+static int
+_Sequencer_wait_output_nogil(SequencerObject *self) {
+  int ret;
+
+  ret = poll(self->output_fds, self->output_max, -1);
+  if (ret < 0 && errno != EINTR) {
+    return -errno;
+  }
+  return 0;
+}
+
+/** internal use: output one event, draining the output buffer and
+    waiting for room in the kernel pool when needed; called without the
+    GIL; returns 0 or a negative error */
+static int
+_Sequencer_output_nogil(SequencerObject *self,
+			snd_seq_event_t *event) {
+  int ret;
+
+  for (;;) {
+    ret = snd_seq_event_output(self->handle, event);
+    if (ret >= 0) {
+      return 0;
+    } else if (ret != -EAGAIN) {
+      return ret;
+    }
+    ret = snd_seq_drain_output(self->handle);
+    if (ret == -EAGAIN) {
+      ret = _Sequencer_wait_output_nogil(self);
+    }
+    if (ret < 0) {
+      return ret;
+    }
+  }
+}
+
+/** internal use: drain the output, waiting for room in the kernel pool
+    when needed; called without the GIL; returns 0 or a negative error */
+static int
+_Sequencer_drain_nogil(SequencerObject *self) {
+  int ret;
+
+  for (;;) {
+    ret = snd_seq_drain_output(self->handle);
+    if (ret == 0) {
+      return 0;
+    } else if (ret > 0 || ret == -EAGAIN) {
+      ret = _Sequencer_wait_output_nogil(self);
+    }
+    if (ret < 0) {
+      return ret;
+    }
+  }
+}
+
+/** alsaseq.Sequencer output_events() method: __doc__ */
+PyDoc_STRVAR(Sequencer_output_events__doc__,
+  "output_events(events, drain=False) -> int\n"
+  "\n"
+  "Put all the given events in the output buffer with a single call.\n"
+  "The events are output with the GIL released. When the output buffer\n"
+  "or the kernel pool is full, the output is drained and the call waits\n"
+  "for room, even if the sequencer is in SEQ_NONBLOCK mode.\n"
+  "\n"
+  "Parameters:\n"
+  "  events -- a SeqEventBuffer, or an iterable (list, tuple, iterator)\n"
+  "            of SeqEvent objects\n"
+  "  drain -- if True, drain the output after the last event, like\n"
+  "           drain_output() does. Default: False\n"
+  "Returns:\n"
+  "  (int) the number of events queued\n"
+  "Raises:\n"
+  "  TypeError: if an item is not a SeqEvent\n"
+  "  SequencerError: if ALSA can't send an event; the events before it\n"
+  "                  remain queued. Also raised if another thread is\n"
+  "                  using the output of this Sequencer with the GIL\n"
+  "                  released (output_events(), SmfPlayer.play()...):\n"
+  "                  alsa-lib handles are not thread-safe"
+);
+
+/** alsaseq.Sequencer output_events() method */
+static PyObject *
+Sequencer_output_events(SequencerObject *self,
+			PyObject *args,
+			PyObject *kwds) {
+  PyObject *events, *iter, *item;
+  snd_seq_event_t chunk[OUTPUT_CHUNK];
+  size_t offsets[OUTPUT_CHUNK];
+  const snd_seq_event_t *ev;
+  unsigned char *scratch = NULL;
+  size_t scratch_size = 0;
+  size_t used;
+  int drain = 0;
+  int count = 0;
+  int n, i;
+  int ret = 0;
+  char *kwlist[] = {"events", "drain", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|i", kwlist, &events,
+				   &drain)) {
+    return NULL;
+  }
+
+  if (_Sequencer_init_output_fds(self) < 0 ||
+      _Sequencer_acquire_output(self) < 0) {
+    return NULL;
+  }
+
+  if (PyObject_TypeCheck(events, &SeqEventBufferType)) {
+    SeqEventBufferObject *buffer = (SeqEventBufferObject *)events;
+
+    /* the slab holding the variable length data stays in place while
+       in_use is set; the events are copied as views may change them */
+    buffer->in_use++;
+    while (count < buffer->count && ret >= 0) {
+      n = buffer->count - count;
+      if (n > OUTPUT_CHUNK) {
+	n = OUTPUT_CHUNK;
+      }
+      memcpy(chunk, &(buffer->events[count]), n * sizeof(snd_seq_event_t));
+      Py_BEGIN_ALLOW_THREADS;
+      for (i = 0; i < n; i++) {
+	ret = _Sequencer_output_nogil(self, &chunk[i]);
+	if (ret < 0) {
+	  break;
+	}
+	count++;
+      }
+      Py_END_ALLOW_THREADS;
+    }
+    buffer->in_use--;
+  } else {
+    iter = PyObject_GetIter(events);
+    if (iter == NULL) {
+      _Sequencer_release_output(self);
+      return NULL;
+    }
+
+    do {
+      /* copy a chunk of events and their variable length data holding
+	 the GIL, as other threads may change the SeqEvent objects... */
+      used = 0;
+      for (n = 0; n < OUTPUT_CHUNK; n++) {
+	item = PyIter_Next(iter);
+	if (item == NULL) {
+	  break;
+	}
+	if (!PyObject_TypeCheck(item, &SeqEventType)) {
+	  Py_DECREF(item);
+	  PyErr_SetString(PyExc_TypeError, "alsaseq.SeqEvent expected");
+	  break;
+	}
+	ev = ((SeqEventObject *)item)->event;
+	chunk[n] = *ev;
+	offsets[n] = used;
+	if (snd_seq_ev_is_variable(ev) && ev->data.ext.len > 0) {
+	  if (used + ev->data.ext.len > scratch_size) {
+	    unsigned char *p = realloc(scratch, used + ev->data.ext.len);
+	    if (p == NULL) {
+	      Py_DECREF(item);
+	      PyErr_NoMemory();
+	      break;
+	    }
+	    scratch = p;
+	    scratch_size = used + ev->data.ext.len;
+	  }
+	  memcpy(scratch + used, ev->data.ext.ptr, ev->data.ext.len);
+	  used += ev->data.ext.len;
+	}
+	Py_DECREF(item);
+      }
+      for (i = 0; i < n; i++) {
+	if (snd_seq_ev_is_variable(&chunk[i]) && chunk[i].data.ext.len > 0) {
+	  chunk[i].data.ext.ptr = scratch + offsets[i];
+	}
+      }
+
+      /* ...and output it without */
+      Py_BEGIN_ALLOW_THREADS;
+      for (i = 0; i < n; i++) {
+	ret = _Sequencer_output_nogil(self, &chunk[i]);
+	if (ret < 0) {
+	  break;
+	}
+	count++;
+      }
+      Py_END_ALLOW_THREADS;
+    } while (n == OUTPUT_CHUNK && ret >= 0 && !PyErr_Occurred());
+
+    free(scratch);
+    Py_DECREF(iter);
+    if (PyErr_Occurred()) {
+      _Sequencer_release_output(self);
+      return NULL;
+    }
+  }
+
+  if (ret < 0) {
+    _Sequencer_release_output(self);
+    RAISESND(ret, "Failed to output event %d", count);
+    return NULL;
+  }
+
+  if (drain) {
+    Py_BEGIN_ALLOW_THREADS;
+    ret = _Sequencer_drain_nogil(self);
+    Py_END_ALLOW_THREADS;
+  }
+  _Sequencer_release_output(self);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to drain output");
+    return NULL;
+  }
+
+  return PyInt_FromLong(count);
+}
+
+/* UMP (MIDI 2.0) sequencer clients need alsa-lib 1.2.10 */
+#if SND_LIB_VERSION >= 0x01020a
+
+/** internal use: number of 32-bit words of the UMP packet starting with
+    word, from its message type */
+static inline int
+_seq_ump_words(uint32_t word) {
+  static const unsigned char words[16] = {
+    1, 1, 1, 2, 2, 4, 1, 1, 2, 2, 2, 3, 3, 4, 4, 4
+  };
+
+  return words[word >> 28];
+}
+
+/** internal use: same as _Sequencer_output_nogil() for an UMP event */
+static int
+_Sequencer_output_ump_nogil(SequencerObject *self,
+			    snd_seq_ump_event_t *event) {
+  int ret;
+
+  for (;;) {
+    ret = snd_seq_ump_event_output(self->handle, event);
+    if (ret >= 0) {
+      return 0;
+    } else if (ret != -EAGAIN) {
+      return ret;
+    }
+    ret = snd_seq_drain_output(self->handle);
+    if (ret == -EAGAIN) {
+      ret = _Sequencer_wait_output_nogil(self);
+    }
+    if (ret < 0) {
+      return ret;
+    }
+  }
+}
+
+/** alsaseq.Sequencer set_midi_version() method: __doc__ */
+PyDoc_STRVAR(Sequencer_set_midi_version__doc__,
+  "set_midi_version(version)\n"
+  "\n"
+  "Sets the MIDI version of the client. In an UMP mode, the events are\n"
+  "sent and received as UMP packets with output_ump() and receive_ump();\n"
+  "the kernel converts between UMP and legacy clients.\n"
+  "\n"
+  "Parameters:\n"
+  "  version -- SEQ_CLIENT_LEGACY_MIDI, SEQ_CLIENT_UMP_MIDI_1_0 or\n"
+  "             SEQ_CLIENT_UMP_MIDI_2_0\n"
+  "Raises:\n"
+  "  SequencerError: if ALSA (or the kernel) doesn't support the version."
+);
+
+/** alsaseq.Sequencer set_midi_version() method */
+static PyObject *
+Sequencer_set_midi_version(SequencerObject *self,
+			   PyObject *args) {
+  int version;
+  int ret;
+
+  if (!PyArg_ParseTuple(args, "i", &version)) {
+    return NULL;
+  }
+
+  ret = snd_seq_set_client_midi_version(self->handle, version);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to set the MIDI version %d", version);
+    return NULL;
+  }
+
+  Py_RETURN_NONE;
+}
+
+/** alsaseq.Sequencer output_ump() method: __doc__ */
+PyDoc_STRVAR(Sequencer_output_ump__doc__,
+  "output_ump(words, port=0, dest=None, drain=False) -> int\n"
+  "\n"
+  "Sends UMP packets, given as native 32-bit words, in one call: the\n"
+  "words are split in packets by their message type and each packet is\n"
+  "sent as a direct event, with the GIL released. Like output_events(),\n"
+  "when the output buffer or the kernel pool is full, the output is\n"
+  "drained and the call waits for room.\n"
+  "The client must be in an UMP mode (see set_midi_version()).\n"
+  "\n"
+  "Parameters:\n"
+  "  words -- a buffer of native uint32 words (array('I'), numpy uint32,\n"
+  "           bytes...), holding whole packets\n"
+  "  port -- the source port\n"
+  "  dest -- (client, port) destination, or None for the subscribers\n"
+  "  drain -- if True, drain the output after the last packet\n"
+  "Returns:\n"
+  "  (int) the number of packets sent\n"
+  "Raises:\n"
+  "  ValueError: if the words don't hold whole packets or are not\n"
+  "              aligned on 4 bytes (e.g. an odd memoryview slice)\n"
+  "  SequencerError: if ALSA can't send a packet; the packets before it\n"
+  "                  remain queued"
+);
+
+/** alsaseq.Sequencer output_ump() method */
+static PyObject *
+Sequencer_output_ump(SequencerObject *self,
+		     PyObject *args,
+		     PyObject *kwds) {
+  PyObject *dest = Py_None;
+  snd_seq_ump_event_t ev;
+  const uint32_t *words;
+  Py_buffer view;
+  Py_ssize_t nwords, i;
+  int port = 0;
+  int drain = 0;
+  int count = 0;
+  int n;
+  int ret = 0;
+
+  char *kwlist[] = {"words", "port", "dest", "drain", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "y*|iOi", kwlist, &view,
+				   &port, &dest, &drain)) {
+    return NULL;
+  }
+
+  memset(&ev, 0, sizeof(ev));
+  ev.flags = SND_SEQ_EVENT_UMP;
+  ev.queue = SND_SEQ_QUEUE_DIRECT;
+  ev.source.port = port;
+  if (dest == Py_None) {
+    ev.dest.client = SND_SEQ_ADDRESS_SUBSCRIBERS;
+    ev.dest.port = SND_SEQ_ADDRESS_UNKNOWN;
+  } else if (!PyArg_ParseTuple(dest, "BB;dest must be a (client, port) "
+			       "tuple", &ev.dest.client, &ev.dest.port)) {
+    PyBuffer_Release(&view);
+    return NULL;
+  }
+
+  words = view.buf;
+  nwords = view.len / 4;
+  if (view.len % 4 != 0 || ((uintptr_t)view.buf & 3) != 0) {
+    PyBuffer_Release(&view);
+    PyErr_SetString(PyExc_ValueError,
+		    "words must hold 32-bit words, aligned on 4 bytes");
+    return NULL;
+  }
+  /* check before sending anything */
+  for (i = 0; i < nwords; i += _seq_ump_words(words[i]));
+  if (i != nwords) {
+    PyBuffer_Release(&view);
+    PyErr_SetString(PyExc_ValueError, "the last UMP packet is incomplete");
+    return NULL;
+  }
+
+  if (_Sequencer_init_output_fds(self) < 0 ||
+      _Sequencer_acquire_output(self) < 0) {
+    PyBuffer_Release(&view);
+    return NULL;
+  }
+
+  Py_BEGIN_ALLOW_THREADS;
+  for (i = 0; i < nwords; i += n) {
+    n = _seq_ump_words(words[i]);
+    memset(ev.ump, 0, sizeof(ev.ump));
+    memcpy(ev.ump, &words[i], n * 4);
+    ret = _Sequencer_output_ump_nogil(self, &ev);
+    if (ret < 0) {
+      break;
+    }
+    count++;
+  }
+  if (ret >= 0 && drain) {
+    ret = _Sequencer_drain_nogil(self);
+  }
+  Py_END_ALLOW_THREADS;
+  _Sequencer_release_output(self);
+
+  PyBuffer_Release(&view);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to output UMP packet %d", count);
+    return NULL;
+  }
+
+  return PyInt_FromLong(count);
+}
+
+/** alsaseq.Sequencer receive_ump() method: __doc__ */
+PyDoc_STRVAR(Sequencer_receive_ump__doc__,
+  "receive_ump(buffer, timeout=0, sources=None) -> int\n"
+  "\n"
+  "Receives UMP packets as native 32-bit words into a writable buffer,\n"
+  "with the GIL released and no Python object created per packet.\n"
+  "Events which are not UMP packets (e.g. system announcements) are\n"
+  "skipped; the receive filter (set_receive_filter()) doesn't apply.\n"
+  "The client must be in an UMP mode (see set_midi_version()).\n"
+  "\n"
+  "Parameters:\n"
+  "  buffer -- a writable buffer of uint32 words (array('I'), numpy\n"
+  "            uint32, bytearray...); reading stops when less than 4\n"
+  "            words (the longest packet) are left\n"
+  "  timeout -- (int) time for waiting for events in milliseconds\n"
+  "  sources -- an optional writable buffer of uint16: the source of\n"
+  "             the n-th packet is stored as client << 8 | port in its\n"
+  "             n-th item; reading also stops when it is full\n"
+  "Returns:\n"
+  "  (int) the number of words written\n"
+  "Raises:\n"
+  "  ValueError: if buffer holds less than 4 words, or a buffer is not\n"
+  "              aligned on its item size\n"
+  "  RuntimeError: if another thread is receiving from the sequencer\n"
+  "  SequencerError: if ALSA error occurs, e.g. an input overrun\n"
+  "                  (ENOSPC); the packets read before it are lost."
+);
+
+/** alsaseq.Sequencer receive_ump() method */
+static PyObject *
+Sequencer_receive_ump(SequencerObject *self,
+		      PyObject *args,
+		      PyObject *kwds) {
+  PyObject *sourcesobj = Py_None;
+  snd_seq_ump_event_t *event = NULL;
+  Py_buffer view, srcview;
+  uint32_t *words;
+  uint16_t *sources = NULL;
+  Py_ssize_t max, maxsrc = 0;
+  Py_ssize_t count = 0, packets = 0;
+  int timeout = 0;
+  int n;
+  int ret;
+
+  char *kwlist[] = {"buffer", "timeout", "sources", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "w*|iO", kwlist, &view,
+				   &timeout, &sourcesobj)) {
+    return NULL;
+  }
+
+  words = view.buf;
+  max = view.len / 4;
+  if (max < 4) {
+    PyBuffer_Release(&view);
+    PyErr_SetString(PyExc_ValueError, "buffer too small (4 words min)");
+    return NULL;
+  }
+  if (((uintptr_t)view.buf & 3) != 0) {
+    PyBuffer_Release(&view);
+    PyErr_SetString(PyExc_ValueError, "buffer must be aligned on 4 bytes");
+    return NULL;
+  }
+  if (sourcesobj != Py_None) {
+    if (PyObject_GetBuffer(sourcesobj, &srcview, PyBUF_WRITABLE) < 0) {
+      PyBuffer_Release(&view);
+      return NULL;
+    }
+    if (((uintptr_t)srcview.buf & 1) != 0) {
+      PyBuffer_Release(&srcview);
+      PyBuffer_Release(&view);
+      PyErr_SetString(PyExc_ValueError,
+		      "sources must be aligned on 2 bytes");
+      return NULL;
+    }
+    sources = srcview.buf;
+    maxsrc = srcview.len / 2;
+  }
+
+  ret = _Sequencer_wait_input(self, timeout);
+  if (ret <= 0) {
+    goto __end;
+  }
+
+  self->input_busy = 1;
+  Py_BEGIN_ALLOW_THREADS;
+  do {
+    if (sources != NULL && packets >= maxsrc) {
+      break;
+    }
+    ret = snd_seq_ump_event_input(self->handle, &event);
+    if (ret < 0) {
+      break;
+    }
+    if (!(event->flags & SND_SEQ_EVENT_UMP)) {
+      continue;
+    }
+    n = _seq_ump_words(event->ump[0]);
+    memcpy(&words[count], event->ump, n * 4);
+    count += n;
+    if (sources != NULL) {
+      sources[packets] = event->source.client << 8 | event->source.port;
+    }
+    packets++;
+  } while (max - count >= 4 && ret > 0);
+  Py_END_ALLOW_THREADS;
+  self->input_busy = 0;
+
+ __end:
+  PyBuffer_Release(&view);
+  if (sources != NULL) {
+    PyBuffer_Release(&srcview);
+  }
+  if (ret < 0 && PyErr_Occurred()) {
+    return NULL;
+  } else if (ret < 0 && ret != -EAGAIN) {
+    RAISESND(ret, "Failed to receive UMP packet %zd", packets);
+    return NULL;
+  }
+  return PyLong_FromSsize_t(count);
+}
+
+#endif
+
+/** alsaseq.Sequencer pool_status() method: __doc__ */
+PyDoc_STRVAR(Sequencer_pool_status__doc__,
+  "pool_status() -> dict\n"
+  "\n"
+  "Returns the usage of the kernel client pool of this Sequencer:\n"
+  "  'output_pool' -> size of the output pool (events)\n"
+  "  'output_free' -> free events in the output pool\n"
+  "  'output_used' -> events of the output pool in use (scheduled)\n"
+  "  'output_room' -> room needed for waking up a blocked writer\n"
+  "  'input_pool' -> size of the input pool (events)\n"
+  "  'input_free' -> free events in the input pool\n"
+  "\n"
+  "Raises:\n"
+  "  SequencerError: if ALSA error occurs."
+);
+
+/** alsaseq.Sequencer pool_status() method */
+static PyObject *
+Sequencer_pool_status(SequencerObject *self,
+		      PyObject *args) {
+  snd_seq_client_pool_t *pool;
+  size_t output_pool, output_free;
+  int ret;
+
+  snd_seq_client_pool_alloca(&pool);
+  ret = snd_seq_get_client_pool(self->handle, pool);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to get client pool");
+    return NULL;
+  }
+
+  output_pool = snd_seq_client_pool_get_output_pool(pool);
+  output_free = snd_seq_client_pool_get_output_free(pool);
+
+  return Py_BuildValue("{snsnsnsnsnsn}",
+		       "output_pool", (Py_ssize_t)output_pool,
+		       "output_free", (Py_ssize_t)output_free,
+		       "output_used",
+		       (Py_ssize_t)(output_pool > output_free ?
+				    output_pool - output_free : 0),
+		       "output_room",
+		       (Py_ssize_t)snd_seq_client_pool_get_output_room(pool),
+		       "input_pool",
+		       (Py_ssize_t)snd_seq_client_pool_get_input_pool(pool),
+		       "input_free",
+		       (Py_ssize_t)snd_seq_client_pool_get_input_free(pool));
+}
+
+/** alsaseq.Sequencer drain_output() method: __doc__ */
+PyDoc_STRVAR(Sequencer_drain_output__doc__,
+  "drain_output()\n"
+  "\n"
+  "Drain the output, making sure all events int the buffer are sent.\n"
+  "The events sent may remain unprocessed, to make sure they are\n"
+  "processed, call the sync_output_queue() method.\n"
+  "\n"
+  "Raises:\n"
+  "  SequencerError: if ALSA can't drain the output"
+);
+
+/** alsaseq.Sequencer drain_output() method */
+static PyObject *Sequencer_drain_output(SequencerObject *self,
+					PyObject *args) {
+  int ret;
+
+  if (_Sequencer_check_output(self) < 0) {
+    return NULL;
+  }
+  ret = snd_seq_drain_output(self->handle);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to drain output");
+    return NULL;
+  }
+
+  Py_RETURN_NONE;
+}
+
+/** alsaseq.Sequencer sync_output_queue() method: __doc__ */
+PyDoc_STRVAR(Sequencer_sync_output_queue__doc__,
+  "sync_output_queue()\n"
+  "\n"
+  "Waits until all events of this clients are processed.\n"
+  "\n"
+  "Raises:\n"
+  "  SequencerError: if an ALSA error occurs."
+);
+
+/** alsaseq.Sequencer sync_output_queue() method */
+static PyObject *
+Sequencer_sync_output_queue(SequencerObject *self,
+			    PyObject *args) {
+  int ret;
+
+  if (_Sequencer_check_output(self) < 0) {
+    return NULL;
+  }
+  ret = snd_seq_sync_output_queue(self->handle);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to sync output queue");
+    return NULL;
+  }
+
+  Py_RETURN_NONE;
+}
+
+
+/** alsaseq.Sequencer parse_address() method: __doc__ */
+PyDoc_STRVAR(Sequencer_parse_address__doc__,
+  "parse_address(string) -> tuple\n"
+  "\n"
+  "Parses the given string as an ALSA client:port. You can use client,\n"
+  "port id's or names.\n"
+  "\n"
+  "Parameters:\n"
+  "  string -- the address in the format client:port.\n"
+  "Returns:\n"
+  "  the tuple (client_id, port_id).\n"
+  "Raises:\n"
+  "  SequencerError: if ALSA can't parse the given address\n"
+  "\n"
+  "Each call scans the clients; see SeqTopology.resolve() for a cached\n"
+  "resolver."
+);
+
+/** alsaseq.Sequencer parse_address() method */
+static PyObject *
+Sequencer_parse_address(SequencerObject *self,
+			PyObject *args) {
+  snd_seq_addr_t addr;
+  char *str = NULL;
+  int ret;
+
+  if (!PyArg_ParseTuple(args, "s", &(str))) {
+    return NULL;
+  }
+
+  ret = snd_seq_parse_address(self->handle, &addr, str);
+  if (ret < 0) {
+    RAISESND(ret, "Invalid client:port specification '%s'", str);
+    return NULL;
+  }
+
+  PyObject *tuple = PyTuple_New(2);
+  PyTuple_SetItem(tuple, 0, PyInt_FromLong(addr.client));
+  PyTuple_SetItem(tuple, 1, PyInt_FromLong(addr.port));
+
+  return tuple;
+}
+
+/** alsaseq.Sequencer create_queue() method: __doc__ */
+PyDoc_STRVAR(Sequencer_create_queue__doc__,
+  "create_queue(name=None)-> int\n"
+  "\n"
+  "Creates a queue with the optional given name.\n"
+  "\n"
+  "Parameters:\n"
+  "  name -- the name of the queue.\n"
+  "Returns:\n"
+  "  the queue id.\n"
+  "Raises:\n"
+  "  SequencerError: if ALSA can't create the queue"
+);
+
+/** alsaseq.Sequencer create_queue() method */
+static PyObject *
+Sequencer_create_queue(SequencerObject *self,
+		       PyObject *args,
+		       PyObject *kwds) {
+  char *kwlist[] = {"name", NULL};
+  char *queue_name = NULL;
+  int ret;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|s", kwlist,
+				   &queue_name)) {
+    return NULL;
+  }
+
+  if (queue_name != NULL) {
+    ret = snd_seq_alloc_named_queue(self->handle, queue_name);
+  } else {
+    ret = snd_seq_alloc_queue(self->handle);
+  }
+
+  if (ret < 0) {
+    RAISESND(ret, "Failed to create queue");
+    return NULL;
+  }
+
+  return PyInt_FromLong(ret);
+}
+
+/** alsaseq.Sequencer delete_queue() method: __doc__ */
+PyDoc_STRVAR(Sequencer_delete_queue__doc__,
+  "delete_queue(queue)\n"
+  "\n"
+  "Deletes (frees) a queue.\n"
+  "\n"
+  "Parameters:\n"
+  "  queue -- the queue id.\n"
+  "Raises:\n"
+  "  SequencerError: if ALSA can't delete the queue."
+);
+
+/** alsaseq.Sequencer delete_queue() method */
+static PyObject *
+Sequencer_delete_queue(SequencerObject *self,
+		       PyObject *args,
+		       PyObject *kwds) {
+  char *kwlist[] = {"queue", NULL};
+  int queue_id;
+  int ret;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "i", kwlist,
+				   &queue_id)) {
+    return NULL;
+  }
+
+  ret = snd_seq_free_queue(self->handle, queue_id);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to create queue");
+    return NULL;
+  }
+
+  Py_RETURN_NONE;
+}
+
+
+/** alsaseq.Sequencer queue_tempo() method: __doc__ */
+PyDoc_STRVAR(Sequencer_queue_tempo__doc__,
+  "queue_tempo(queue, tempo=None, ppq=None) -> tuple"
+  "\n"
+  "Query and changes the queue tempo. For querying (not changing) the queue\n"
+  "tempo, pass only the queue id.\n"
+  "\n"
+  "Parameters:\n"
+  "  queue -- the queue id.\n"
+  "  tempo -- the new queue tempo or None for keeping the current tempo.\n"
+  "  ppq -- the new queue ppq or None for keeping the current tempo.\n"
+  "Returns:\n"
+  "  a tuple (tempo, ppq) with the current or changed tempo.\n"
+  "Raises:\n"
+  "  SequencerError: if ALSA can't change the queue tempo or an invalid\n"
+  "                  queue was specified."
+);
+
+/** alsaseq.Sequencer queue_tempo() method */
+static PyObject *
+Sequencer_queue_tempo(SequencerObject *self,
+		      PyObject *args,
+		      PyObject *kwds) {
+  char *kwlist[] = {"queue", "tempo", "ppq", NULL};
+  int queueid, tempo=-1, ppq=-1;
+  int ret;
+  snd_seq_queue_tempo_t *queue_tempo;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "i|ii", kwlist,
+				   &queueid, &tempo, &ppq)) {
+    return NULL;
+  }
+
+  snd_seq_queue_tempo_alloca(&queue_tempo);
+  ret = snd_seq_get_queue_tempo(self->handle, queueid, queue_tempo);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to retrieve current queue tempo");
+    return NULL;
+  }
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "i|ii", kwlist,
+				   &queueid, &tempo, &ppq)) {
+    return NULL;
+  }
+
+  if (tempo != -1) {
+    snd_seq_queue_tempo_set_tempo(queue_tempo, tempo);
+  }
+  if (ppq != -1) {
+    snd_seq_queue_tempo_set_ppq(queue_tempo, ppq);
+  }
+
+  if (tempo != -1 && ppq != -1) {
+    ret = snd_seq_set_queue_tempo(self->handle, queueid, queue_tempo);
+    if (ret < 0) {
+      RAISESND(ret, "Failed to set queue tempo");
+      return NULL;
+    }
+  }
+
+  tempo = snd_seq_queue_tempo_get_tempo(queue_tempo);
+  ppq = snd_seq_queue_tempo_get_ppq(queue_tempo);
+
+  PyObject *tuple = PyTuple_New(2);
+  PyTuple_SetItem(tuple, 0, PyInt_FromLong(tempo));
+  PyTuple_SetItem(tuple, 1, PyInt_FromLong(ppq));
+
+  return tuple;
+}
+
+/** alsaseq.Sequencer start_queue() method: __doc__ */
+PyDoc_STRVAR(Sequencer_start_queue__doc__,
+  "start_queue(queue)\n"
+  "\n"
+  "Starts the specified queue.\n"
+  "\n"
+  "Parameters:\n"
+  "  queue -- the queue id.\n"
+  "Raises:\n"
+  "  SequencerError: if ALSA can't start the queue."
+);
+
+/** alsaseq.Sequencer start_queue() method */
+static PyObject *
+Sequencer_start_queue(SequencerObject *self,
+		      PyObject *args,
+		      PyObject *kwds) {
+  char *kwlist[] = {"queue", NULL};
+  int queueid;
+  int ret;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "i", kwlist,
+				   &queueid)) {
+    return NULL;
+  }
+
+  if (_Sequencer_check_output(self) < 0) {
+    return NULL;
+  }
+  ret = snd_seq_start_queue(self->handle, queueid, NULL);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to start queue");
+    return NULL;
+  }
+
+  Py_RETURN_NONE;
+}
+
+/** alsaseq.Sequencer stop_queue() method: __doc__ */
+PyDoc_STRVAR(Sequencer_stop_queue__doc__,
+  "stop_queue(queue)\n"
+  "\n"
+  "Stops the specified queue.\n"
+  "\n"
+  "Parameters:\n"
+  "  queue -- the queue id.\n"
+  "Raises:\n"
+  "  SequencerError: if ALSA can't stop the queue."
+);
+
+/** alsaseq.Sequencer stop_queue() method */
+static PyObject *
+Sequencer_stop_queue(SequencerObject *self,
+		      PyObject *args,
+		      PyObject *kwds) {
+  char *kwlist[] = {"queue", NULL};
+  int queueid;
+  int ret;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "i", kwlist,
+				   &queueid)) {
+    return NULL;
+  }
+
+  if (_Sequencer_check_output(self) < 0) {
+    return NULL;
+  }
+  ret = snd_seq_stop_queue(self->handle, queueid, NULL);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to stop queue");
+    return NULL;
+  }
+
+  Py_RETURN_NONE;
+}
+
+/** alsaseq.Sequencer queue_skew() method: __doc__ */
+PyDoc_STRVAR(Sequencer_queue_skew__doc__,
+  "queue_skew(queue, skew=None) -> tuple\n"
+  "\n"
+  "Query and changes the queue skew: the queue runs at skew/base times\n"
+  "its nominal speed, for following an external clock. For querying\n"
+  "(not changing) the queue skew, pass only the queue id.\n"
+  "\n"
+  "Parameters:\n"
+  "  queue -- the queue id.\n"
+  "  skew -- the new skew, or None for keeping the current skew; the\n"
+  "          base is 0x10000, so 0x10000 is the nominal speed.\n"
+  "Returns:\n"
+  "  a tuple (skew, base) with the current or changed skew.\n"
+  "Raises:\n"
+  "  SequencerError: if ALSA can't change the queue skew or an invalid\n"
+  "                  queue was specified."
+);
+
+/** alsaseq.Sequencer queue_skew() method */
+static PyObject *
+Sequencer_queue_skew(SequencerObject *self,
+		     PyObject *args,
+		     PyObject *kwds) {
+  char *kwlist[] = {"queue", "skew", NULL};
+  snd_seq_queue_tempo_t *queue_tempo;
+  PyObject *skew = Py_None;
+  unsigned long value;
+  int queueid;
+  int ret;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "i|O", kwlist,
+				   &queueid, &skew)) {
+    return NULL;
+  }
+
+  snd_seq_queue_tempo_alloca(&queue_tempo);
+  ret = snd_seq_get_queue_tempo(self->handle, queueid, queue_tempo);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to retrieve current queue skew");
+    return NULL;
+  }
+
+  if (skew != Py_None) {
+    value = PyLong_AsUnsignedLong(skew);
+    if (PyErr_Occurred()) {
+      return NULL;
+    }
+    if (value == 0 || value > 0xffffffffUL) {
+      PyErr_SetString(PyExc_ValueError, "skew must be 1-0xffffffff");
+      return NULL;
+    }
+    snd_seq_queue_tempo_set_skew(queue_tempo, value);
+    snd_seq_queue_tempo_set_skew_base(queue_tempo, 0x10000);
+    ret = snd_seq_set_queue_tempo(self->handle, queueid, queue_tempo);
+    if (ret < 0) {
+      RAISESND(ret, "Failed to set queue skew");
+      return NULL;
+    }
+  }
+
+  return Py_BuildValue("(II)", snd_seq_queue_tempo_get_skew(queue_tempo),
+		       snd_seq_queue_tempo_get_skew_base(queue_tempo));
+}
+
+/** alsaseq.Sequencer queue_timer() method: __doc__ */
+PyDoc_STRVAR(Sequencer_queue_timer__doc__,
+  "queue_timer(queue, device=None, resolution=None, type=None) -> dict\n"
+  "\n"
+  "Query and changes the timer of a queue. For querying (not changing)\n"
+  "the queue timer, pass only the queue id. The timer is changed while\n"
+  "the queue is stopped.\n"
+  "\n"
+  "Parameters:\n"
+  "  queue -- the queue id.\n"
+  "  device -- a global timer (TIMER_GLOBAL_SYSTEM, TIMER_GLOBAL_HRTIMER,\n"
+  "            TIMER_GLOBAL_RTC, TIMER_GLOBAL_HPET), or the tuple\n"
+  "            (class, sclass, card, device, subdevice) of any ALSA\n"
+  "            timer, e.g. of a PCM.\n"
+  "  resolution -- the requested resolution in Hz, 0 for the default.\n"
+  "  type -- SEQ_TIMER_ALSA (default), SEQ_TIMER_MIDI_CLOCK or\n"
+  "          SEQ_TIMER_MIDI_TICK.\n"
+  "Returns:\n"
+  "  (dict) the current or changed timer:\n"
+  "    type -- the timer type constant\n"
+  "    device -- (class, sclass, card, device, subdevice) tuple\n"
+  "    resolution -- the resolution in Hz\n"
+  "Raises:\n"
+  "  SequencerError: if ALSA can't change the queue timer or an invalid\n"
+  "                  queue was specified."
+);
+
+/** alsaseq.Sequencer queue_timer() method */
+static PyObject *
+Sequencer_queue_timer(SequencerObject *self,
+		      PyObject *args,
+		      PyObject *kwds) {
+  char *kwlist[] = {"queue", "device", "resolution", "type", NULL};
+  PyObject *device = Py_None, *type;
+  snd_seq_queue_timer_t *timer;
+  snd_timer_id_t *id;
+  int queueid, resolution = -1, timer_type = -1;
+  int tclass, sclass, card, dev, subdev;
+  int ret;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "i|Oii", kwlist,
+				   &queueid, &device, &resolution,
+				   &timer_type)) {
+    return NULL;
+  }
+
+  snd_seq_queue_timer_alloca(&timer);
+  ret = snd_seq_get_queue_timer(self->handle, queueid, timer);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to retrieve current queue timer");
+    return NULL;
+  }
+
+  if (device != Py_None || resolution >= 0 || timer_type >= 0) {
+    if (device != Py_None) {
+      snd_timer_id_alloca(&id);
+      if (PyTuple_Check(device)) {
+	if (!PyArg_ParseTuple(device, "iiiii;device must be an int or a "
+			      "(class, sclass, card, device, subdevice) "
+			      "tuple", &tclass, &sclass, &card, &dev,
+			      &subdev)) {
+	  return NULL;
+	}
+      } else {
+	dev = PyLong_AsLong(device);
+	if (dev == -1 && PyErr_Occurred()) {
+	  return NULL;
+	}
+	tclass = SND_TIMER_CLASS_GLOBAL;
+	sclass = SND_TIMER_SCLASS_NONE;
+	card = 0;
+	subdev = 0;
+      }
+      snd_timer_id_set_class(id, tclass);
+      snd_timer_id_set_sclass(id, sclass);
+      snd_timer_id_set_card(id, card);
+      snd_timer_id_set_device(id, dev);
+      snd_timer_id_set_subdevice(id, subdev);
+      snd_seq_queue_timer_set_id(timer, id);
+    }
+    if (resolution >= 0) {
+      snd_seq_queue_timer_set_resolution(timer, resolution);
+    }
+    if (timer_type >= 0) {
+      snd_seq_queue_timer_set_type(timer, timer_type);
+    }
+    ret = snd_seq_set_queue_timer(self->handle, queueid, timer);
+    if (ret < 0) {
+      RAISESND(ret, "Failed to set queue timer");
+      return NULL;
+    }
+    snd_seq_get_queue_timer(self->handle, queueid, timer);
+  }
+
+  id = (snd_timer_id_t *)snd_seq_queue_timer_get_id(timer);
+  TCONSTASSIGN(QUEUE_TIMER, snd_seq_queue_timer_get_type(timer), type);
+  return Py_BuildValue("{sNs(iiiii)sI}",
+		       "type", type,
+		       "device", snd_timer_id_get_class(id),
+		       snd_timer_id_get_sclass(id),
+		       snd_timer_id_get_card(id),
+		       snd_timer_id_get_device(id),
+		       snd_timer_id_get_subdevice(id),
+		       "resolution",
+		       snd_seq_queue_timer_get_resolution(timer));
+}
+
+PyDoc_STRVAR(Sequencer_registerpoll__doc__,
+"register_poll(pollObj, input=False, output=False) -- Register poll file descriptors.");
+
+static PyObject *
+Sequencer_registerpoll(SequencerObject *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *pollObj, *reg, *t;
+    struct pollfd *pfd;
+    int i, count;
+    int input = 0;
+    int output = 0;
+    int mode = POLLIN|POLLOUT;
+
+    static char * kwlist[] = { "pollObj", "input", "output", NULL };
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|ii", kwlist, &pollObj, &input, &output))
+        return NULL;
+
+    if (input && !output)
+        mode = POLLIN;
+    else if (!input && output)
+        mode = POLLOUT;
+
+    count = snd_seq_poll_descriptors_count(self->handle, mode);
+    if (count <= 0)
+        Py_RETURN_NONE;
+    pfd = alloca(sizeof(struct pollfd) * count);
+    count = snd_seq_poll_descriptors(self->handle, pfd, count, mode);
+    if (count <= 0)
+        Py_RETURN_NONE;
+
+    reg = PyObject_GetAttrString(pollObj, "register");
+    if (!reg)
+        return NULL;
+
+    for (i = 0; i < count; i++) {
+        t = PyTuple_New(2);
+        if (!t) {
+            Py_DECREF(reg);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(t, 0, PyInt_FromLong(pfd[i].fd));
+        PyTuple_SET_ITEM(t, 1, PyInt_FromLong(pfd[i].events));
+        Py_XDECREF(PyObject_CallObject(reg, t));
+        Py_DECREF(t);
+    }
+
+    Py_DECREF(reg);
+
+    Py_RETURN_NONE;
+}
+
+
+
+/** state of Sequencer.start_dispatch(): the reader thread fills the ring
+    and the dispatcher thread calls the callback with batches of events */
+struct seq_dispatch {
+  seq_reader_t reader;
+  seq_ring_t ring;
+
+  /* owner (kept alive while dispatching) and callback */
+  SequencerObject *seq;
+  PyObject *callback;
+  unsigned int batch;
+  long max_latency_us;
+
+  pthread_t thread;
+  /* lock and cond only wake up the dispatcher; the ring is lock-free */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int stop;
+
+  /* counters: events dropped because the ring was full, events and
+     batches given to the callback */
+  unsigned long dropped;
+  unsigned long dispatched;
+  unsigned long batches;
+
+  /* next running dispatch (dispatch_list, changed with the GIL held) */
+  struct seq_dispatch *next;
+};
+
+/* the running dispatches, stopped at exit before the interpreter is
+   finalized: the dispatcher threads need it for calling the callbacks */
+static struct seq_dispatch *dispatch_list = NULL;
+
+/** internal use: reader sink of start_dispatch() */
+static void
+_seq_dispatch_sink(seq_reader_t *reader,
+		   const snd_seq_event_t *event) {
+  struct seq_dispatch *d = reader->data;
+
+  if (_seq_ring_push(&d->ring, event) < 0) {
+    __atomic_add_fetch(&d->dropped, 1, __ATOMIC_RELAXED);
+  }
+}
+
+/** internal use: reader flush of start_dispatch(); wakes the dispatcher */
+static void
+_seq_dispatch_flush(seq_reader_t *reader) {
+  struct seq_dispatch *d = reader->data;
+
+  if (_seq_ring_count(&d->ring) > 0) {
+    pthread_mutex_lock(&d->lock);
+    pthread_cond_signal(&d->cond);
+    pthread_mutex_unlock(&d->lock);
+  }
+}
+
+/** internal use: call the callback with the events in the ring, in
+    batches of at most d->batch events */
+static void
+_seq_dispatch_deliver(struct seq_dispatch *d) {
+  snd_seq_event_t *event;
+  PyObject *list, *obj, *ret;
+  unsigned int count;
+  CALLBACK_VARIABLES;
+
+  CALLBACK_INIT;
+
+  while ((count = _seq_ring_count(&d->ring)) > 0) {
+    if (count > d->batch) {
+      count = d->batch;
+    }
+    list = PyList_New(0);
+    if (list == NULL) {
+      break;
+    }
+    while (count-- > 0 && (event = _seq_ring_peek(&d->ring)) != NULL) {
+      obj = SeqEvent_create(event);
+      _seq_ring_pop(&d->ring);
+      if (obj == NULL || PyList_Append(list, obj) < 0) {
+	Py_XDECREF(obj);
+	PyErr_Print();
+	continue;
+      }
+      Py_DECREF(obj);
+    }
+
+    d->dispatched += PyList_GET_SIZE(list);
+    d->batches++;
+    ret = PyObject_CallFunctionObjArgs(d->callback, list, NULL);
+    Py_DECREF(list);
+    if (ret == NULL) {
+      PyErr_Print();
+      PyErr_Clear();
+    } else {
+      Py_DECREF(ret);
+    }
+  }
+
+  CALLBACK_DONE;
+}
+
+/** internal use: the dispatcher thread */
+static void *
+_seq_dispatch_run(void *arg) {
+  struct seq_dispatch *d = arg;
+  struct timespec deadline;
+  int stop;
+
+  for (;;) {
+    pthread_mutex_lock(&d->lock);
+    /* wait for the first event... */
+    while (!d->stop && _seq_ring_count(&d->ring) == 0) {
+      pthread_cond_wait(&d->cond, &d->lock);
+    }
+    /* ...then for a full batch, or until it is max_latency_us old */
+    if (!d->stop && _seq_ring_count(&d->ring) < d->batch &&
+	d->max_latency_us > 0) {
+      clock_gettime(CLOCK_MONOTONIC, &deadline);
+      deadline.tv_sec += d->max_latency_us / 1000000;
+      deadline.tv_nsec += (d->max_latency_us % 1000000) * 1000;
+      if (deadline.tv_nsec >= 1000000000L) {
+	deadline.tv_sec++;
+	deadline.tv_nsec -= 1000000000L;
+      }
+      while (!d->stop && _seq_ring_count(&d->ring) < d->batch) {
+	if (pthread_cond_timedwait(&d->cond, &d->lock, &deadline) != 0) {
+	  break;
+	}
+      }
+    }
+    stop = d->stop;
+    pthread_mutex_unlock(&d->lock);
+
+    /* on stop, the reader is already gone: deliver what is left */
+    _seq_dispatch_deliver(d);
+    if (stop) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+/** internal use: build the counters dict of start_dispatch() */
+static PyObject *
+_seq_dispatch_stats(struct seq_dispatch *d) {
+  return Py_BuildValue("{sksksksksksi}",
+		       "events",
+		       __atomic_load_n(&d->reader.events, __ATOMIC_RELAXED),
+		       "overruns",
+		       __atomic_load_n(&d->reader.overruns, __ATOMIC_RELAXED),
+		       "dropped",
+		       __atomic_load_n(&d->dropped, __ATOMIC_RELAXED),
+		       "dispatched", d->dispatched,
+		       "batches", d->batches,
+		       "error", d->reader.error);
+}
+
+/** alsaseq.Sequencer start_dispatch() method: __doc__ */
+PyDoc_STRVAR(Sequencer_start_dispatch__doc__,
+  "start_dispatch(callback, batch = 64, max_latency_us = 1000,\n"
+  "               ringsize = 4096)\n"
+  "\n"
+  "Receive events on a native thread and pass them to callback in\n"
+  "batches. The reader thread drains the sequencer input without the\n"
+  "GIL into a lock-free ring; a dispatcher thread takes the GIL and\n"
+  "calls callback(events) with a list of SeqEvent objects as soon as\n"
+  "batch events are waiting, or max_latency_us after the first waiting\n"
+  "event, whichever comes first. Python scheduling delays don't slow\n"
+  "down the draining of the kernel queue.\n"
+  "\n"
+  "While dispatching, the input is owned by the threads: the receive\n"
+  "methods raise SequencerError. Output methods may still be used, but\n"
+  "the handle is non-blocking meanwhile whatever the mode is: they fail\n"
+  "with EAGAIN instead of waiting when the output is full. Exceptions\n"
+  "raised by callback are printed and ignored. The Sequencer is kept\n"
+  "alive until stop_dispatch() is called, or until the interpreter\n"
+  "exits.\n"
+  "\n"
+  "Parameters:\n"
+  "  callback -- a callable receiving a list of SeqEvent objects\n"
+  "  batch -- (int) max events per callback call\n"
+  "  max_latency_us -- (int) max time in microseconds an event waits\n"
+  "                    for a batch to fill up; 0 dispatches at once\n"
+  "  ringsize -- (int) capacity of the ring, rounded up to a power of 2;\n"
+  "              events arriving when it is full are dropped (counted)\n"
+  "Raises:\n"
+  "  TypeError: if callback is not callable\n"
+  "  ValueError: if a parameter is out of range\n"
+  "  SequencerError: if the input is already owned or can't be read."
+);
+
+/** alsaseq.Sequencer start_dispatch() method */
+static PyObject *
+Sequencer_start_dispatch(SequencerObject *self,
+			 PyObject *args,
+			 PyObject *kwds) {
+  struct seq_dispatch *d;
+  pthread_condattr_t attr;
+  PyObject *callback;
+  int batch = 64;
+  long max_latency_us = 1000;
+  int ringsize = 4096;
+  int ret;
+
+  char *kwlist[] = {"callback", "batch", "max_latency_us", "ringsize",
+		    NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|ili", kwlist, &callback,
+				   &batch, &max_latency_us, &ringsize)) {
+    return NULL;
+  }
+
+  if (!PyCallable_Check(callback)) {
+    PyErr_SetString(PyExc_TypeError, "callback must be callable");
+    return NULL;
+  }
+  if (batch <= 0 || max_latency_us < 0 || ringsize <= 0) {
+    PyErr_SetString(PyExc_ValueError,
+		    "batch and ringsize must be > 0, max_latency_us >= 0");
+    return NULL;
+  }
+  if (_Sequencer_check_input(self) < 0) {
+    return NULL;
+  }
+  if (self->areading) {
+    RAISESTR("The input is owned by areceive()");
+    return NULL;
+  }
+
+  d = calloc(1, sizeof(*d));
+  if (d == NULL) {
+    return PyErr_NoMemory();
+  }
+  if (_seq_ring_init(&d->ring, ringsize) < 0) {
+    free(d);
+    return PyErr_NoMemory();
+  }
+  d->reader.handle = self->handle;
+  d->reader.mode = self->mode;
+  d->reader.sink = _seq_dispatch_sink;
+  d->reader.flush = _seq_dispatch_flush;
+  d->reader.data = d;
+  d->reader.filter = &self->filter;
+  d->batch = batch;
+  d->max_latency_us = max_latency_us;
+  pthread_mutex_init(&d->lock, NULL);
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&d->cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+#if PY_VERSION_HEX < 0x03070000
+  PyEval_InitThreads();
+#endif
+
+  ret = pthread_create(&d->thread, NULL, _seq_dispatch_run, d);
+  if (ret == 0) {
+    ret = _seq_reader_start(&d->reader);
+    if (ret < 0) {
+      /* no GIL needed: the ring is empty */
+      pthread_mutex_lock(&d->lock);
+      d->stop = 1;
+      pthread_cond_signal(&d->cond);
+      pthread_mutex_unlock(&d->lock);
+      pthread_join(d->thread, NULL);
+    }
+  } else {
+    ret = -ret;
+  }
+  if (ret < 0) {
+    pthread_cond_destroy(&d->cond);
+    pthread_mutex_destroy(&d->lock);
+    _seq_ring_free(&d->ring);
+    free(d);
+    RAISESND(ret, "Failed to start dispatching");
+    return NULL;
+  }
+
+  Py_INCREF(callback);
+  d->callback = callback;
+  Py_INCREF(self);
+  d->seq = self;
+  d->next = dispatch_list;
+  dispatch_list = d;
+  self->dispatch = d;
+  self->input_owner = "start_dispatch()";
+
+  Py_RETURN_NONE;
+}
+
+/** alsaseq.Sequencer stop_dispatch() method: __doc__ */
+PyDoc_STRVAR(Sequencer_stop_dispatch__doc__,
+  "stop_dispatch() -> dict\n"
+  "\n"
+  "Stop the threads started by start_dispatch(). The events already\n"
+  "read are passed to the callback before returning.\n"
+  "\n"
+  "Returns:\n"
+  "  (dict) the counters of the dispatching, like dispatch_stats()\n"
+  "Raises:\n"
+  "  SequencerError: if not dispatching\n"
+  "  RuntimeError: if called from the callback."
+);
+
+/** alsaseq.Sequencer stop_dispatch() method */
+static PyObject *
+Sequencer_stop_dispatch(SequencerObject *self,
+			PyObject *args) {
+  struct seq_dispatch *d = self->dispatch;
+  struct seq_dispatch **link;
+  PyObject *stats;
+
+  if (d == NULL) {
+    RAISESTR("Not dispatching");
+    return NULL;
+  }
+  if (pthread_equal(pthread_self(), d->thread)) {
+    PyErr_SetString(PyExc_RuntimeError,
+		    "stop_dispatch() can't be called from the callback");
+    return NULL;
+  }
+
+  Py_BEGIN_ALLOW_THREADS;
+  _seq_reader_stop(&d->reader);
+  pthread_mutex_lock(&d->lock);
+  d->stop = 1;
+  pthread_cond_signal(&d->cond);
+  pthread_mutex_unlock(&d->lock);
+  pthread_join(d->thread, NULL);
+  Py_END_ALLOW_THREADS;
+
+  stats = _seq_dispatch_stats(d);
+
+  for (link = &dispatch_list; *link != d; link = &(*link)->next) {
+  }
+  *link = d->next;
+  self->dispatch = NULL;
+  self->input_owner = NULL;
+  pthread_cond_destroy(&d->cond);
+  pthread_mutex_destroy(&d->lock);
+  _seq_ring_free(&d->ring);
+  Py_DECREF(d->callback);
+  free(d);
+  /* may be the last reference */
+  Py_DECREF(self);
+
+  return stats;
+}
+
+/** alsaseq.Sequencer dispatch_stats() method: __doc__ */
+PyDoc_STRVAR(Sequencer_dispatch_stats__doc__,
+  "dispatch_stats() -> dict or None\n"
+  "\n"
+  "Returns the counters of start_dispatch(), or None if not dispatching:\n"
+  "  'events' -> events read by the reader thread\n"
+  "  'overruns' -> input overruns reported by ALSA (events lost in the\n"
+  "                kernel)\n"
+  "  'dropped' -> events dropped because the ring was full\n"
+  "  'dispatched' -> events passed to the callback\n"
+  "  'batches' -> calls of the callback\n"
+  "  'error' -> the ALSA error which stopped the reader thread, or 0"
+);
+
+/** alsaseq.Sequencer dispatch_stats() method */
+static PyObject *
+Sequencer_dispatch_stats(SequencerObject *self,
+			 PyObject *args) {
+  if (self->dispatch == NULL) {
+    Py_RETURN_NONE;
+  }
+  return _seq_dispatch_stats(self->dispatch);
+}
+
+/** internal use: replace the event filter of the client by types (an
+    iterable of event types, or NULL) */
+static int
+_Sequencer_set_event_filter(SequencerObject *self,
+			    PyObject *types) {
+  snd_seq_client_info_t *cinfo;
+  PyObject *iter, *item;
+  long type;
+  int ret;
+
+  snd_seq_client_info_alloca(&cinfo);
+  ret = snd_seq_get_client_info(self->handle, cinfo);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to get client info");
+    return -1;
+  }
+  snd_seq_client_info_event_filter_clear(cinfo);
+
+  if (types != NULL) {
+    iter = PyObject_GetIter(types);
+    if (iter == NULL) {
+      return -1;
+    }
+    while ((item = PyIter_Next(iter)) != NULL) {
+      ret = get_long(item, &type);
+      Py_DECREF(item);
+      if (ret) {
+	Py_DECREF(iter);
+	return -1;
+      }
+      if (type < 0 || type > 255) {
+	Py_DECREF(iter);
+	PyErr_Format(PyExc_ValueError, "invalid event type %ld", type);
+	return -1;
+      }
+      snd_seq_client_info_event_filter_add(cinfo, type);
+    }
+    Py_DECREF(iter);
+    if (PyErr_Occurred()) {
+      return -1;
+    }
+  }
+
+  ret = snd_seq_set_client_info(self->handle, cinfo);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to set the event filter");
+    return -1;
+  }
+  return 0;
+}
+
+/** alsaseq.Sequencer set_event_filter() method: __doc__ */
+PyDoc_STRVAR(Sequencer_set_event_filter__doc__,
+  "set_event_filter(types)\n"
+  "\n"
+  "Set the event filter of this client: the kernel delivers only the\n"
+  "events of the given types to it; the other events are not even\n"
+  "copied to its input. The previous filter is replaced; an empty list\n"
+  "accepts all the events, like clear_event_filter(). The current\n"
+  "filter is the event_filter item of get_client_info().\n"
+  "\n"
+  "Parameters:\n"
+  "  types -- an iterable of event types (SEQ_EVENT_*)\n"
+  "Raises:\n"
+  "  ValueError: if a type is out of range\n"
+  "  SequencerError: if ALSA can't set the filter."
+);
+
+/** alsaseq.Sequencer set_event_filter() method */
+static PyObject *
+Sequencer_set_event_filter(SequencerObject *self,
+			   PyObject *args) {
+  PyObject *types;
+
+  if (!PyArg_ParseTuple(args, "O", &types)) {
+    return NULL;
+  }
+  if (_Sequencer_set_event_filter(self, types) < 0) {
+    return NULL;
+  }
+
+  Py_RETURN_NONE;
+}
+
+/** alsaseq.Sequencer clear_event_filter() method: __doc__ */
+PyDoc_STRVAR(Sequencer_clear_event_filter__doc__,
+  "clear_event_filter()\n"
+  "\n"
+  "Remove the event filter of this client: all the events are\n"
+  "delivered.\n"
+  "\n"
+  "Raises:\n"
+  "  SequencerError: if ALSA can't set the filter."
+);
+
+/** alsaseq.Sequencer clear_event_filter() method */
+static PyObject *
+Sequencer_clear_event_filter(SequencerObject *self,
+			     PyObject *args) {
+  if (_Sequencer_set_event_filter(self, NULL) < 0) {
+    return NULL;
+  }
+
+  Py_RETURN_NONE;
+}
+
+/** internal use: parse an iterable of ints in [0, max] into a bitmap */
+static int
+_seq_parse_bitmap(PyObject *obj,
+		  unsigned char *bitmap,
+		  long max,
+		  const char *what) {
+  PyObject *iter, *item;
+  long value;
+  int ret;
+
+  iter = PyObject_GetIter(obj);
+  if (iter == NULL) {
+    return -1;
+  }
+  while ((item = PyIter_Next(iter)) != NULL) {
+    ret = get_long(item, &value);
+    Py_DECREF(item);
+    if (ret) {
+      Py_DECREF(iter);
+      return -1;
+    }
+    if (value < 0 || value > max) {
+      Py_DECREF(iter);
+      PyErr_Format(PyExc_ValueError, "invalid %s %ld", what, value);
+      return -1;
+    }
+    bitmap[value >> 3] |= 1 << (value & 7);
+  }
+  Py_DECREF(iter);
+  return PyErr_Occurred() ? -1 : 0;
+}
+
+/** internal use: parse the sources of a receive filter: client ids or
+    (client, port) tuples */
+static int
+_seq_parse_filter_sources(PyObject *obj,
+			  seq_filter_t *filter) {
+  PyObject *seq, *item;
+  long client, port;
+  Py_ssize_t i, n;
+
+  seq = PySequence_Fast(obj, "sources must be a sequence");
+  if (seq == NULL) {
+    return -1;
+  }
+  n = PySequence_Fast_GET_SIZE(seq);
+  filter->sources = malloc(sizeof(seq_filter_source_t) * (n ? n : 1));
+  if (filter->sources == NULL) {
+    Py_DECREF(seq);
+    PyErr_NoMemory();
+    return -1;
+  }
+  for (i = 0; i < n; i++) {
+    item = PySequence_Fast_GET_ITEM(seq, i);
+    port = -1;
+    if (PyTuple_Check(item)) {
+      if (PyTuple_Size(item) != 2) {
+	PyErr_SetString(PyExc_TypeError, "expected tuple (client,port)");
+	goto __error;
+      }
+      if (get_long(PyTuple_GET_ITEM(item, 0), &client) ||
+	  get_long(PyTuple_GET_ITEM(item, 1), &port)) {
+	goto __error;
+      }
+    } else if (get_long(item, &client)) {
+      goto __error;
+    }
+    filter->sources[i].client = client;
+    filter->sources[i].port = port;
+  }
+  filter->nsources = n;
+  Py_DECREF(seq);
+  return 0;
+
+ __error:
+  Py_DECREF(seq);
+  return -1;
+}
+
+/** internal use: check that the receive filter may be replaced: the
+    native readers and receive_records() use it without the GIL */
+static int
+_Sequencer_check_filter(SequencerObject *self) {
+  if (_Sequencer_check_input(self) < 0) {
+    return -1;
+  }
+  if (self->filter_busy) {
+    RAISESTR("The receive filter is in use by another thread");
+    return -1;
+  }
+  return 0;
+}
+
+/** alsaseq.Sequencer set_receive_filter() method: __doc__ */
+PyDoc_STRVAR(Sequencer_set_receive_filter__doc__,
+  "set_receive_filter(types = None, channels = None, sources = None)\n"
+  "\n"
+  "Set a filter applied in C to the received events, before any object\n"
+  "is created for them: the events not matching are dropped by\n"
+  "receive_events(), receive_into(), receive_records(), the asyncio\n"
+  "methods and the native readers (start_dispatch(), SmfRecorder,\n"
+  "EventLogger). Unlike set_event_filter(), it can filter by channel\n"
+  "and by source, but the events still reach the input of the client.\n"
+  "Each criterion set to None accepts everything; the receive methods\n"
+  "may return less events than available, or none.\n"
+  "\n"
+  "Parameters:\n"
+  "  types -- iterable of accepted event types (SEQ_EVENT_*)\n"
+  "  channels -- iterable of accepted channels (0-15) of the note and\n"
+  "              control events; the other events are not affected\n"
+  "  sources -- sequence of accepted sources: client ids (any port) or\n"
+  "             (client, port) tuples\n"
+  "Raises:\n"
+  "  ValueError: if a type or a channel is out of range\n"
+  "  SequencerError: if the input is owned by a native reader, or\n"
+  "                  receive_records() runs in another thread."
+);
+
+/** alsaseq.Sequencer set_receive_filter() method */
+static PyObject *
+Sequencer_set_receive_filter(SequencerObject *self,
+			     PyObject *args,
+			     PyObject *kwds) {
+  PyObject *types = Py_None;
+  PyObject *channels = Py_None;
+  PyObject *sources = Py_None;
+  unsigned char bits[32];
+  seq_filter_t filter;
+
+  char *kwlist[] = {"types", "channels", "sources", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OOO", kwlist, &types,
+				   &channels, &sources)) {
+    return NULL;
+  }
+  if (_Sequencer_check_filter(self) < 0) {
+    return NULL;
+  }
+
+  memset(&filter, 0, sizeof(filter));
+  if (types != Py_None) {
+    if (_seq_parse_bitmap(types, filter.types, 255, "event type") < 0) {
+      return NULL;
+    }
+    filter.has_types = 1;
+  }
+  if (channels != Py_None) {
+    memset(bits, 0, sizeof(bits));
+    if (_seq_parse_bitmap(channels, bits, 15, "channel") < 0) {
+      return NULL;
+    }
+    filter.channels = bits[0] | (bits[1] << 8);
+    filter.has_channels = 1;
+  }
+  if (sources != Py_None &&
+      _seq_parse_filter_sources(sources, &filter) < 0) {
+    _seq_filter_clear(&filter);
+    return NULL;
+  }
+  filter.has_sources = sources != Py_None;
+  filter.active = filter.has_types || filter.has_channels ||
+    filter.has_sources;
+
+  _seq_filter_clear(&self->filter);
+  self->filter = filter;
+
+  Py_RETURN_NONE;
+}
+
+/** alsaseq.Sequencer clear_receive_filter() method: __doc__ */
+PyDoc_STRVAR(Sequencer_clear_receive_filter__doc__,
+  "clear_receive_filter()\n"
+  "\n"
+  "Remove the receive filter set by set_receive_filter().\n"
+  "\n"
+  "Raises:\n"
+  "  SequencerError: if the input is owned by a native reader, or\n"
+  "                  receive_records() runs in another thread."
+);
+
+/** alsaseq.Sequencer clear_receive_filter() method */
+static PyObject *
+Sequencer_clear_receive_filter(SequencerObject *self,
+			       PyObject *args) {
+  if (_Sequencer_check_filter(self) < 0) {
+    return NULL;
+  }
+  _seq_filter_clear(&self->filter);
+
+  Py_RETURN_NONE;
+}
+
+/** alsaseq.Sequencer get_receive_filter() method: __doc__ */
+PyDoc_STRVAR(Sequencer_get_receive_filter__doc__,
+  "get_receive_filter() -> dict or None\n"
+  "\n"
+  "Returns None if there is no receive filter, else a dictionary:\n"
+  "  'types' -> list of accepted event types, or None\n"
+  "  'channels' -> list of accepted channels, or None\n"
+  "  'sources' -> list of accepted (client, port) sources (port -1 is\n"
+  "               any port), or None\n"
+  "  'dropped' -> number of events dropped by the filter"
+);
+
+/** alsaseq.Sequencer get_receive_filter() method */
+static PyObject *
+Sequencer_get_receive_filter(SequencerObject *self,
+			     PyObject *args) {
+  seq_filter_t *filter = &self->filter;
+  PyObject *types, *channels, *sources, *item;
+  int i;
+
+  if (!filter->active) {
+    Py_RETURN_NONE;
+  }
+
+  types = filter->has_types ? PyList_New(0) : (Py_INCREF(Py_None), Py_None);
+  channels = filter->has_channels ? PyList_New(0) :
+    (Py_INCREF(Py_None), Py_None);
+  sources = filter->has_sources ? PyList_New(0) :
+    (Py_INCREF(Py_None), Py_None);
+  if (types == NULL || channels == NULL || sources == NULL) {
+    goto __error;
+  }
+
+  for (i = 0; filter->has_types && i < 256; i++) {
+    if (filter->types[i >> 3] & (1 << (i & 7))) {
+      item = PyInt_FromLong(i);
+      if (item == NULL || PyList_Append(types, item) < 0) {
+	Py_XDECREF(item);
+	goto __error;
+      }
+      Py_DECREF(item);
+    }
+  }
+  for (i = 0; filter->has_channels && i < 16; i++) {
+    if (filter->channels & (1U << i)) {
+      item = PyInt_FromLong(i);
+      if (item == NULL || PyList_Append(channels, item) < 0) {
+	Py_XDECREF(item);
+	goto __error;
+      }
+      Py_DECREF(item);
+    }
+  }
+  for (i = 0; i < filter->nsources; i++) {
+    item = Py_BuildValue("(ii)", filter->sources[i].client,
+			 filter->sources[i].port);
+    if (item == NULL || PyList_Append(sources, item) < 0) {
+      Py_XDECREF(item);
+      goto __error;
+    }
+    Py_DECREF(item);
+  }
+
+  return Py_BuildValue("{sNsNsNsk}",
+		       "types", types,
+		       "channels", channels,
+		       "sources", sources,
+		       "dropped",
+		       __atomic_load_n(&filter->dropped, __ATOMIC_RELAXED));
+
+ __error:
+  Py_XDECREF(types);
+  Py_XDECREF(channels);
+  Py_XDECREF(sources);
+  return NULL;
+}
+
+#if PY_VERSION_HEX >= 0x03070000
+
+/* max poll descriptors watched by the asyncio support */
+#define ASYNC_MAX_FDS 8
+
+/** internal use: check if the loop of the Sequencer is closed */
+static int
+_Sequencer_async_closed(SequencerObject *self) {
+  PyObject *ret = PyObject_CallMethod(self->aloop, "is_closed", NULL);
+  int closed;
+
+  if (ret == NULL) {
+    return -1;
+  }
+  closed = PyObject_IsTrue(ret);
+  Py_DECREF(ret);
+  return closed;
+}
+
+/** internal use: forget the loop, its futures and its callbacks */
+static void
+_Sequencer_async_reset(SequencerObject *self) {
+  if (self->areaders != NULL) {
+    PyList_SetSlice(self->areaders, 0, PyList_GET_SIZE(self->areaders),
+		    NULL);
+    PyList_SetSlice(self->awriters, 0, PyList_GET_SIZE(self->awriters),
+		    NULL);
+  }
+  self->areading = 0;
+  self->awriting = 0;
+  Py_CLEAR(self->aloop);
+}
+
+/** internal use: release the loop when nothing is waiting on it, so
+    that a closed loop is not kept alive by the Sequencer */
+static void
+_Sequencer_async_idle(SequencerObject *self) {
+  if (!self->areading && !self->awriting &&
+      PyList_GET_SIZE(self->areaders) == 0 &&
+      PyList_GET_SIZE(self->awriters) == 0) {
+    Py_CLEAR(self->aloop);
+  }
+}
+
+/** internal use: the Sequencer of a callback given to the loop or to a
+    future, which is bound to a weak reference to it; NULL if the
+    Sequencer is gone, else a new reference */
+static SequencerObject *
+_Sequencer_async_ref(PyObject *ref) {
+  PyObject *self = PyWeakref_GetObject(ref);
+
+  if (self == NULL || self == Py_None) {
+    PyErr_Clear();
+    return NULL;
+  }
+  Py_INCREF(self);
+  return (SequencerObject *)self;
+}
+
+/** internal use: get the running asyncio loop and bind this Sequencer to
+    it; a Sequencer can't be used from two loops at the same time */
+static PyObject *
+_Sequencer_async_loop(SequencerObject *self) {
+  static PyObject *get_running_loop = NULL;
+  PyObject *loop;
+
+  if (self->mode != SND_SEQ_NONBLOCK) {
+    RAISESTR("asyncio support requires the SEQ_NONBLOCK mode");
+    return NULL;
+  }
+
+  if (get_running_loop == NULL) {
+    PyObject *asyncio = PyImport_ImportModule("asyncio");
+    if (asyncio == NULL) {
+      return NULL;
+    }
+    get_running_loop = PyObject_GetAttrString(asyncio, "get_running_loop");
+    Py_DECREF(asyncio);
+    if (get_running_loop == NULL) {
+      return NULL;
+    }
+  }
+
+  loop = PyObject_CallObject(get_running_loop, NULL);
+  if (loop == NULL) {
+    return NULL;
+  }
+
+  if (self->aloop != NULL && self->aloop != loop) {
+    int closed = _Sequencer_async_closed(self);
+
+    if (closed < 0) {
+      Py_DECREF(loop);
+      return NULL;
+    } else if (closed) {
+      /* the futures and the callbacks went with the closed loop */
+      _Sequencer_async_reset(self);
+    } else if (self->areading || self->awriting) {
+      Py_DECREF(loop);
+      PyErr_SetString(PyExc_RuntimeError,
+		      "Sequencer is in use by another event loop");
+      return NULL;
+    }
+  }
+  if (self->aloop != loop) {
+    Py_XDECREF(self->aloop);
+    Py_INCREF(loop);
+    self->aloop = loop;
+  }
+  if (self->aref == NULL) {
+    self->aref = PyWeakref_NewRef((PyObject *)self, NULL);
+    if (self->aref == NULL) {
+      Py_DECREF(loop);
+      return NULL;
+    }
+  }
+
+  if (self->areaders == NULL) {
+    self->areaders = PyList_New(0);
+    self->apending = PyList_New(0);
+    self->awriters = PyList_New(0);
+    if (self->areaders == NULL || self->apending == NULL ||
+	self->awriters == NULL) {
+      Py_DECREF(loop);
+      return NULL;
+    }
+  }
+
+  return loop;
+}
+
+/** internal use: call method (add_reader, remove_writer...) of the loop
+    for each descriptor of the given poll events; callback may be NULL */
+static int
+_Sequencer_async_watch(SequencerObject *self,
+		       short events,
+		       const char *method,
+		       PyObject *callback) {
+  struct pollfd pfds[ASYNC_MAX_FDS];
+  PyObject *ret;
+  int count, i;
+
+  count = snd_seq_poll_descriptors(self->handle, pfds, ASYNC_MAX_FDS, events);
+  for (i = 0; i < count; i++) {
+    if (callback != NULL) {
+      ret = PyObject_CallMethod(self->aloop, method, "iO", pfds[i].fd,
+				callback);
+    } else {
+      ret = PyObject_CallMethod(self->aloop, method, "i", pfds[i].fd);
+    }
+    if (ret == NULL) {
+      return -1;
+    }
+    Py_DECREF(ret);
+  }
+  return 0;
+}
+
+/** internal use: check if a future is already done (or cancelled) */
+static int
+_future_done(PyObject *future) {
+  PyObject *ret = PyObject_CallMethod(future, "done", NULL);
+  int done;
+
+  if (ret == NULL) {
+    return -1;
+  }
+  done = PyObject_IsTrue(ret);
+  Py_DECREF(ret);
+  return done;
+}
+
+/** internal use: set the result of a future; steals result */
+static int
+_future_set_result(PyObject *future,
+		   PyObject *result) {
+  PyObject *ret;
+
+  if (result == NULL) {
+    return -1;
+  }
+  ret = PyObject_CallMethod(future, "set_result", "O", result);
+  Py_DECREF(result);
+  if (ret == NULL) {
+    return -1;
+  }
+  Py_DECREF(ret);
+  return 0;
+}
+
+/** internal use: set the current Python error as exception of a
+    future; the error is cleared */
+static int
+_future_set_error(PyObject *future) {
+  PyObject *type, *value, *traceback, *ret;
+
+  PyErr_Fetch(&type, &value, &traceback);
+  PyErr_NormalizeException(&type, &value, &traceback);
+  if (traceback != NULL) {
+    PyException_SetTraceback(value, traceback);
+  }
+  ret = PyObject_CallMethod(future, "set_exception", "O", value);
+  Py_XDECREF(type);
+  Py_XDECREF(value);
+  Py_XDECREF(traceback);
+  if (ret == NULL) {
+    return -1;
+  }
+  Py_DECREF(ret);
+  return 0;
+}
+
+/** internal use: move all the events available without blocking to the
+    pending list; returns 0 or a negative ALSA error */
+static int
+_Sequencer_async_drain(SequencerObject *self) {
+  snd_seq_event_t *event;
+  PyObject *obj;
+  int ret;
+
+  for (;;) {
+    ret = snd_seq_event_input(self->handle, &event);
+    if (ret == -EAGAIN) {
+      return 0;
+    } else if (ret < 0) {
+      return ret;
+    }
+    if (!_seq_filter_match(&self->filter, event)) {
+      continue;
+    }
+    obj = SeqEvent_create(event);
+    if (obj == NULL) {
+      return -ENOMEM;
+    }
+    ret = PyList_Append(self->apending, obj);
+    Py_DECREF(obj);
+    if (ret < 0) {
+      return -ENOMEM;
+    }
+  }
+}
+
+/* input descriptors callback (defined later...) */
+static PyMethodDef Sequencer_aread_def;
+
+/** internal use: deliver the pending events to the waiting futures, in
+    order, and (un)register the input descriptors as needed */
+static int
+_Sequencer_async_serve(SequencerObject *self) {
+  PyObject *callback;
+  int ret;
+
+  while (PyList_GET_SIZE(self->areaders) > 0) {
+    PyObject *item = PyList_GET_ITEM(self->areaders, 0);
+    PyObject *future = PyTuple_GET_ITEM(item, 0);
+    Py_ssize_t maxevents = PyLong_AsSsize_t(PyTuple_GET_ITEM(item, 1));
+    Py_ssize_t count = PyList_GET_SIZE(self->apending);
+
+    ret = _future_done(future);
+    if (ret < 0) {
+      return -1;
+    } else if (ret == 0) {
+      if (count == 0) {
+	break;
+      }
+      if (maxevents == 0) {
+	/* __anext__(): a single event */
+	PyObject *result = PyList_GET_ITEM(self->apending, 0);
+	Py_INCREF(result);
+	ret = _future_set_result(future, result);
+	count = 1;
+      } else {
+	if (count > maxevents) {
+	  count = maxevents;
+	}
+	ret = _future_set_result(future,
+				 PyList_GetSlice(self->apending, 0, count));
+      }
+      if (ret < 0 ||
+	  PyList_SetSlice(self->apending, 0, count, NULL) < 0) {
+	return -1;
+      }
+    }
+    if (PyList_SetSlice(self->areaders, 0, 1, NULL) < 0) {
+      return -1;
+    }
+  }
+
+  if (PyList_GET_SIZE(self->areaders) > 0 && !self->areading) {
+    callback = PyCFunction_New(&Sequencer_aread_def, self->aref);
+    if (callback == NULL) {
+      return -1;
+    }
+    ret = _Sequencer_async_watch(self, POLLIN, "add_reader", callback);
+    Py_DECREF(callback);
+    if (ret < 0) {
+      return -1;
+    }
+    self->areading = 1;
+  } else if (PyList_GET_SIZE(self->areaders) == 0 && self->areading) {
+    self->areading = 0;
+    if (_Sequencer_async_watch(self, POLLIN, "remove_reader", NULL) < 0) {
+      return -1;
+    }
+  }
+  _Sequencer_async_idle(self);
+
+  return 0;
+}
+
+/** internal use: fail all the futures of list with the current error */
+static int
+_Sequencer_async_fail(PyObject *list) {
+  PyObject *type, *value, *traceback;
+  Py_ssize_t i;
+
+  PyErr_Fetch(&type, &value, &traceback);
+  for (i = 0; i < PyList_GET_SIZE(list); i++) {
+    PyObject *future = PyTuple_GET_ITEM(PyList_GET_ITEM(list, i), 0);
+    if (_future_done(future) == 0) {
+      Py_XINCREF(type);
+      Py_XINCREF(value);
+      Py_XINCREF(traceback);
+      PyErr_Restore(type, value, traceback);
+      _future_set_error(future);
+    }
+    PyErr_Clear();
+  }
+  Py_XDECREF(type);
+  Py_XDECREF(value);
+  Py_XDECREF(traceback);
+
+  return PyList_SetSlice(list, 0, PyList_GET_SIZE(list), NULL);
+}
+
+/** internal use: read the input and deliver it; errors are passed to
+    the waiting futures */
+static int
+_Sequencer_async_read(SequencerObject *self) {
+  int ret;
+
+  /* another thread is reading the input with the GIL released */
+  if (self->input_busy) {
+    return _Sequencer_async_serve(self);
+  }
+  ret = _Sequencer_async_drain(self);
+  if (ret < 0) {
+    if (!PyErr_Occurred()) {
+      RAISESND(ret, "Failed to receive events");
+    }
+    if (_Sequencer_async_fail(self->areaders) < 0) {
+      return -1;
+    }
+  }
+  return _Sequencer_async_serve(self);
+}
+
+/** alsaseq.Sequencer input descriptors callback for the asyncio loop */
+static PyObject *
+Sequencer__aread(PyObject *ref,
+		 PyObject *unused) {
+  SequencerObject *self = _Sequencer_async_ref(ref);
+  int ret;
+
+  if (self == NULL) {
+    Py_RETURN_NONE;
+  }
+  ret = _Sequencer_async_read(self);
+  Py_DECREF(self);
+  if (ret < 0) {
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
+static PyMethodDef Sequencer_aread_def = {
+  "_aread", (PyCFunction) Sequencer__aread, METH_NOARGS, NULL
+};
+
+/* output of the waiting events (defined later...) */
+static int _Sequencer_async_write(SequencerObject *self);
+
+/** alsaseq.Sequencer future done callback: a cancelled future is dropped
+    from the waiting lists, releasing the descriptors and the loop when
+    nothing is waiting any more */
+static PyObject *
+Sequencer__adone(PyObject *ref,
+		 PyObject *future) {
+  SequencerObject *self;
+  PyObject *cancelled;
+  int ret;
+
+  cancelled = PyObject_CallMethod(future, "cancelled", NULL);
+  if (cancelled == NULL) {
+    return NULL;
+  }
+  ret = PyObject_IsTrue(cancelled);
+  Py_DECREF(cancelled);
+  if (ret < 0) {
+    return NULL;
+  } else if (ret == 0) {
+    Py_RETURN_NONE;
+  }
+
+  self = _Sequencer_async_ref(ref);
+  if (self == NULL || self->aloop == NULL) {
+    Py_XDECREF(self);
+    Py_RETURN_NONE;
+  }
+  ret = _Sequencer_async_serve(self);
+  if (ret >= 0 && self->aloop != NULL) {
+    ret = _Sequencer_async_write(self);
+  }
+  Py_DECREF(self);
+  if (ret < 0) {
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
+static PyMethodDef Sequencer_adone_def = {
+  "_adone", (PyCFunction) Sequencer__adone, METH_O, NULL
+};
+
+/** internal use: create a future of the loop, watched for cancellation */
+static PyObject *
+_Sequencer_async_future(SequencerObject *self,
+			PyObject *loop) {
+  PyObject *future, *callback, *ret;
+
+  future = PyObject_CallMethod(loop, "create_future", NULL);
+  if (future == NULL) {
+    return NULL;
+  }
+  callback = PyCFunction_New(&Sequencer_adone_def, self->aref);
+  if (callback == NULL) {
+    Py_DECREF(future);
+    return NULL;
+  }
+  ret = PyObject_CallMethod(future, "add_done_callback", "O", callback);
+  Py_DECREF(callback);
+  if (ret == NULL) {
+    Py_DECREF(future);
+    return NULL;
+  }
+  Py_DECREF(ret);
+  return future;
+}
+
+/** internal use: see the declaration above Sequencer_dealloc() */
+static void
+_Sequencer_async_close(SequencerObject *self) {
+  PyObject *type, *value, *traceback, *list, *ret;
+  Py_ssize_t i;
+  int l;
+
+  if (self->aloop == NULL) {
+    return;
+  }
+  PyErr_Fetch(&type, &value, &traceback);
+  if (_Sequencer_async_closed(self) == 0) {
+    if (self->areading) {
+      _Sequencer_async_watch(self, POLLIN, "remove_reader", NULL);
+    }
+    if (self->awriting) {
+      _Sequencer_async_watch(self, POLLOUT, "remove_writer", NULL);
+    }
+    /* nobody can complete them any more */
+    for (l = 0; l < 2; l++) {
+      list = l == 0 ? self->areaders : self->awriters;
+      for (i = 0; i < PyList_GET_SIZE(list); i++) {
+	ret = PyObject_CallMethod(PyTuple_GET_ITEM(PyList_GET_ITEM(list, i), 0),
+				  "cancel", NULL);
+	Py_XDECREF(ret);
+      }
+    }
+  }
+  PyErr_Clear();
+  PyErr_Restore(type, value, traceback);
+  _Sequencer_async_reset(self);
+}
+
+/** internal use: queue a future for maxevents (0 for one event, not in
+    a list) and try to complete it at once */
+static PyObject *
+_Sequencer_areceive(SequencerObject *self,
+		    Py_ssize_t maxevents) {
+  PyObject *loop, *future, *item;
+  int ret;
+
+  if (_Sequencer_check_input(self) < 0) {
+    return NULL;
+  }
+  loop = _Sequencer_async_loop(self);
+  if (loop == NULL) {
+    return NULL;
+  }
+  future = _Sequencer_async_future(self, loop);
+  Py_DECREF(loop);
+  if (future == NULL) {
+    return NULL;
+  }
+
+  item = Py_BuildValue("(On)", future, maxevents);
+  if (item == NULL || PyList_Append(self->areaders, item) < 0) {
+    Py_XDECREF(item);
+    Py_DECREF(future);
+    return NULL;
+  }
+  Py_DECREF(item);
+
+  /* events already read by alsa-lib don't wake up the loop */
+  if (PyList_GET_SIZE(self->apending) == 0 &&
+      snd_seq_event_input_pending(self->handle, 0) > 0) {
+    ret = _Sequencer_async_read(self);
+  } else {
+    ret = _Sequencer_async_serve(self);
+  }
+  if (ret < 0) {
+    Py_DECREF(future);
+    return NULL;
+  }
+
+  return future;
+}
+
+/** alsaseq.Sequencer areceive() method: __doc__ */
+PyDoc_STRVAR(Sequencer_areceive__doc__,
+  "areceive(maxevents = self.receive_maxevents) -> asyncio.Future\n"
+  "\n"
+  "Receive events from an asyncio coroutine:\n"
+  "  events = await seq.areceive()\n"
+  "\n"
+  "The input descriptors are watched by the running event loop\n"
+  "(add_reader) while there are pending calls, and the events are read\n"
+  "in C when they become readable; no helper thread is used. A\n"
+  "Sequencer is also an asynchronous iterator of SeqEvent objects:\n"
+  "  async for event in seq: ...\n"
+  "\n"
+  "The Sequencer must be in SEQ_NONBLOCK mode and used from a single\n"
+  "event loop at a time. Pending calls complete in order.\n"
+  "\n"
+  "Parameters:\n"
+  "  maxevents -- (int) max events to be returned\n"
+  "Returns:\n"
+  "  (asyncio.Future) resolving to a non empty list of SeqEvent objects\n"
+  "Raises:\n"
+  "  RuntimeError: if there is no running event loop\n"
+  "  SequencerError: if the Sequencer is not in SEQ_NONBLOCK mode, or\n"
+  "                  through the future, if ALSA error occurs."
+);
+
+/** alsaseq.Sequencer areceive() method */
+static PyObject *
+Sequencer_areceive(SequencerObject *self,
+		   PyObject *args,
+		   PyObject *kwds) {
+  int maxevents = self->receive_max_events;
+  char *kwlist[] = {"maxevents", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist, &maxevents)) {
+    return NULL;
+  }
+  if (maxevents <= 0) {
+    PyErr_SetString(PyExc_ValueError, "maxevents must be > 0");
+    return NULL;
+  }
+
+  return _Sequencer_areceive(self, maxevents);
+}
+
+/** alsaseq.Sequencer tp_as_async am_aiter */
+static PyObject *
+Sequencer_aiter(SequencerObject *self) {
+  Py_INCREF(self);
+  return (PyObject *)self;
+}
+
+/** alsaseq.Sequencer tp_as_async am_anext */
+static PyObject *
+Sequencer_anext(SequencerObject *self) {
+  return _Sequencer_areceive(self, 0);
+}
+
+/** alsaseq.Sequencer tp_as_async */
+static PyAsyncMethods Sequencer_as_async = {
+  am_aiter: (unaryfunc) Sequencer_aiter,
+  am_anext: (unaryfunc) Sequencer_anext,
+};
+
+/* output descriptors callback (defined later...) */
+static PyMethodDef Sequencer_awrite_def;
+
+/** internal use: output the waiting events and drains, in order, and
+    (un)register the output descriptors as needed */
+static int
+_Sequencer_async_write(SequencerObject *self) {
+  PyObject *callback;
+  int ret;
+
+  while (PyList_GET_SIZE(self->awriters) > 0) {
+    PyObject *item = PyList_GET_ITEM(self->awriters, 0);
+    PyObject *future = PyTuple_GET_ITEM(item, 0);
+    PyObject *event = PyTuple_GET_ITEM(item, 1);
+
+    ret = _future_done(future);
+    if (ret < 0) {
+      return -1;
+    } else if (ret == 0) {
+      /* another thread is outputting: retry on the next POLLOUT */
+      if (self->output_busy) {
+	break;
+      }
+      if (event == Py_None) {
+	ret = snd_seq_drain_output(self->handle);
+      } else {
+	ret = snd_seq_event_output(self->handle,
+				   ((SeqEventObject *)event)->event);
+	if (ret > 0) {
+	  ret = 0;
+	}
+      }
+      /* no room in the kernel pool: wait for POLLOUT */
+      if (ret > 0 || ret == -EAGAIN) {
+	break;
+      }
+      if (ret < 0) {
+	RAISESND(ret, event == Py_None ? "Failed to drain output" :
+		 "Failed to output event");
+	ret = _future_set_error(future);
+      } else {
+	Py_INCREF(Py_None);
+	ret = _future_set_result(future, Py_None);
+      }
+      if (ret < 0) {
+	return -1;
+      }
+    }
+    if (PyList_SetSlice(self->awriters, 0, 1, NULL) < 0) {
+      return -1;
+    }
+  }
+
+  if (PyList_GET_SIZE(self->awriters) > 0 && !self->awriting) {
+    callback = PyCFunction_New(&Sequencer_awrite_def, self->aref);
+    if (callback == NULL) {
+      return -1;
+    }
+    ret = _Sequencer_async_watch(self, POLLOUT, "add_writer", callback);
+    Py_DECREF(callback);
+    if (ret < 0) {
+      return -1;
+    }
+    self->awriting = 1;
+  } else if (PyList_GET_SIZE(self->awriters) == 0 && self->awriting) {
+    self->awriting = 0;
+    if (_Sequencer_async_watch(self, POLLOUT, "remove_writer", NULL) < 0) {
+      return -1;
+    }
+  }
+  _Sequencer_async_idle(self);
+
+  return 0;
+}
+
+/** alsaseq.Sequencer output descriptors callback for the asyncio loop */
+static PyObject *
+Sequencer__awrite(PyObject *ref,
+		  PyObject *unused) {
+  SequencerObject *self = _Sequencer_async_ref(ref);
+  int ret;
+
+  if (self == NULL) {
+    Py_RETURN_NONE;
+  }
+  /* push what alsa-lib holds to the kernel before the next event */
+  ret = self->output_busy ? 0 : snd_seq_drain_output(self->handle);
+  if (ret < 0 && ret != -EAGAIN) {
+    RAISESND(ret, "Failed to drain output");
+    ret = _Sequencer_async_fail(self->awriters);
+  } else {
+    ret = 0;
+  }
+  if (ret >= 0) {
+    ret = _Sequencer_async_write(self);
+  }
+  Py_DECREF(self);
+  if (ret < 0) {
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
+static PyMethodDef Sequencer_awrite_def = {
+  "_awrite", (PyCFunction) Sequencer__awrite, METH_NOARGS, NULL
+};
+
+/** internal use: queue a future for outputting event (None for a drain)
+    and try to complete it at once */
+static PyObject *
+_Sequencer_aoutput(SequencerObject *self,
+		   PyObject *event) {
+  PyObject *loop, *future, *item;
+
+  if (!(self->streams & SND_SEQ_OPEN_OUTPUT)) {
+    RAISESTR("Sequencer has no output stream");
+    return NULL;
+  }
+
+  loop = _Sequencer_async_loop(self);
+  if (loop == NULL) {
+    return NULL;
+  }
+  future = _Sequencer_async_future(self, loop);
+  Py_DECREF(loop);
+  if (future == NULL) {
+    return NULL;
+  }
+
+  item = PyTuple_Pack(2, future, event);
+  if (item == NULL || PyList_Append(self->awriters, item) < 0) {
+    Py_XDECREF(item);
+    Py_DECREF(future);
+    return NULL;
+  }
+  Py_DECREF(item);
+
+  if (_Sequencer_async_write(self) < 0) {
+    Py_DECREF(future);
+    return NULL;
+  }
+
+  return future;
+}
+
+/** alsaseq.Sequencer aoutput_event() method: __doc__ */
+PyDoc_STRVAR(Sequencer_aoutput_event__doc__,
+  "aoutput_event(event) -> asyncio.Future\n"
+  "\n"
+  "Put the given event in the output buffer from an asyncio coroutine:\n"
+  "  await seq.aoutput_event(event)\n"
+  "\n"
+  "When the kernel pool is full, the output descriptors are watched by\n"
+  "the running event loop (add_writer) and the event is put when there\n"
+  "is room again, instead of failing with EAGAIN. The event must not be\n"
+  "changed until the future is done. Like output_event(), use\n"
+  "adrain_output() to make sure it's sent.\n"
+  "\n"
+  "The Sequencer must be in SEQ_NONBLOCK mode and used from a single\n"
+  "event loop at a time. Pending calls complete in order.\n"
+  "\n"
+  "Parameters:\n"
+  "  event -- a SeqEvent object\n"
+  "Returns:\n"
+  "  (asyncio.Future) resolving to None\n"
+  "Raises:\n"
+  "  RuntimeError: if there is no running event loop\n"
+  "  SequencerError: if the Sequencer is not in SEQ_NONBLOCK mode, or\n"
+  "                  through the future, if ALSA error occurs."
+);
+
+/** alsaseq.Sequencer aoutput_event() method */
+static PyObject *
+Sequencer_aoutput_event(SequencerObject *self,
+			PyObject *args,
+			PyObject *kwds) {
+  PyObject *event;
+  char *kwlist[] = {"event", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist, &event)) {
+    return NULL;
+  }
+  if (!PyObject_TypeCheck(event, &SeqEventType)) {
+    PyErr_SetString(PyExc_TypeError, "alsaseq.SeqEvent expected");
+    return NULL;
+  }
+
+  return _Sequencer_aoutput(self, event);
+}
+
+/** alsaseq.Sequencer adrain_output() method: __doc__ */
+PyDoc_STRVAR(Sequencer_adrain_output__doc__,
+  "adrain_output() -> asyncio.Future\n"
+  "\n"
+  "Drain the output from an asyncio coroutine:\n"
+  "  await seq.adrain_output()\n"
+  "\n"
+  "Like drain_output(), but waits for room in the kernel pool with the\n"
+  "running event loop (add_writer) instead of failing with EAGAIN; the\n"
+  "future is done when the output buffer is empty.\n"
+  "\n"
+  "Returns:\n"
+  "  (asyncio.Future) resolving to None\n"
+  "Raises:\n"
+  "  RuntimeError: if there is no running event loop\n"
+  "  SequencerError: if the Sequencer is not in SEQ_NONBLOCK mode, or\n"
+  "                  through the future, if ALSA error occurs."
+);
+
+/** alsaseq.Sequencer adrain_output() method */
+static PyObject *
+Sequencer_adrain_output(SequencerObject *self,
+			PyObject *args) {
+  return _Sequencer_aoutput(self, Py_None);
+}
+
+#endif /* PY_VERSION_HEX >= 0x03070000 */
+
+/** alsaseq.Sequencer tp_methods */
+static PyMethodDef Sequencer_methods[] = {
+  {"create_simple_port",
+   (PyCFunction) Sequencer_create_simple_port,
+   METH_VARARGS | METH_KEYWORDS,
+   Sequencer_create_simple_port__doc__ },
+  {"create_ports",
+   (PyCFunction) Sequencer_create_ports,
+   METH_VARARGS,
+   Sequencer_create_ports__doc__},
+  {"connection_list",
+   (PyCFunction) Sequencer_connection_list,
+   METH_VARARGS,
+   Sequencer_connection_list__doc__ },
+  {"get_client_info",
+   (PyCFunction) Sequencer_get_client_info,
+   METH_VARARGS | METH_KEYWORDS,
+   Sequencer_get_client_info__doc__ },
+  {"get_port_info",
+   (PyCFunction) Sequencer_get_port_info,
+   METH_VARARGS | METH_KEYWORDS,
+   Sequencer_get_port_info__doc__ },
+  {"connect_ports",
+   (PyCFunction) Sequencer_connect_ports,
+   METH_VARARGS,
+   Sequencer_connect_ports__doc__ },
+  {"disconnect_ports",
+   (PyCFunction) Sequencer_disconnect_ports,
+   METH_VARARGS,
+   Sequencer_disconnect_ports__doc__ },
+  {"apply_subscriptions",
+   (PyCFunction) Sequencer_apply_subscriptions,
+   METH_VARARGS | METH_KEYWORDS,
+   Sequencer_apply_subscriptions__doc__ },
+  {"get_connect_info",
+   (PyCFunction) Sequencer_get_connect_info,
+   METH_VARARGS,
+   Sequencer_get_connect_info__doc__},
+  {"receive_events",
+   (PyCFunction) Sequencer_receive_events,
+   METH_VARARGS | METH_KEYWORDS,
+   Sequencer_receive_events__doc__},
+  {"poll_stats",
+   (PyCFunction) Sequencer_poll_stats,
+   METH_VARARGS | METH_KEYWORDS,
+   Sequencer_poll_stats__doc__},
+  {"receive_into",
+   (PyCFunction) Sequencer_receive_into,
+   METH_VARARGS | METH_KEYWORDS,
+   Sequencer_receive_into__doc__},
+  {"receive_records",
+   (PyCFunction) Sequencer_receive_records,
+   METH_VARARGS | METH_KEYWORDS,
+   Sequencer_receive_records__doc__},
+  {"output_event",
+   (PyCFunction) Sequencer_output_event,
+   METH_VARARGS | METH_KEYWORDS,
+   Sequencer_output_event__doc__},
+  {"output_events",
+   (PyCFunction) Sequencer_output_events,
+   METH_VARARGS | METH_KEYWORDS,
+   Sequencer_output_events__doc__},
+#if SND_LIB_VERSION >= 0x01020a
+  {"set_midi_version",
+   (PyCFunction) Sequencer_set_midi_version,
+   METH_VARARGS,
+   Sequencer_set_midi_version__doc__},
+  {"output_ump",
+   (PyCFunction) Sequencer_output_ump,
+   METH_VARARGS | METH_KEYWORDS,
+   Sequencer_output_ump__doc__},
+  {"receive_ump",
+   (PyCFunction) Sequencer_receive_ump,
+   METH_VARARGS | METH_KEYWORDS,
+   Sequencer_receive_ump__doc__},
+#endif
+  {"pool_status",
+   (PyCFunction) Sequencer_pool_status,
+   METH_NOARGS,
+   Sequencer_pool_status__doc__},
+  {"drain_output",
+   (PyCFunction) Sequencer_drain_output,
+   METH_VARARGS,
+   Sequencer_drain_output__doc__},
+  {"sync_output_queue",
+   (PyCFunction) Sequencer_sync_output_queue,
+   METH_VARARGS,
+   Sequencer_sync_output_queue__doc__},
+  {"parse_address",
+   (PyCFunction) Sequencer_parse_address,
+   METH_VARARGS,
+   Sequencer_parse_address__doc__},
+  {"create_queue",
+   (PyCFunction) Sequencer_create_queue,
+   METH_VARARGS | METH_KEYWORDS,
+   Sequencer_create_queue__doc__},
+  {"delete_queue",
+   (PyCFunction) Sequencer_delete_queue,
+   METH_VARARGS | METH_KEYWORDS,
+   Sequencer_delete_queue__doc__},
+  {"queue_tempo",
+   (PyCFunction) Sequencer_queue_tempo,
+   METH_VARARGS | METH_KEYWORDS,
+   Sequencer_queue_tempo__doc__},
+  {"start_queue",
+   (PyCFunction) Sequencer_start_queue,
+   METH_VARARGS | METH_KEYWORDS,
+   Sequencer_start_queue__doc__},
+  {"stop_queue",
+   (PyCFunction) Sequencer_stop_queue,
+   METH_VARARGS | METH_KEYWORDS,
+   Sequencer_stop_queue__doc__},
+  {"queue_skew",
+   (PyCFunction) Sequencer_queue_skew,
+   METH_VARARGS | METH_KEYWORDS,
+   Sequencer_queue_skew__doc__},
+  {"queue_timer",
+   (PyCFunction) Sequencer_queue_timer,
+   METH_VARARGS | METH_KEYWORDS,
+   Sequencer_queue_timer__doc__},
+  {"start_dispatch",
+   (PyCFunction) Sequencer_start_dispatch,
+   METH_VARARGS | METH_KEYWORDS,
+   Sequencer_start_dispatch__doc__},
+  {"stop_dispatch",
+   (PyCFunction) Sequencer_stop_dispatch,
+   METH_NOARGS,
+   Sequencer_stop_dispatch__doc__},
+  {"dispatch_stats",
+   (PyCFunction) Sequencer_dispatch_stats,
+   METH_NOARGS,
+   Sequencer_dispatch_stats__doc__},
+  {"set_event_filter",
+   (PyCFunction) Sequencer_set_event_filter,
+   METH_VARARGS,
+   Sequencer_set_event_filter__doc__},
+  {"clear_event_filter",
+   (PyCFunction) Sequencer_clear_event_filter,
+   METH_NOARGS,
+   Sequencer_clear_event_filter__doc__},
+  {"set_receive_filter",
+   (PyCFunction) Sequencer_set_receive_filter,
+   METH_VARARGS | METH_KEYWORDS,
+   Sequencer_set_receive_filter__doc__},
+  {"clear_receive_filter",
+   (PyCFunction) Sequencer_clear_receive_filter,
+   METH_NOARGS,
+   Sequencer_clear_receive_filter__doc__},
+  {"get_receive_filter",
+   (PyCFunction) Sequencer_get_receive_filter,
+   METH_NOARGS,
+   Sequencer_get_receive_filter__doc__},
+#if PY_VERSION_HEX >= 0x03070000
+  {"areceive",
+   (PyCFunction) Sequencer_areceive,
+   METH_VARARGS | METH_KEYWORDS,
+   Sequencer_areceive__doc__},
+  {"aoutput_event",
+   (PyCFunction) Sequencer_aoutput_event,
+   METH_VARARGS | METH_KEYWORDS,
+   Sequencer_aoutput_event__doc__},
+  {"adrain_output",
+   (PyCFunction) Sequencer_adrain_output,
+   METH_NOARGS,
+   Sequencer_adrain_output__doc__},
+#endif
+  {"register_poll",
+   (PyCFunction) Sequencer_registerpoll,
+   METH_VARARGS | METH_KEYWORDS,
+   Sequencer_registerpoll__doc__},
+  {NULL}
+};
+
+/** alsaseq.Sequencer type */
+static PyTypeObject SequencerType = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  tp_name: "alsaseq.Sequencer",
+  tp_basicsize: sizeof(SequencerObject),
+  tp_dealloc: (destructor) Sequencer_dealloc,
+  tp_flags: Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+  tp_doc: Sequencer__doc__,
+  tp_init: (initproc) Sequencer_init,
+  tp_new: PyType_GenericNew,
+  tp_alloc: PyType_GenericAlloc,
+  tp_free: PyObject_Del,
+  tp_repr: (reprfunc) Sequencer_repr,
+  tp_methods: Sequencer_methods,
+  tp_getset: Sequencer_getset,
+  tp_weaklistoffset: offsetof(SequencerObject, weakreflist),
+#if PY_VERSION_HEX >= 0x03070000
+  tp_as_async: &Sequencer_as_async,
+#endif
+};
+
+
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// alsaseq.SmfPlayer implementation
+//////////////////////////////////////////////////////////////////////////////
+
+/** packed event of a Standard MIDI File */
+typedef struct {
+  unsigned int tick;
+  /* SND_SEQ_EVENT_* */
+  unsigned char type;
+  /* value of the last MIDI port meta event of the track */
+  unsigned char port;
+  /* MIDI channel; for SYSEX, 1 if a 0xf0 byte must be prepended */
+  unsigned char channel;
+  /* note or controller number */
+  unsigned char param;
+  /* velocity, value, tempo or SYSEX length (including the 0xf0) */
+  int value;
+  /* SYSEX: offset of the data in the file */
+  unsigned int offset;
+} smf_event_t;
+
+/** reading position in one track of a Standard MIDI File */
+typedef struct {
+  const unsigned char *pos;
+  const unsigned char *end;
+  unsigned int tick;
+  /* running status */
+  unsigned char running;
+  unsigned char port;
+  /* track number; events at the same tick are ordered by track */
+  int index;
+  /* next event of the track, valid until done */
+  smf_event_t next;
+  int done;
+} smf_cursor_t;
+
+/** k-way merge of the tracks of a Standard MIDI File, in tick order */
+typedef struct {
+  const unsigned char *data;
+  int smpte;
+  smf_cursor_t *cursors;
+  /* min-heap of the cursors with events, by (tick, index) */
+  int *heap;
+  int count;
+  /* highest end of track tick seen */
+  unsigned int end_tick;
+  /* parse error: message and file position */
+  const char *error;
+  size_t error_pos;
+} smf_merge_t;
+
+/** internal use: read a variable-length number; returns -1 on error */
+static int
+_smf_read_var(const unsigned char **pos,
+	      const unsigned char *end,
+	      unsigned int *value) {
+  unsigned int v = 0;
+  int i;
+
+  for (i = 0; i < 4; i++) {
+    if (*pos >= end) {
+      return -1;
+    }
+    v = (v << 7) | (**pos & 0x7f);
+    if (!(*(*pos)++ & 0x80)) {
+      *value = v;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/** internal use: decode the next event of a track into c->next; sets
+    c->done at the end of the track; returns -1 on invalid data */
+static int
+_smf_cursor_advance(smf_merge_t *m,
+		    smf_cursor_t *c) {
+  smf_event_t *ev = &(c->next);
+  unsigned int delta, len;
+  unsigned char cmd, meta;
+
+  for (;;) {
+    /* a missing end of track event ends the track too */
+    if (c->pos >= c->end) {
+      break;
+    }
+    if (_smf_read_var(&(c->pos), c->end, &delta) < 0 || c->pos >= c->end) {
+      goto __error;
+    }
+    c->tick += delta;
+
+    cmd = *c->pos;
+    if (cmd & 0x80) {
+      c->pos++;
+      /* sysex and meta events cancel the running status */
+      c->running = cmd < 0xf0 ? cmd : 0;
+    } else if (c->running) {
+      cmd = c->running;
+    } else {
+      goto __error;
+    }
+
+    memset(ev, 0, sizeof(*ev));
+    ev->tick = c->tick;
+    ev->port = c->port;
+    ev->channel = cmd & 0x0f;
+
+    switch (cmd >> 4) {
+    case 0x8:
+    case 0x9:
+    case 0xa:
+    case 0xb:
+    case 0xe:
+      if (c->end - c->pos < 2) {
+	goto __error;
+      }
+      ev->param = c->pos[0] & 0x7f;
+      ev->value = c->pos[1] & 0x7f;
+      switch (cmd >> 4) {
+      case 0x8: ev->type = SND_SEQ_EVENT_NOTEOFF; break;
+      case 0x9: ev->type = SND_SEQ_EVENT_NOTEON; break;
+      case 0xa: ev->type = SND_SEQ_EVENT_KEYPRESS; break;
+      case 0xb: ev->type = SND_SEQ_EVENT_CONTROLLER; break;
+      case 0xe:
+	ev->type = SND_SEQ_EVENT_PITCHBEND;
+	ev->value = (ev->param | (ev->value << 7)) - 0x2000;
+	ev->param = 0;
+	break;
+      }
+      c->pos += 2;
+      return 0;
+
+    case 0xc:
+    case 0xd:
+      if (c->end - c->pos < 1) {
+	goto __error;
+      }
+      ev->type = (cmd >> 4) == 0xc ? SND_SEQ_EVENT_PGMCHANGE :
+	SND_SEQ_EVENT_CHANPRESS;
+      ev->value = c->pos[0] & 0x7f;
+      c->pos += 1;
+      return 0;
+
+    default:
+      if (cmd == 0xf0 || cmd == 0xf7) {
+	if (_smf_read_var(&(c->pos), c->end, &len) < 0 ||
+	    (size_t)(c->end - c->pos) < len) {
+	  goto __error;
+	}
+	ev->type = SND_SEQ_EVENT_SYSEX;
+	ev->channel = cmd == 0xf0;
+	ev->value = len + ev->channel;
+	ev->offset = c->pos - m->data;
+	c->pos += len;
+	return 0;
+      } else if (cmd == 0xff) {
+	if (c->pos >= c->end) {
+	  goto __error;
+	}
+	meta = *c->pos++;
+	if (_smf_read_var(&(c->pos), c->end, &len) < 0 ||
+	    (size_t)(c->end - c->pos) < len) {
+	  goto __error;
+	}
+	if (meta == 0x21 && len >= 1) {
+	  /* port number */
+	  c->port = c->pos[0];
+	} else if (meta == 0x2f) {
+	  /* end of track */
+	  c->pos = c->end;
+	  break;
+	} else if (meta == 0x51 && len >= 3 && !m->smpte) {
+	  /* tempo */
+	  ev->type = SND_SEQ_EVENT_TEMPO;
+	  ev->channel = 0;
+	  ev->value = (c->pos[0] << 16) | (c->pos[1] << 8) | c->pos[2];
+	  c->pos += len;
+	  return 0;
+	}
+	/* other meta events are ignored */
+	c->pos += len;
+	continue;
+      }
+      goto __error;
+    }
+    break;
+  }
+
+  c->done = 1;
+  if (c->tick > m->end_tick) {
+    m->end_tick = c->tick;
+  }
+  return 0;
+
+ __error:
+  m->error = "Invalid MIDI data";
+  m->error_pos = c->pos - m->data;
+  return -1;
+}
+
+/** internal use: compare the next events of two cursors */
+static int
+_smf_merge_less(smf_merge_t *m,
+		int a,
+		int b) {
+  smf_cursor_t *ca = &(m->cursors[a]);
+  smf_cursor_t *cb = &(m->cursors[b]);
+
+  if (ca->next.tick != cb->next.tick) {
+    return ca->next.tick < cb->next.tick;
+  }
+  return ca->index < cb->index;
+}
+
+/** internal use: restore the heap order from position i down */
+static void
+_smf_merge_sift_down(smf_merge_t *m,
+		     int i) {
+  int child, tmp;
+
+  for (;;) {
+    child = 2 * i + 1;
+    if (child >= m->count) {
+      return;
+    }
+    if (child + 1 < m->count &&
+	_smf_merge_less(m, m->heap[child + 1], m->heap[child])) {
+      child++;
+    }
+    if (!_smf_merge_less(m, m->heap[child], m->heap[i])) {
+      return;
+    }
+    tmp = m->heap[i];
+    m->heap[i] = m->heap[child];
+    m->heap[child] = tmp;
+    i = child;
+  }
+}
+
+/** internal use: free the merge state */
+static void
+_smf_merge_free(smf_merge_t *m) {
+  FREECHECKED("cursors", m->cursors);
+  FREECHECKED("heap", m->heap);
+  m->count = 0;
+}
+
+/** internal use: prepare the merge of the given tracks (offset and
+    length pairs in data); returns -1 with m->error set on failure */
+static int
+_smf_merge_init(smf_merge_t *m,
+		const unsigned char *data,
+		const size_t (*tracks)[2],
+		int ntracks,
+		int smpte) {
+  int i;
+
+  memset(m, 0, sizeof(*m));
+  m->data = data;
+  m->smpte = smpte;
+  m->cursors = calloc(ntracks, sizeof(smf_cursor_t));
+  m->heap = calloc(ntracks, sizeof(int));
+  if (m->cursors == NULL || m->heap == NULL) {
+    _smf_merge_free(m);
+    m->error = "Out of memory";
+    return -1;
+  }
+
+  for (i = 0; i < ntracks; i++) {
+    smf_cursor_t *c = &(m->cursors[i]);
+    c->pos = data + tracks[i][0];
+    c->end = c->pos + tracks[i][1];
+    c->index = i;
+    if (_smf_cursor_advance(m, c) < 0) {
+      _smf_merge_free(m);
+      return -1;
+    }
+    if (!c->done) {
+      m->heap[m->count++] = i;
+    }
+  }
+  for (i = m->count / 2 - 1; i >= 0; i--) {
+    _smf_merge_sift_down(m, i);
+  }
+
+  return 0;
+}
+
+/** internal use: get the next event of the song; returns 1, 0 at the
+    end of the song, or -1 with m->error set */
+static int
+_smf_merge_next(smf_merge_t *m,
+		smf_event_t *ev) {
+  smf_cursor_t *c;
+
+  if (m->count == 0) {
+    return 0;
+  }
+
+  c = &(m->cursors[m->heap[0]]);
+  *ev = c->next;
+  if (_smf_cursor_advance(m, c) < 0) {
+    return -1;
+  }
+  if (c->done) {
+    m->heap[0] = m->heap[--m->count];
+  }
+  _smf_merge_sift_down(m, 0);
+
+  return 1;
+}
+
+/** internal use: build the sequencer event of a packed event; scratch
+    must have room for the longest SYSEX */
+static void
+_smf_event_to_seq(const smf_event_t *e,
+		  snd_seq_event_t *ev,
+		  const unsigned char *data,
+		  unsigned char *scratch,
+		  int queue,
+		  int source_port,
+		  const snd_seq_addr_t *ports,
+		  int nports) {
+  snd_seq_ev_clear(ev);
+  snd_seq_ev_set_source(ev, source_port);
+  snd_seq_ev_schedule_tick(ev, queue, 0, e->tick);
+  ev->type = e->type;
+  ev->dest = ports[e->port % nports];
+
+  switch (e->type) {
+  case SND_SEQ_EVENT_NOTEON:
+  case SND_SEQ_EVENT_NOTEOFF:
+  case SND_SEQ_EVENT_KEYPRESS:
+    ev->data.note.channel = e->channel;
+    ev->data.note.note = e->param;
+    ev->data.note.velocity = e->value;
+    break;
+  case SND_SEQ_EVENT_SYSEX:
+    if (e->channel) {
+      scratch[0] = 0xf0;
+      memcpy(scratch + 1, data + e->offset, e->value - 1);
+      snd_seq_ev_set_sysex(ev, e->value, scratch);
+    } else {
+      snd_seq_ev_set_sysex(ev, e->value, (void *)(data + e->offset));
+    }
+    break;
+  case SND_SEQ_EVENT_TEMPO:
+    ev->dest.client = SND_SEQ_CLIENT_SYSTEM;
+    ev->dest.port = SND_SEQ_PORT_SYSTEM_TIMER;
+    ev->data.queue.queue = queue;
+    ev->data.queue.param.value = e->value;
+    break;
+  default:
+    ev->data.control.channel = e->channel;
+    ev->data.control.param = e->param;
+    ev->data.control.value = e->value;
+    break;
+  }
+}
+
+/** contents of an input file: mapped in memory (map_size > 0) or the
+    buffer of a bytes-like object */
+typedef struct {
+  const unsigned char *data;
+  size_t size;
+  size_t map_size;
+  Py_buffer view;
+} seq_file_t;
+
+/** internal use: map the file at path in memory; advice is given to
+    madvise() */
+static int
+_seq_file_map(seq_file_t *f,
+	      const char *path,
+	      int advice) {
+  struct stat st;
+  void *data;
+  int fd;
+
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+    return -1;
+  }
+  if (fstat(fd, &st) < 0) {
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+    close(fd);
+    return -1;
+  }
+  if (st.st_size == 0) {
+    /* nothing to map; the callers check the size */
+    close(fd);
+    return 0;
+  }
+  data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+    return -1;
+  }
+  madvise(data, st.st_size, advice);
+
+  f->data = data;
+  f->size = st.st_size;
+  f->map_size = st.st_size;
+  return 0;
+}
+
+/** internal use: get the contents of file, a path (str or os.PathLike)
+    or a bytes-like object */
+static int
+_seq_file_load(seq_file_t *f,
+	       PyObject *file,
+	       int advice) {
+  PyObject *path;
+  int ret;
+
+  memset(f, 0, sizeof(*f));
+  if (PyUnicode_Check(file) || PyObject_HasAttrString(file, "__fspath__")) {
+    if (!PyUnicode_FSConverter(file, &path)) {
+      return -1;
+    }
+    ret = _seq_file_map(f, PyBytes_AS_STRING(path), advice);
+    Py_DECREF(path);
+    return ret;
+  }
+
+  if (PyObject_GetBuffer(file, &(f->view), PyBUF_SIMPLE) < 0) {
+    return -1;
+  }
+  f->data = f->view.buf;
+  f->size = f->view.len;
+  return 0;
+}
+
+/** internal use: release the contents of a file */
+static void
+_seq_file_release(seq_file_t *f) {
+  if (f->map_size > 0) {
+    munmap((void *)f->data, f->map_size);
+  } else if (f->view.obj != NULL) {
+    PyBuffer_Release(&(f->view));
+  }
+  memset(f, 0, sizeof(*f));
+}
+
+/* max tracks of a Standard MIDI File */
+#define SMF_MAX_TRACKS 1000
+
+/** alsaseq.SmfPlayer __doc__ */
+PyDoc_STRVAR(SmfPlayer__doc__,
+  "SmfPlayer(file, preload=True) -> SmfPlayer object\n"
+  "\n"
+  "Loads a Standard MIDI File (type 0 or 1, or RIFF RMID) for playing\n"
+  "it with a Sequencer. The file is a path (the file is mapped in\n"
+  "memory) or a bytes-like object with the contents of the file.\n"
+  "\n"
+  "The tracks are parsed and merged in tick order in C into a packed\n"
+  "array of 16 bytes per event; no Python object is created per event.\n"
+  "The alsaseq.load_smf() function is an alias.\n"
+  "\n"
+  "With preload=False only the header is read; the tracks are parsed\n"
+  "while playing with stream(), len() is not available and end_tick is\n"
+  "only known after a complete stream().\n"
+  "\n"
+  "The attributes are:\n"
+  "format -- SMF format (0 or 1)\n"
+  "tracks -- number of tracks\n"
+  "ppq -- ticks per quarter note, for Sequencer.queue_tempo()\n"
+  "tempo -- initial tempo (microseconds per quarter note)\n"
+  "smpte -- True if the file uses SMPTE timing\n"
+  "end_tick -- tick of the end of the song\n"
+  "len(player) -- number of events\n"
+  "\n"
+  "Raises:\n"
+  "  ValueError: if the file is not a valid Standard MIDI File\n"
+  "  OSError: if the file can't be read\n"
+  "  RuntimeError: on re-initialization while play() or stream() runs\n"
+  "                in another thread."
+);
+
+/** alsaseq.SmfPlayer object structure type */
+typedef struct {
+  PyObject_HEAD
+  ;
+
+  /* contents of the file */
+  seq_file_t file;
+
+  /* header */
+  int format;
+  int ntracks;
+  int ppq;
+  int tempo;
+  int smpte;
+  /* offset and length of each track in data */
+  size_t (*tracks)[2];
+
+  /* packed events, in tick order */
+  smf_event_t *events;
+  size_t count;
+  unsigned int end_tick;
+  /* longest SYSEX */
+  size_t max_sysex;
+  /* the events are parsed into the packed array */
+  int preload;
+  /* number of play()/stream() calls reading the file and the events
+     with the GIL released */
+  int in_use;
+} SmfPlayerObject;
+
+/** alsaseq.SmfPlayer type (initialized later...) */
+static PyTypeObject SmfPlayerType;
+
+/** internal use: read a big-endian number */
+static unsigned int
+_smf_read_int(const unsigned char *p,
+	      int bytes) {
+  unsigned int value = 0;
+
+  while (bytes-- > 0) {
+    value = (value << 8) | *p++;
+  }
+  return value;
+}
+
+/** internal use: parse the header and locate the tracks */
+static int
+_SmfPlayer_parse_header(SmfPlayerObject *self) {
+  const unsigned char *p = self->file.data;
+  const unsigned char *end = self->file.data + self->file.size;
+  unsigned int len, division;
+  int i;
+
+  /* RIFF MIDI: the SMF is in the 'data' chunk */
+  if (end - p >= 12 && !memcmp(p, "RIFF", 4) && !memcmp(p + 8, "RMID", 4)) {
+    p += 12;
+    for (;;) {
+      if (end - p < 8) {
+	goto __invalid;
+      }
+      len = p[4] | (p[5] << 8) | (p[6] << 16) | ((unsigned int)p[7] << 24);
+      p += 8;
+      if ((size_t)(end - p) < len) {
+	goto __invalid;
+      }
+      if (!memcmp(p - 8, "data", 4)) {
+	end = p + len;
+	break;
+      }
+      p += (len + 1) & ~1;
+    }
+  }
+
+  if (end - p < 14 || memcmp(p, "MThd", 4)) {
+    PyErr_SetString(PyExc_ValueError, "Not a Standard MIDI File");
+    return -1;
+  }
+  len = _smf_read_int(p + 4, 4);
+  if (len < 6 || (size_t)(end - p - 8) < len) {
+    goto __invalid;
+  }
+  self->format = _smf_read_int(p + 8, 2);
+  if (self->format != 0 && self->format != 1) {
+    PyErr_Format(PyExc_ValueError, "Not supported SMF type: %d",
+		 self->format);
+    return -1;
+  }
+  self->ntracks = _smf_read_int(p + 10, 2);
+  if (self->ntracks < 1 || self->ntracks > SMF_MAX_TRACKS) {
+    PyErr_Format(PyExc_ValueError, "Invalid number of tracks: %d",
+		 self->ntracks);
+    return -1;
+  }
+  division = _smf_read_int(p + 12, 2);
+  p += 8 + len;
+
+  self->smpte = division & 0x8000 ? 1 : 0;
+  if (!self->smpte) {
+    /* time division is ticks per quarter */
+    self->tempo = 500000;
+    self->ppq = division;
+  } else {
+    int fps = 0x80 - ((division >> 8) & 0x7f);
+    division &= 0xff;
+    switch (fps) {
+    case 24:
+      self->tempo = 500000;
+      self->ppq = 12 * division;
+      break;
+    case 25:
+      self->tempo = 400000;
+      self->ppq = 10 * division;
+      break;
+    case 29:
+      /* 30 drop-frame */
+      self->tempo = 100000000;
+      self->ppq = 2997 * division;
+      break;
+    case 30:
+      self->tempo = 500000;
+      self->ppq = 15 * division;
+      break;
+    default:
+      PyErr_Format(PyExc_ValueError,
+		   "Invalid number of SMPTE frames per second (%d)", fps);
+      return -1;
+    }
+  }
+
+  self->tracks = calloc(self->ntracks, sizeof(*self->tracks));
+  if (self->tracks == NULL) {
+    PyErr_NoMemory();
+    return -1;
+  }
+  for (i = 0; i < self->ntracks; i++) {
+    /* search for the MTrk chunk */
+    for (;;) {
+      if (end - p < 8) {
+	goto __invalid;
+      }
+      len = _smf_read_int(p + 4, 4);
+      if (len >= 0x10000000) {
+	PyErr_Format(PyExc_ValueError, "Invalid chunk length %u", len);
+	return -1;
+      }
+      p += 8;
+      /* a truncated last track is played up to the end of file */
+      if ((size_t)(end - p) < len) {
+	len = end - p;
+      }
+      if (!memcmp(p - 8, "MTrk", 4)) {
+	break;
+      }
+      p += len;
+    }
+    self->tracks[i][0] = p - self->file.data;
+    self->tracks[i][1] = len;
+    p += len;
+  }
+
+  return 0;
+
+ __invalid:
+  PyErr_Format(PyExc_ValueError, "Invalid MIDI file at position %zu",
+	       (size_t)(p - self->file.data));
+  return -1;
+}
+
+/** internal use: raise the parse error of a merge */
+static void
+_smf_merge_raise(smf_merge_t *m) {
+  if (!strcmp(m->error, "Out of memory")) {
+    PyErr_NoMemory();
+  } else {
+    PyErr_Format(PyExc_ValueError, "%s at file position %zu",
+		 m->error, m->error_pos);
+  }
+}
+
+/** internal use: parse and merge all the tracks into the packed array */
+static int
+_SmfPlayer_load(SmfPlayerObject *self) {
+  smf_merge_t merge;
+  smf_event_t ev;
+  size_t size = 0;
+  int ret;
+
+  if (_smf_merge_init(&merge, self->file.data,
+		      (const size_t (*)[2])self->tracks,
+		      self->ntracks, self->smpte) < 0) {
+    _smf_merge_raise(&merge);
+    return -1;
+  }
+
+  while ((ret = _smf_merge_next(&merge, &ev)) > 0) {
+    if (self->count == size) {
+      smf_event_t *events;
+      size = size ? size * 2 : 1024;
+      events = realloc(self->events, size * sizeof(smf_event_t));
+      if (events == NULL) {
+	_smf_merge_free(&merge);
+	PyErr_NoMemory();
+	return -1;
+      }
+      self->events = events;
+    }
+    if (ev.type == SND_SEQ_EVENT_SYSEX && (size_t)ev.value > self->max_sysex) {
+      self->max_sysex = ev.value;
+    }
+    self->events[self->count++] = ev;
+  }
+  if (ret < 0) {
+    _smf_merge_raise(&merge);
+    _smf_merge_free(&merge);
+    return -1;
+  }
+
+  self->end_tick = merge.end_tick;
+  _smf_merge_free(&merge);
+
+  return 0;
+}
+
+/** internal use: release the file contents and the packed events */
+static void
+_SmfPlayer_clear(SmfPlayerObject *self) {
+  _seq_file_release(&(self->file));
+  FREECHECKED("tracks", self->tracks);
+  FREECHECKED("events", self->events);
+  self->count = 0;
+  self->max_sysex = 0;
+}
+
+/** alsaseq.SmfPlayer tp_init */
+static int
+SmfPlayer_init(SmfPlayerObject *self,
+	       PyObject *args,
+	       PyObject *kwds) {
+  PyObject *file;
+  int preload = 1;
+
+  char *kwlist[] = {"file", "preload", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|i", kwlist, &file,
+				   &preload)) {
+    return -1;
+  }
+  if (self->in_use > 0) {
+    PyErr_SetString(PyExc_RuntimeError,
+		    "SmfPlayer is playing in another thread");
+    return -1;
+  }
+
+  _SmfPlayer_clear(self);
+
+  if (_seq_file_load(&(self->file), file, MADV_SEQUENTIAL) < 0) {
+    return -1;
+  }
+
+  self->preload = preload;
+  if (_SmfPlayer_parse_header(self) < 0 ||
+      (preload && _SmfPlayer_load(self) < 0)) {
+    _SmfPlayer_clear(self);
+    return -1;
+  }
+
+  return 0;
+}
+
+/** alsaseq.SmfPlayer tp_dealloc */
+static void
+SmfPlayer_dealloc(SmfPlayerObject *self) {
+  _SmfPlayer_clear(self);
+  Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+/** alsaseq.SmfPlayer sq_length */
+static Py_ssize_t
+SmfPlayer_length(SmfPlayerObject *self) {
+  if (!self->preload) {
+    PyErr_SetString(PyExc_TypeError, "events are not preloaded");
+    return -1;
+  }
+  return self->count;
+}
+
+/** alsaseq.SmfPlayer tp_repr */
+static PyObject *
+SmfPlayer_repr(SmfPlayerObject *self) {
+  return PyUnicode_FromFormat("<alsaseq.SmfPlayer format=%d tracks=%d "
+			      "ppq=%d events=%zd end_tick=%u at %p>",
+			      self->format, self->ntracks, self->ppq,
+			      (Py_ssize_t)self->count, self->end_tick, self);
+}
+
+/** internal use: convert a list of (client, port) tuples to addresses;
+    the returned array must be freed */
+static snd_seq_addr_t *
+_seq_parse_addr_list(PyObject *list,
+		     int *count) {
+  snd_seq_addr_t *addrs;
+  PyObject *seq, *item;
+  long client, port;
+  Py_ssize_t i, n;
+
+  seq = PySequence_Fast(list, "ports must be a sequence of (client, port)");
+  if (seq == NULL) {
+    return NULL;
+  }
+  n = PySequence_Fast_GET_SIZE(seq);
+  if (n < 1) {
+    Py_DECREF(seq);
+    PyErr_SetString(PyExc_ValueError, "at least one port is needed");
+    return NULL;
+  }
+  addrs = malloc(sizeof(snd_seq_addr_t) * n);
+  if (addrs == NULL) {
+    Py_DECREF(seq);
+    PyErr_NoMemory();
+    return NULL;
+  }
+  for (i = 0; i < n; i++) {
+    item = PySequence_Fast_GET_ITEM(seq, i);
+    if (!PyTuple_Check(item) || PyTuple_Size(item) != 2) {
+      PyErr_SetString(PyExc_TypeError, "expected tuple (client,port)");
+      goto __error;
+    }
+    if (get_long(PyTuple_GET_ITEM(item, 0), &client) ||
+	get_long(PyTuple_GET_ITEM(item, 1), &port)) {
+      goto __error;
+    }
+    addrs[i].client = client;
+    addrs[i].port = port;
+  }
+  Py_DECREF(seq);
+  *count = n;
+  return addrs;
+
+ __error:
+  Py_DECREF(seq);
+  free(addrs);
+  return NULL;
+}
+
+/** alsaseq.SmfPlayer play() method: __doc__ */
+PyDoc_STRVAR(SmfPlayer_play__doc__,
+  "play(sequencer, queue, ports, source_port = 0) -> int\n"
+  "\n"
+  "Put all the events of the song in the output of sequencer,\n"
+  "scheduled on queue at their tick. The events are output with the\n"
+  "GIL released; when the output buffer or the kernel pool is full,\n"
+  "the output is drained and the call waits for room (even in\n"
+  "SEQ_NONBLOCK mode), like Sequencer.output_events().\n"
+  "\n"
+  "The queue tempo is not changed: call sequencer.queue_tempo(queue,\n"
+  "player.tempo, player.ppq) and start the queue. Tempo changes of the\n"
+  "song are sent to the system timer. Drain the output when done.\n"
+  "\n"
+  "Parameters:\n"
+  "  sequencer -- the Sequencer\n"
+  "  queue -- (int) the queue id\n"
+  "  ports -- list of (client, port) destinations; the MIDI port meta\n"
+  "           events of the file select one of them\n"
+  "  source_port -- (int) source port of the events\n"
+  "Returns:\n"
+  "  (int) the number of events output\n"
+  "Raises:\n"
+  "  SequencerError: if ALSA can't send an event."
+);
+
+/** alsaseq.SmfPlayer play() method */
+static PyObject *
+SmfPlayer_play(SmfPlayerObject *self,
+	       PyObject *args,
+	       PyObject *kwds) {
+  SequencerObject *seq;
+  PyObject *portlist;
+  snd_seq_addr_t *ports;
+  snd_seq_event_t ev;
+  unsigned char *scratch;
+  int queue, nports;
+  int source_port = 0;
+  size_t i = 0;
+  int ret = 0;
+
+  char *kwlist[] = {"sequencer", "queue", "ports", "source_port", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!iO|i", kwlist,
+				   &SequencerType, &seq, &queue, &portlist,
+				   &source_port)) {
+    return NULL;
+  }
+  if (!self->preload) {
+    PyErr_SetString(PyExc_ValueError,
+		    "events are not preloaded, use stream()");
+    return NULL;
+  }
+
+  if (_Sequencer_init_output_fds(seq) < 0) {
+    return NULL;
+  }
+  ports = _seq_parse_addr_list(portlist, &nports);
+  if (ports == NULL) {
+    return NULL;
+  }
+  scratch = malloc(self->max_sysex + 1);
+  if (scratch == NULL) {
+    free(ports);
+    return PyErr_NoMemory();
+  }
+  if (_Sequencer_acquire_output(seq) < 0) {
+    free(scratch);
+    free(ports);
+    return NULL;
+  }
+
+  self->in_use++;
+  Py_BEGIN_ALLOW_THREADS;
+  for (i = 0; i < self->count; i++) {
+    _smf_event_to_seq(&(self->events[i]), &ev, self->file.data, scratch,
+		      queue, source_port, ports, nports);
+    ret = _Sequencer_output_nogil(seq, &ev);
+    if (ret < 0) {
+      break;
+    }
+  }
+  Py_END_ALLOW_THREADS;
+  self->in_use--;
+  _Sequencer_release_output(seq);
+
+  free(scratch);
+  free(ports);
+
+  if (ret < 0) {
+    RAISESND(ret, "Failed to output event %zu", i);
+    return NULL;
+  }
+
+  return PyLong_FromSize_t(i);
+}
+
+/** state of a streaming playback */
+typedef struct {
+  SmfPlayerObject *player;
+  SequencerObject *seq;
+  /* lazy merge of the tracks, when the events are not preloaded */
+  smf_merge_t merge;
+  /* next preloaded event */
+  size_t index;
+  /* next event of the song, not yet output */
+  smf_event_t next;
+  int have_next;
+  int queue;
+  int source_port;
+  const snd_seq_addr_t *ports;
+  int nports;
+  /* lookahead window: ticks if >= 0, else milliseconds */
+  long window_ticks;
+  long window_ms;
+  snd_seq_queue_status_t *status;
+  snd_seq_queue_tempo_t *tempo;
+  unsigned char *scratch;
+  size_t scratch_size;
+  size_t count;
+  /* set when the song data is invalid */
+  int parse_error;
+} smf_stream_t;
+
+/** internal use: get the next event of a streaming playback; returns 1,
+    0 at the end of the song, or -1 on invalid data */
+static int
+_smf_stream_next(smf_stream_t *st,
+		 smf_event_t *ev) {
+  if (st->player->preload) {
+    if (st->index >= st->player->count) {
+      return 0;
+    }
+    *ev = st->player->events[st->index++];
+    return 1;
+  }
+  return _smf_merge_next(&(st->merge), ev);
+}
+
+/** internal use: queue the events inside the lookahead window, then
+    sleep for a part of it; called without the GIL; returns 1 to be
+    called again, 0 at the end of the song, or a negative error */
+static int
+_smf_stream_step(smf_stream_t *st) {
+  snd_seq_t *handle = st->seq->handle;
+  unsigned long long horizon, window;
+  unsigned int tempo, ppq;
+  struct timespec ts;
+  long long sleep_us;
+  snd_seq_event_t ev;
+  int ret;
+
+  ret = snd_seq_get_queue_status(handle, st->queue, st->status);
+  if (ret < 0) {
+    return ret;
+  }
+  ret = snd_seq_get_queue_tempo(handle, st->queue, st->tempo);
+  if (ret < 0) {
+    return ret;
+  }
+  tempo = snd_seq_queue_tempo_get_tempo(st->tempo);
+  ppq = snd_seq_queue_tempo_get_ppq(st->tempo);
+  if (tempo == 0 || ppq == 0) {
+    return -EINVAL;
+  }
+
+  /* the window in ticks at the current tempo of the queue */
+  if (st->window_ticks >= 0) {
+    window = st->window_ticks;
+  } else {
+    window = (unsigned long long)st->window_ms * 1000 * ppq / tempo;
+  }
+  horizon = snd_seq_queue_status_get_tick_time(st->status) + window;
+
+  for (;;) {
+    if (!st->have_next) {
+      ret = _smf_stream_next(st, &(st->next));
+      if (ret < 0) {
+	st->parse_error = 1;
+	return -EINVAL;
+      } else if (ret == 0) {
+	ret = _Sequencer_drain_nogil(st->seq);
+	return ret < 0 ? ret : 0;
+      }
+      st->have_next = 1;
+    }
+    if (st->next.tick > horizon) {
+      break;
+    }
+    if (st->next.type == SND_SEQ_EVENT_SYSEX &&
+	(size_t)st->next.value > st->scratch_size) {
+      unsigned char *scratch = realloc(st->scratch, st->next.value);
+      if (scratch == NULL) {
+	return -ENOMEM;
+      }
+      st->scratch = scratch;
+      st->scratch_size = st->next.value;
+    }
+    _smf_event_to_seq(&(st->next), &ev, st->player->file.data, st->scratch,
+		      st->queue, st->source_port, st->ports, st->nports);
+    ret = _Sequencer_output_nogil(st->seq, &ev);
+    if (ret < 0) {
+      return ret;
+    }
+    st->count++;
+    st->have_next = 0;
+  }
+
+  ret = _Sequencer_drain_nogil(st->seq);
+  if (ret < 0) {
+    return ret;
+  }
+
+  /* refill when half of the window has been played */
+  sleep_us = (long long)(window / 2) * tempo / ppq;
+  if (sleep_us < 1000) {
+    sleep_us = 1000;
+  } else if (sleep_us > 100000) {
+    sleep_us = 100000;
+  }
+  ts.tv_sec = 0;
+  ts.tv_nsec = sleep_us * 1000;
+  nanosleep(&ts, NULL);
+
+  return 1;
+}
+
+/** alsaseq.SmfPlayer stream() method: __doc__ */
+PyDoc_STRVAR(SmfPlayer_stream__doc__,
+  "stream(sequencer, queue, ports, lookahead_ticks = -1,\n"
+  "       lookahead_ms = 500, source_port = 0) -> int\n"
+  "\n"
+  "Play the song keeping only a lookahead window of events queued in\n"
+  "the kernel. The queue position is read with the queue status, and\n"
+  "the events up to position + window are output; the window is\n"
+  "refilled when half of it has been played. The kernel pool and the\n"
+  "memory used stay proportional to the window, not to the song.\n"
+  "\n"
+  "With a player created with preload=False, the tracks are parsed\n"
+  "while playing, so playback starts without parsing the whole file.\n"
+  "\n"
+  "The queue must be set up and started before (see play()). The\n"
+  "call returns when all the events are output and drained, without\n"
+  "waiting for the queue to play them. Output and sleeps are done\n"
+  "with the GIL released; signals are checked between refills.\n"
+  "\n"
+  "Parameters:\n"
+  "  sequencer -- the Sequencer\n"
+  "  queue -- (int) the queue id\n"
+  "  ports -- list of (client, port) destinations, as for play()\n"
+  "  lookahead_ticks -- (int) window in ticks; if given, it is used\n"
+  "                     instead of lookahead_ms\n"
+  "  lookahead_ms -- (int) window in milliseconds at the current tempo\n"
+  "                  of the queue. Default: 500\n"
+  "  source_port -- (int) source port of the events\n"
+  "Returns:\n"
+  "  (int) the number of events output\n"
+  "Raises:\n"
+  "  ValueError: if the song data is invalid (preload=False)\n"
+  "  SequencerError: if ALSA can't send an event or get the queue status."
+);
+
+/** alsaseq.SmfPlayer stream() method */
+static PyObject *
+SmfPlayer_stream(SmfPlayerObject *self,
+		 PyObject *args,
+		 PyObject *kwds) {
+  smf_stream_t st;
+  PyObject *portlist;
+  snd_seq_addr_t *ports;
+  int ret = 0;
+
+  char *kwlist[] = {"sequencer", "queue", "ports", "lookahead_ticks",
+		    "lookahead_ms", "source_port", NULL};
+
+  memset(&st, 0, sizeof(st));
+  st.window_ticks = -1;
+  st.window_ms = 500;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!iO|lli", kwlist,
+				   &SequencerType, &(st.seq), &(st.queue),
+				   &portlist, &(st.window_ticks),
+				   &(st.window_ms), &(st.source_port))) {
+    return NULL;
+  }
+  if (st.window_ticks < 0 && st.window_ms <= 0) {
+    PyErr_SetString(PyExc_ValueError, "lookahead must be positive");
+    return NULL;
+  }
+
+  if (_Sequencer_init_output_fds(st.seq) < 0) {
+    return NULL;
+  }
+  ports = _seq_parse_addr_list(portlist, &(st.nports));
+  if (ports == NULL) {
+    return NULL;
+  }
+  st.ports = ports;
+  st.player = self;
+  snd_seq_queue_status_alloca(&(st.status));
+  snd_seq_queue_tempo_alloca(&(st.tempo));
+
+  if (!self->preload &&
+      _smf_merge_init(&(st.merge), self->file.data,
+		      (const size_t (*)[2])self->tracks,
+		      self->ntracks, self->smpte) < 0) {
+    _smf_merge_raise(&(st.merge));
+    free(ports);
+    return NULL;
+  }
+  /* the output stays reserved between the refills */
+  if (_Sequencer_acquire_output(st.seq) < 0) {
+    _smf_merge_free(&(st.merge));
+    free(ports);
+    return NULL;
+  }
+
+  self->in_use++;
+  for (;;) {
+    Py_BEGIN_ALLOW_THREADS;
+    ret = _smf_stream_step(&st);
+    Py_END_ALLOW_THREADS;
+    if (ret <= 0 || PyErr_CheckSignals() < 0) {
+      break;
+    }
+  }
+  self->in_use--;
+  _Sequencer_release_output(st.seq);
+
+  if (!self->preload && ret == 0) {
+    self->end_tick = st.merge.end_tick;
+  }
+  if (st.parse_error) {
+    _smf_merge_raise(&(st.merge));
+  } else if (ret < 0) {
+    RAISESND(ret, "Failed to stream event %zu", st.count);
+  }
+  _smf_merge_free(&(st.merge));
+  free(st.scratch);
+  free(ports);
+
+  if (PyErr_Occurred()) {
+    return NULL;
+  }
+
+  return PyLong_FromSize_t(st.count);
+}
+
+/** alsaseq.SmfPlayer format attribute: tp_getset getter() */
+static PyObject *
+SmfPlayer_get_format(SmfPlayerObject *self) {
+  return PyInt_FromLong(self->format);
+}
+
+/** alsaseq.SmfPlayer tracks attribute: tp_getset getter() */
+static PyObject *
+SmfPlayer_get_tracks(SmfPlayerObject *self) {
+  return PyInt_FromLong(self->ntracks);
+}
+
+/** alsaseq.SmfPlayer ppq attribute: tp_getset getter() */
+static PyObject *
+SmfPlayer_get_ppq(SmfPlayerObject *self) {
+  return PyInt_FromLong(self->ppq);
+}
+
+/** alsaseq.SmfPlayer tempo attribute: tp_getset getter() */
+static PyObject *
+SmfPlayer_get_tempo(SmfPlayerObject *self) {
+  return PyInt_FromLong(self->tempo);
+}
+
+/** alsaseq.SmfPlayer smpte attribute: tp_getset getter() */
+static PyObject *
+SmfPlayer_get_smpte(SmfPlayerObject *self) {
+  return get_bool(self->smpte);
+}
+
+/** alsaseq.SmfPlayer end_tick attribute: tp_getset getter() */
+static PyObject *
+SmfPlayer_get_end_tick(SmfPlayerObject *self) {
+  return PyLong_FromUnsignedLong(self->end_tick);
+}
+
+/** alsaseq.SmfPlayer tp_getset list */
+static PyGetSetDef SmfPlayer_getset[] = {
+  {"format",
+   (getter) SmfPlayer_get_format,
+   NULL,
+   "SMF format (0 or 1).",
+   NULL},
+  {"tracks",
+   (getter) SmfPlayer_get_tracks,
+   NULL,
+   "Number of tracks.",
+   NULL},
+  {"ppq",
+   (getter) SmfPlayer_get_ppq,
+   NULL,
+   "Ticks per quarter note.",
+   NULL},
+  {"tempo",
+   (getter) SmfPlayer_get_tempo,
+   NULL,
+   "Initial tempo in microseconds per quarter note.",
+   NULL},
+  {"smpte",
+   (getter) SmfPlayer_get_smpte,
+   NULL,
+   "True if the file uses SMPTE timing.",
+   NULL},
+  {"end_tick",
+   (getter) SmfPlayer_get_end_tick,
+   NULL,
+   "Tick of the end of the song (last end of track).",
+   NULL},
+  {NULL}
+};
+
+/** alsaseq.SmfPlayer tp_methods */
+static PyMethodDef SmfPlayer_methods[] = {
+  {"play",
+   (PyCFunction) SmfPlayer_play,
+   METH_VARARGS | METH_KEYWORDS,
+   SmfPlayer_play__doc__},
+  {"stream",
+   (PyCFunction) SmfPlayer_stream,
+   METH_VARARGS | METH_KEYWORDS,
+   SmfPlayer_stream__doc__},
+  {NULL}
+};
+
+/** alsaseq.SmfPlayer tp_as_sequence */
+static PySequenceMethods SmfPlayer_as_sequence = {
+  sq_length: (lenfunc) SmfPlayer_length,
+};
+
+/** alsaseq.SmfPlayer type */
+static PyTypeObject SmfPlayerType = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  tp_name: "alsaseq.SmfPlayer",
+  tp_basicsize: sizeof(SmfPlayerObject),
+  tp_dealloc: (destructor) SmfPlayer_dealloc,
+  tp_flags: Py_TPFLAGS_DEFAULT,
+  tp_doc: SmfPlayer__doc__,
+  tp_init: (initproc) SmfPlayer_init,
+  tp_new: PyType_GenericNew,
+  tp_alloc: PyType_GenericAlloc,
+  tp_free: PyObject_Del,
+  tp_as_sequence: &SmfPlayer_as_sequence,
+  tp_methods: SmfPlayer_methods,
+  tp_getset: SmfPlayer_getset,
+  tp_repr: (reprfunc) SmfPlayer_repr,
+};
+
+/** alsaseq.load_smf() function: __doc__ */
+PyDoc_STRVAR(alsaseq_load_smf__doc__,
+  "load_smf(file, preload=True) -> SmfPlayer\n"
+  "\n"
+  "Loads a Standard MIDI File; same as SmfPlayer(file, preload).\n"
+  "\n"
+  "Parameters:\n"
+  "  file -- a path, or a bytes-like object with the file contents\n"
+  "  preload -- if False, only the header is read and the tracks are\n"
+  "             parsed while playing with SmfPlayer.stream()\n"
+  "Returns:\n"
+  "  (SmfPlayer) the loaded file\n"
+  "Raises:\n"
+  "  ValueError: if the file is not a valid Standard MIDI File\n"
+  "  OSError: if the file can't be read."
+);
+
+/** alsaseq.load_smf() function */
+static PyObject *
+alsaseq_load_smf(PyObject *module,
+		 PyObject *args,
+		 PyObject *kwds) {
+  return PyObject_Call((PyObject *)&SmfPlayerType, args, kwds);
+}
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// alsaseq.SmfRecorder implementation
+//////////////////////////////////////////////////////////////////////////////
+
+/** growing buffer of the data of one SMF track */
+typedef struct {
+  unsigned char *data;
+  size_t len;
+  size_t size;
+  /* tick of the last event */
+  unsigned int tick;
+} smf_track_t;
+
+/** internal use: make room for n more bytes; returns 0 or -ENOMEM */
+static int
+_smf_track_reserve(smf_track_t *t,
+		   size_t n) {
+  unsigned char *data;
+  size_t size;
+
+  if (t->len + n <= t->size) {
+    return 0;
+  }
+  size = t->size ? t->size : 4096;
+  while (size < t->len + n) {
+    size *= 2;
+  }
+  data = realloc(t->data, size);
+  if (data == NULL) {
+    return -ENOMEM;
+  }
+  t->data = data;
+  t->size = size;
+  return 0;
+}
+
+/** internal use: append bytes; room must be reserved */
+static void
+_smf_track_put(smf_track_t *t,
+	       const unsigned char *data,
+	       size_t len) {
+  memcpy(t->data + t->len, data, len);
+  t->len += len;
+}
+
+/** internal use: append a variable-length number (max 4 bytes); room
+    must be reserved */
+static void
+_smf_track_put_var(smf_track_t *t,
+		   unsigned int value) {
+  unsigned char buf[4];
+  int n = 0;
+
+  value &= 0x0fffffff;
+  do {
+    buf[n++] = value & 0x7f;
+    value >>= 7;
+  } while (value);
+  while (n > 1) {
+    t->data[t->len++] = buf[--n] | 0x80;
+  }
+  t->data[t->len++] = buf[0];
+}
+
+/** internal use: append the delta time up to tick; room for 4 bytes
+    must be reserved */
+static void
+_smf_track_put_delta(smf_track_t *t,
+		     unsigned int tick) {
+  if (tick < t->tick) {
+    tick = t->tick;
+  }
+  _smf_track_put_var(t, tick - t->tick);
+  t->tick = tick;
+}
+
+/** internal use: store a big-endian number */
+static void
+_smf_put_int(unsigned char *p,
+	     unsigned int value,
+	     int bytes) {
+  while (bytes-- > 0) {
+    p[bytes] = value & 0xff;
+    value >>= 8;
+  }
+}
+
+/* size of the SMF header chunk and of a track chunk header */
+#define SMF_HEADER_SIZE 14
+#define SMF_TRACK_HEADER_SIZE 8
+
+/** internal use: get the descriptor of an output file: a path (str or
+    os.PathLike, created or truncated), a file descriptor or an object
+    with fileno(); *own is set if the descriptor must be closed */
+static int
+_seq_open_output(PyObject *file,
+		 int *own) {
+  PyObject *path, *obj;
+  int fd;
+
+  *own = 0;
+  if (PyUnicode_Check(file) || PyObject_HasAttrString(file, "__fspath__")) {
+    if (!PyUnicode_FSConverter(file, &path)) {
+      return -1;
+    }
+    fd = open(PyBytes_AS_STRING(path), O_WRONLY | O_CREAT | O_TRUNC |
+	      O_CLOEXEC, 0666);
+    if (fd < 0) {
+      PyErr_SetFromErrnoWithFilename(PyExc_OSError,
+				     PyBytes_AS_STRING(path));
+    }
+    Py_DECREF(path);
+    *own = 1;
+  } else if (PyLong_Check(file)) {
+    fd = PyLong_AsLong(file);
+  } else {
+    obj = PyObject_CallMethod(file, "fileno", NULL);
+    fd = obj != NULL ? PyLong_AsLong(obj) : -1;
+    Py_XDECREF(obj);
+  }
+  if (fd < 0 && !PyErr_Occurred()) {
+    PyErr_SetString(PyExc_ValueError, "invalid file descriptor");
+  }
+  return fd;
+}
+
+/** internal use: write all the data to fd, retrying on EINTR and
+    partial writes; returns 0 or the errno */
+static int
+_seq_write_all(int fd,
+	       const void *data,
+	       size_t len,
+	       size_t *written) {
+  ssize_t ret;
+
+  while (len > 0) {
+    ret = write(fd, data, len);
+    if (ret < 0) {
+      if (errno == EINTR) {
+	continue;
+      }
+      return errno;
+    }
+    data = (const char *)data + ret;
+    len -= ret;
+    *written += ret;
+  }
+  return 0;
+}
+
+/** alsaseq.SmfRecorder __doc__ */
+PyDoc_STRVAR(SmfRecorder__doc__,
+  "SmfRecorder(sequencer, file, ports, format = 0, queue = -1,\n"
+  "            ppq = 384, tempo = 500000, buffer_size = 65536,\n"
+  "            fsync_ms = 1000) -> SmfRecorder object\n"
+  "\n"
+  "Records the events sent by ports to a Standard MIDI File. The\n"
+  "events are read by a native thread (as for start_dispatch()),\n"
+  "time-stamped by the kernel against a queue and encoded to MIDI\n"
+  "bytes in C; no Python object is created per event.\n"
+  "\n"
+  "start() creates a port on sequencer, subscribes ports to it and\n"
+  "starts the reader thread; the input of the sequencer is owned by\n"
+  "the recorder until stop(), which completes the file.\n"
+  "\n"
+  "With format 0, all the events go to a single track written\n"
+  "incrementally: the data is written when buffer_size bytes are\n"
+  "buffered or fsync_ms has elapsed, and a helper thread calls fsync()\n"
+  "every fsync_ms milliseconds (0 disables it). The file must be\n"
+  "seekable: the track length is written by stop().\n"
+  "With format 1, each port gets its own track; as the tracks are\n"
+  "stored one after the other, they are kept in memory and the file\n"
+  "is written by stop().\n"
+  "\n"
+  "Parameters:\n"
+  "  sequencer -- the Sequencer (opened for input)\n"
+  "  file -- a path, a file descriptor or an object with fileno()\n"
+  "  ports -- list of (client, port) sources to record\n"
+  "  format -- SMF format, 0 or 1\n"
+  "  queue -- (int) the queue used for time-stamping; by default, a\n"
+  "           queue is created with ppq and tempo and started by start().\n"
+  "           A given queue must be started by the caller.\n"
+  "  ppq -- (int) ticks per quarter note of the file\n"
+  "  tempo -- (int) tempo of the file (microseconds per quarter note)\n"
+  "  buffer_size -- (int) bytes buffered before writing (format 0)\n"
+  "  fsync_ms -- (int) interval of the periodic fsync (format 0)\n"
+  "Raises:\n"
+  "  ValueError: if a parameter is out of range\n"
+  "  OSError: if the file can't be opened."
+);
+
+/** alsaseq.SmfRecorder object structure type */
+typedef struct {
+  PyObject_HEAD
+  ;
+
+  SequencerObject *seq;
+  snd_seq_addr_t *sources;
+  int nsources;
+  int format;
+  int ppq;
+  int tempo;
+  /* queue and recording port; -1 when not created */
+  int queue;
+  int own_queue;
+  int port;
+
+  int fd;
+  int own_fd;
+  /* file offset of the header */
+  off_t start;
+  size_t buffer_size;
+  long fsync_ms;
+
+  /* format 0: one track; format 1: one per source */
+  smf_track_t *tracks;
+  snd_midi_event_t *codec;
+  seq_reader_t reader;
+  int recording;
+
+  /* periodic fsync() */
+  pthread_t syncer;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int syncing;
+  int sync_stop;
+  int dirty;
+  struct timespec last_write;
+
+  /* counters; write_error is the errno of the first failed write */
+  unsigned long recorded;
+  unsigned long ignored;
+  unsigned long syncs;
+  size_t written;
+  int write_error;
+} SmfRecorderObject;
+
+/** internal use: write all the data to the file (reader thread, or
+    after it stopped); the first error is kept in write_error */
+static void
+_SmfRecorder_write(SmfRecorderObject *self,
+		   const unsigned char *data,
+		   size_t len) {
+  if (self->write_error == 0) {
+    self->write_error = _seq_write_all(self->fd, data, len, &self->written);
+  }
+}
+
+/** internal use: write the buffered data of the format 0 track */
+static void
+_SmfRecorder_write_track(SmfRecorderObject *self) {
+  smf_track_t *t = &(self->tracks[0]);
+
+  if (t->len == 0) {
+    return;
+  }
+  _SmfRecorder_write(self, t->data, t->len);
+  t->len = 0;
+  clock_gettime(CLOCK_MONOTONIC, &self->last_write);
+  __atomic_store_n(&self->dirty, 1, __ATOMIC_RELEASE);
+}
+
+/** internal use: reader sink; encodes an event in its track */
+static void
+_SmfRecorder_sink(seq_reader_t *reader,
+		  const snd_seq_event_t *event) {
+  SmfRecorderObject *self = reader->data;
+  const unsigned char *data;
+  unsigned char buf[16];
+  smf_track_t *t;
+  long len;
+  int i;
+
+  if (event->dest.port != self->port || self->write_error) {
+    goto __ignored;
+  }
+  for (i = 0; i < self->nsources; i++) {
+    if (self->sources[i].client == event->source.client &&
+	self->sources[i].port == event->source.port) {
+      break;
+    }
+  }
+  if (i == self->nsources) {
+    goto __ignored;
+  }
+  t = &(self->tracks[self->format == 0 ? 0 : i]);
+
+  if (event->type == SND_SEQ_EVENT_SYSEX) {
+    data = event->data.ext.ptr;
+    len = event->data.ext.len;
+    if (len <= 0 || _smf_track_reserve(t, 9 + len) < 0) {
+      goto __nomem;
+    }
+    _smf_track_put_delta(t, event->time.tick);
+    /* the 0xf0 is the event type; continued packets use 0xf7 */
+    if (data[0] == 0xf0) {
+      data++;
+      len--;
+      t->data[t->len++] = 0xf0;
+    } else {
+      t->data[t->len++] = 0xf7;
+    }
+    _smf_track_put_var(t, len);
+    _smf_track_put(t, data, len);
+  } else {
+    len = snd_midi_event_decode(self->codec, buf, sizeof(buf), event);
+    /* system common and real time messages are not allowed in a SMF */
+    if (len <= 0 || buf[0] >= 0xf0) {
+      goto __ignored;
+    }
+    if (_smf_track_reserve(t, 4 + len) < 0) {
+      goto __nomem;
+    }
+    _smf_track_put_delta(t, event->time.tick);
+    _smf_track_put(t, buf, len);
+  }
+
+  self->recorded++;
+  if (self->format == 0 && t->len >= self->buffer_size) {
+    _SmfRecorder_write_track(self);
+  }
+  return;
+
+ __nomem:
+  if (len > 0) {
+    self->write_error = ENOMEM;
+  }
+ __ignored:
+  self->ignored++;
+}
+
+/** internal use: reader flush; writes the format 0 data at least every
+    fsync_ms, so the syncer makes it durable */
+static void
+_SmfRecorder_flush(seq_reader_t *reader) {
+  SmfRecorderObject *self = reader->data;
+  struct timespec now;
+  long elapsed;
+
+  if (!self->syncing || self->tracks[0].len == 0) {
+    return;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  elapsed = (now.tv_sec - self->last_write.tv_sec) * 1000 +
+    (now.tv_nsec - self->last_write.tv_nsec) / 1000000;
+  if (elapsed >= self->fsync_ms) {
+    _SmfRecorder_write_track(self);
+  }
+}
+
+/** internal use: the syncer thread; fsync()s the written data */
+static void *
+_SmfRecorder_sync_run(void *arg) {
+  SmfRecorderObject *self = arg;
+  struct timespec deadline;
+  int stop = 0;
+
+  while (!stop) {
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += self->fsync_ms / 1000;
+    deadline.tv_nsec += (self->fsync_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&self->lock);
+    while (!self->sync_stop &&
+	   pthread_cond_timedwait(&self->cond, &self->lock, &deadline) == 0) {
+    }
+    stop = self->sync_stop;
+    pthread_mutex_unlock(&self->lock);
+
+    if (!stop && __atomic_exchange_n(&self->dirty, 0, __ATOMIC_ACQ_REL)) {
+      fsync(self->fd);
+      __atomic_add_fetch(&self->syncs, 1, __ATOMIC_RELAXED);
+    }
+  }
+  return NULL;
+}
+
+/** internal use: stop the syncer thread */
+static void
+_SmfRecorder_stop_syncer(SmfRecorderObject *self) {
+  if (!self->syncing) {
+    return;
+  }
+  pthread_mutex_lock(&self->lock);
+  self->sync_stop = 1;
+  pthread_cond_signal(&self->cond);
+  pthread_mutex_unlock(&self->lock);
+  pthread_join(self->syncer, NULL);
+  self->syncing = 0;
+}
+
+/** internal use: append the end of track events and write the file;
+    called after the threads are stopped, without the GIL */
+static void
+_SmfRecorder_finish(SmfRecorderObject *self,
+		    unsigned int end_tick) {
+  static const unsigned char eot[] = {0xff, 0x2f, 0x00};
+  unsigned char header[SMF_HEADER_SIZE + SMF_TRACK_HEADER_SIZE];
+  int ntracks = self->format == 0 ? 1 : self->nsources;
+  smf_track_t *t;
+  int i;
+
+  for (i = 0; i < ntracks; i++) {
+    t = &(self->tracks[i]);
+    if (_smf_track_reserve(t, 4 + sizeof(eot)) < 0) {
+      self->write_error = ENOMEM;
+      return;
+    }
+    _smf_track_put_delta(t, end_tick);
+    _smf_track_put(t, eot, sizeof(eot));
+  }
+
+  if (self->format == 0) {
+    _SmfRecorder_write_track(self);
+    /* the track length, now known */
+    _smf_put_int(header, self->written - sizeof(header), 4);
+    if (self->write_error == 0 &&
+	pwrite(self->fd, header, 4, self->start + SMF_HEADER_SIZE + 4) < 0) {
+      self->write_error = errno;
+    }
+  } else {
+    memcpy(header, "MThd", 4);
+    _smf_put_int(header + 4, 6, 4);
+    _smf_put_int(header + 8, 1, 2);
+    _smf_put_int(header + 10, ntracks, 2);
+    _smf_put_int(header + 12, self->ppq, 2);
+    _SmfRecorder_write(self, header, SMF_HEADER_SIZE);
+    for (i = 0; i < ntracks; i++) {
+      t = &(self->tracks[i]);
+      memcpy(header, "MTrk", 4);
+      _smf_put_int(header + 4, t->len, 4);
+      _SmfRecorder_write(self, header, SMF_TRACK_HEADER_SIZE);
+      _SmfRecorder_write(self, t->data, t->len);
+    }
+  }
+
+  if (self->write_error == 0 && fsync(self->fd) < 0 && errno != EINVAL) {
+    self->write_error = errno;
+  }
+}
+
+/** internal use: free the tracks */
+static void
+_SmfRecorder_free_tracks(SmfRecorderObject *self) {
+  int i;
+
+  if (self->tracks == NULL) {
+    return;
+  }
+  for (i = 0; i < (self->format == 0 ? 1 : self->nsources); i++) {
+    free(self->tracks[i].data);
+  }
+  FREECHECKED("tracks", self->tracks);
+}
+
+/** internal use: unsubscribe the sources and delete the port and the
+    owned queue */
+static void
+_SmfRecorder_release(SmfRecorderObject *self,
+		     int nsubscribed) {
+  snd_seq_port_subscribe_t *sinfo;
+  snd_seq_addr_t dest;
+  int i;
+
+  snd_seq_port_subscribe_alloca(&sinfo);
+  dest.client = snd_seq_client_id(self->seq->handle);
+  dest.port = self->port;
+  for (i = 0; i < nsubscribed; i++) {
+    snd_seq_port_subscribe_set_sender(sinfo, &(self->sources[i]));
+    snd_seq_port_subscribe_set_dest(sinfo, &dest);
+    snd_seq_unsubscribe_port(self->seq->handle, sinfo);
+  }
+  if (self->port >= 0) {
+    snd_seq_delete_simple_port(self->seq->handle, self->port);
+    self->port = -1;
+  }
+  if (self->own_queue && self->queue >= 0) {
+    if (!self->seq->output_busy) {
+      snd_seq_stop_queue(self->seq->handle, self->queue, NULL);
+      snd_seq_drain_output(self->seq->handle);
+    }
+    snd_seq_free_queue(self->seq->handle, self->queue);
+    self->queue = -1;
+  }
+}
+
+/** internal use: stop the recording and complete the file; returns 0
+    or the errno of the file */
+static int
+_SmfRecorder_stop(SmfRecorderObject *self) {
+  snd_seq_queue_status_t *status;
+  unsigned int end_tick = 0;
+  int i;
+
+  snd_seq_queue_status_alloca(&status);
+
+  Py_BEGIN_ALLOW_THREADS;
+  _seq_reader_stop(&self->reader);
+  _SmfRecorder_stop_syncer(self);
+  if (snd_seq_get_queue_status(self->seq->handle, self->queue, status) >= 0) {
+    end_tick = snd_seq_queue_status_get_tick_time(status);
+  }
+  for (i = 0; i < (self->format == 0 ? 1 : self->nsources); i++) {
+    if (end_tick < self->tracks[i].tick) {
+      end_tick = self->tracks[i].tick;
+    }
+  }
+  _SmfRecorder_finish(self, end_tick);
+  Py_END_ALLOW_THREADS;
+
+  _SmfRecorder_release(self, self->nsources);
+  snd_midi_event_free(self->codec);
+  self->codec = NULL;
+  _SmfRecorder_free_tracks(self);
+  pthread_cond_destroy(&self->cond);
+  pthread_mutex_destroy(&self->lock);
+  if (self->own_fd) {
+    close(self->fd);
+    self->fd = -1;
+    self->own_fd = 0;
+  }
+  self->recording = 0;
+  self->seq->input_owner = NULL;
+
+  return self->write_error;
+}
+
+/** alsaseq.SmfRecorder tp_init */
+static int
+SmfRecorder_init(SmfRecorderObject *self,
+		 PyObject *args,
+		 PyObject *kwds) {
+  SequencerObject *seq;
+  PyObject *file, *portlist;
+  snd_seq_addr_t *sources;
+  Py_ssize_t buffer_size = 65536;
+  long fsync_ms = 1000;
+  int format = 0;
+  int queue = -1;
+  int ppq = 384;
+  int tempo = 500000;
+  int nsources, fd, own_fd;
+
+  char *kwlist[] = {"sequencer", "file", "ports", "format", "queue", "ppq",
+		    "tempo", "buffer_size", "fsync_ms", NULL};
+
+  if (self->recording) {
+    RAISESTR("The recorder is recording");
+    return -1;
+  }
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!OO|iiiinl", kwlist,
+				   &SequencerType, &seq, &file, &portlist,
+				   &format, &queue, &ppq, &tempo,
+				   &buffer_size, &fsync_ms)) {
+    return -1;
+  }
+  if ((format != 0 && format != 1) || ppq <= 0 || ppq > 0x7fff ||
+      tempo <= 0 || tempo > 0xffffff || buffer_size <= 0 || fsync_ms < 0) {
+    PyErr_SetString(PyExc_ValueError,
+		    "format must be 0 or 1, ppq 1-32767, tempo 1-16777215, "
+		    "buffer_size > 0 and fsync_ms >= 0");
+    return -1;
+  }
+  sources = _seq_parse_addr_list(portlist, &nsources);
+  if (sources == NULL) {
+    return -1;
+  }
+
+  fd = _seq_open_output(file, &own_fd);
+  if (fd < 0) {
+    free(sources);
+    return -1;
+  }
+
+  if (self->own_fd && self->fd >= 0) {
+    close(self->fd);
+  }
+  free(self->sources);
+  Py_XDECREF(self->seq);
+  Py_INCREF(seq);
+  self->seq = seq;
+  self->sources = sources;
+  self->nsources = nsources;
+  self->format = format;
+  self->queue = queue;
+  self->own_queue = queue < 0;
+  self->port = -1;
+  self->ppq = ppq;
+  self->tempo = tempo;
+  self->fd = fd;
+  self->own_fd = own_fd;
+  self->buffer_size = buffer_size;
+  self->fsync_ms = fsync_ms;
+
+  return 0;
+}
+
+/** internal use: create the port and the queue and subscribe the
+    sources; returns 0 or a negative error */
+static int
+_SmfRecorder_connect(SmfRecorderObject *self) {
+  snd_seq_port_subscribe_t *sinfo;
+  snd_seq_queue_tempo_t *qtempo;
+  snd_seq_t *handle = self->seq->handle;
+  snd_seq_addr_t dest;
+  int ret, i;
+
+  ret = snd_seq_create_simple_port(handle, "pyalsa SMF recorder",
+				   SND_SEQ_PORT_CAP_WRITE |
+				   SND_SEQ_PORT_CAP_SUBS_WRITE,
+				   SND_SEQ_PORT_TYPE_MIDI_GENERIC |
+				   SND_SEQ_PORT_TYPE_APPLICATION);
+  if (ret < 0) {
+    return ret;
+  }
+  self->port = ret;
+
+  if (self->own_queue) {
+    ret = snd_seq_alloc_named_queue(handle, "pyalsa SMF recorder");
+    if (ret < 0) {
+      _SmfRecorder_release(self, 0);
+      return ret;
+    }
+    self->queue = ret;
+    snd_seq_queue_tempo_alloca(&qtempo);
+    snd_seq_queue_tempo_set_tempo(qtempo, self->tempo);
+    snd_seq_queue_tempo_set_ppq(qtempo, self->ppq);
+    ret = snd_seq_set_queue_tempo(handle, self->queue, qtempo);
+    if (ret < 0) {
+      _SmfRecorder_release(self, 0);
+      return ret;
+    }
+  }
+
+  snd_seq_port_subscribe_alloca(&sinfo);
+  dest.client = snd_seq_client_id(handle);
+  dest.port = self->port;
+  for (i = 0; i < self->nsources; i++) {
+    snd_seq_port_subscribe_set_sender(sinfo, &(self->sources[i]));
+    snd_seq_port_subscribe_set_dest(sinfo, &dest);
+    snd_seq_port_subscribe_set_queue(sinfo, self->queue);
+    snd_seq_port_subscribe_set_time_update(sinfo, 1);
+    snd_seq_port_subscribe_set_time_real(sinfo, 0);
+    ret = snd_seq_subscribe_port(handle, sinfo);
+    if (ret < 0) {
+      _SmfRecorder_release(self, i);
+      return ret;
+    }
+  }
+  return 0;
+}
+
+/** alsaseq.SmfRecorder start() method: __doc__ */
+PyDoc_STRVAR(SmfRecorder_start__doc__,
+  "start()\n"
+  "\n"
+  "Start recording: creates the recording port (and the queue),\n"
+  "subscribes the ports, writes the header (format 0) and starts the\n"
+  "threads.\n"
+  "\n"
+  "Raises:\n"
+  "  SequencerError: if already recording, if the input of the\n"
+  "                  sequencer is owned, or on ALSA errors\n"
+  "  OSError: if the file is not seekable (format 0) or can't be\n"
+  "           written."
+);
+
+/** alsaseq.SmfRecorder start() method */
+static PyObject *
+SmfRecorder_start(SmfRecorderObject *self,
+		  PyObject *args) {
+  unsigned char header[SMF_HEADER_SIZE + SMF_TRACK_HEADER_SIZE];
+  pthread_condattr_t attr;
+  smf_track_t *t;
+  int ntracks, ret;
+
+  if (self->seq == NULL) {
+    RAISESTR("The recorder is not initialized");
+    return NULL;
+  }
+  if (self->recording) {
+    RAISESTR("The recorder is recording");
+    return NULL;
+  }
+  if (_Sequencer_check_input(self->seq) < 0) {
+    return NULL;
+  }
+  if (self->seq->areading) {
+    RAISESTR("The input is owned by areceive()");
+    return NULL;
+  }
+  if (self->own_queue && _Sequencer_check_output(self->seq) < 0) {
+    return NULL;
+  }
+  if (self->format == 0) {
+    self->start = lseek(self->fd, 0, SEEK_CUR);
+    if (self->start < 0) {
+      PyErr_SetFromErrno(PyExc_OSError);
+      return NULL;
+    }
+  }
+
+  ntracks = self->format == 0 ? 1 : self->nsources;
+  self->tracks = calloc(ntracks, sizeof(smf_track_t));
+  if (self->tracks == NULL ||
+      _smf_track_reserve(&(self->tracks[0]), sizeof(header) + 7) < 0 ||
+      snd_midi_event_new(16, &self->codec) < 0) {
+    _SmfRecorder_free_tracks(self);
+    return PyErr_NoMemory();
+  }
+  snd_midi_event_no_status(self->codec, 1);
+  self->recorded = 0;
+  self->ignored = 0;
+  self->syncs = 0;
+  self->written = 0;
+  self->write_error = 0;
+  self->dirty = 0;
+  self->sync_stop = 0;
+
+  /* format 0: the header is written first, the track length later */
+  t = &(self->tracks[0]);
+  if (self->format == 0) {
+    memcpy(header, "MThd", 4);
+    _smf_put_int(header + 4, 6, 4);
+    _smf_put_int(header + 8, 0, 2);
+    _smf_put_int(header + 10, 1, 2);
+    _smf_put_int(header + 12, self->ppq, 2);
+    memcpy(header + SMF_HEADER_SIZE, "MTrk", 4);
+    _smf_put_int(header + SMF_HEADER_SIZE + 4, 0, 4);
+    _smf_track_put(t, header, sizeof(header));
+  }
+  /* tempo of the song */
+  _smf_track_put_var(t, 0);
+  _smf_track_put(t, (const unsigned char *)"\xff\x51\x03", 3);
+  _smf_put_int(t->data + t->len, self->tempo, 3);
+  t->len += 3;
+
+  ret = _SmfRecorder_connect(self);
+  if (ret < 0) {
+    snd_midi_event_free(self->codec);
+    self->codec = NULL;
+    _SmfRecorder_free_tracks(self);
+    RAISESND(ret, "Failed to set up the recording");
+    return NULL;
+  }
+
+  pthread_mutex_init(&self->lock, NULL);
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&self->cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  if (self->format == 0) {
+    _SmfRecorder_write_track(self);
+    if (self->fsync_ms > 0) {
+      ret = pthread_create(&self->syncer, NULL, _SmfRecorder_sync_run, self);
+      self->syncing = ret == 0;
+    }
+  }
+
+  self->reader.handle = self->seq->handle;
+  self->reader.mode = self->seq->mode;
+  self->reader.sink = _SmfRecorder_sink;
+  self->reader.flush = _SmfRecorder_flush;
+  self->reader.data = self;
+  self->reader.filter = &self->seq->filter;
+  ret = self->write_error ? -self->write_error :
+    _seq_reader_start(&self->reader);
+  if (ret == 0 && self->own_queue) {
+    ret = snd_seq_start_queue(self->seq->handle, self->queue, NULL);
+    if (ret >= 0) {
+      ret = snd_seq_drain_output(self->seq->handle);
+    }
+    if (ret < 0) {
+      _seq_reader_stop(&self->reader);
+    }
+  }
+  if (ret < 0) {
+    _SmfRecorder_stop_syncer(self);
+    pthread_cond_destroy(&self->cond);
+    pthread_mutex_destroy(&self->lock);
+    _SmfRecorder_release(self, self->nsources);
+    snd_midi_event_free(self->codec);
+    self->codec = NULL;
+    _SmfRecorder_free_tracks(self);
+    RAISESND(ret, "Failed to start recording");
+    return NULL;
+  }
+
+  self->recording = 1;
+  self->seq->input_owner = "SmfRecorder";
+
+  Py_RETURN_NONE;
+}
+
+/** internal use: build the counters dict */
+static PyObject *
+SmfRecorder_stats(SmfRecorderObject *self,
+		  PyObject *args);
+
+/** alsaseq.SmfRecorder stop() method: __doc__ */
+PyDoc_STRVAR(SmfRecorder_stop__doc__,
+  "stop() -> dict\n"
+  "\n"
+  "Stop recording and complete the file: the end of track events are\n"
+  "put at the current tick of the queue, the data is written and\n"
+  "fsync()ed. The port, the subscriptions and the owned queue are\n"
+  "removed, and a file opened from a path is closed.\n"
+  "\n"
+  "Returns:\n"
+  "  (dict) the counters of the recording, like stats()\n"
+  "Raises:\n"
+  "  SequencerError: if not recording\n"
+  "  OSError: if the file could not be written."
+);
+
+/** alsaseq.SmfRecorder stop() method */
+static PyObject *
+SmfRecorder_stop(SmfRecorderObject *self,
+		 PyObject *args) {
+  PyObject *stats;
+  int err;
+
+  if (!self->recording) {
+    RAISESTR("The recorder is not recording");
+    return NULL;
+  }
+
+  err = _SmfRecorder_stop(self);
+  if (err) {
+    errno = err;
+    PyErr_SetFromErrno(PyExc_OSError);
+    return NULL;
+  }
+  stats = SmfRecorder_stats(self, NULL);
+
+  return stats;
+}
+
+/** alsaseq.SmfRecorder stats() method: __doc__ */
+PyDoc_STRVAR(SmfRecorder_stats__doc__,
+  "stats() -> dict\n"
+  "\n"
+  "Returns the counters of the recording:\n"
+  "  'events' -> events read by the reader thread\n"
+  "  'overruns' -> input overruns reported by ALSA (events lost in the\n"
+  "                kernel)\n"
+  "  'recorded' -> events written to the tracks\n"
+  "  'ignored' -> events not recorded (other ports, messages not\n"
+  "               allowed in a SMF, errors)\n"
+  "  'bytes' -> bytes written to the file\n"
+  "  'syncs' -> fsync() calls of the syncer thread\n"
+  "  'error' -> the ALSA error which stopped the reader thread, or 0\n"
+  "  'write_error' -> the errno of the first failed write, or 0"
+);
+
+/** alsaseq.SmfRecorder stats() method */
+static PyObject *
+SmfRecorder_stats(SmfRecorderObject *self,
+		  PyObject *args) {
+  return Py_BuildValue("{sksksksksnsksisi}",
+		       "events",
+		       __atomic_load_n(&self->reader.events, __ATOMIC_RELAXED),
+		       "overruns",
+		       __atomic_load_n(&self->reader.overruns,
+				       __ATOMIC_RELAXED),
+		       "recorded",
+		       __atomic_load_n(&self->recorded, __ATOMIC_RELAXED),
+		       "ignored",
+		       __atomic_load_n(&self->ignored, __ATOMIC_RELAXED),
+		       "bytes",
+		       (Py_ssize_t)__atomic_load_n(&self->written,
+						   __ATOMIC_RELAXED),
+		       "syncs",
+		       __atomic_load_n(&self->syncs, __ATOMIC_RELAXED),
+		       "error", self->reader.error,
+		       "write_error", self->write_error);
+}
+
+/** alsaseq.SmfRecorder tp_dealloc */
+static void
+SmfRecorder_dealloc(SmfRecorderObject *self) {
+  if (self->recording) {
+    _SmfRecorder_stop(self);
+  }
+  if (self->own_fd && self->fd >= 0) {
+    close(self->fd);
+  }
+  free(self->sources);
+  Py_XDECREF(self->seq);
+  Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+/** alsaseq.SmfRecorder port attribute: tp_getset getter() */
+static PyObject *
+SmfRecorder_get_port(SmfRecorderObject *self) {
+  return PyInt_FromLong(self->port);
+}
+
+/** alsaseq.SmfRecorder queue attribute: tp_getset getter() */
+static PyObject *
+SmfRecorder_get_queue(SmfRecorderObject *self) {
+  return PyInt_FromLong(self->queue);
+}
+
+/** alsaseq.SmfRecorder recording attribute: tp_getset getter() */
+static PyObject *
+SmfRecorder_get_recording(SmfRecorderObject *self) {
+  return get_bool(self->recording);
+}
+
+/** alsaseq.SmfRecorder tp_getset list */
+static PyGetSetDef SmfRecorder_getset[] = {
+  {"port",
+   (getter) SmfRecorder_get_port,
+   NULL,
+   "The recording port while recording, else -1.",
+   NULL},
+  {"queue",
+   (getter) SmfRecorder_get_queue,
+   NULL,
+   "The time-stamping queue; -1 if it is created by start() and not "
+   "recording.",
+   NULL},
+  {"recording",
+   (getter) SmfRecorder_get_recording,
+   NULL,
+   "True between start() and stop().",
+   NULL},
+  {NULL}
+};
+
+/** alsaseq.SmfRecorder tp_methods */
+static PyMethodDef SmfRecorder_methods[] = {
+  {"start",
+   (PyCFunction) SmfRecorder_start,
+   METH_VARARGS,
+   SmfRecorder_start__doc__},
+  {"stop",
+   (PyCFunction) SmfRecorder_stop,
+   METH_VARARGS,
+   SmfRecorder_stop__doc__},
+  {"stats",
+   (PyCFunction) SmfRecorder_stats,
+   METH_VARARGS,
+   SmfRecorder_stats__doc__},
+  {NULL}
+};
+
+/** alsaseq.SmfRecorder tp_new */
+static PyObject *
+SmfRecorder_new(PyTypeObject *type,
+		PyObject *args,
+		PyObject *kwds) {
+  SmfRecorderObject *self;
+
+  self = (SmfRecorderObject *)type->tp_alloc(type, 0);
+  if (self != NULL) {
+    self->fd = -1;
+    self->queue = -1;
+    self->port = -1;
+  }
+  return (PyObject *)self;
+}
+
+/** alsaseq.SmfRecorder type */
+static PyTypeObject SmfRecorderType = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  tp_name: "alsaseq.SmfRecorder",
+  tp_basicsize: sizeof(SmfRecorderObject),
+  tp_dealloc: (destructor) SmfRecorder_dealloc,
+  tp_flags: Py_TPFLAGS_DEFAULT,
+  tp_doc: SmfRecorder__doc__,
+  tp_init: (initproc) SmfRecorder_init,
+  tp_new: SmfRecorder_new,
+  tp_alloc: PyType_GenericAlloc,
+  tp_free: PyObject_Del,
+  tp_methods: SmfRecorder_methods,
+  tp_getset: SmfRecorder_getset,
+};
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// alsaseq.EventLogger and alsaseq.EventLog implementation
+//////////////////////////////////////////////////////////////////////////////
+
+/* magic and version of the event log files */
+#define SEQ_LOG_MAGIC "PYALSAEV"
+#define SEQ_LOG_VERSION 1
+
+/** header of an event log file; the whole file is in native byte order
+    (a log from another byte order has a wrong version) */
+typedef struct {
+  char magic[8];
+  unsigned short version;
+  unsigned short header_size;
+  /* sizeof(snd_seq_event_t) of the writer */
+  unsigned short event_size;
+  /* client id of the logging Sequencer */
+  unsigned short client;
+  /* wall clock time of the start of the log */
+  unsigned long long start_sec;
+  unsigned int start_nsec;
+  unsigned int reserved;
+} seq_log_header_t;
+
+/** header of a log record; it is followed by the raw snd_seq_event_t
+    (data.ext.ptr cleared) and, for variable length events, by the
+    data.ext.len bytes of data */
+typedef struct {
+  /* nanoseconds since the start of the log (monotonic clock) */
+  unsigned long long time;
+} seq_log_record_t;
+
+/* size of a record without variable length data */
+#define SEQ_LOG_RECORD_SIZE (sizeof(seq_log_record_t) + \
+			     sizeof(snd_seq_event_t))
+
+/** alsaseq.EventLogger __doc__ */
+PyDoc_STRVAR(EventLogger__doc__,
+  "EventLogger(sequencer, file, buffer_size = 65536, flush_ms = 100)\n"
+  "  -> EventLogger object\n"
+  "\n"
+  "Logs all the events received by sequencer to an append-only binary\n"
+  "file, to be read with EventLog. The events are read by a native\n"
+  "thread (as for start_dispatch()) and stored as raw snd_seq_event_t\n"
+  "records with their variable length data and a capture time; no\n"
+  "Python object is created per event, so floods of clock or controller\n"
+  "events are captured at the rate the kernel delivers them.\n"
+  "\n"
+  "The records are written when buffer_size bytes are buffered, or\n"
+  "flush_ms after the last write. The input of the sequencer is owned by\n"
+  "the logger between start() and stop(). A file cut short (crash) is\n"
+  "readable up to its last complete record.\n"
+  "\n"
+  "Parameters:\n"
+  "  sequencer -- the Sequencer (opened for input)\n"
+  "  file -- a path, a file descriptor or an object with fileno()\n"
+  "  buffer_size -- (int) bytes buffered before writing\n"
+  "  flush_ms -- (int) max time the records stay in the buffer; 0 writes\n"
+  "              after each burst of events\n"
+  "Raises:\n"
+  "  ValueError: if a parameter is out of range\n"
+  "  OSError: if the file can't be opened."
+);
+
+/** alsaseq.EventLogger object structure type */
+typedef struct {
+  PyObject_HEAD
+  ;
+
+  SequencerObject *seq;
+  int fd;
+  int own_fd;
+  unsigned char *buffer;
+  size_t len;
+  size_t size;
+  long flush_ms;
+
+  seq_reader_t reader;
+  int logging;
+  struct timespec start;
+  struct timespec last_write;
+
+  /* counters; write_error is the errno of the first failed write */
+  unsigned long logged;
+  size_t written;
+  int write_error;
+} EventLoggerObject;
+
+/** internal use: write the buffered records */
+static void
+_EventLogger_write(EventLoggerObject *self) {
+  if (self->len > 0 && self->write_error == 0) {
+    self->write_error = _seq_write_all(self->fd, self->buffer, self->len,
+				       &self->written);
+  }
+  self->len = 0;
+  clock_gettime(CLOCK_MONOTONIC, &self->last_write);
+}
+
+/** internal use: reader sink; appends a record */
+static void
+_EventLogger_sink(seq_reader_t *reader,
+		  const snd_seq_event_t *event) {
+  EventLoggerObject *self = reader->data;
+  seq_log_record_t rec;
+  snd_seq_event_t ev;
+  struct timespec now;
+  size_t extlen = 0;
+  size_t n;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  rec.time = (unsigned long long)(now.tv_sec - self->start.tv_sec) *
+    1000000000ULL + now.tv_nsec - self->start.tv_nsec;
+  memcpy(&ev, event, sizeof(ev));
+  if (snd_seq_ev_is_variable(event)) {
+    extlen = event->data.ext.len;
+    ev.data.ext.ptr = NULL;
+  }
+
+  n = SEQ_LOG_RECORD_SIZE + extlen;
+  if (self->len + n > self->size) {
+    _EventLogger_write(self);
+  }
+  if (n > self->size) {
+    /* larger than the buffer: written directly */
+    memcpy(self->buffer, &rec, sizeof(rec));
+    memcpy(self->buffer + sizeof(rec), &ev, sizeof(ev));
+    self->len = SEQ_LOG_RECORD_SIZE;
+    _EventLogger_write(self);
+    if (self->write_error == 0) {
+      self->write_error = _seq_write_all(self->fd, event->data.ext.ptr,
+					 extlen, &self->written);
+    }
+  } else {
+    memcpy(self->buffer + self->len, &rec, sizeof(rec));
+    memcpy(self->buffer + self->len + sizeof(rec), &ev, sizeof(ev));
+    if (extlen > 0) {
+      memcpy(self->buffer + self->len + SEQ_LOG_RECORD_SIZE,
+	     event->data.ext.ptr, extlen);
+    }
+    self->len += n;
+  }
+  __atomic_add_fetch(&self->logged, 1, __ATOMIC_RELAXED);
+}
+
+/** internal use: reader flush; writes the records older than flush_ms */
+static void
+_EventLogger_flush(seq_reader_t *reader) {
+  EventLoggerObject *self = reader->data;
+  struct timespec now;
+  long elapsed;
+
+  if (self->len == 0) {
+    return;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  elapsed = (now.tv_sec - self->last_write.tv_sec) * 1000 +
+    (now.tv_nsec - self->last_write.tv_nsec) / 1000000;
+  if (elapsed >= self->flush_ms) {
+    _EventLogger_write(self);
+  }
+}
+
+/** alsaseq.EventLogger tp_init */
+static int
+EventLogger_init(EventLoggerObject *self,
+		 PyObject *args,
+		 PyObject *kwds) {
+  SequencerObject *seq;
+  PyObject *file;
+  Py_ssize_t buffer_size = 65536;
+  long flush_ms = 100;
+  unsigned char *buffer;
+  int fd, own_fd;
+
+  char *kwlist[] = {"sequencer", "file", "buffer_size", "flush_ms", NULL};
+
+  if (self->logging) {
+    RAISESTR("The logger is logging");
+    return -1;
+  }
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!O|nl", kwlist,
+				   &SequencerType, &seq, &file,
+				   &buffer_size, &flush_ms)) {
+    return -1;
+  }
+  if (buffer_size < (Py_ssize_t)SEQ_LOG_RECORD_SIZE || flush_ms < 0) {
+    PyErr_Format(PyExc_ValueError,
+		 "buffer_size must be >= %d and flush_ms >= 0",
+		 (int)SEQ_LOG_RECORD_SIZE);
+    return -1;
+  }
+  buffer = malloc(buffer_size);
+  if (buffer == NULL) {
+    PyErr_NoMemory();
+    return -1;
+  }
+  fd = _seq_open_output(file, &own_fd);
+  if (fd < 0) {
+    free(buffer);
+    return -1;
+  }
+
+  if (self->own_fd && self->fd >= 0) {
+    close(self->fd);
+  }
+  free(self->buffer);
+  Py_XDECREF(self->seq);
+  Py_INCREF(seq);
+  self->seq = seq;
+  self->fd = fd;
+  self->own_fd = own_fd;
+  self->buffer = buffer;
+  self->size = buffer_size;
+  self->len = 0;
+  self->flush_ms = flush_ms;
+
+  return 0;
+}
+
+/** alsaseq.EventLogger start() method: __doc__ */
+PyDoc_STRVAR(EventLogger_start__doc__,
+  "start()\n"
+  "\n"
+  "Write the header of the log and start the reader thread. A log is\n"
+  "written by one run: once stopped, the logger must be initialized\n"
+  "again with a file for a new log.\n"
+  "\n"
+  "Raises:\n"
+  "  SequencerError: if already logging or stopped, if the input of the\n"
+  "                  sequencer is owned or can't be read\n"
+  "  OSError: if the file can't be written."
+);
+
+/** alsaseq.EventLogger start() method */
+static PyObject *
+EventLogger_start(EventLoggerObject *self,
+		  PyObject *args) {
+  seq_log_header_t header;
+  struct timespec now;
+  int ret;
+
+  if (self->seq == NULL) {
+    RAISESTR("The logger is not initialized");
+    return NULL;
+  }
+  if (self->logging) {
+    RAISESTR("The logger is logging");
+    return NULL;
+  }
+  if (self->fd < 0) {
+    RAISESTR("The log is stopped, call __init__() for a new one");
+    return NULL;
+  }
+  if (_Sequencer_check_input(self->seq) < 0) {
+    return NULL;
+  }
+  if (self->seq->areading) {
+    RAISESTR("The input is owned by areceive()");
+    return NULL;
+  }
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  clock_gettime(CLOCK_MONOTONIC, &self->start);
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SEQ_LOG_MAGIC, sizeof(header.magic));
+  header.version = SEQ_LOG_VERSION;
+  header.header_size = sizeof(header);
+  header.event_size = sizeof(snd_seq_event_t);
+  header.client = snd_seq_client_id(self->seq->handle);
+  header.start_sec = now.tv_sec;
+  header.start_nsec = now.tv_nsec;
+
+  self->logged = 0;
+  self->written = 0;
+  self->write_error = 0;
+  memcpy(self->buffer, &header, sizeof(header));
+  self->len = sizeof(header);
+  _EventLogger_write(self);
+  if (self->write_error) {
+    errno = self->write_error;
+    PyErr_SetFromErrno(PyExc_OSError);
+    return NULL;
+  }
+
+  self->reader.handle = self->seq->handle;
+  self->reader.mode = self->seq->mode;
+  self->reader.sink = _EventLogger_sink;
+  self->reader.flush = _EventLogger_flush;
+  self->reader.data = self;
+  self->reader.filter = &self->seq->filter;
+  ret = _seq_reader_start(&self->reader);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to start logging");
+    return NULL;
+  }
+
+  self->logging = 1;
+  self->seq->input_owner = "EventLogger";
+
+  Py_RETURN_NONE;
+}
+
+/** alsaseq.EventLogger stats() method: __doc__ */
+PyDoc_STRVAR(EventLogger_stats__doc__,
+  "stats() -> dict\n"
+  "\n"
+  "Returns the counters of the logging:\n"
+  "  'events' -> events read by the reader thread\n"
+  "  'overruns' -> input overruns reported by ALSA (events lost in the\n"
+  "                kernel)\n"
+  "  'logged' -> records stored\n"
+  "  'bytes' -> bytes written to the file\n"
+  "  'error' -> the ALSA error which stopped the reader thread, or 0\n"
+  "  'write_error' -> the errno of the first failed write, or 0"
+);
+
+/** alsaseq.EventLogger stats() method */
+static PyObject *
+EventLogger_stats(EventLoggerObject *self,
+		  PyObject *args) {
+  return Py_BuildValue("{sksksksnsisi}",
+		       "events",
+		       __atomic_load_n(&self->reader.events, __ATOMIC_RELAXED),
+		       "overruns",
+		       __atomic_load_n(&self->reader.overruns,
+				       __ATOMIC_RELAXED),
+		       "logged",
+		       __atomic_load_n(&self->logged, __ATOMIC_RELAXED),
+		       "bytes",
+		       (Py_ssize_t)__atomic_load_n(&self->written,
+						   __ATOMIC_RELAXED),
+		       "error", self->reader.error,
+		       "write_error", self->write_error);
+}
+
+/** internal use: stop the reader thread and write the buffered records;
+    returns 0 or the errno of the file */
 static int
-Sequencer_set_clientname(SequencerObject *self,
-			 PyObject *val) {
-  char *s;
+_EventLogger_stop(EventLoggerObject *self) {
+  Py_BEGIN_ALLOW_THREADS;
+  _seq_reader_stop(&self->reader);
+  _EventLogger_write(self);
+  if (self->write_error == 0 && fsync(self->fd) < 0 && errno != EINVAL) {
+    self->write_error = errno;
+  }
+  Py_END_ALLOW_THREADS;
 
-  if (get_utf8_string(val, &s))
+  /* the log is complete: a second start() would append a header */
+  if (self->own_fd) {
+    close(self->fd);
+  }
+  self->fd = -1;
+  self->own_fd = 0;
+  self->logging = 0;
+  self->seq->input_owner = NULL;
+
+  return self->write_error;
+}
+
+/** alsaseq.EventLogger stop() method: __doc__ */
+PyDoc_STRVAR(EventLogger_stop__doc__,
+  "stop() -> dict\n"
+  "\n"
+  "Stop the reader thread, write the buffered records and fsync() the\n"
+  "file; a file opened from a path is closed. The logger can't be\n"
+  "started again without a new __init__().\n"
+  "\n"
+  "Returns:\n"
+  "  (dict) the counters of the logging, like stats()\n"
+  "Raises:\n"
+  "  SequencerError: if not logging\n"
+  "  OSError: if the file could not be written."
+);
+
+/** alsaseq.EventLogger stop() method */
+static PyObject *
+EventLogger_stop(EventLoggerObject *self,
+		 PyObject *args) {
+  int err;
+
+  if (!self->logging) {
+    RAISESTR("The logger is not logging");
+    return NULL;
+  }
+
+  err = _EventLogger_stop(self);
+  if (err) {
+    errno = err;
+    PyErr_SetFromErrno(PyExc_OSError);
+    return NULL;
+  }
+
+  return EventLogger_stats(self, NULL);
+}
+
+/** alsaseq.EventLogger tp_dealloc */
+static void
+EventLogger_dealloc(EventLoggerObject *self) {
+  if (self->logging) {
+    _EventLogger_stop(self);
+  }
+  if (self->own_fd && self->fd >= 0) {
+    close(self->fd);
+  }
+  free(self->buffer);
+  Py_XDECREF(self->seq);
+  Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+/** alsaseq.EventLogger logging attribute: tp_getset getter() */
+static PyObject *
+EventLogger_get_logging(EventLoggerObject *self) {
+  return get_bool(self->logging);
+}
+
+/** alsaseq.EventLogger tp_getset list */
+static PyGetSetDef EventLogger_getset[] = {
+  {"logging",
+   (getter) EventLogger_get_logging,
+   NULL,
+   "True between start() and stop().",
+   NULL},
+  {NULL}
+};
+
+/** alsaseq.EventLogger tp_methods */
+static PyMethodDef EventLogger_methods[] = {
+  {"start",
+   (PyCFunction) EventLogger_start,
+   METH_VARARGS,
+   EventLogger_start__doc__},
+  {"stop",
+   (PyCFunction) EventLogger_stop,
+   METH_VARARGS,
+   EventLogger_stop__doc__},
+  {"stats",
+   (PyCFunction) EventLogger_stats,
+   METH_VARARGS,
+   EventLogger_stats__doc__},
+  {NULL}
+};
+
+/** alsaseq.EventLogger tp_new */
+static PyObject *
+EventLogger_new(PyTypeObject *type,
+		PyObject *args,
+		PyObject *kwds) {
+  EventLoggerObject *self;
+
+  self = (EventLoggerObject *)type->tp_alloc(type, 0);
+  if (self != NULL) {
+    self->fd = -1;
+  }
+  return (PyObject *)self;
+}
+
+/** alsaseq.EventLogger type */
+static PyTypeObject EventLoggerType = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  tp_name: "alsaseq.EventLogger",
+  tp_basicsize: sizeof(EventLoggerObject),
+  tp_dealloc: (destructor) EventLogger_dealloc,
+  tp_flags: Py_TPFLAGS_DEFAULT,
+  tp_doc: EventLogger__doc__,
+  tp_init: (initproc) EventLogger_init,
+  tp_new: EventLogger_new,
+  tp_alloc: PyType_GenericAlloc,
+  tp_free: PyObject_Del,
+  tp_methods: EventLogger_methods,
+  tp_getset: EventLogger_getset,
+};
+
+/** alsaseq.EventLog __doc__ */
+PyDoc_STRVAR(EventLog__doc__,
+  "EventLog(file) -> EventLog object\n"
+  "\n"
+  "Reads a log written by EventLogger. The file is a path (the file is\n"
+  "mapped in memory) or a bytes-like object. An index of the records is\n"
+  "built when opening, so any event is available at once:\n"
+  "  len(log) -> number of records\n"
+  "  log[i] -> the i-th event, as a new SeqEvent\n"
+  "  for event in log: ... -> the events, created one at a time\n"
+  "\n"
+  "records() and times() export ranges of events as packed arrays,\n"
+  "e.g. for numpy.frombuffer().\n"
+  "\n"
+  "The attributes are:\n"
+  "start_time -- wall clock time of the start of the log (seconds since\n"
+  "              the epoch)\n"
+  "client -- client id of the logging Sequencer\n"
+  "truncated -- True if the file ends with an incomplete record\n"
+  "\n"
+  "Raises:\n"
+  "  ValueError: if the file is not an event log of this machine\n"
+  "  OSError: if the file can't be read\n"
+  "  RuntimeError: on re-initialization while records() runs in another\n"
+  "                thread."
+);
+
+/** alsaseq.EventLog object structure type */
+typedef struct {
+  PyObject_HEAD
+  ;
+
+  seq_file_t file;
+  /* offset of each record in the file */
+  size_t *offsets;
+  size_t count;
+  int truncated;
+  int client;
+  double start_time;
+  /* number of records() calls reading the file with the GIL released */
+  int in_use;
+} EventLogObject;
+
+/** internal use: build the index of the records */
+static int
+_EventLog_index(EventLogObject *self,
+		size_t pos) {
+  snd_seq_event_t ev;
+  size_t size = 0;
+  size_t n;
+
+  while (pos < self->file.size) {
+    if (self->file.size - pos < SEQ_LOG_RECORD_SIZE) {
+      self->truncated = 1;
+      break;
+    }
+    memcpy(&ev, self->file.data + pos + sizeof(seq_log_record_t),
+	   sizeof(ev));
+    n = SEQ_LOG_RECORD_SIZE;
+    if (snd_seq_ev_is_variable(&ev)) {
+      n += ev.data.ext.len;
+    }
+    if (self->file.size - pos < n) {
+      self->truncated = 1;
+      break;
+    }
+
+    if (self->count == size) {
+      size_t *offsets;
+      size = size ? size * 2 : 4096;
+      offsets = realloc(self->offsets, size * sizeof(size_t));
+      if (offsets == NULL) {
+	PyErr_NoMemory();
+	return -1;
+      }
+      self->offsets = offsets;
+    }
+    self->offsets[self->count++] = pos;
+    pos += n;
+  }
+  return 0;
+}
+
+/** internal use: release the file and the index */
+static void
+_EventLog_clear(EventLogObject *self) {
+  _seq_file_release(&(self->file));
+  FREECHECKED("offsets", self->offsets);
+  self->count = 0;
+  self->truncated = 0;
+}
+
+/** alsaseq.EventLog tp_init */
+static int
+EventLog_init(EventLogObject *self,
+	      PyObject *args,
+	      PyObject *kwds) {
+  seq_log_header_t header;
+  PyObject *file;
+
+  char *kwlist[] = {"file", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist, &file)) {
     return -1;
+  }
+  if (self->in_use > 0) {
+    PyErr_SetString(PyExc_RuntimeError,
+		    "EventLog is being read in another thread");
+    return -1;
+  }
 
-  snd_seq_set_client_name(self->handle, s);
-  free(s);
+  _EventLog_clear(self);
+  if (_seq_file_load(&(self->file), file, MADV_NORMAL) < 0) {
+    return -1;
+  }
+
+  if (self->file.size < sizeof(header)) {
+    goto __invalid;
+  }
+  memcpy(&header, self->file.data, sizeof(header));
+  if (memcmp(header.magic, SEQ_LOG_MAGIC, sizeof(header.magic)) ||
+      header.version != SEQ_LOG_VERSION ||
+      header.header_size < sizeof(header) ||
+      header.header_size > self->file.size) {
+    goto __invalid;
+  }
+  if (header.event_size != sizeof(snd_seq_event_t)) {
+    PyErr_Format(PyExc_ValueError,
+		 "Event log written with events of %d bytes (expected %d)",
+		 header.event_size, (int)sizeof(snd_seq_event_t));
+    _EventLog_clear(self);
+    return -1;
+  }
+  self->client = header.client;
+  self->start_time = header.start_sec + header.start_nsec / 1e9;
+
+  if (_EventLog_index(self, header.header_size) < 0) {
+    _EventLog_clear(self);
+    return -1;
+  }
+
+  return 0;
+
+ __invalid:
+  _EventLog_clear(self);
+  PyErr_SetString(PyExc_ValueError, "Not an event log (or written on a "
+		  "machine with another byte order)");
+  return -1;
+}
+
+/** alsaseq.EventLog tp_dealloc */
+static void
+EventLog_dealloc(EventLogObject *self) {
+  _EventLog_clear(self);
+  Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+/** internal use: get the record at index; the variable length data of
+    event points into the file */
+static void
+_EventLog_get(EventLogObject *self,
+	      size_t index,
+	      snd_seq_event_t *event,
+	      unsigned long long *time) {
+  const unsigned char *p = self->file.data + self->offsets[index];
+  seq_log_record_t rec;
+
+  memcpy(&rec, p, sizeof(rec));
+  memcpy(event, p + sizeof(rec), sizeof(*event));
+  if (snd_seq_ev_is_variable(event)) {
+    event->data.ext.ptr = (void *)(p + SEQ_LOG_RECORD_SIZE);
+  }
+  if (time != NULL) {
+    *time = rec.time;
+  }
+}
+
+/** alsaseq.EventLog sq_length */
+static Py_ssize_t
+EventLog_length(EventLogObject *self) {
+  return self->count;
+}
+
+/** alsaseq.EventLog sq_item */
+static PyObject *
+EventLog_item(EventLogObject *self,
+	      Py_ssize_t index) {
+  snd_seq_event_t event;
+
+  if (index < 0 || (size_t)index >= self->count) {
+    PyErr_SetString(PyExc_IndexError, "event index out of range");
+    return NULL;
+  }
+  _EventLog_get(self, index, &event, NULL);
+  return SeqEvent_create(&event);
+}
 
+/** internal use: parse the (start, stop) arguments of the exports */
+static int
+_EventLog_range(EventLogObject *self,
+		PyObject *args,
+		PyObject *kwds,
+		Py_ssize_t *start,
+		Py_ssize_t *stop) {
+  char *kwlist[] = {"start", "stop", NULL};
+
+  *start = 0;
+  *stop = self->count;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|nn", kwlist, start, stop)) {
+    return -1;
+  }
+  PySlice_AdjustIndices(self->count, start, stop, 1);
+  /* an empty range, as for a slice */
+  if (*stop < *start) {
+    *stop = *start;
+  }
   return 0;
 }
 
-/** alsaseq.Sequencer streams attribute: __doc__ */
-PyDoc_STRVAR(Sequencer_streams__doc__,
-  "streams -> Constant object\n"
-  "\n"
-  "The streams of this alsaseq.Sequencer. Posible values:\n"
-  "alsaseq.SEQ_OPEN_OUTPUT, alsaseq.SEQ_OPEN_INPUT, \n"
-  "alsaseq.SEQ_OPEN_DUPLEX.\n"
-  "Note: read-only attribute."
-);
-
-/** alsaseq.Sequencer streams attribute: tp_getset getter() */
+/** alsaseq.EventLog records() method: __doc__ */
+PyDoc_STRVAR(EventLog_records__doc__,
+  "records(start = 0, stop = len(log)) -> bytes\n"
+  "\n"
+  "Returns the events start to stop (as for a slice) as packed records,\n"
+  "in the format of Sequencer.receive_records() (SEQ_RECORD_FORMAT,\n"
+  "SEQ_RECORD_SIZE bytes each)."
+);
+
+/** alsaseq.EventLog records() method */
+static PyObject *
+EventLog_records(EventLogObject *self,
+		 PyObject *args,
+		 PyObject *kwds) {
+  snd_seq_event_t event;
+  seq_record_t *records;
+  Py_ssize_t start, stop, i;
+  PyObject *bytes;
+
+  if (_EventLog_range(self, args, kwds, &start, &stop) < 0) {
+    return NULL;
+  }
+  bytes = PyBytes_FromStringAndSize(NULL, (stop - start) *
+				    sizeof(seq_record_t));
+  if (bytes == NULL) {
+    return NULL;
+  }
+  records = (seq_record_t *)PyBytes_AS_STRING(bytes);
+
+  self->in_use++;
+  Py_BEGIN_ALLOW_THREADS;
+  for (i = start; i < stop; i++) {
+    _EventLog_get(self, i, &event, NULL);
+    _seq_record_pack(&records[i - start], &event);
+  }
+  Py_END_ALLOW_THREADS;
+  self->in_use--;
+
+  return bytes;
+}
+
+/** alsaseq.EventLog times() method: __doc__ */
+PyDoc_STRVAR(EventLog_times__doc__,
+  "times(start = 0, stop = len(log)) -> bytes\n"
+  "\n"
+  "Returns the capture times of the events start to stop (as for a\n"
+  "slice), in nanoseconds since the start of the log, as an array of\n"
+  "native unsigned 64-bit integers (struct format 'Q', numpy 'u8')."
+);
+
+/** alsaseq.EventLog times() method */
+static PyObject *
+EventLog_times(EventLogObject *self,
+	       PyObject *args,
+	       PyObject *kwds) {
+  unsigned long long *times;
+  snd_seq_event_t event;
+  Py_ssize_t start, stop, i;
+  PyObject *bytes;
+
+  if (_EventLog_range(self, args, kwds, &start, &stop) < 0) {
+    return NULL;
+  }
+  bytes = PyBytes_FromStringAndSize(NULL, (stop - start) *
+				    sizeof(unsigned long long));
+  if (bytes == NULL) {
+    return NULL;
+  }
+  times = (unsigned long long *)PyBytes_AS_STRING(bytes);
+
+  for (i = start; i < stop; i++) {
+    _EventLog_get(self, i, &event, &times[i - start]);
+  }
+
+  return bytes;
+}
+
+/** alsaseq.EventLog start_time attribute: tp_getset getter() */
+static PyObject *
+EventLog_get_start_time(EventLogObject *self) {
+  return PyFloat_FromDouble(self->start_time);
+}
+
+/** alsaseq.EventLog client attribute: tp_getset getter() */
+static PyObject *
+EventLog_get_client(EventLogObject *self) {
+  return PyInt_FromLong(self->client);
+}
+
+/** alsaseq.EventLog truncated attribute: tp_getset getter() */
+static PyObject *
+EventLog_get_truncated(EventLogObject *self) {
+  return get_bool(self->truncated);
+}
+
+/** alsaseq.EventLog tp_getset list */
+static PyGetSetDef EventLog_getset[] = {
+  {"start_time",
+   (getter) EventLog_get_start_time,
+   NULL,
+   "Wall clock time of the start of the log.",
+   NULL},
+  {"client",
+   (getter) EventLog_get_client,
+   NULL,
+   "Client id of the logging Sequencer.",
+   NULL},
+  {"truncated",
+   (getter) EventLog_get_truncated,
+   NULL,
+   "True if the file ends with an incomplete record.",
+   NULL},
+  {NULL}
+};
+
+/** alsaseq.EventLog tp_methods */
+static PyMethodDef EventLog_methods[] = {
+  {"records",
+   (PyCFunction) EventLog_records,
+   METH_VARARGS | METH_KEYWORDS,
+   EventLog_records__doc__},
+  {"times",
+   (PyCFunction) EventLog_times,
+   METH_VARARGS | METH_KEYWORDS,
+   EventLog_times__doc__},
+  {NULL}
+};
+
+/** alsaseq.EventLog tp_as_sequence */
+static PySequenceMethods EventLog_as_sequence = {
+  sq_length: (lenfunc) EventLog_length,
+  sq_item: (ssizeargfunc) EventLog_item,
+};
+
+/** alsaseq.EventLog type */
+static PyTypeObject EventLogType = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  tp_name: "alsaseq.EventLog",
+  tp_basicsize: sizeof(EventLogObject),
+  tp_dealloc: (destructor) EventLog_dealloc,
+  tp_flags: Py_TPFLAGS_DEFAULT,
+  tp_doc: EventLog__doc__,
+  tp_init: (initproc) EventLog_init,
+  tp_new: PyType_GenericNew,
+  tp_alloc: PyType_GenericAlloc,
+  tp_free: PyObject_Del,
+  tp_as_sequence: &EventLog_as_sequence,
+  tp_methods: EventLog_methods,
+  tp_getset: EventLog_getset,
+};
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// alsaseq.SeqTopology implementation
+//////////////////////////////////////////////////////////////////////////////
+
+/** alsaseq.SeqTopology __doc__ */
+PyDoc_STRVAR(SeqTopology__doc__,
+  "SeqTopology(name = 'default', auto_update = True) -> SeqTopology object\n"
+  "\n"
+  "A cache of the clients, ports and connections of the ALSA sequencer.\n"
+  "The topology is read once with a full walk, then kept up to date by\n"
+  "the System Announce events (client and port start/exit/change, port\n"
+  "subscribed/unsubscribed), received on a sequencer handle of its own.\n"
+  "Lookups by address are dictionary lookups; generation is incremented\n"
+  "on each change, so callers can tell cheaply if something changed.\n"
+  "\n"
+  "With auto_update, the pending announcements are applied before each\n"
+  "query (a non-blocking read); else call update(), e.g. when fileno()\n"
+  "is readable.\n"
+  "\n"
+  "Parameters:\n"
+  "  name -- the ALSA sequencer device name\n"
+  "  auto_update -- (bool) apply the announcements before each query\n"
+  "Raises:\n"
+  "  SequencerError: if the sequencer can't be opened or the announce\n"
+  "                  port can't be subscribed."
+);
+
+/** internal use: an entry of the name index */
+typedef struct {
+  int client;
+  int port;			/* -1 for the client entries */
+  char *name;			/* client or port name */
+} seq_name_entry_t;
+
+/** internal use: order of the client index: name, then id */
+static int
+_seq_name_cmp_client(const void *a,
+		     const void *b) {
+  const seq_name_entry_t *x = a, *y = b;
+  int ret = strcmp(x->name, y->name);
+
+  return ret != 0 ? ret : x->client - y->client;
+}
+
+/** internal use: order of the port index: client, name, then id */
+static int
+_seq_name_cmp_port(const void *a,
+		   const void *b) {
+  const seq_name_entry_t *x = a, *y = b;
+  int ret;
+
+  if (x->client != y->client) {
+    return x->client - y->client;
+  }
+  ret = strcmp(x->name, y->name);
+  return ret != 0 ? ret : x->port - y->port;
+}
+
+/** internal use: free a name index */
+static void
+_seq_names_free(seq_name_entry_t **names,
+		size_t *count) {
+  size_t i;
+
+  for (i = 0; *names != NULL && i < *count; i++) {
+    free((*names)[i].name);
+  }
+  free(*names);
+  *names = NULL;
+  *count = 0;
+}
+
+/** internal use: the first entry of a sorted range not ordered before
+    key (lower bound) */
+static size_t
+_seq_names_lower(const seq_name_entry_t *names,
+		 size_t count,
+		 const seq_name_entry_t *key,
+		 int (*cmp)(const void *, const void *)) {
+  size_t lo = 0, hi = count, mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (cmp(&names[mid], key) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/** alsaseq.SeqTopology object structure type */
+typedef struct {
+  PyObject_HEAD
+  ;
+
+  snd_seq_t *handle;
+  /* client id: dict {'name', 'type', 'ports': set of port ids} */
+  PyObject *clients;
+  /* (client, port): dict {'name', 'type', 'capability',
+     'read': {(client, port): info}, 'write': {(client, port): info}} */
+  PyObject *ports;
+  unsigned long generation;
+  unsigned long announcements;
+  unsigned long walks;
+  int auto_update;
+  /* name index, rebuilt when the generation changes */
+  seq_name_entry_t *cnames;
+  size_t ncnames;
+  seq_name_entry_t *pnames;
+  size_t npnames;
+  unsigned long names_generation;
+  unsigned long index_builds;
+  unsigned long resolves;
+} SeqTopologyObject;
+
+/** internal use: the (client, port) key of an address */
+static PyObject *
+_seq_addr_key(int client,
+	      int port) {
+  return Py_BuildValue("(ii)", client, port);
+}
+
+/** internal use: read the subscriptions of one direction of a port */
+static PyObject *
+_SeqTopology_query_subs(SeqTopologyObject *self,
+			const snd_seq_addr_t *addr,
+			int type) {
+  snd_seq_query_subscribe_t *query;
+  const snd_seq_addr_t *peer;
+  PyObject *dict, *key, *info;
+  int index = 0;
+  int ret;
+
+  dict = PyDict_New();
+  if (dict == NULL) {
+    return NULL;
+  }
+  snd_seq_query_subscribe_alloca(&query);
+  snd_seq_query_subscribe_set_root(query, addr);
+  snd_seq_query_subscribe_set_type(query, type);
+  snd_seq_query_subscribe_set_index(query, index);
+  while (snd_seq_query_port_subscribers(self->handle, query) >= 0) {
+    peer = snd_seq_query_subscribe_get_addr(query);
+    key = _seq_addr_key(peer->client, peer->port);
+    info = Py_BuildValue("{sisisisi}",
+		"queue", snd_seq_query_subscribe_get_queue(query),
+		"exclusive", snd_seq_query_subscribe_get_exclusive(query),
+		"time_update", snd_seq_query_subscribe_get_time_update(query),
+		"time_real", snd_seq_query_subscribe_get_time_real(query));
+    ret = key != NULL && info != NULL ? PyDict_SetItem(dict, key, info) : -1;
+    Py_XDECREF(key);
+    Py_XDECREF(info);
+    if (ret < 0) {
+      Py_DECREF(dict);
+      return NULL;
+    }
+    snd_seq_query_subscribe_set_index(query, ++index);
+  }
+  return dict;
+}
+
+/** internal use: (re)read a client; returns its dict (borrowed), or
+    None if the client is gone */
 static PyObject *
-Sequencer_get_streams(SequencerObject *self) {
-  TCONSTRETURN(STREAMS, self->streams);
-}
+_SeqTopology_query_client(SeqTopologyObject *self,
+			  int client) {
+  snd_seq_client_info_t *cinfo;
+  PyObject *key, *entry, *ports;
+  int ret;
 
-/** alsaseq.Sequencer mode attribute: __doc__ */
-PyDoc_STRVAR(Sequencer_mode__doc__,
-  "mode -> Constant object\n"
-  "\n"
-  "The blocking mode of this alsaseq.Sequencer. Use\n"
-  "alsaseq.SEQ_BLOCK, alsaseq.SEQ_NONBLOCK."
-);
+  key = PyInt_FromLong(client);
+  if (key == NULL) {
+    return NULL;
+  }
+  snd_seq_client_info_alloca(&cinfo);
+  if (snd_seq_get_any_client_info(self->handle, client, cinfo) < 0) {
+    Py_DECREF(key);
+    return Py_None;
+  }
 
-/** alsaseq.Sequencer mode attribute: tp_getset getter() */
-static PyObject *Sequencer_get_mode(SequencerObject *self) {
-  TCONSTRETURN(MODE, self->mode);
+  entry = PyDict_GetItem(self->clients, key);
+  ports = entry != NULL ? PyDict_GetItemString(entry, "ports") : NULL;
+  if (ports != NULL) {
+    Py_INCREF(ports);
+  } else {
+    ports = PySet_New(NULL);
+  }
+  entry = Py_BuildValue("{sssisN}",
+			"name", snd_seq_client_info_get_name(cinfo),
+			"type", snd_seq_client_info_get_type(cinfo),
+			"ports", ports);
+  ret = entry != NULL ? PyDict_SetItem(self->clients, key, entry) : -1;
+  Py_DECREF(key);
+  Py_XDECREF(entry);
+  return ret < 0 ? NULL : entry;
 }
 
-/** alsaseq.Sequencer mode attribute: tp_getset setter() */
+/** internal use: (re)read a port; its connections are read too if subs
+    or if the port is new */
 static int
-Sequencer_set_mode(SequencerObject *self,
-		   PyObject *val) {
+_SeqTopology_query_port(SeqTopologyObject *self,
+			int client,
+			int port,
+			int subs) {
+  snd_seq_port_info_t *pinfo;
+  PyObject *key, *entry, *old, *read, *write, *cl, *ports;
+  snd_seq_addr_t addr;
   int ret;
-  long mode;
 
-  if (get_long(val, &mode))
+  snd_seq_port_info_alloca(&pinfo);
+  if (snd_seq_get_any_port_info(self->handle, client, port, pinfo) < 0) {
+    /* already gone: its exit is announced later */
+    return 0;
+  }
+  key = _seq_addr_key(client, port);
+  if (key == NULL) {
     return -1;
+  }
 
-  if (mode != 0 && mode != SND_SEQ_NONBLOCK) {
-    PyErr_SetString(PyExc_ValueError, "Invalid value for mode.");
+  addr.client = client;
+  addr.port = port;
+  old = PyDict_GetItem(self->ports, key);
+  if (old != NULL && !subs) {
+    read = PyDict_GetItemString(old, "read");
+    write = PyDict_GetItemString(old, "write");
+    Py_XINCREF(read);
+    Py_XINCREF(write);
+  } else {
+    read = _SeqTopology_query_subs(self, &addr, SND_SEQ_QUERY_SUBS_READ);
+    write = _SeqTopology_query_subs(self, &addr, SND_SEQ_QUERY_SUBS_WRITE);
+  }
+  if (read == NULL || write == NULL) {
+    Py_XDECREF(read);
+    Py_XDECREF(write);
+    Py_DECREF(key);
+    return -1;
+  }
+  entry = Py_BuildValue("{sssIsIsNsN}",
+			"name", snd_seq_port_info_get_name(pinfo),
+			"type", snd_seq_port_info_get_type(pinfo),
+			"capability", snd_seq_port_info_get_capability(pinfo),
+			"read", read,
+			"write", write);
+  ret = entry != NULL ? PyDict_SetItem(self->ports, key, entry) : -1;
+  Py_XDECREF(entry);
+  Py_DECREF(key);
+  if (ret < 0) {
     return -1;
   }
 
-  ret = snd_seq_nonblock(self->handle, mode);
-  if (ret == 0) {
-    self->mode = mode;
-  } else {
-    RAISESND(ret, "Failed to set mode");
+  /* the port set of the client */
+  key = PyInt_FromLong(client);
+  if (key == NULL) {
     return -1;
   }
-  return 0;
+  cl = PyDict_GetItem(self->clients, key);
+  Py_DECREF(key);
+  if (cl == NULL) {
+    cl = _SeqTopology_query_client(self, client);
+    if (cl == NULL) {
+      return -1;
+    } else if (cl == Py_None) {
+      return 0;
+    }
+  }
+  ports = PyDict_GetItemString(cl, "ports");
+  key = PyInt_FromLong(port);
+  ret = key != NULL ? PySet_Add(ports, key) : -1;
+  Py_XDECREF(key);
+  return ret;
 }
 
-/** alsaseq.Sequencer client_id attribute: __doc__ */
-PyDoc_STRVAR(Sequencer_client_id__doc__,
-  "client_id -> int\n"
-  "\n"
-  "The client id of this alsaseq.Sequencer.\n"
-  "Note: read-only attribute."
-);
+/** internal use: forget a port and the connections of other ports to
+    it */
+static int
+_SeqTopology_remove_port(SeqTopologyObject *self,
+			 PyObject *key) {
+  PyObject *entry, *peers, *peer, *peerkey, *cl, *ckey, *pkey;
+  const char *dirs[2] = {"read", "write"};
+  Py_ssize_t pos;
+  int i;
+
+  entry = PyDict_GetItem(self->ports, key);
+  if (entry == NULL) {
+    return 0;
+  }
+  Py_INCREF(entry);
+  for (i = 0; i < 2; i++) {
+    peers = PyDict_GetItemString(entry, dirs[i]);
+    pos = 0;
+    while (peers != NULL && PyDict_Next(peers, &pos, &peerkey, NULL)) {
+      peer = PyDict_GetItem(self->ports, peerkey);
+      if (peer != NULL) {
+	/* read of this port is write of the peer, and vice versa */
+	peer = PyDict_GetItemString(peer, dirs[1 - i]);
+	if (peer != NULL && PyDict_DelItem(peer, key) < 0) {
+	  PyErr_Clear();
+	}
+      }
+    }
+  }
+  Py_DECREF(entry);
 
-/** alsaseq.Sequencer client_id attribute: tp_getset getter() */
-static PyObject *
-Sequencer_get_client_id(SequencerObject *self) {
-  snd_seq_client_info_t *cinfo;
+  ckey = PyTuple_GET_ITEM(key, 0);
+  pkey = PyTuple_GET_ITEM(key, 1);
+  cl = PyDict_GetItem(self->clients, ckey);
+  if (cl != NULL) {
+    PySet_Discard(PyDict_GetItemString(cl, "ports"), pkey);
+  }
+  return PyDict_DelItem(self->ports, key);
+}
 
-  snd_seq_client_info_alloca(&cinfo);
-  snd_seq_get_client_info(self->handle, cinfo);
-  return PyInt_FromLong(snd_seq_client_info_get_client(cinfo));
+/** internal use: forget a client and its ports */
+static int
+_SeqTopology_remove_client(SeqTopologyObject *self,
+			   int client) {
+  PyObject *ckey, *cl, *ports, *port, *key;
+  Py_ssize_t i;
+  int ret = 0;
+
+  ckey = PyInt_FromLong(client);
+  if (ckey == NULL) {
+    return -1;
+  }
+  cl = PyDict_GetItem(self->clients, ckey);
+  if (cl != NULL) {
+    /* a copy: the set shrinks while removing */
+    ports = PySequence_List(PyDict_GetItemString(cl, "ports"));
+    if (ports == NULL) {
+      Py_DECREF(ckey);
+      return -1;
+    }
+    for (i = 0; ret == 0 && i < PyList_GET_SIZE(ports); i++) {
+      port = PyList_GET_ITEM(ports, i);
+      key = PyTuple_Pack(2, ckey, port);
+      ret = key != NULL ? _SeqTopology_remove_port(self, key) : -1;
+      Py_XDECREF(key);
+    }
+    Py_DECREF(ports);
+    if (ret == 0) {
+      ret = PyDict_DelItem(self->clients, ckey);
+    }
+  }
+  Py_DECREF(ckey);
+  return ret;
 }
 
-/** alsaseq.Sequencer: tp_getset list*/
-static PyGetSetDef Sequencer_getset[] = {
-  {"name",
-   (getter) Sequencer_get_name,
-   NULL,
-   (char *) Sequencer_name__doc__,
-   NULL},
-  {"clientname",
-   (getter) Sequencer_get_clientname,
-   (setter) Sequencer_set_clientname,
-   (char *) Sequencer_clientname__doc__,
-   NULL},
-  {"streams",
-   (getter) Sequencer_get_streams,
-   NULL,
-   (char *) Sequencer_streams__doc__,
-   NULL},
-  {"mode",
-   (getter) Sequencer_get_mode,
-   (setter) Sequencer_set_mode,
-   (char *) Sequencer_mode__doc__,
-   NULL},
-  {"client_id",
-   (getter) Sequencer_get_client_id,
-   NULL,
-   (char *) Sequencer_client_id__doc__,
-   NULL},
-  {NULL}
-};
+/** internal use: add or remove a connection */
+static int
+_SeqTopology_connect(SeqTopologyObject *self,
+		     const snd_seq_addr_t *sender,
+		     const snd_seq_addr_t *dest,
+		     int connected) {
+  snd_seq_port_subscribe_t *sub;
+  PyObject *skey, *dkey, *sentry, *dentry, *info = NULL;
+  int ret = 0;
+
+  skey = _seq_addr_key(sender->client, sender->port);
+  dkey = _seq_addr_key(dest->client, dest->port);
+  if (skey == NULL || dkey == NULL) {
+    goto __end;
+  }
+  sentry = PyDict_GetItem(self->ports, skey);
+  dentry = PyDict_GetItem(self->ports, dkey);
+
+  if (connected) {
+    snd_seq_port_subscribe_alloca(&sub);
+    snd_seq_port_subscribe_set_sender(sub, sender);
+    snd_seq_port_subscribe_set_dest(sub, dest);
+    if (snd_seq_get_port_subscription(self->handle, sub) < 0) {
+      /* already disconnected: announced later */
+      goto __end;
+    }
+    info = Py_BuildValue("{sisisisi}",
+		"queue", snd_seq_port_subscribe_get_queue(sub),
+		"exclusive", snd_seq_port_subscribe_get_exclusive(sub),
+		"time_update", snd_seq_port_subscribe_get_time_update(sub),
+		"time_real", snd_seq_port_subscribe_get_time_real(sub));
+    if (info == NULL ||
+	(sentry != NULL &&
+	 PyDict_SetItem(PyDict_GetItemString(sentry, "read"), dkey,
+			info) < 0) ||
+	(dentry != NULL &&
+	 PyDict_SetItem(PyDict_GetItemString(dentry, "write"), skey,
+			info) < 0)) {
+      ret = -1;
+    }
+  } else {
+    if (sentry != NULL &&
+	PyDict_DelItem(PyDict_GetItemString(sentry, "read"), dkey) < 0) {
+      PyErr_Clear();
+    }
+    if (dentry != NULL &&
+	PyDict_DelItem(PyDict_GetItemString(dentry, "write"), skey) < 0) {
+      PyErr_Clear();
+    }
+  }
 
-/** alsaseq.Sequencer: tp_repr */
-static PyObject *
-Sequencer_repr(SequencerObject *self) {
+ __end:
+  if (skey == NULL || dkey == NULL) {
+    ret = -1;
+  }
+  Py_XDECREF(info);
+  Py_XDECREF(skey);
+  Py_XDECREF(dkey);
+  return ret;
+}
+
+/** internal use: read the whole topology */
+static int
+_SeqTopology_walk(SeqTopologyObject *self) {
   snd_seq_client_info_t *cinfo;
+  snd_seq_port_info_t *pinfo;
+  int client;
+
+  PyDict_Clear(self->clients);
+  PyDict_Clear(self->ports);
 
   snd_seq_client_info_alloca(&cinfo);
-  snd_seq_get_client_info(self->handle, cinfo);
+  snd_seq_port_info_alloca(&pinfo);
+  snd_seq_client_info_set_client(cinfo, -1);
+  while (snd_seq_query_next_client(self->handle, cinfo) >= 0) {
+    client = snd_seq_client_info_get_client(cinfo);
+    if (_SeqTopology_query_client(self, client) == NULL) {
+      return -1;
+    }
+    snd_seq_port_info_set_client(pinfo, client);
+    snd_seq_port_info_set_port(pinfo, -1);
+    while (snd_seq_query_next_port(self->handle, pinfo) >= 0) {
+      if (_SeqTopology_query_port(self, client,
+				  snd_seq_port_info_get_port(pinfo), 1) < 0) {
+	return -1;
+      }
+    }
+  }
 
-  return PyUnicode_FromFormat("<alsaseq.Sequencer name=%s client_id=%d "
-			     "clientname=%s streams=%d mode=%d at 0x%p>",
-			     snd_seq_name(self->handle),
-			     snd_seq_client_info_get_client(cinfo),
-			     snd_seq_client_info_get_name(cinfo),
-			     self->streams,
-			     self->mode,
-			     self
-			     );
+  self->walks++;
+  self->generation++;
+  return 0;
 }
 
-/** alsaseq.Sequencer create_simple_port() method: __doc__ */
-PyDoc_STRVAR(Sequencer_create_simple_port__doc__,
-  "create_simple_port(name, type, caps=0) -> int"
-  "\n"
-  "Creates a port for receiving or sending events.\n"
-  "\n"
-  "Parameters:\n"
-  "    name -- name of the port\n"
-  "    type -- type of port (use one of the alsaseq.SEQ_PORT_TYPE_*\n"
-  "            constants)\n"
-  "    caps -- capabilites of the port (use bitwise alsaseq.SEQ_PORT_CAP_*\n"
-  "            constants). Default=0\n"
-  "Returns:\n"
-  "  the port id.\n"
-  "Raises:\n"
-  "  TypeError: if an invalid type was used in a parameter\n"
-  "  ValueError: if an invalid value was used in a parameter\n"
-  "  SequencerError: if ALSA can't create the port"
-);
-	
+/** internal use: apply one announcement */
+static int
+_SeqTopology_apply(SeqTopologyObject *self,
+		   const snd_seq_event_t *event) {
+  const snd_seq_addr_t *addr = &event->data.addr;
+  PyObject *key;
+  int ret;
 
-/** alsaseq.Sequencer create_simple_port() method */
+  switch (event->type) {
+  case SND_SEQ_EVENT_CLIENT_START:
+  case SND_SEQ_EVENT_CLIENT_CHANGE:
+    return _SeqTopology_query_client(self, addr->client) == NULL ? -1 : 1;
+  case SND_SEQ_EVENT_CLIENT_EXIT:
+    return _SeqTopology_remove_client(self, addr->client) < 0 ? -1 : 1;
+  case SND_SEQ_EVENT_PORT_START:
+  case SND_SEQ_EVENT_PORT_CHANGE:
+    return _SeqTopology_query_port(self, addr->client, addr->port,
+				   0) < 0 ? -1 : 1;
+  case SND_SEQ_EVENT_PORT_EXIT:
+    key = _seq_addr_key(addr->client, addr->port);
+    if (key == NULL) {
+      return -1;
+    }
+    ret = _SeqTopology_remove_port(self, key);
+    Py_DECREF(key);
+    return ret < 0 ? -1 : 1;
+  case SND_SEQ_EVENT_PORT_SUBSCRIBED:
+  case SND_SEQ_EVENT_PORT_UNSUBSCRIBED:
+    return _SeqTopology_connect(self, &event->data.connect.sender,
+				&event->data.connect.dest,
+				event->type ==
+				SND_SEQ_EVENT_PORT_SUBSCRIBED) < 0 ? -1 : 1;
+  }
+  return 0;
+}
+
+/** internal use: apply the pending announcements; returns the number
+    of changes, or -1 */
+static long
+_SeqTopology_update(SeqTopologyObject *self) {
+  snd_seq_event_t *event;
+  long changes = 0;
+  int ret;
+
+  for (;;) {
+    ret = snd_seq_event_input(self->handle, &event);
+    if (ret == -EAGAIN) {
+      break;
+    } else if (ret == -ENOSPC) {
+      /* announcements lost: start again */
+      if (_SeqTopology_walk(self) < 0) {
+	return -1;
+      }
+      changes++;
+      continue;
+    } else if (ret < 0) {
+      RAISESND(ret, "Failed to read the announcements");
+      return -1;
+    }
+    self->announcements++;
+    ret = _SeqTopology_apply(self, event);
+    if (ret < 0) {
+      return -1;
+    }
+    if (ret > 0) {
+      self->generation++;
+      changes++;
+    }
+  }
+  return changes;
+}
+
+/** internal use: apply the pending announcements if auto_update */
+static int
+_SeqTopology_sync(SeqTopologyObject *self) {
+  if (self->handle == NULL) {
+    RAISESTR("The topology is not initialized");
+    return -1;
+  }
+  if (self->auto_update && _SeqTopology_update(self) < 0) {
+    return -1;
+  }
+  return 0;
+}
+
+/** alsaseq.SeqTopology tp_new */
 static PyObject *
-Sequencer_create_simple_port(SequencerObject *self,
-			     PyObject *args,
-			     PyObject *kwds) {
-  char *name;
-  unsigned int type;
-  unsigned int caps=0;
-  char *kwlist[] = { "name", "type", "caps", NULL };
-  int port;
+SeqTopology_new(PyTypeObject *type,
+		PyObject *args,
+		PyObject *kwds) {
+  SeqTopologyObject *self;
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "sI|I", kwlist,
-				   &name, &type, &caps)) {
+  self = (SeqTopologyObject *)type->tp_alloc(type, 0);
+  if (self == NULL) {
     return NULL;
   }
-
-  port = snd_seq_create_simple_port(self->handle, name, caps, type);
-  if (port < 0) {
-    RAISESND(port, "Failed to create simple port");
+  self->clients = PyDict_New();
+  self->ports = PyDict_New();
+  if (self->clients == NULL || self->ports == NULL) {
+    Py_DECREF(self);
     return NULL;
   }
+  return (PyObject *)self;
+}
+
+/** alsaseq.SeqTopology tp_init */
+static int
+SeqTopology_init(SeqTopologyObject *self,
+		 PyObject *args,
+		 PyObject *kwds) {
+  char *name = "default";
+  int auto_update = 1;
+  int port, ret;
+
+  char *kwlist[] = {"name", "auto_update", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|si", kwlist, &name,
+				   &auto_update)) {
+    return -1;
+  }
+  if (self->handle != NULL) {
+    snd_seq_close(self->handle);
+    self->handle = NULL;
+  }
+  self->auto_update = auto_update;
+
+  ret = snd_seq_open(&self->handle, name, SND_SEQ_OPEN_DUPLEX,
+		     SND_SEQ_NONBLOCK);
+  if (ret < 0) {
+    self->handle = NULL;
+    RAISESND(ret, "Failed to open sequencer %s", name);
+    return -1;
+  }
+  snd_seq_set_client_name(self->handle, "pyalsa-topology");
+  port = snd_seq_create_simple_port(self->handle, "announce",
+				    SND_SEQ_PORT_CAP_WRITE |
+				    SND_SEQ_PORT_CAP_NO_EXPORT,
+				    SND_SEQ_PORT_TYPE_APPLICATION);
+  ret = port;
+  if (port >= 0) {
+    ret = snd_seq_connect_from(self->handle, port, SND_SEQ_CLIENT_SYSTEM,
+			       SND_SEQ_PORT_SYSTEM_ANNOUNCE);
+  }
+  if (ret < 0) {
+    snd_seq_close(self->handle);
+    self->handle = NULL;
+    RAISESND(ret, "Failed to subscribe the announce port");
+    return -1;
+  }
 
-  return PyInt_FromLong(port);
+  /* subscribed first: no change is missed during the walk */
+  if (_SeqTopology_walk(self) < 0) {
+    return -1;
+  }
+  return 0;
 }
 
-/** alsaseq.Sequencer connection_list() method: __doc__ */
-PyDoc_STRVAR(Sequencer_connection_list__doc__,
-  "connection_list() -> list\n"
+/** alsaseq.SeqTopology tp_dealloc */
+static void
+SeqTopology_dealloc(SeqTopologyObject *self) {
+  if (self->handle != NULL) {
+    snd_seq_close(self->handle);
+  }
+  _seq_names_free(&self->cnames, &self->ncnames);
+  _seq_names_free(&self->pnames, &self->npnames);
+  Py_XDECREF(self->clients);
+  Py_XDECREF(self->ports);
+  Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+/** alsaseq.SeqTopology update() method: __doc__ */
+PyDoc_STRVAR(SeqTopology_update__doc__,
+  "update() -> int\n"
   "\n"
-  "List all clients and their ports connections.\n"
+  "Apply the pending announcements. If announcements were lost (input\n"
+  "overrun), the whole topology is read again.\n"
   "\n"
   "Returns:\n"
-  "  (list) a list of tuples: client_name, client_id, port_list:.\n"
-  "    client_name -- the client's name.\n"
-  "    client_id -- the client's id.\n"
-  "    port_list -- a list of tuples: port_name, port_id, connection_list:\n"
-  "      port_name -- the name of the port.\n"
-  "      port_id -- the port id.\n"
-  "      connection_list -- a list of tuples: read_conn, write_conn:\n"
-  "        read_conn -- a list of (client_id, port_id, info) tuples this\n"
-  "                     port is connected to (sends events);\n"
-  "                     info is the same of the get_connect_info() method.\n"
-  "        write_conn -- a list of (client_id, port_id, info) tuples this\n"
-  "                      port is connected from (receives events);\n"
-  "                      info is the same of the get_connect_info() method.\n"
+  "  (int) the number of changes applied\n"
+  "Raises:\n"
+  "  SequencerError: if the announcements can't be read."
 );
 
-
+/** alsaseq.SeqTopology update() method */
 static PyObject *
-_query_connections_list(snd_seq_t *handle,
-			snd_seq_query_subscribe_t *query,
-			int type) {
+SeqTopology_update(SeqTopologyObject *self,
+		   PyObject *args) {
+  long changes;
 
-  PyObject *list = PyList_New(0);
-  int index = 0;
-  snd_seq_query_subscribe_set_type(query, type);
-  snd_seq_query_subscribe_set_index(query, index);
-  while (snd_seq_query_port_subscribers(handle, query) >= 0) {
-    const snd_seq_addr_t *addr =
-      snd_seq_query_subscribe_get_addr(query);
+  if (self->handle == NULL) {
+    RAISESTR("The topology is not initialized");
+    return NULL;
+  }
+  changes = _SeqTopology_update(self);
+  if (changes < 0) {
+    return NULL;
+  }
+  return PyInt_FromLong(changes);
+}
 
-    PyObject *tuple = Py_BuildValue(
-        "(ii{sisisisi})",
-        (int)addr->client,
-        (int)addr->port,
-        "queue", (int)snd_seq_query_subscribe_get_queue(query),
-        "exclusive", (int)snd_seq_query_subscribe_get_exclusive(query),
-        "time_update", (int)snd_seq_query_subscribe_get_time_update(query),
-        "time_real", (int)snd_seq_query_subscribe_get_time_real(query));
+/** alsaseq.SeqTopology refresh() method: __doc__ */
+PyDoc_STRVAR(SeqTopology_refresh__doc__,
+  "refresh()\n"
+  "\n"
+  "Read the whole topology again, discarding the pending announcements."
+);
 
-    PyList_Append(list, tuple);
-    Py_DECREF(tuple);
-    snd_seq_query_subscribe_set_index(query, ++index);
+/** alsaseq.SeqTopology refresh() method */
+static PyObject *
+SeqTopology_refresh(SeqTopologyObject *self,
+		    PyObject *args) {
+  if (self->handle == NULL) {
+    RAISESTR("The topology is not initialized");
+    return NULL;
   }
-  return list;
+  snd_seq_drop_input(self->handle);
+  if (_SeqTopology_walk(self) < 0) {
+    return NULL;
+  }
+  Py_RETURN_NONE;
 }
 
+/** internal use: sorted list of the (client, port, info) connections */
 static PyObject *
-_query_connections(snd_seq_t *handle,
-		   const snd_seq_addr_t *addr) {
-  snd_seq_query_subscribe_t *query;
-  snd_seq_query_subscribe_alloca(&query);
-  snd_seq_query_subscribe_set_root(query, addr);
+_SeqTopology_conn_list(PyObject *conns) {
+  PyObject *list, *key, *info, *item;
+  Py_ssize_t pos = 0;
 
-  // create tuple for read,write lists
-  PyObject *tuple = PyTuple_New(2);
-  PyObject *readlist = _query_connections_list(handle, query,
-					       SND_SEQ_QUERY_SUBS_READ);
-  PyObject *writelist = _query_connections_list(handle, query,
-						SND_SEQ_QUERY_SUBS_WRITE);
-  PyTuple_SetItem(tuple, 0, readlist);
-  PyTuple_SetItem(tuple, 1, writelist);
+  list = PyList_New(0);
+  if (list == NULL) {
+    return NULL;
+  }
+  while (PyDict_Next(conns, &pos, &key, &info)) {
+    item = Py_BuildValue("(OOO)", PyTuple_GET_ITEM(key, 0),
+			 PyTuple_GET_ITEM(key, 1), info);
+    if (item == NULL || PyList_Append(list, item) < 0) {
+      Py_XDECREF(item);
+      Py_DECREF(list);
+      return NULL;
+    }
+    Py_DECREF(item);
+  }
+  if (PyList_Sort(list) < 0) {
+    Py_DECREF(list);
+    return NULL;
+  }
+  return list;
+}
 
-  return tuple;
+/** internal use: a copy of a port entry, with sorted connection lists */
+static PyObject *
+_SeqTopology_port_copy(PyObject *entry) {
+  PyObject *copy, *read, *write;
+
+  read = _SeqTopology_conn_list(PyDict_GetItemString(entry, "read"));
+  write = _SeqTopology_conn_list(PyDict_GetItemString(entry, "write"));
+  copy = PyDict_Copy(entry);
+  if (read == NULL || write == NULL || copy == NULL ||
+      PyDict_SetItemString(copy, "read", read) < 0 ||
+      PyDict_SetItemString(copy, "write", write) < 0) {
+    Py_XDECREF(copy);
+    copy = NULL;
+  }
+  Py_XDECREF(read);
+  Py_XDECREF(write);
+  return copy;
 }
 
-/** alsaseq.Sequencer connection_list() method */
+/** alsaseq.SeqTopology get_port() method: __doc__ */
+PyDoc_STRVAR(SeqTopology_get_port__doc__,
+  "get_port(client, port) -> dict or None\n"
+  "\n"
+  "Returns the cached info of a port, or None if it doesn't exist:\n"
+  "  'name', 'type', 'capability' -> as in Sequencer.get_port_info()\n"
+  "  'read' -> sorted list of (client, port, info) this port sends to\n"
+  "  'write' -> sorted list of (client, port, info) this port receives\n"
+  "             from; info is as in Sequencer.connection_list()"
+);
+
+/** alsaseq.SeqTopology get_port() method */
 static PyObject *
-Sequencer_connection_list(SequencerObject *self,
-			  PyObject *args) {
-  snd_seq_client_info_t *cinfo;
-  snd_seq_port_info_t *pinfo;
-  PyObject *client, *port, *name;
-  PyObject *list = PyList_New(0);
+SeqTopology_get_port(SeqTopologyObject *self,
+		     PyObject *args) {
+  PyObject *key, *entry;
+  int client, port;
 
-  if (list == NULL) {
+  if (!PyArg_ParseTuple(args, "ii", &client, &port)) {
+    return NULL;
+  }
+  if (_SeqTopology_sync(self) < 0) {
+    return NULL;
+  }
+  key = _seq_addr_key(client, port);
+  if (key == NULL) {
     return NULL;
   }
+  entry = PyDict_GetItem(self->ports, key);
+  Py_DECREF(key);
+  if (entry == NULL) {
+    Py_RETURN_NONE;
+  }
+  return _SeqTopology_port_copy(entry);
+}
 
-  snd_seq_client_info_alloca(&cinfo);
-  snd_seq_port_info_alloca(&pinfo);
-  snd_seq_client_info_set_client(cinfo, -1);
-  while (snd_seq_query_next_client(self->handle, cinfo) >= 0) {
-    /* reset query info */
-    snd_seq_port_info_set_client(pinfo,
-				 snd_seq_client_info_get_client(cinfo));
-    snd_seq_port_info_set_port(pinfo, -1);
+/** alsaseq.SeqTopology get_client() method: __doc__ */
+PyDoc_STRVAR(SeqTopology_get_client__doc__,
+  "get_client(client) -> dict or None\n"
+  "\n"
+  "Returns the cached info of a client, or None if it doesn't exist:\n"
+  "  'name' -> name of the client\n"
+  "  'type' -> type of the client (SEQ_USER_CLIENT or SEQ_KERNEL_CLIENT)\n"
+  "  'ports' -> sorted list of its port ids"
+);
 
-    /* create tuple for client info */
-    PyObject *tuple = PyTuple_New(3);
-    PyObject *portlist = PyList_New(0);
+/** alsaseq.SeqTopology get_client() method */
+static PyObject *
+SeqTopology_get_client(SeqTopologyObject *self,
+		       PyObject *args) {
+  PyObject *key, *entry, *copy, *ports;
+  int client;
 
-    name = PyUnicode_FromFormat("%s", snd_seq_client_info_get_name(cinfo));
-    client = PyInt_FromLong(snd_seq_client_info_get_client(cinfo));
-    PyTuple_SetItem(tuple, 0, name);
-    PyTuple_SetItem(tuple, 1, client);
+  if (!PyArg_ParseTuple(args, "i", &client)) {
+    return NULL;
+  }
+  if (_SeqTopology_sync(self) < 0) {
+    return NULL;
+  }
+  key = PyInt_FromLong(client);
+  if (key == NULL) {
+    return NULL;
+  }
+  entry = PyDict_GetItem(self->clients, key);
+  Py_DECREF(key);
+  if (entry == NULL) {
+    Py_RETURN_NONE;
+  }
 
-    while (snd_seq_query_next_port(self->handle, pinfo) >= 0) {
-      /* create tuple for port info */
-      PyObject *porttuple = PyTuple_New(3);
+  ports = PySequence_List(PyDict_GetItemString(entry, "ports"));
+  copy = PyDict_Copy(entry);
+  if (ports == NULL || copy == NULL || PyList_Sort(ports) < 0 ||
+      PyDict_SetItemString(copy, "ports", ports) < 0) {
+    Py_XDECREF(copy);
+    copy = NULL;
+  }
+  Py_XDECREF(ports);
+  return copy;
+}
 
-      name = PyUnicode_FromFormat("%s", snd_seq_port_info_get_name(pinfo));
-      port = PyInt_FromLong(snd_seq_port_info_get_port(pinfo));
+/** alsaseq.SeqTopology connection_list() method: __doc__ */
+PyDoc_STRVAR(SeqTopology_connection_list__doc__,
+  "connection_list() -> list\n"
+  "\n"
+  "The cached topology, in the same format as Sequencer.connection_list();\n"
+  "the clients, ports and connections are sorted by number."
+);
 
-      PyTuple_SetItem(porttuple, 0, name);
-      PyTuple_SetItem(porttuple, 1, port);
+/** alsaseq.SeqTopology connection_list() method */
+static PyObject *
+SeqTopology_connection_list(SeqTopologyObject *self,
+			    PyObject *args) {
+  PyObject *list, *clients, *ckey, *centry, *ports, *pkey, *key, *pentry;
+  PyObject *portlist, *read, *write, *item;
+  Py_ssize_t i, j;
 
-      /* create tuple for read,write connections */
-      PyObject *conntuple =
-	_query_connections(self->handle, snd_seq_port_info_get_addr(pinfo));
-      PyTuple_SetItem(porttuple, 2, conntuple);
+  if (_SeqTopology_sync(self) < 0) {
+    return NULL;
+  }
+  clients = PyDict_Keys(self->clients);
+  if (clients == NULL || PyList_Sort(clients) < 0) {
+    Py_XDECREF(clients);
+    return NULL;
+  }
+  list = PyList_New(0);
+  if (list == NULL) {
+    Py_DECREF(clients);
+    return NULL;
+  }
 
-      PyList_Append(portlist, porttuple);
-      Py_DECREF(porttuple);
+  for (i = 0; i < PyList_GET_SIZE(clients); i++) {
+    ckey = PyList_GET_ITEM(clients, i);
+    centry = PyDict_GetItem(self->clients, ckey);
+    ports = PySequence_List(PyDict_GetItemString(centry, "ports"));
+    portlist = PyList_New(0);
+    if (ports == NULL || portlist == NULL || PyList_Sort(ports) < 0) {
+      goto __error;
     }
-    PyTuple_SetItem(tuple, 2, portlist);
-
-    /* append list of port tuples */
-    PyList_Append(list, tuple);
-    Py_DECREF(tuple);
+    for (j = 0; j < PyList_GET_SIZE(ports); j++) {
+      pkey = PyList_GET_ITEM(ports, j);
+      key = PyTuple_Pack(2, ckey, pkey);
+      pentry = key != NULL ? PyDict_GetItem(self->ports, key) : NULL;
+      Py_XDECREF(key);
+      if (pentry == NULL) {
+	if (PyErr_Occurred()) {
+	  goto __error;
+	}
+	continue;
+      }
+      read = _SeqTopology_conn_list(PyDict_GetItemString(pentry, "read"));
+      write = _SeqTopology_conn_list(PyDict_GetItemString(pentry, "write"));
+      item = read != NULL && write != NULL ?
+	Py_BuildValue("(OO(NN))", PyDict_GetItemString(pentry, "name"),
+		      pkey, read, write) : NULL;
+      if (item == NULL) {
+	if (read == NULL || write == NULL) {
+	  Py_XDECREF(read);
+	  Py_XDECREF(write);
+	}
+	goto __error;
+      }
+      if (PyList_Append(portlist, item) < 0) {
+	Py_DECREF(item);
+	goto __error;
+      }
+      Py_DECREF(item);
+    }
+    item = Py_BuildValue("(OON)", PyDict_GetItemString(centry, "name"),
+			 ckey, portlist);
+    portlist = NULL;
+    Py_CLEAR(ports);
+    if (item == NULL || PyList_Append(list, item) < 0) {
+      Py_XDECREF(item);
+      goto __error;
+    }
+    Py_DECREF(item);
   }
 
+  Py_DECREF(clients);
   return list;
+
+ __error:
+  Py_XDECREF(ports);
+  Py_XDECREF(portlist);
+  Py_DECREF(clients);
+  Py_DECREF(list);
+  return NULL;
 }
 
-/** alsaseq.Sequencer get_client_info() method: __doc__ */
-PyDoc_STRVAR(Sequencer_get_client_info__doc__,
-  "get_client_info(client_id = self.client_id) -> dictionary\n"
-  "\n"
-  "Retrieve info about an existing client.\n"
+/** alsaseq.SeqTopology fileno() method: __doc__ */
+PyDoc_STRVAR(SeqTopology_fileno__doc__,
+  "fileno() -> int\n"
   "\n"
-  "Parameters:\n"
-  "  client_id -- the client id (defaults to: self.client_id)\n"
-  "Returns:\n"
-  "  (dict) a dictionary with the following values:\n"
-  "    id  -- id of client.\n"
-  "    type -- type of client (SEQ_USER_CLIENT or SEQ_KERNEL_CLIENT).\n"
-  "    name -- name of client.\n"
-  "    broadcast_filter -- broadcast filter flag of client as int.\n"
-  "    error_bounce -- error bounce of client as int.\n"
-  "    event_filter -- event filter of client as string.\n"
-  "    num_ports -- number of opened ports of client.\n"
-  "    event_lost -- number of lost events of client.\n"
-  "Raises:\n"
-  " SequencerError: ALSA error occurred."
+  "Returns a descriptor readable when announcements are pending, for\n"
+  "select/poll or an event loop; call update() when it is readable."
 );
 
-/** alsaseq.Sequencer get_client_info() method */
+/** alsaseq.SeqTopology fileno() method */
 static PyObject *
-Sequencer_get_client_info(SequencerObject *self,
-			  PyObject *args,
-			  PyObject *kwds) {
-  snd_seq_client_info_t *cinfo;
-  int client_id = -1;
-  int ret;
-  char *kwlist[] = { "client_id", NULL};
+SeqTopology_fileno(SeqTopologyObject *self,
+		   PyObject *args) {
+  struct pollfd pfd;
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist,
-				   &client_id)) {
+  if (self->handle == NULL ||
+      snd_seq_poll_descriptors(self->handle, &pfd, 1, POLLIN) != 1) {
+    RAISESTR("The topology is not initialized");
     return NULL;
   }
+  return PyInt_FromLong(pfd.fd);
+}
 
-  snd_seq_client_info_alloca(&cinfo);
-  if (client_id == -1) {
-    ret = snd_seq_get_client_info(self->handle, cinfo);
-    if (ret < 0) {
-      RAISESND(ret, "Failed to retrieve client info for self.client_id");
-      return NULL;
+/** internal use: nonzero if str is a non-empty decimal number */
+static int
+_seq_is_number(const char *str) {
+  if (*str == '\0') {
+    return 0;
+  }
+  for (; *str; str++) {
+    if (!isdigit((unsigned char)*str)) {
+      return 0;
     }
-    client_id = snd_seq_client_info_get_client(cinfo);
+  }
+  return 1;
+}
+
+/** internal use: (re)build the name index if the topology changed */
+static int
+_SeqTopology_names(SeqTopologyObject *self) {
+  PyObject *key, *entry, *name;
+  seq_name_entry_t *e;
+  Py_ssize_t pos;
+  const char *str;
+
+  if (self->cnames != NULL && self->names_generation == self->generation) {
+    return 0;
+  }
+  _seq_names_free(&self->cnames, &self->ncnames);
+  _seq_names_free(&self->pnames, &self->npnames);
+
+  /* one more entry each: calloc(0) may return NULL */
+  self->cnames = calloc(PyDict_Size(self->clients) + 1,
+			sizeof(seq_name_entry_t));
+  self->pnames = calloc(PyDict_Size(self->ports) + 1,
+			sizeof(seq_name_entry_t));
+  if (self->cnames == NULL || self->pnames == NULL) {
+    goto __nomem;
+  }
+
+  pos = 0;
+  while (PyDict_Next(self->clients, &pos, &key, &entry)) {
+    name = PyDict_GetItemString(entry, "name");
+    str = name != NULL ? PyUnicode_AsUTF8(name) : NULL;
+    if (str == NULL) {
+      goto __error;
+    }
+    e = &self->cnames[self->ncnames];
+    e->client = PyLong_AsLong(key);
+    e->port = -1;
+    e->name = strdup(str);
+    if (e->name == NULL) {
+      goto __nomem;
+    }
+    self->ncnames++;
+  }
+
+  pos = 0;
+  while (PyDict_Next(self->ports, &pos, &key, &entry)) {
+    name = PyDict_GetItemString(entry, "name");
+    str = name != NULL ? PyUnicode_AsUTF8(name) : NULL;
+    if (str == NULL) {
+      goto __error;
+    }
+    e = &self->pnames[self->npnames];
+    e->client = PyLong_AsLong(PyTuple_GET_ITEM(key, 0));
+    e->port = PyLong_AsLong(PyTuple_GET_ITEM(key, 1));
+    e->name = strdup(str);
+    if (e->name == NULL) {
+      goto __nomem;
+    }
+    self->npnames++;
+  }
+
+  qsort(self->cnames, self->ncnames, sizeof(seq_name_entry_t),
+	_seq_name_cmp_client);
+  qsort(self->pnames, self->npnames, sizeof(seq_name_entry_t),
+	_seq_name_cmp_port);
+  self->names_generation = self->generation;
+  self->index_builds++;
+  return 0;
+
+ __nomem:
+  PyErr_NoMemory();
+ __error:
+  _seq_names_free(&self->cnames, &self->ncnames);
+  _seq_names_free(&self->pnames, &self->npnames);
+  return -1;
+}
+
+/** internal use: find a client by name: exact match, else the lowest
+    client id whose name starts with name; -1 if none */
+static int
+_SeqTopology_find_client(SeqTopologyObject *self,
+			 const char *name) {
+  seq_name_entry_t key = {-1, -1, (char *)name};
+  size_t len = strlen(name);
+  size_t i;
+  int client = -1;
+
+  i = _seq_names_lower(self->cnames, self->ncnames, &key,
+		       _seq_name_cmp_client);
+  if (i < self->ncnames && strcmp(self->cnames[i].name, name) == 0) {
+    return self->cnames[i].client;
+  }
+  for (; i < self->ncnames &&
+	 strncmp(self->cnames[i].name, name, len) == 0; i++) {
+    if (client < 0 || self->cnames[i].client < client) {
+      client = self->cnames[i].client;
+    }
+  }
+  return client;
+}
+
+/** internal use: find a port of a client by name: exact match, else the
+    lowest port id whose name starts with name; -1 if none */
+static int
+_SeqTopology_find_port(SeqTopologyObject *self,
+		       int client,
+		       const char *name) {
+  seq_name_entry_t key = {client, -1, (char *)name};
+  size_t len = strlen(name);
+  size_t i;
+  int port = -1;
+
+  i = _seq_names_lower(self->pnames, self->npnames, &key,
+		       _seq_name_cmp_port);
+  if (i < self->npnames && self->pnames[i].client == client &&
+      strcmp(self->pnames[i].name, name) == 0) {
+    return self->pnames[i].port;
+  }
+  for (; i < self->npnames && self->pnames[i].client == client &&
+	 strncmp(self->pnames[i].name, name, len) == 0; i++) {
+    if (port < 0 || self->pnames[i].port < port) {
+      port = self->pnames[i].port;
+    }
+  }
+  return port;
+}
+
+/** internal use: resolve a client:port string with the name index;
+    returns 0, or a negative errno */
+static int
+_SeqTopology_resolve(SeqTopologyObject *self,
+		     const char *str,
+		     snd_seq_addr_t *addr) {
+  const char *sep, *portname;
+  char *clientname;
+  int client, port;
+
+  /* client names may contain '.', port names can't be given with it */
+  sep = strrchr(str, ':');
+  if (sep == NULL) {
+    sep = strchr(str, '.');
+    if (sep != NULL && !_seq_is_number(sep + 1)) {
+      sep = NULL;
+    }
+  }
+  if (sep == str || *str == '\0') {
+    return -EINVAL;
+  }
+  clientname = sep != NULL ? strndup(str, sep - str) : strdup(str);
+  if (clientname == NULL) {
+    return -ENOMEM;
+  }
+  client = _seq_is_number(clientname) ? atoi(clientname) :
+    _SeqTopology_find_client(self, clientname);
+  free(clientname);
+  if (client < 0) {
+    return -ENOENT;
+  }
+
+  portname = sep != NULL ? sep + 1 : "";
+  if (*portname == '\0') {
+    port = 0;
+  } else if (_seq_is_number(portname)) {
+    port = atoi(portname);
   } else {
-    ret = snd_seq_get_any_client_info(self->handle, client_id, cinfo);
-    if (ret < 0) {
-      RAISESND(ret, "Failed to retrieve client info for '%d'", client_id);
-      return NULL;
+    port = _SeqTopology_find_port(self, client, portname);
+    if (port < 0) {
+      return -ENOENT;
     }
   }
 
-  PyObject *d_id, *d_type;
-  TCONSTASSIGN(ADDR_CLIENT, client_id, d_id);
-  TCONSTASSIGN(CLIENT_TYPE, snd_seq_client_info_get_type(cinfo), d_type);
-  const char *d_name = snd_seq_client_info_get_name(cinfo);
-
-  PyObject *dict = Py_BuildValue(
-      "{sNsNsssisiss#sisi}",
-      "id", d_id,
-      "type", d_type,
-      "name", d_name == NULL ? "" : d_name,
-      "broadcast_filter", (int)snd_seq_client_info_get_broadcast_filter(cinfo),
-      "error_bounce", (int)snd_seq_client_info_get_error_bounce(cinfo),
-      "event_filter", snd_seq_client_info_get_event_filter(cinfo), 32,
-      "num_ports", (int)snd_seq_client_info_get_num_ports(cinfo),
-      "event_lost", (int)snd_seq_client_info_get_event_lost(cinfo));
-
-  return dict;
+  addr->client = client;
+  addr->port = port;
+  self->resolves++;
+  return 0;
 }
 
-/** alsaseq.Sequencer get_port_info() method: __doc__ */
-PyDoc_STRVAR(Sequencer_get_port_info__doc__,
-  "get_port_info(port_id, client_id = self.client_id) -> dictionary\n"
+/** alsaseq.SeqTopology resolve() method: __doc__ */
+PyDoc_STRVAR(SeqTopology_resolve__doc__,
+  "resolve(address) -> tuple\n"
   "\n"
-  "Retrieve info about an existing client's port.\n"
+  "Resolves a client:port string like Sequencer.parse_address(), from\n"
+  "a name index rebuilt only when the topology changes.\n"
+  "The client is an id or a name: an exact name match wins, else the\n"
+  "lowest client id whose name starts with it. The port is an id, or\n"
+  "a port name matched the same way among the ports of the client;\n"
+  "without a port, port 0 is used. 'client.port' is also accepted\n"
+  "with a numeric port.\n"
   "\n"
   "Parameters:\n"
-  "  port_id -- the port id\n"
-  "  client_id -- the client id (defaults to: self.client_id)\n"
+  "  address -- (string) the address, e.g. 'Synth:0' or 'Synth:MIDI 1'\n"
   "Returns:\n"
-  "  (dict) a dictionary with the following values:\n"
-  "    name -- the port name\n"
-  "    type -- the port type bit flags\n"
-  "    capability -- the port capability bit flags as integer\n"
+  "  the tuple (client_id, port_id).\n"
   "Raises:\n"
-  "  SequencerError: ALSA error occurred."
+  "  SequencerError: if the address is invalid or the name unknown."
 );
 
-/** alsaseq.Sequencer get_port_info() method */
+/** alsaseq.SeqTopology resolve() method */
 static PyObject *
-Sequencer_get_port_info(SequencerObject *self,
-			PyObject *args,
-			PyObject *kwds) {
-  snd_seq_port_info_t *pinfo;
-  snd_seq_client_info_t *cinfo;
-  int port_id;
-  int client_id;
+SeqTopology_resolve(SeqTopologyObject *self,
+		    PyObject *args) {
+  snd_seq_addr_t addr;
+  char *str;
   int ret;
-  char *kwlist[] = { "port_id", "client_id", NULL };
 
-  snd_seq_client_info_alloca(&cinfo);
-  ret = snd_seq_get_client_info(self->handle, cinfo);
-  if (ret < 0) {
-    RAISESND(ret, "Failed to determine self.client_id");
+  if (!PyArg_ParseTuple(args, "s", &str)) {
     return NULL;
   }
-  client_id = snd_seq_client_info_get_client(cinfo);
-
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "i|i", kwlist,
-				   &port_id, &client_id)) {
+  if (_SeqTopology_sync(self) < 0 || _SeqTopology_names(self) < 0) {
     return NULL;
   }
-
-  snd_seq_port_info_alloca(&pinfo);
-  ret = snd_seq_get_any_port_info(self->handle, client_id,
-				  port_id, pinfo);
+  ret = _SeqTopology_resolve(self, str, &addr);
   if (ret < 0) {
-    RAISESND(ret, "Failed to get port info for %d:%d", client_id, port_id);
+    RAISESND(ret, "Invalid client:port specification '%s'", str);
     return NULL;
   }
-
-  return Py_BuildValue(
-      "{sssIsI}",
-      "name", snd_seq_port_info_get_name(pinfo),
-      "capability", (unsigned int)snd_seq_port_info_get_capability(pinfo),
-      "type", (unsigned int)snd_seq_port_info_get_type(pinfo));
+  return Py_BuildValue("(ii)", addr.client, addr.port);
 }
 
-/** alsaseq.Sequencer connect_ports() method: __doc__ */
-PyDoc_STRVAR(Sequencer_connect_ports__doc__,
-  "connect_ports(srcaddr,dstaddr,queue,exclusive,time_update,time_real)\n"
+/** alsaseq.SeqTopology resolve_many() method: __doc__ */
+PyDoc_STRVAR(SeqTopology_resolve_many__doc__,
+  "resolve_many(addresses, strict=True) -> list\n"
   "\n"
-  "Connect the ports specified by srcaddr and dstaddr.\n"
+  "Resolves a sequence of client:port strings as resolve() does, with\n"
+  "one update of the topology and of the name index for the batch.\n"
   "\n"
   "Parameters:\n"
-  "  srcaddr -- (tuple) the (client_id, port_id) tuple for the source\n"
-  "              port (the port sending events)\n"
-  "  dstaddr -- (tuple) the (client_id, port_id) tuple for the destination\n"
-  "              port (the port receiveng events)\n"
-  "  queue   -- the queue of the connection.\n"
-  "             If not specified, defaults to 0.\n"
-  "  exclusive -- 1 if the connection is exclusive, 0 otherwise.\n"
-  "               If not specified, defaults to 0.\n"
-  "  time_update -- 1 if the connection should update time, 0 otherwise.\n"
-  "                 If not specified, defaults to 0.\n"
-  "  time_real -- 1 if the update time is in real, 0 if is in tick.\n"
-  "                 If not specified, defaults to 0.\n"
+  "  addresses -- iterable of address strings\n"
+  "  strict -- (bool) raise for an unresolved address; if False, its\n"
+  "            entry in the result is None\n"
+  "Returns:\n"
+  "  the list of (client_id, port_id) tuples, in the given order.\n"
   "Raises:\n"
-  "  SequenceError: if ALSA can't connect the ports"
+  "  SequencerError: if strict and an address can't be resolved."
 );
 
-/** alsaseq.Sequencer connect_ports() method */
+/** alsaseq.SeqTopology resolve_many() method */
 static PyObject *
-Sequencer_connect_ports(SequencerObject *self,
-			PyObject *args) {
-  snd_seq_addr_t sender, dest;
-  snd_seq_port_subscribe_t *sinfo;
+SeqTopology_resolve_many(SeqTopologyObject *self,
+			 PyObject *args,
+			 PyObject *kwds) {
+  PyObject *addresses, *seq, *list, *item;
+  snd_seq_addr_t addr;
+  const char *str;
+  Py_ssize_t i, n;
+  int strict = 1;
   int ret;
-  int queue = 0;
-  int exclusive = 0;
-  int time_update = 0;
-  int time_real = 0;
 
-  if (!PyArg_ParseTuple(args, "(BB)(BB)|iiii", &(sender.client),
-	                &(sender.port), &(dest.client), &(dest.port),
-			&queue, &exclusive, &time_update, &time_real)) {
+  char *kwlist[] = {"addresses", "strict", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|i", kwlist, &addresses,
+				   &strict)) {
+    return NULL;
+  }
+  seq = PySequence_Fast(addresses, "addresses must be iterable");
+  if (seq == NULL) {
+    return NULL;
+  }
+  if (_SeqTopology_sync(self) < 0 || _SeqTopology_names(self) < 0) {
+    Py_DECREF(seq);
     return NULL;
   }
 
-  snd_seq_port_subscribe_alloca(&sinfo);
-  snd_seq_port_subscribe_set_sender(sinfo, &sender);
-  snd_seq_port_subscribe_set_dest(sinfo, &dest);
-  snd_seq_port_subscribe_set_queue(sinfo, queue);
-  snd_seq_port_subscribe_set_exclusive(sinfo, exclusive);
-  snd_seq_port_subscribe_set_time_update(sinfo, time_update);
-  snd_seq_port_subscribe_set_time_real(sinfo, time_real);
-
-  ret = snd_seq_subscribe_port(self->handle, sinfo);
-  if (ret < 0) {
-    RAISESND(ret, "Failed to connect ports %d:%d -> %d:%d",
-	     sender.client, sender.port, dest.client, dest.port);
+  n = PySequence_Fast_GET_SIZE(seq);
+  list = PyList_New(n);
+  if (list == NULL) {
+    Py_DECREF(seq);
     return NULL;
   }
+  for (i = 0; i < n; i++) {
+    str = PyUnicode_AsUTF8(PySequence_Fast_GET_ITEM(seq, i));
+    if (str == NULL) {
+      goto __error;
+    }
+    ret = _SeqTopology_resolve(self, str, &addr);
+    if (ret < 0) {
+      if (strict) {
+	RAISESND(ret, "Invalid client:port specification '%s'", str);
+	goto __error;
+      }
+      Py_INCREF(Py_None);
+      item = Py_None;
+    } else {
+      item = Py_BuildValue("(ii)", addr.client, addr.port);
+      if (item == NULL) {
+	goto __error;
+      }
+    }
+    PyList_SET_ITEM(list, i, item);
+  }
+  Py_DECREF(seq);
+  return list;
 
-  Py_RETURN_NONE;
+ __error:
+  Py_DECREF(seq);
+  Py_DECREF(list);
+  return NULL;
 }
 
-/** alsaseq.Sequencer disconnect_ports() method: __doc__ */
-PyDoc_STRVAR(Sequencer_disconnect_ports__doc__,
-  "disconnect_ports(srcaddr, destaddr)\n"
+/** alsaseq.SeqTopology find() method: __doc__ */
+PyDoc_STRVAR(SeqTopology_find__doc__,
+  "find(pattern, regex=False) -> list\n"
   "\n"
-  "Disconnect the ports specified by srcaddr and dstaddr.\n"
+  "Finds the ports whose 'client name:port name' starts with pattern, or\n"
+  "matches it as a POSIX extended regular expression (searched, not\n"
+  "anchored: use ^ and $ as needed).\n"
   "\n"
   "Parameters:\n"
-  "  srcaddr -- (tuple) the client_id, port_id tuple for the source\n"
-  "             port (the port sending events)\n"
-  "  dstaddr -- (tuple) the client_id, port_id tuple for the destination\n"
-  "             port (the port receiveng events)\n"
+  "  pattern -- (string) the prefix or the regular expression\n"
+  "  regex -- (bool) pattern is a regular expression\n"
+  "Returns:\n"
+  "  the sorted list of (client_id, port_id) tuples.\n"
   "Raises:\n"
-  "  SequenceError: if ALSA can't disconnect the port"
+  "  ValueError: if the regular expression is invalid."
 );
 
-/** alsaseq.Sequencer disconnect_ports() method */
+/** alsaseq.SeqTopology find() method */
 static PyObject *
-Sequencer_disconnect_ports(SequencerObject *self,
-			   PyObject *args) {
-  snd_seq_addr_t sender, dest;
-  snd_seq_port_subscribe_t *sinfo;
-  int ret;
-
-  if (!PyArg_ParseTuple(args, "(BB)(BB)", &(sender.client),
-	                &(sender.port), &(dest.client), &(dest.port))) {
+SeqTopology_find(SeqTopologyObject *self,
+		 PyObject *args,
+		 PyObject *kwds) {
+  PyObject *list, *cl, *item;
+  seq_name_entry_t *e;
+  const char *cname;
+  char buf[256];
+  char *pattern;
+  size_t i, len;
+  int use_regex = 0;
+  int matched;
+  regex_t re;
+
+  char *kwlist[] = {"pattern", "regex", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|i", kwlist, &pattern,
+				   &use_regex)) {
     return NULL;
   }
+  if (_SeqTopology_sync(self) < 0 || _SeqTopology_names(self) < 0) {
+    return NULL;
+  }
+  if (use_regex) {
+    int ret = regcomp(&re, pattern, REG_EXTENDED | REG_NOSUB);
+    if (ret != 0) {
+      regerror(ret, &re, buf, sizeof(buf));
+      PyErr_Format(PyExc_ValueError, "Invalid pattern '%s': %s", pattern,
+		   buf);
+      return NULL;
+    }
+  }
+  len = strlen(pattern);
 
-  snd_seq_port_subscribe_alloca(&sinfo);
-  snd_seq_port_subscribe_set_sender(sinfo, &sender);
-  snd_seq_port_subscribe_set_dest(sinfo, &dest);
+  list = PyList_New(0);
+  if (list == NULL) {
+    goto __end;
+  }
+  cname = NULL;
+  for (i = 0; i < self->npnames; i++) {
+    e = &self->pnames[i];
+    /* the port index is grouped by client */
+    if (i == 0 || e->client != self->pnames[i - 1].client) {
+      item = PyInt_FromLong(e->client);
+      cl = item != NULL ? PyDict_GetItem(self->clients, item) : NULL;
+      Py_XDECREF(item);
+      cl = cl != NULL ? PyDict_GetItemString(cl, "name") : NULL;
+      cname = cl != NULL ? PyUnicode_AsUTF8(cl) : NULL;
+      if (cname == NULL) {
+	PyErr_Clear();
+	cname = "";
+      }
+    }
+    snprintf(buf, sizeof(buf), "%s:%s", cname, e->name);
+    matched = use_regex ? regexec(&re, buf, 0, NULL, 0) == 0 :
+      strncmp(buf, pattern, len) == 0;
+    if (!matched) {
+      continue;
+    }
+    item = Py_BuildValue("(ii)", e->client, e->port);
+    if (item == NULL || PyList_Append(list, item) < 0) {
+      Py_XDECREF(item);
+      Py_CLEAR(list);
+      goto __end;
+    }
+    Py_DECREF(item);
+  }
+  if (PyList_Sort(list) < 0) {
+    Py_CLEAR(list);
+  }
 
-  ret = snd_seq_unsubscribe_port(self->handle, sinfo);
-  if (ret < 0) {
-    RAISESND(ret, "Failed to disconnect ports: %d:%d --> %d:%d",
-	     sender.client, sender.port, dest.client, dest.port);
-    return NULL;
+ __end:
+  if (use_regex) {
+    regfree(&re);
   }
+  return list;
+}
 
-  Py_RETURN_NONE;
+/** alsaseq.SeqTopology generation attribute: tp_getset getter() */
+static PyObject *
+SeqTopology_get_generation(SeqTopologyObject *self) {
+  if (_SeqTopology_sync(self) < 0) {
+    return NULL;
+  }
+  return PyLong_FromUnsignedLong(self->generation);
 }
 
-/** alsaseq.Sequencer get_connect_info() method: __doc__ */
-PyDoc_STRVAR(Sequencer_get_connect_info__doc__,
-  "get_connect_info(srcaddr, dstaddr) -> dictionary\n"
-  "\n"
-  "Retrieve the subscribe info of the specified connection.\n"
-  "\n"
-  "Parameters:\n"
-  "  srcaddr -- (tuple) the client_id, port_id tuple for the source\n"
-  "             port (the port sending events)\n"
-  "  dstaddr -- (tuple) the client_id, port_id tuple for the destination\n"
-  "             port (the port receiveng events)\n"
-  "Returns:\n"
-  "  (dict) a dictionary with the following values:\n"
-  "    queue -- \n"
-  "    exclusive -- \n"
-  "    time_update -- \n"
-  "    time_real --- \n"
-  "Raises:\n"
-  "  SequenceError: if ALSA can't retrieve the connection or the\n"
-  "                 connection doesn't exists."
-);
+/** alsaseq.SeqTopology stats attribute: tp_getset getter() */
+static PyObject *
+SeqTopology_get_stats(SeqTopologyObject *self) {
+  return Py_BuildValue("{sksksksksnsn}",
+		       "announcements", self->announcements,
+		       "walks", self->walks,
+		       "index_builds", self->index_builds,
+		       "resolves", self->resolves,
+		       "clients", PyDict_Size(self->clients),
+		       "ports", PyDict_Size(self->ports));
+}
 
+/** alsaseq.SeqTopology tp_getset list */
+static PyGetSetDef SeqTopology_getset[] = {
+  {"generation",
+   (getter) SeqTopology_get_generation,
+   NULL,
+   "Change counter: incremented on each change of the topology.",
+   NULL},
+  {"stats",
+   (getter) SeqTopology_get_stats,
+   NULL,
+   "Counters: announcements read, full walks, name index builds,\n"
+   "addresses resolved, clients and ports cached.",
+   NULL},
+  {NULL}
+};
 
-static PyObject*
-Sequencer_get_connect_info(SequencerObject *self,
-			  PyObject *args) {
-  snd_seq_addr_t sender, dest;
-  snd_seq_port_subscribe_t *sinfo;
-  int ret;
+/** alsaseq.SeqTopology tp_methods */
+static PyMethodDef SeqTopology_methods[] = {
+  {"update",
+   (PyCFunction) SeqTopology_update,
+   METH_NOARGS,
+   SeqTopology_update__doc__},
+  {"refresh",
+   (PyCFunction) SeqTopology_refresh,
+   METH_NOARGS,
+   SeqTopology_refresh__doc__},
+  {"get_port",
+   (PyCFunction) SeqTopology_get_port,
+   METH_VARARGS,
+   SeqTopology_get_port__doc__},
+  {"get_client",
+   (PyCFunction) SeqTopology_get_client,
+   METH_VARARGS,
+   SeqTopology_get_client__doc__},
+  {"connection_list",
+   (PyCFunction) SeqTopology_connection_list,
+   METH_NOARGS,
+   SeqTopology_connection_list__doc__},
+  {"resolve",
+   (PyCFunction) SeqTopology_resolve,
+   METH_VARARGS,
+   SeqTopology_resolve__doc__},
+  {"resolve_many",
+   (PyCFunction) SeqTopology_resolve_many,
+   METH_VARARGS | METH_KEYWORDS,
+   SeqTopology_resolve_many__doc__},
+  {"find",
+   (PyCFunction) SeqTopology_find,
+   METH_VARARGS | METH_KEYWORDS,
+   SeqTopology_find__doc__},
+  {"fileno",
+   (PyCFunction) SeqTopology_fileno,
+   METH_NOARGS,
+   SeqTopology_fileno__doc__},
+  {NULL}
+};
 
-  if (!PyArg_ParseTuple(args, "(BB)(BB)", &(sender.client),
-	                &(sender.port), &(dest.client), &(dest.port))) {
-    return NULL;
-  }
+/** alsaseq.SeqTopology type */
+static PyTypeObject SeqTopologyType = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  tp_name: "alsaseq.SeqTopology",
+  tp_basicsize: sizeof(SeqTopologyObject),
+  tp_dealloc: (destructor) SeqTopology_dealloc,
+  tp_flags: Py_TPFLAGS_DEFAULT,
+  tp_doc: SeqTopology__doc__,
+  tp_init: (initproc) SeqTopology_init,
+  tp_new: SeqTopology_new,
+  tp_alloc: PyType_GenericAlloc,
+  tp_free: PyObject_Del,
+  tp_methods: SeqTopology_methods,
+  tp_getset: SeqTopology_getset,
+};
 
-  snd_seq_port_subscribe_alloca(&sinfo);
-  snd_seq_port_subscribe_set_sender(sinfo, &sender);
-  snd_seq_port_subscribe_set_dest(sinfo, &dest);
 
-  ret = snd_seq_get_port_subscription(self->handle, sinfo);
-  if (ret < 0) {
-    RAISESND(ret, "Failed to get port subscript: %d:%d --> %d:%d",
-	     sender.client, sender.port, dest.client, dest.port);
-    return NULL;
-  }
 
-  return Py_BuildValue(
-      "{sisisisi}",
-      "queue", (int)snd_seq_port_subscribe_get_queue(sinfo),
-      "exclusive", (int)snd_seq_port_subscribe_get_exclusive(sinfo),
-      "time_update", (int)snd_seq_port_subscribe_get_time_update(sinfo),
-      "time_real", (int)snd_seq_port_subscribe_get_time_real(sinfo));
-}
+//////////////////////////////////////////////////////////////////////////////
+// alsaseq.QueueStatus implementation
+//////////////////////////////////////////////////////////////////////////////
 
-/** alsaseq.Sequencer receive_events() method: __doc__ */
-PyDoc_STRVAR(Sequencer_receive_events__doc__,
-  "receive_events(timeout = 0, maxevents = self.receive_maxevents) -> list\n"
+/** alsaseq.QueueStatus __doc__ */
+PyDoc_STRVAR(QueueStatus__doc__,
+  "QueueStatus(sequencer, queue) -> QueueStatus object\n"
   "\n"
-  "Receive events.\n"
+  "A reader of the position of a queue, for clock-following loops.\n"
+  "The status buffer is allocated once; tick(), real_time() and times()\n"
+  "read the queue status with one call to ALSA and return plain ints,\n"
+  "without building a dict. The attributes return the values of the\n"
+  "last read, without calling ALSA.\n"
   "\n"
   "Parameters:\n"
-  "  timeout -- (int) time for wating for events in miliseconds\n"
-  "  maxevents -- (int) max events to be returned\n"
-  "Returns:\n"
-  "  (list) a list of alsaseq.SeqEvent objects\n"
+  "  sequencer -- the Sequencer object owning or using the queue\n"
+  "  queue -- the queue id\n"
   "Raises:\n"
-  "  TypeError: if an invalid type was used in a parameter\n"
-  "  SequencerError: if ALSA error occurs."
-);
-
-/** alsaseq.Sequencer receive_events() method */
-static PyObject *
-Sequencer_receive_events(SequencerObject *self,
-			 PyObject *args,
-			 PyObject *kwds) {
-  int maxevents = self->receive_max_events;
-  snd_seq_event_t *event = NULL;
-  int timeout = 0;
-  int ret;
+  "  SequencerError: if the status of the queue can't be read."
+);
 
-  char *kwlist[] = {"timeout", "maxevents", NULL};
+/** alsaseq.QueueStatus object structure type */
+typedef struct {
+  PyObject_HEAD
+  ;
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|ii", kwlist, &timeout,
-				   &maxevents)) {
-    return NULL;
-  }
+  SequencerObject *seq;
+  int queue;
+  snd_seq_queue_status_t *status;
+  unsigned long reads;
+} QueueStatusObject;
 
-  if (self->receive_fds == NULL) {
-    self->receive_max = snd_seq_poll_descriptors_count(self->handle, POLLOUT);
-    self->receive_fds = malloc(sizeof(struct pollfd) * self->receive_max);
-  }
+/** internal use: read the queue status */
+static inline int
+_QueueStatus_read(QueueStatusObject *self) {
+  int ret;
 
-  PyObject *list = PyList_New(0);
-  if (list == NULL) {
-    return NULL;
+  if (self->seq == NULL) {
+    RAISESTR("The queue status is not initialized");
+    return -1;
   }
-
-
-  if (self->receive_bytes <= 0 && timeout != 0) {
-    snd_seq_poll_descriptors(self->handle, self->receive_fds,
-			     self->receive_max, POLLIN);
-    Py_BEGIN_ALLOW_THREADS;
-    ret = poll(self->receive_fds, self->receive_max, timeout);
-    Py_END_ALLOW_THREADS;
-    if (ret == 0) {
-      return list;
-    } else if (ret < 0) {
-      RAISESTR("Failed to poll from receive: %s", strerror(-ret));
-      return NULL;
-    }
+  ret = snd_seq_get_queue_status(self->seq->handle, self->queue,
+				 self->status);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to read the status of queue %d", self->queue);
+    return -1;
   }
+  self->reads++;
+  return 0;
+}
 
-  do {
-    ret = snd_seq_event_input(self->handle, &event);
-    self->receive_bytes = ret;
-    if (ret < 0) {
-      if (ret != -EAGAIN) {
-      }
-      break;
-    }
+/** internal use: the real time of the last read, in nanoseconds */
+static inline unsigned long long
+_QueueStatus_real_ns(QueueStatusObject *self) {
+  const snd_seq_real_time_t *rt =
+    snd_seq_queue_status_get_real_time(self->status);
 
+  return rt->tv_sec * 1000000000ULL + rt->tv_nsec;
+}
 
-    PyObject *SeqEventObject = SeqEvent_create(event);
-    if (SeqEventObject == NULL) {
-      RAISESTR("Error creating event!");
-      return NULL;
-    }
+/** alsaseq.QueueStatus tp_new */
+static PyObject *
+QueueStatus_new(PyTypeObject *type,
+		PyObject *args,
+		PyObject *kwds) {
+  QueueStatusObject *self;
 
-    PyList_Append(list, SeqEventObject);
-    Py_DECREF(SeqEventObject);
+  self = (QueueStatusObject *)type->tp_alloc(type, 0);
+  if (self == NULL) {
+    return NULL;
+  }
+  /* allocated once, zeroed: the attributes are valid before a read */
+  if (snd_seq_queue_status_malloc(&self->status) < 0) {
+    self->status = NULL;
+    Py_DECREF(self);
+    return PyErr_NoMemory();
+  }
+  return (PyObject *)self;
+}
 
-    maxevents --;
+/** alsaseq.QueueStatus tp_init */
+static int
+QueueStatus_init(QueueStatusObject *self,
+		 PyObject *args,
+		 PyObject *kwds) {
+  SequencerObject *seq, *old;
+  int queue;
 
-  } while (maxevents > 0 && ret > 0);
+  char *kwlist[] = {"sequencer", "queue", NULL};
 
-  return list;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!i", kwlist,
+				   &SequencerType, &seq, &queue)) {
+    return -1;
+  }
+  old = self->seq;
+  Py_INCREF(seq);
+  self->seq = seq;
+  Py_XDECREF(old);
+  self->queue = queue;
+  self->reads = 0;
+
+  return _QueueStatus_read(self);
 }
 
-/** alsaseq.Sequencer output_event() method: __doc__ */
-PyDoc_STRVAR(Sequencer_output_event__doc__,
-  "output_event(event)\n"
-  "\n"
-  "Put the the given event in the outputbuffer. This actually will enqueue\n"
-  "the event, to make sure it's sent, use the drain_output() method.\n"
+/** alsaseq.QueueStatus tp_dealloc */
+static void
+QueueStatus_dealloc(QueueStatusObject *self) {
+  if (self->status != NULL) {
+    snd_seq_queue_status_free(self->status);
+  }
+  Py_XDECREF(self->seq);
+  Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+/** alsaseq.QueueStatus tick() method: __doc__ */
+PyDoc_STRVAR(QueueStatus_tick__doc__,
+  "tick() -> int\n"
   "\n"
-  "Parameters:\n"
-  "  event -- a SeqEvent object\n"
-  "Raises:\n"
-  "  SequencerError: if ALSA can't send the event"
+  "Reads the queue status and returns its position in ticks."
 );
 
-/** alsaseq.Sequencer output_event() method */
+/** alsaseq.QueueStatus tick() method */
 static PyObject *
-Sequencer_output_event(SequencerObject *self,
-		       PyObject *args,
-		       PyObject *kwds) {
-  SeqEventObject *seqevent;
-  char *kwlist[] = {"event", NULL};
-
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist,
-				   &seqevent)) {
+QueueStatus_tick(QueueStatusObject *self,
+		 PyObject *args) {
+  if (_QueueStatus_read(self) < 0) {
     return NULL;
   }
+  return PyLong_FromUnsignedLong(
+	   snd_seq_queue_status_get_tick_time(self->status));
+}
 
-  if (!PyObject_TypeCheck(seqevent, &SeqEventType)) {
-    PyErr_SetString(PyExc_TypeError, "alsaseq.SeqEvent expected");
+/** alsaseq.QueueStatus real_time() method: __doc__ */
+PyDoc_STRVAR(QueueStatus_real_time__doc__,
+  "real_time() -> int\n"
+  "\n"
+  "Reads the queue status and returns its real time position in\n"
+  "nanoseconds."
+);
+
+/** alsaseq.QueueStatus real_time() method */
+static PyObject *
+QueueStatus_real_time(QueueStatusObject *self,
+		      PyObject *args) {
+  if (_QueueStatus_read(self) < 0) {
     return NULL;
   }
+  return PyLong_FromUnsignedLongLong(_QueueStatus_real_ns(self));
+}
 
-  snd_seq_event_output(self->handle, seqevent->event);
+/** alsaseq.QueueStatus times() method: __doc__ */
+PyDoc_STRVAR(QueueStatus_times__doc__,
+  "times() -> tuple\n"
+  "\n"
+  "Reads the queue status and returns (tick, real time in nanoseconds),\n"
+  "both from the same read."
+);
 
-  Py_RETURN_NONE;
+/** alsaseq.QueueStatus times() method */
+static PyObject *
+QueueStatus_times(QueueStatusObject *self,
+		  PyObject *args) {
+  if (_QueueStatus_read(self) < 0) {
+    return NULL;
+  }
+  return Py_BuildValue("(kK)",
+		       (unsigned long)
+		       snd_seq_queue_status_get_tick_time(self->status),
+		       _QueueStatus_real_ns(self));
 }
 
-/** alsaseq.Sequencer drain_output() method: __doc__ */
-PyDoc_STRVAR(Sequencer_drain_output__doc__,
-  "drain_output()\n"
-  "\n"
-  "Drain the output, making sure all events int the buffer are sent.\n"
-  "The events sent may remain unprocessed, to make sure they are\n"
-  "processed, call the sync_output_queue() method.\n"
+/** alsaseq.QueueStatus update() method: __doc__ */
+PyDoc_STRVAR(QueueStatus_update__doc__,
+  "update()\n"
   "\n"
-  "Raises:\n"
-  "  SequencerError: if ALSA can't drain the output"
+  "Reads the queue status, for the attributes."
 );
 
-/** alsaseq.Sequencer drain_output() method */
-static PyObject *Sequencer_drain_output(SequencerObject *self,
-					PyObject *args) {
-  int ret;
-
-  ret = snd_seq_drain_output(self->handle);
-  if (ret < 0) {
-    RAISESND(ret, "Failed to drain output");
+/** alsaseq.QueueStatus update() method */
+static PyObject *
+QueueStatus_update(QueueStatusObject *self,
+		   PyObject *args) {
+  if (_QueueStatus_read(self) < 0) {
     return NULL;
   }
-
   Py_RETURN_NONE;
 }
 
-/** alsaseq.Sequencer sync_output_queue() method: __doc__ */
-PyDoc_STRVAR(Sequencer_sync_output_queue__doc__,
-  "sync_output_queue()\n"
+/** alsaseq.QueueStatus last_tick attribute: tp_getset getter() */
+static PyObject *
+QueueStatus_get_last_tick(QueueStatusObject *self) {
+  return PyLong_FromUnsignedLong(
+	   snd_seq_queue_status_get_tick_time(self->status));
+}
+
+/** alsaseq.QueueStatus last_real_time attribute: tp_getset getter() */
+static PyObject *
+QueueStatus_get_last_real_time(QueueStatusObject *self) {
+  return PyLong_FromUnsignedLongLong(_QueueStatus_real_ns(self));
+}
+
+/** alsaseq.QueueStatus running attribute: tp_getset getter() */
+static PyObject *
+QueueStatus_get_running(QueueStatusObject *self) {
+  return PyBool_FromLong(snd_seq_queue_status_get_status(self->status) & 1);
+}
+
+/** alsaseq.QueueStatus events attribute: tp_getset getter() */
+static PyObject *
+QueueStatus_get_events(QueueStatusObject *self) {
+  return PyInt_FromLong(snd_seq_queue_status_get_events(self->status));
+}
+
+/** alsaseq.QueueStatus queue attribute: tp_getset getter() */
+static PyObject *
+QueueStatus_get_queue(QueueStatusObject *self) {
+  return PyInt_FromLong(self->queue);
+}
+
+/** alsaseq.QueueStatus reads attribute: tp_getset getter() */
+static PyObject *
+QueueStatus_get_reads(QueueStatusObject *self) {
+  return PyLong_FromUnsignedLong(self->reads);
+}
+
+/** alsaseq.QueueStatus tp_getset list */
+static PyGetSetDef QueueStatus_getset[] = {
+  {"last_tick",
+   (getter) QueueStatus_get_last_tick,
+   NULL,
+   "Position in ticks, at the last read.",
+   NULL},
+  {"last_real_time",
+   (getter) QueueStatus_get_last_real_time,
+   NULL,
+   "Real time position in nanoseconds, at the last read.",
+   NULL},
+  {"running",
+   (getter) QueueStatus_get_running,
+   NULL,
+   "True if the queue was running, at the last read.",
+   NULL},
+  {"events",
+   (getter) QueueStatus_get_events,
+   NULL,
+   "Number of events scheduled on the queue, at the last read.",
+   NULL},
+  {"queue",
+   (getter) QueueStatus_get_queue,
+   NULL,
+   "The queue id.",
+   NULL},
+  {"reads",
+   (getter) QueueStatus_get_reads,
+   NULL,
+   "Number of reads of the queue status.",
+   NULL},
+  {NULL}
+};
+
+/** alsaseq.QueueStatus tp_methods */
+static PyMethodDef QueueStatus_methods[] = {
+  {"tick",
+   (PyCFunction) QueueStatus_tick,
+   METH_NOARGS,
+   QueueStatus_tick__doc__},
+  {"real_time",
+   (PyCFunction) QueueStatus_real_time,
+   METH_NOARGS,
+   QueueStatus_real_time__doc__},
+  {"times",
+   (PyCFunction) QueueStatus_times,
+   METH_NOARGS,
+   QueueStatus_times__doc__},
+  {"update",
+   (PyCFunction) QueueStatus_update,
+   METH_NOARGS,
+   QueueStatus_update__doc__},
+  {NULL}
+};
+
+/** alsaseq.QueueStatus type */
+static PyTypeObject QueueStatusType = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  tp_name: "alsaseq.QueueStatus",
+  tp_basicsize: sizeof(QueueStatusObject),
+  tp_dealloc: (destructor) QueueStatus_dealloc,
+  tp_flags: Py_TPFLAGS_DEFAULT,
+  tp_doc: QueueStatus__doc__,
+  tp_init: (initproc) QueueStatus_init,
+  tp_new: QueueStatus_new,
+  tp_alloc: PyType_GenericAlloc,
+  tp_free: PyObject_Del,
+  tp_methods: QueueStatus_methods,
+  tp_getset: QueueStatus_getset,
+};
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// alsaseq.MidiCodec implementation
+//////////////////////////////////////////////////////////////////////////////
+
+/** alsaseq.MidiCodec __doc__ */
+PyDoc_STRVAR(MidiCodec__doc__,
+  "MidiCodec(bufsize=256, running_status=True) -> MidiCodec object\n"
   "\n"
-  "Waits until all events of this clients are processed.\n"
+  "Converts a raw MIDI byte stream to sequencer events and back, with\n"
+  "the ALSA MIDI event parser (snd_midi_event). Each direction keeps its\n"
+  "parser state between calls: a message split between two chunks of a\n"
+  "stream, and running status, are handled across calls.\n"
   "\n"
+  "Parameters:\n"
+  "  bufsize -- the size of the SysEx chunks: longer SysEx messages are\n"
+  "             split in several SYSEX events.\n"
+  "  running_status -- if True, to_bytes() omits repeated status bytes.\n"
   "Raises:\n"
-  "  SequencerError: if an ALSA error occurs."
+  "  SequencerError: if the parser can't be created."
 );
 
-/** alsaseq.Sequencer sync_output_queue() method */
-static PyObject *
-Sequencer_sync_output_queue(SequencerObject *self,
-			    PyObject *args) {
+/** alsaseq.MidiCodec object structure type */
+typedef struct {
+  PyObject_HEAD
+  ;
+
+  /* bytes to events */
+  snd_midi_event_t *encoder;
+  /* events to bytes */
+  snd_midi_event_t *decoder;
+  int bufsize;
+  int running_status;
+
+  unsigned long long bytes_in;
+  unsigned long long events_out;
+  unsigned long long events_in;
+  unsigned long long bytes_out;
+  unsigned long long skipped;
+} MidiCodecObject;
+
+/** alsaseq.MidiCodec tp_init */
+static int
+MidiCodec_init(MidiCodecObject *self,
+	       PyObject *args,
+	       PyObject *kwds) {
+  int bufsize = 256;
+  int running_status = 1;
   int ret;
 
-  ret = snd_seq_sync_output_queue(self->handle);
+  char *kwlist[] = {"bufsize", "running_status", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|ii", kwlist, &bufsize,
+				   &running_status)) {
+    return -1;
+  }
+  if (bufsize < 16) {
+    PyErr_SetString(PyExc_ValueError, "bufsize must be >= 16");
+    return -1;
+  }
+
+  if (self->encoder != NULL) {
+    snd_midi_event_free(self->encoder);
+    self->encoder = NULL;
+  }
+  if (self->decoder != NULL) {
+    snd_midi_event_free(self->decoder);
+    self->decoder = NULL;
+  }
+  ret = snd_midi_event_new(bufsize, &self->encoder);
+  if (ret >= 0) {
+    /* the decoder needs no SysEx buffer: it copies from the event */
+    ret = snd_midi_event_new(16, &self->decoder);
+  }
   if (ret < 0) {
-    RAISESND(ret, "Failed to sync output queue");
-    return NULL;
+    RAISESND(ret, "Failed to create the MIDI parser");
+    return -1;
   }
+  snd_midi_event_no_status(self->decoder, !running_status);
+  self->bufsize = bufsize;
+  self->running_status = running_status != 0;
 
-  Py_RETURN_NONE;
+  return 0;
 }
 
+/** alsaseq.MidiCodec tp_dealloc */
+static void
+MidiCodec_dealloc(MidiCodecObject *self) {
+  if (self->encoder != NULL) {
+    snd_midi_event_free(self->encoder);
+  }
+  if (self->decoder != NULL) {
+    snd_midi_event_free(self->decoder);
+  }
+  Py_TYPE(self)->tp_free((PyObject*)self);
+}
 
-/** alsaseq.Sequencer parse_address() method: __doc__ */
-PyDoc_STRVAR(Sequencer_parse_address__doc__,
-  "parse_address(string) -> tuple\n"
+/** internal use: check the parsers are created */
+static int
+_MidiCodec_check(MidiCodecObject *self) {
+  if (self->encoder == NULL || self->decoder == NULL) {
+    RAISESTR("The codec is not initialized");
+    return -1;
+  }
+  return 0;
+}
+
+/** alsaseq.MidiCodec from_bytes() method: __doc__ */
+PyDoc_STRVAR(MidiCodec_from_bytes__doc__,
+  "from_bytes(data, buffer=None) -> list or int\n"
   "\n"
-  "Parses the given string as an ALSA client:port. You can use client,\n"
-  "port id's or names.\n"
+  "Parses raw MIDI bytes into sequencer events. The events are direct\n"
+  "(no queue) and sent to the subscribers, like a new SeqEvent. A\n"
+  "message incomplete at the end of data is completed by the next call.\n"
   "\n"
   "Parameters:\n"
-  "  string -- the address in the format client:port.\n"
+  "  data -- a bytes-like object (bytes, bytearray, memoryview, mmap...)\n"
+  "  buffer -- a SeqEventBuffer to fill instead of creating SeqEvent\n"
+  "            objects; it is cleared first, and parsing stops when it\n"
+  "            is full.\n"
   "Returns:\n"
-  "  the tuple (client_id, port_id).\n"
+  "  without buffer, the list of the SeqEvent parsed from all the data;\n"
+  "  with buffer, the number of bytes parsed: call again with the rest\n"
+  "  of data if it is less than len(data).\n"
   "Raises:\n"
-  "  SequencerError: if ALSA can't parse the given address"
+  "  SequencerError: if the parser fails."
 );
 
-/** alsaseq.Sequencer parse_address() method */
+/** alsaseq.MidiCodec from_bytes() method */
 static PyObject *
-Sequencer_parse_address(SequencerObject *self,
-			PyObject *args) {
-  snd_seq_addr_t addr;
-  char *str = NULL;
-  int ret;
-
-  if (!PyArg_ParseTuple(args, "s", &(str))) {
+MidiCodec_from_bytes(MidiCodecObject *self,
+		     PyObject *args,
+		     PyObject *kwds) {
+  PyObject *data, *bufobj = Py_None, *list = NULL, *item;
+  SeqEventBufferObject *buffer = NULL;
+  const unsigned char *p;
+  snd_seq_event_t ev;
+  Py_buffer view;
+  Py_ssize_t left;
+  long n;
+
+  char *kwlist[] = {"data", "buffer", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", kwlist, &data,
+				   &bufobj)) {
+    return NULL;
+  }
+  if (_MidiCodec_check(self) < 0) {
+    return NULL;
+  }
+  if (bufobj != Py_None) {
+    if (!PyObject_TypeCheck(bufobj, &SeqEventBufferType)) {
+      PyErr_SetString(PyExc_TypeError, "buffer must be a SeqEventBuffer");
+      return NULL;
+    }
+    buffer = (SeqEventBufferObject *)bufobj;
+    if (_SeqEventBuffer_check_busy(buffer) < 0) {
+      return NULL;
+    }
+    _SeqEventBuffer_reset(buffer);
+  } else {
+    list = PyList_New(0);
+    if (list == NULL) {
+      return NULL;
+    }
+  }
+  if (PyObject_GetBuffer(data, &view, PyBUF_SIMPLE) < 0) {
+    Py_XDECREF(list);
     return NULL;
   }
 
-  ret = snd_seq_parse_address(self->handle, &addr, str);
-  if (ret < 0) {
-    RAISESND(ret, "Invalid client:port specification '%s'", str);
-    return NULL;
+  p = view.buf;
+  left = view.len;
+  while (left > 0) {
+    if (buffer != NULL && buffer->count >= buffer->size) {
+      break;
+    }
+    snd_seq_ev_clear(&ev);
+    n = snd_midi_event_encode(self->encoder, p, left, &ev);
+    if (n <= 0) {
+      if (n < 0) {
+	RAISESND(n, "Failed to parse the MIDI bytes at offset %zd",
+		 view.len - left);
+	goto __error;
+      }
+      break;
+    }
+    p += n;
+    left -= n;
+    self->bytes_in += n;
+    if (ev.type == SND_SEQ_EVENT_NONE) {
+      continue;
+    }
+
+    snd_seq_ev_set_direct(&ev);
+    snd_seq_ev_set_subs(&ev);
+    if (buffer != NULL) {
+      if (_SeqEventBuffer_append(buffer, &ev) < 0) {
+	goto __error;
+      }
+    } else {
+      item = SeqEvent_create(&ev);
+      if (item == NULL || PyList_Append(list, item) < 0) {
+	Py_XDECREF(item);
+	goto __error;
+      }
+      Py_DECREF(item);
+    }
+    self->events_out++;
+  }
+
+  PyBuffer_Release(&view);
+  if (buffer != NULL) {
+    return PyLong_FromSsize_t(view.len - left);
+  }
+  return list;
+
+ __error:
+  PyBuffer_Release(&view);
+  Py_XDECREF(list);
+  return NULL;
+}
+
+/** internal use: output buffer of to_bytes() */
+typedef struct {
+  unsigned char *data;
+  size_t len;
+  size_t size;
+} midi_out_t;
+
+/** internal use: convert one event, appending to out */
+static int
+_MidiCodec_decode_one(MidiCodecObject *self,
+		      midi_out_t *out,
+		      const snd_seq_event_t *event) {
+  /* the longest messages are 14-bit and (N)RPN controls: 12 bytes */
+  size_t need = 16;
+  unsigned char *data;
+  long n;
+
+  if (snd_seq_ev_is_variable(event)) {
+    need += event->data.ext.len;
+  }
+  if (out->len + need > out->size) {
+    size_t size = out->size;
+
+    while (size < out->len + need) {
+      size *= 2;
+    }
+    data = realloc(out->data, size);
+    if (data == NULL) {
+      PyErr_NoMemory();
+      return -1;
+    }
+    out->data = data;
+    out->size = size;
   }
 
-  PyObject *tuple = PyTuple_New(2);
-  PyTuple_SetItem(tuple, 0, PyInt_FromLong(addr.client));
-  PyTuple_SetItem(tuple, 1, PyInt_FromLong(addr.port));
-
-  return tuple;
+  n = snd_midi_event_decode(self->decoder, out->data + out->len,
+			    out->size - out->len, event);
+  if (n == -ENOENT) {
+    /* not a MIDI event */
+    self->skipped++;
+    return 0;
+  } else if (n < 0) {
+    RAISESND(n, "Failed to convert the event to MIDI bytes");
+    return -1;
+  }
+  out->len += n;
+  self->bytes_out += n;
+  self->events_in++;
+  return 0;
 }
 
-/** alsaseq.Sequencer create_queue() method: __doc__ */
-PyDoc_STRVAR(Sequencer_create_queue__doc__,
-  "create_queue(name=None)-> int\n"
+/** alsaseq.MidiCodec to_bytes() method: __doc__ */
+PyDoc_STRVAR(MidiCodec_to_bytes__doc__,
+  "to_bytes(events) -> bytes\n"
   "\n"
-  "Creates a queue with the optional given name.\n"
+  "Converts sequencer events to raw MIDI bytes. Events which have no\n"
+  "MIDI equivalent (queue control, client/port announcements...) are\n"
+  "skipped. With running_status, a status byte equal to the last one,\n"
+  "also from the previous call, is omitted.\n"
   "\n"
   "Parameters:\n"
-  "  name -- the name of the queue.\n"
+  "  events -- a SeqEvent, a SeqEventBuffer or an iterable of SeqEvent\n"
   "Returns:\n"
-  "  the queue id.\n"
+  "  (bytes) the MIDI bytes.\n"
   "Raises:\n"
-  "  SequencerError: if ALSA can't create the queue"
+  "  TypeError: if an item is not a SeqEvent\n"
+  "  SequencerError: if an event can't be converted."
 );
 
-/** alsaseq.Sequencer create_queue() method */
+/** alsaseq.MidiCodec to_bytes() method */
 static PyObject *
-Sequencer_create_queue(SequencerObject *self,
-		       PyObject *args,
-		       PyObject *kwds) {
-  char *kwlist[] = {"name", NULL};
-  char *queue_name = NULL;
-  int ret;
+MidiCodec_to_bytes(MidiCodecObject *self,
+		   PyObject *args) {
+  PyObject *events, *iter, *item, *ret = NULL;
+  midi_out_t out;
+  int i;
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|s", kwlist,
-				   &queue_name)) {
+  if (!PyArg_ParseTuple(args, "O", &events)) {
+    return NULL;
+  }
+  if (_MidiCodec_check(self) < 0) {
     return NULL;
   }
+  out.len = 0;
+  out.size = 256;
+  out.data = malloc(out.size);
+  if (out.data == NULL) {
+    return PyErr_NoMemory();
+  }
 
-  if (queue_name != NULL) {
-    ret = snd_seq_alloc_named_queue(self->handle, queue_name);
+  if (PyObject_TypeCheck(events, &SeqEventType)) {
+    if (_MidiCodec_decode_one(self, &out,
+			      ((SeqEventObject *)events)->event) < 0) {
+      goto __end;
+    }
+  } else if (PyObject_TypeCheck(events, &SeqEventBufferType)) {
+    SeqEventBufferObject *buffer = (SeqEventBufferObject *)events;
+
+    for (i = 0; i < buffer->count; i++) {
+      if (_MidiCodec_decode_one(self, &out, &buffer->events[i]) < 0) {
+	goto __end;
+      }
+    }
   } else {
-    ret = snd_seq_alloc_queue(self->handle);
+    iter = PyObject_GetIter(events);
+    if (iter == NULL) {
+      goto __end;
+    }
+    while ((item = PyIter_Next(iter)) != NULL) {
+      if (!PyObject_TypeCheck(item, &SeqEventType)) {
+	PyErr_SetString(PyExc_TypeError, "alsaseq.SeqEvent expected");
+      } else {
+	_MidiCodec_decode_one(self, &out, ((SeqEventObject *)item)->event);
+      }
+      Py_DECREF(item);
+      if (PyErr_Occurred()) {
+	break;
+      }
+    }
+    Py_DECREF(iter);
+    if (PyErr_Occurred()) {
+      goto __end;
+    }
   }
 
-  if (ret < 0) {
-    RAISESND(ret, "Failed to create queue");
-    return NULL;
-  }
+  ret = PyBytes_FromStringAndSize((char *)out.data, out.len);
 
-  return PyInt_FromLong(ret);
+ __end:
+  free(out.data);
+  return ret;
 }
 
-/** alsaseq.Sequencer delete_queue() method: __doc__ */
-PyDoc_STRVAR(Sequencer_delete_queue__doc__,
-  "delete_queue(queue)\n"
-  "\n"
-  "Deletes (frees) a queue.\n"
+/** alsaseq.MidiCodec reset() method: __doc__ */
+PyDoc_STRVAR(MidiCodec_reset__doc__,
+  "reset()\n"
   "\n"
-  "Parameters:\n"
-  "  queue -- the queue id.\n"
-  "Raises:\n"
-  "  SequencerError: if ALSA can't delete the queue."
+  "Resets the parser states: a partial message given to from_bytes() is\n"
+  "discarded, and the next status byte of to_bytes() is always sent."
 );
 
-/** alsaseq.Sequencer delete_queue() method */
+/** alsaseq.MidiCodec reset() method */
 static PyObject *
-Sequencer_delete_queue(SequencerObject *self,
-		       PyObject *args,
-		       PyObject *kwds) {
-  char *kwlist[] = {"queue", NULL};
-  int queue_id;
-  int ret;
-
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "i", kwlist,
-				   &queue_id)) {
+MidiCodec_reset(MidiCodecObject *self,
+		PyObject *args) {
+  if (_MidiCodec_check(self) < 0) {
     return NULL;
   }
+  snd_midi_event_reset_encode(self->encoder);
+  snd_midi_event_reset_decode(self->decoder);
+  Py_RETURN_NONE;
+}
 
-  ret = snd_seq_free_queue(self->handle, queue_id);
-  if (ret < 0) {
-    RAISESND(ret, "Failed to create queue");
-    return NULL;
+/** alsaseq.MidiCodec running_status attribute: tp_getset getter() */
+static PyObject *
+MidiCodec_get_running_status(MidiCodecObject *self) {
+  return PyBool_FromLong(self->running_status);
+}
+
+/** alsaseq.MidiCodec running_status attribute: tp_getset setter() */
+static int
+MidiCodec_set_running_status(MidiCodecObject *self,
+			     PyObject *val) {
+  int value;
+
+  if (val == NULL) {
+    PyErr_SetString(PyExc_AttributeError,
+		    "can't delete running_status");
+    return -1;
+  }
+  if (_MidiCodec_check(self) < 0) {
+    return -1;
   }
+  value = PyObject_IsTrue(val);
+  if (value < 0) {
+    return -1;
+  }
+  snd_midi_event_no_status(self->decoder, !value);
+  self->running_status = value;
+  return 0;
+}
 
-  Py_RETURN_NONE;
+/** alsaseq.MidiCodec bufsize attribute: tp_getset getter() */
+static PyObject *
+MidiCodec_get_bufsize(MidiCodecObject *self) {
+  return PyInt_FromLong(self->bufsize);
 }
 
+/** alsaseq.MidiCodec stats attribute: tp_getset getter() */
+static PyObject *
+MidiCodec_get_stats(MidiCodecObject *self) {
+  return Py_BuildValue("{sKsKsKsKsK}",
+		       "bytes_in", self->bytes_in,
+		       "events_out", self->events_out,
+		       "events_in", self->events_in,
+		       "bytes_out", self->bytes_out,
+		       "skipped", self->skipped);
+}
 
-/** alsaseq.Sequencer queue_tempo() method: __doc__ */
-PyDoc_STRVAR(Sequencer_queue_tempo__doc__,
-  "queue_tempo(queue, tempo=None, ppq=None) -> tuple"
+/** alsaseq.MidiCodec tp_getset list */
+static PyGetSetDef MidiCodec_getset[] = {
+  {"running_status",
+   (getter) MidiCodec_get_running_status,
+   (setter) MidiCodec_set_running_status,
+   "If True, to_bytes() omits repeated status bytes.",
+   NULL},
+  {"bufsize",
+   (getter) MidiCodec_get_bufsize,
+   NULL,
+   "Size of the SysEx chunks of from_bytes().",
+   NULL},
+  {"stats",
+   (getter) MidiCodec_get_stats,
+   NULL,
+   "Counters: bytes parsed and events made by from_bytes(), events\n"
+   "converted, bytes made and events skipped by to_bytes().",
+   NULL},
+  {NULL}
+};
+
+/** alsaseq.MidiCodec tp_methods */
+static PyMethodDef MidiCodec_methods[] = {
+  {"from_bytes",
+   (PyCFunction) MidiCodec_from_bytes,
+   METH_VARARGS | METH_KEYWORDS,
+   MidiCodec_from_bytes__doc__},
+  {"to_bytes",
+   (PyCFunction) MidiCodec_to_bytes,
+   METH_VARARGS,
+   MidiCodec_to_bytes__doc__},
+  {"reset",
+   (PyCFunction) MidiCodec_reset,
+   METH_NOARGS,
+   MidiCodec_reset__doc__},
+  {NULL}
+};
+
+/** alsaseq.MidiCodec type */
+static PyTypeObject MidiCodecType = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  tp_name: "alsaseq.MidiCodec",
+  tp_basicsize: sizeof(MidiCodecObject),
+  tp_dealloc: (destructor) MidiCodec_dealloc,
+  tp_flags: Py_TPFLAGS_DEFAULT,
+  tp_doc: MidiCodec__doc__,
+  tp_init: (initproc) MidiCodec_init,
+  tp_new: PyType_GenericNew,
+  tp_alloc: PyType_GenericAlloc,
+  tp_free: PyObject_Del,
+  tp_methods: MidiCodec_methods,
+  tp_getset: MidiCodec_getset,
+};
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// alsaseq.EventTemplate implementation
+//////////////////////////////////////////////////////////////////////////////
+
+/** alsaseq.EventTemplate __doc__ */
+PyDoc_STRVAR(EventTemplate__doc__,
+  "EventTemplate(event, **fields) -> EventTemplate object\n"
   "\n"
-  "Query and changes the queue tempo. For querying (not changing) the queue\n"
-  "tempo, pass only the queue id.\n"
+  "A copy of a SeqEvent, sent many times with a few fields changed at\n"
+  "each send: the fields are patched in C and the event is output\n"
+  "directly, without creating a SeqEvent per send.\n"
+  "\n"
+  "The template keeps everything set on the event: type, flags (time\n"
+  "stamp and mode), source, dest, queue and data. The fields given to\n"
+  "the constructor, send() or send_many() are:\n"
+  "  the integer data attributes of SeqEvent valid for the event type\n"
+  "  (channel, note, velocity, off_velocity, duration, param, value,\n"
+  "  queue_id, queue_param), time and dest.\n"
   "\n"
   "Parameters:\n"
-  "  queue -- the queue id.\n"
-  "  tempo -- the new queue tempo or None for keeping the current tempo.\n"
-  "  ppq -- the new queue ppq or None for keeping the current tempo.\n"
-  "Returns:\n"
-  "  a tuple (tempo, ppq) with the current or changed tempo.\n"
+  "  event -- the SeqEvent copied; events with variable length data\n"
+  "           (SYSEX...) can't be templates\n"
+  "  fields -- fields changed in the copy\n"
   "Raises:\n"
-  "  SequencerError: if ALSA can't change the queue tempo or an invalid\n"
-  "                  queue was specified."
+  "  TypeError: if event is not a SeqEvent\n"
+  "  ValueError: if event has variable length data, or a field value is\n"
+  "              out of range\n"
+  "  AttributeError: if a field is not valid for the event type"
 );
 
-/** alsaseq.Sequencer queue_tempo() method */
-static PyObject *
-Sequencer_queue_tempo(SequencerObject *self,
-		      PyObject *args,
-		      PyObject *kwds) {
-  char *kwlist[] = {"queue", "tempo", "ppq", NULL};
-  int queueid, tempo=-1, ppq=-1;
-  int ret;
-  snd_seq_queue_tempo_t *queue_tempo;
+/** alsaseq.EventTemplate object structure type */
+typedef struct {
+  PyObject_HEAD
+  ;
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "i|ii", kwlist,
-				   &queueid, &tempo, &ppq)) {
-    return NULL;
-  }
+  /* the event sent, before patching */
+  snd_seq_event_t event;
 
-  snd_seq_queue_tempo_alloca(&queue_tempo);
-  ret = snd_seq_get_queue_tempo(self->handle, queueid, queue_tempo);
-  if (ret < 0) {
-    RAISESND(ret, "Failed to retrieve current queue tempo");
-    return NULL;
-  }
+  unsigned long long sent;
+} EventTemplateObject;
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "i|ii", kwlist,
-				   &queueid, &tempo, &ppq)) {
-    return NULL;
+/* fields of send() and send_many() besides the integer data attributes,
+   whose ids are below SEQEVENT_DATA_ADDR */
+enum {
+  TEMPLATE_FIELD_TIME = SEQEVENT_DATA_ADDR,
+  TEMPLATE_FIELD_DEST,
+  TEMPLATE_FIELD_DRAIN,
+};
+
+/** internal use: the field id of a keyword; -1 and TypeError if the
+    keyword is not a field */
+static int
+_EventTemplate_field(PyObject *key) {
+  int id;
+
+  if (PyUnicode_Check(key)) {
+    for (id = 0; id < SEQEVENT_DATA_ADDR; id++) {
+      if (PyUnicode_CompareWithASCIIString(key,
+					    seqevent_data[id].name) == 0) {
+	return id;
+      }
+    }
+    if (PyUnicode_CompareWithASCIIString(key, "time") == 0) {
+      return TEMPLATE_FIELD_TIME;
+    }
+    if (PyUnicode_CompareWithASCIIString(key, "dest") == 0) {
+      return TEMPLATE_FIELD_DEST;
+    }
+    if (PyUnicode_CompareWithASCIIString(key, "drain") == 0) {
+      return TEMPLATE_FIELD_DRAIN;
+    }
   }
+  PyErr_Format(PyExc_TypeError, "'%S' is not an EventTemplate field", key);
+  return -1;
+}
 
-  if (tempo != -1) {
-    snd_seq_queue_tempo_set_tempo(queue_tempo, tempo);
+/** internal use: store a (client, port) tuple as the destination */
+static int
+_EventTemplate_store_dest(snd_seq_event_t *event,
+			  PyObject *val) {
+  long client, port;
+
+  if (!PyTuple_Check(val) || PyTuple_Size(val) != 2) {
+    PyErr_SetString(PyExc_TypeError, "expected tuple (client,port)");
+    return -1;
   }
-  if (ppq != -1) {
-    snd_seq_queue_tempo_set_ppq(queue_tempo, ppq);
+  if (get_long(PyTuple_GetItem(val, 0), &client) ||
+      get_long(PyTuple_GetItem(val, 1), &port)) {
+    return -1;
   }
+  event->dest.client = client;
+  event->dest.port = port;
+  return 0;
+}
 
-  if (tempo != -1 && ppq != -1) {
-    ret = snd_seq_set_queue_tempo(self->handle, queueid, queue_tempo);
-    if (ret < 0) {
-      RAISESND(ret, "Failed to set queue tempo");
-      return NULL;
+/** internal use: store a field value in event; id was checked against
+    the event type */
+static int
+_EventTemplate_store(snd_seq_event_t *event,
+		     int id,
+		     PyObject *val) {
+  PY_LONG_LONG v;
+
+  switch (id) {
+  case TEMPLATE_FIELD_TIME:
+    if (_SeqEvent_store_time(event, val) < 0) {
+      if (!PyErr_Occurred()) {
+	PyErr_SetString(PyExc_ValueError, "invalid time");
+      }
+      return -1;
     }
+    return 0;
+  case TEMPLATE_FIELD_DEST:
+    return _EventTemplate_store_dest(event, val);
   }
-
-  tempo = snd_seq_queue_tempo_get_tempo(queue_tempo);
-  ppq = snd_seq_queue_tempo_get_ppq(queue_tempo);
-
-  PyObject *tuple = PyTuple_New(2);
-  PyTuple_SetItem(tuple, 0, PyInt_FromLong(tempo));
-  PyTuple_SetItem(tuple, 1, PyInt_FromLong(ppq));
-
-  return tuple;
+  if (_SeqEvent_data_long(val, event->type, id, &v)) {
+    return -1;
+  }
+  _SeqEvent_store_data(event, id, v);
+  return 0;
 }
 
-/** alsaseq.Sequencer start_queue() method: __doc__ */
-PyDoc_STRVAR(Sequencer_start_queue__doc__,
-  "start_queue(queue)\n"
-  "\n"
-  "Starts the specified queue.\n"
-  "\n"
-  "Parameters:\n"
-  "  queue -- the queue id.\n"
-  "Raises:\n"
-  "  SequencerError: if ALSA can't start the queue."
-);
+/** internal use: patch event with the fields of kwds; drain receives the
+    drain keyword, which is not accepted if drain is NULL */
+static int
+_EventTemplate_patch(snd_seq_event_t *event,
+		     PyObject *kwds,
+		     int *drain) {
+  PyObject *key, *val;
+  Py_ssize_t pos = 0;
+  int id;
+
+  if (kwds == NULL) {
+    return 0;
+  }
+  while (PyDict_Next(kwds, &pos, &key, &val)) {
+    id = _EventTemplate_field(key);
+    if (id < 0) {
+      return -1;
+    }
+    if (id == TEMPLATE_FIELD_DRAIN && drain != NULL) {
+      *drain = PyObject_IsTrue(val);
+      if (*drain < 0) {
+	return -1;
+      }
+      continue;
+    } else if (id == TEMPLATE_FIELD_DRAIN) {
+      PyErr_Format(PyExc_TypeError, "'%S' is not an EventTemplate field",
+		   key);
+      return -1;
+    }
+    if (id < SEQEVENT_DATA_ADDR && _SeqEvent_check_data(event, id)) {
+      return -1;
+    }
+    if (_EventTemplate_store(event, id, val) < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
 
-/** alsaseq.Sequencer start_queue() method */
-static PyObject *
-Sequencer_start_queue(SequencerObject *self,
-		      PyObject *args,
-		      PyObject *kwds) {
-  char *kwlist[] = {"queue", NULL};
-  int queueid;
-  int ret;
+/** alsaseq.EventTemplate tp_init */
+static int
+EventTemplate_init(EventTemplateObject *self,
+		   PyObject *args,
+		   PyObject *kwds) {
+  SeqEventObject *event;
+  snd_seq_event_t copy;
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "i", kwlist,
-				   &queueid)) {
-    return NULL;
+  if (!PyArg_ParseTuple(args, "O!", &SeqEventType, &event)) {
+    return -1;
+  }
+  if (snd_seq_ev_is_variable_type(event->event)) {
+    PyErr_SetString(PyExc_ValueError,
+		    "events with variable length data can't be templates");
+    return -1;
   }
 
-  ret = snd_seq_start_queue(self->handle, queueid, NULL);
-  if (ret < 0) {
-    RAISESND(ret, "Failed to start queue");
-    return NULL;
+  copy = *event->event;
+  if (_EventTemplate_patch(&copy, kwds, NULL) < 0) {
+    return -1;
   }
+  self->event = copy;
+  self->sent = 0;
 
-  Py_RETURN_NONE;
+  return 0;
 }
 
-/** alsaseq.Sequencer stop_queue() method: __doc__ */
-PyDoc_STRVAR(Sequencer_stop_queue__doc__,
-  "stop_queue(queue)\n"
+/** alsaseq.EventTemplate tp_dealloc */
+static void
+EventTemplate_dealloc(EventTemplateObject *self) {
+  Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+/** alsaseq.EventTemplate send() method: __doc__ */
+PyDoc_STRVAR(EventTemplate_send__doc__,
+  "send(sequencer, drain=False, **fields)\n"
   "\n"
-  "Stops the specified queue.\n"
+  "Outputs a copy of the template with the given fields changed; the\n"
+  "template itself is not modified. Like output_events(), the event is\n"
+  "output with the GIL released and the call waits for room when the\n"
+  "output buffer or the kernel pool is full.\n"
+  "\n"
+  "  tmpl = EventTemplate(SeqEvent(SEQ_EVENT_NOTEON), channel=0)\n"
+  "  tmpl.send(seq, note=60, velocity=100, time=480)\n"
   "\n"
   "Parameters:\n"
-  "  queue -- the queue id.\n"
+  "  sequencer -- the Sequencer sending the event\n"
+  "  drain -- if True, drain the output after the event\n"
+  "  fields -- the fields changed; time is an int (ticks) or a float\n"
+  "            (seconds), as the SeqEvent time attribute, and dest a\n"
+  "            (client, port) tuple\n"
   "Raises:\n"
-  "  SequencerError: if ALSA can't stop the queue."
+  "  ValueError: if a field value is out of range\n"
+  "  AttributeError: if a field is not valid for the event type\n"
+  "  SequencerError: if ALSA can't send the event"
 );
 
-/** alsaseq.Sequencer stop_queue() method */
+/** alsaseq.EventTemplate send() method */
 static PyObject *
-Sequencer_stop_queue(SequencerObject *self,
-		      PyObject *args,
-		      PyObject *kwds) {
-  char *kwlist[] = {"queue", NULL};
-  int queueid;
+EventTemplate_send(EventTemplateObject *self,
+		   PyObject *args,
+		   PyObject *kwds) {
+  SequencerObject *seq;
+  snd_seq_event_t event;
+  int drain = 0;
   int ret;
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "i", kwlist,
-				   &queueid)) {
+  if (!PyArg_ParseTuple(args, "O!", &SequencerType, &seq)) {
+    return NULL;
+  }
+  event = self->event;
+  if (_EventTemplate_patch(&event, kwds, &drain) < 0) {
+    return NULL;
+  }
+  if (_Sequencer_init_output_fds(seq) < 0 ||
+      _Sequencer_acquire_output(seq) < 0) {
     return NULL;
   }
 
-  ret = snd_seq_stop_queue(self->handle, queueid, NULL);
+  Py_BEGIN_ALLOW_THREADS;
+  ret = _Sequencer_output_nogil(seq, &event);
+  if (ret >= 0 && drain) {
+    ret = _Sequencer_drain_nogil(seq);
+  }
+  Py_END_ALLOW_THREADS;
+  _Sequencer_release_output(seq);
+
   if (ret < 0) {
-    RAISESND(ret, "Failed to stop queue");
+    RAISESND(ret, "Failed to output event");
     return NULL;
   }
+  self->sent++;
 
   Py_RETURN_NONE;
 }
 
-PyDoc_STRVAR(Sequencer_registerpoll__doc__,
-"register_poll(pollObj, input=False, output=False) -- Register poll file descriptors.");
+/* an array of send_many() */
+typedef struct {
+  int id;
+  char format;
+  Py_buffer view;
+} template_array_t;
+
+/** internal use: the native size of the integer format of an array
+    item, 0 for other formats */
+static Py_ssize_t
+_template_format_size(char format) {
+  switch (format) {
+  case 'b':
+  case 'B':
+    return 1;
+  case 'h':
+  case 'H':
+    return sizeof(short);
+  case 'i':
+  case 'I':
+    return sizeof(int);
+  case 'l':
+  case 'L':
+    return sizeof(long);
+  case 'q':
+  case 'Q':
+    return sizeof(PY_LONG_LONG);
+  }
+  return 0;
+}
 
-static PyObject *
-Sequencer_registerpoll(SequencerObject *self, PyObject *args, PyObject *kwds)
-{
-    PyObject *pollObj, *reg, *t;
-    struct pollfd *pfd;
-    int i, count;
-    int input = 0;
-    int output = 0;
-    int mode = POLLIN|POLLOUT;
+/** internal use: the integer item i of an array; the items have their
+    native size and alignment (see send_many()) */
+static inline PY_LONG_LONG
+_template_array_item(const template_array_t *array,
+		     Py_ssize_t i) {
+  const char *p = (const char *)array->view.buf + i * array->view.itemsize;
+
+  switch (array->format) {
+  case 'b':
+    return *(const signed char *)p;
+  case 'B':
+    return *(const unsigned char *)p;
+  case 'h':
+    return *(const short *)p;
+  case 'H':
+    return *(const unsigned short *)p;
+  case 'i':
+    return *(const int *)p;
+  case 'I':
+    return *(const unsigned int *)p;
+  case 'l':
+    return *(const long *)p;
+  case 'L':
+    return *(const unsigned long *)p;
+  case 'q':
+    return *(const PY_LONG_LONG *)p;
+  case 'Q':
+    return (PY_LONG_LONG)*(const unsigned PY_LONG_LONG *)p;
+  }
+  return 0;
+}
 
-    static char * kwlist[] = { "pollObj", "input", "output", NULL };
+/** internal use: check the range of the items of an array, for events
+    like event */
+static int
+_template_array_check(const template_array_t *array,
+		      const snd_seq_event_t *event,
+		      Py_ssize_t count) {
+  PY_LONG_LONG v, max;
+  Py_ssize_t i;
+
+  /* ticks are 32-bit, real times have 32-bit seconds */
+  if (array->id == TEMPLATE_FIELD_DEST) {
+    max = 0xffff;
+  } else if (snd_seq_ev_is_tick(event)) {
+    max = 0xffffffffLL;
+  } else {
+    max = 0xffffffffLL * 1000000000 + 999999999;
+  }
+  for (i = 0; i < count; i++) {
+    v = _template_array_item(array, i);
+    if (array->id < SEQEVENT_DATA_ADDR) {
+      if (_SeqEvent_data_range(event->type, array->id, v)) {
+	return -1;
+      }
+      continue;
+    }
+    if (v < 0 || v > max) {
+      PyErr_Format(PyExc_ValueError, "invalid value '%lld' for '%s'",
+		   v, array->id == TEMPLATE_FIELD_DEST ? "dest" : "time");
+      return -1;
+    }
+  }
+  return 0;
+}
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|ii", kwlist, &pollObj, &input, &output))
-        return NULL;
+/** alsaseq.EventTemplate send_many() method: __doc__ */
+PyDoc_STRVAR(EventTemplate_send_many__doc__,
+  "send_many(sequencer, drain=False, **fields) -> int\n"
+  "\n"
+  "Outputs one event per item of the given arrays, the n-th event being\n"
+  "the template with each field set to the n-th item of its array. The\n"
+  "items are read and the events output with the GIL released; no\n"
+  "Python object is created per event.\n"
+  "\n"
+  "  notes = array('B', [60, 64, 67, 72])\n"
+  "  ticks = array('I', [0, 120, 240, 360])\n"
+  "  tmpl.send_many(seq, note=notes, time=ticks, velocity=100)\n"
+  "\n"
+  "Parameters:\n"
+  "  sequencer -- the Sequencer sending the events\n"
+  "  drain -- if True, drain the output after the last event\n"
+  "  fields -- one-dimensional buffers of native integers (array,\n"
+  "            bytes, numpy arrays...), aligned on their item size and\n"
+  "            all of the same length, or a value used for all the\n"
+  "            events as for send(). In arrays, time is in ticks for\n"
+  "            tick time stamps and in nanoseconds for real time ones,\n"
+  "            and dest is client << 8 | port.\n"
+  "Returns:\n"
+  "  (int) the number of events output\n"
+  "Raises:\n"
+  "  ValueError: if the arrays differ in length or are not aligned, or\n"
+  "              a value is out of range; no event is output then\n"
+  "  AttributeError: if a field is not valid for the event type\n"
+  "  SequencerError: if ALSA can't send an event; the events before it\n"
+  "                  remain queued"
+);
 
-    if (input && !output)
-        mode = POLLIN;
-    else if (!input && output)
-        mode = POLLOUT;
+/** alsaseq.EventTemplate send_many() method */
+static PyObject *
+EventTemplate_send_many(EventTemplateObject *self,
+			PyObject *args,
+			PyObject *kwds) {
+  template_array_t arrays[TEMPLATE_FIELD_DRAIN];
+  PyObject *scalars = NULL;
+  PyObject *key, *val;
+  SequencerObject *seq;
+  snd_seq_event_t event;
+  Py_ssize_t pos = 0;
+  Py_ssize_t count = -1;
+  Py_ssize_t len;
+  Py_ssize_t i = 0;
+  const char *format;
+  int narrays = 0;
+  int drain = 0;
+  int tick;
+  int id, n;
+  int ret = 0;
+
+  if (!PyArg_ParseTuple(args, "O!", &SequencerType, &seq)) {
+    return NULL;
+  }
 
-    count = snd_seq_poll_descriptors_count(self->handle, mode);
-    if (count <= 0)
-        Py_RETURN_NONE;
-    pfd = alloca(sizeof(struct pollfd) * count);
-    count = snd_seq_poll_descriptors(self->handle, pfd, count, mode);
-    if (count <= 0)
-        Py_RETURN_NONE;
+  /* the scalar fields patch the event once, the buffers are acquired */
+  scalars = PyDict_New();
+  if (scalars == NULL) {
+    return NULL;
+  }
+  while (kwds != NULL && PyDict_Next(kwds, &pos, &key, &val)) {
+    if (!PyObject_CheckBuffer(val)) {
+      if (PyDict_SetItem(scalars, key, val) < 0) {
+	goto __error;
+      }
+      continue;
+    }
+    id = _EventTemplate_field(key);
+    if (id < 0) {
+      goto __error;
+    }
+    if (id == TEMPLATE_FIELD_DRAIN) {
+      PyErr_SetString(PyExc_TypeError, "drain must be a bool");
+      goto __error;
+    }
+    if (id < SEQEVENT_DATA_ADDR && _SeqEvent_check_data(&self->event, id)) {
+      goto __error;
+    }
+    if (PyObject_GetBuffer(val, &arrays[narrays].view,
+			   PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) < 0) {
+      goto __error;
+    }
+    arrays[narrays].id = id;
+    narrays++;
+    format = arrays[narrays - 1].view.format;
+    if (format != NULL && *format == '@') {
+      format++;
+    }
+    if (format == NULL || format[0] == '\0' || format[1] != '\0' ||
+	_template_format_size(format[0]) !=
+	arrays[narrays - 1].view.itemsize ||
+	arrays[narrays - 1].view.ndim > 1) {
+      PyErr_Format(PyExc_ValueError,
+		   "'%S' must be a one-dimensional buffer of native integers",
+		   key);
+      goto __error;
+    }
+    if (((uintptr_t)arrays[narrays - 1].view.buf %
+	 arrays[narrays - 1].view.itemsize) != 0) {
+      PyErr_Format(PyExc_ValueError,
+		   "'%S' must be aligned on its item size", key);
+      goto __error;
+    }
+    arrays[narrays - 1].format = format[0];
+    len = arrays[narrays - 1].view.len / arrays[narrays - 1].view.itemsize;
+    if (count >= 0 && len != count) {
+      PyErr_Format(PyExc_ValueError,
+		   "'%S' has %zd items, the other arrays %zd", key, len, count);
+      goto __error;
+    }
+    count = len;
+  }
+  if (count < 0) {
+    PyErr_SetString(PyExc_ValueError, "no array given");
+    goto __error;
+  }
 
-    reg = PyObject_GetAttrString(pollObj, "register");
-    if (!reg)
-        return NULL;
+  event = self->event;
+  if (_EventTemplate_patch(&event, scalars, &drain) < 0) {
+    goto __error;
+  }
+  for (n = 0; n < narrays; n++) {
+    if (_template_array_check(&arrays[n], &event, count) < 0) {
+      goto __error;
+    }
+  }
+  if (_Sequencer_init_output_fds(seq) < 0 ||
+      _Sequencer_acquire_output(seq) < 0) {
+    goto __error;
+  }
 
-    for (i = 0; i < count; i++) {
-        t = PyTuple_New(2);
-        if (!t) {
-            Py_DECREF(reg);
-            return NULL;
-        }
-        PyTuple_SET_ITEM(t, 0, PyInt_FromLong(pfd[i].fd));
-        PyTuple_SET_ITEM(t, 1, PyInt_FromLong(pfd[i].events));
-        Py_XDECREF(PyObject_CallObject(reg, t));
-        Py_DECREF(t);
+  tick = snd_seq_ev_is_tick(&event);
+  Py_BEGIN_ALLOW_THREADS;
+  for (i = 0; i < count; i++) {
+    for (n = 0; n < narrays; n++) {
+      PY_LONG_LONG v = _template_array_item(&arrays[n], i);
+
+      switch (arrays[n].id) {
+      case TEMPLATE_FIELD_TIME:
+	if (tick) {
+	  event.time.tick = v;
+	} else {
+	  event.time.time.tv_sec = v / 1000000000;
+	  event.time.time.tv_nsec = v % 1000000000;
+	}
+	break;
+      case TEMPLATE_FIELD_DEST:
+	event.dest.client = v >> 8;
+	event.dest.port = v & 0xff;
+	break;
+      default:
+	_SeqEvent_store_data(&event, arrays[n].id, v);
+      }
+    }
+    ret = _Sequencer_output_nogil(seq, &event);
+    if (ret < 0) {
+      break;
     }
+  }
+  if (ret >= 0 && drain) {
+    ret = _Sequencer_drain_nogil(seq);
+  }
+  Py_END_ALLOW_THREADS;
+  _Sequencer_release_output(seq);
+  self->sent += i;
 
-    Py_DECREF(reg);
+  if (ret < 0) {
+    RAISESND(ret, "Failed to output event %d", (int)i);
+  }
 
-    Py_RETURN_NONE;
+ __error:
+  for (n = 0; n < narrays; n++) {
+    PyBuffer_Release(&arrays[n].view);
+  }
+  Py_XDECREF(scalars);
+  if (PyErr_Occurred()) {
+    return NULL;
+  }
+  return PyLong_FromSsize_t(i);
 }
 
+/** alsaseq.EventTemplate event attribute: tp_getset getter() */
+static PyObject *
+EventTemplate_get_event(EventTemplateObject *self) {
+  return SeqEvent_create(&self->event);
+}
 
+/** alsaseq.EventTemplate type attribute: tp_getset getter() */
+static PyObject *
+EventTemplate_get_type(EventTemplateObject *self) {
+  TCONSTRETURN(EVENT_TYPE, self->event.type);
+}
 
-/** alsaseq.Sequencer tp_methods */
-static PyMethodDef Sequencer_methods[] = {
-  {"create_simple_port",
-   (PyCFunction) Sequencer_create_simple_port,
-   METH_VARARGS | METH_KEYWORDS,
-   Sequencer_create_simple_port__doc__ },
-  {"connection_list",
-   (PyCFunction) Sequencer_connection_list,
-   METH_VARARGS,
-   Sequencer_connection_list__doc__ },
-  {"get_client_info",
-   (PyCFunction) Sequencer_get_client_info,
-   METH_VARARGS | METH_KEYWORDS,
-   Sequencer_get_client_info__doc__ },
-  {"get_port_info",
-   (PyCFunction) Sequencer_get_port_info,
-   METH_VARARGS | METH_KEYWORDS,
-   Sequencer_get_port_info__doc__ },
-  {"connect_ports",
-   (PyCFunction) Sequencer_connect_ports,
-   METH_VARARGS,
-   Sequencer_connect_ports__doc__ },
-  {"disconnect_ports",
-   (PyCFunction) Sequencer_disconnect_ports,
-   METH_VARARGS,
-   Sequencer_disconnect_ports__doc__ },
-  {"get_connect_info",
-   (PyCFunction) Sequencer_get_connect_info,
-   METH_VARARGS,
-   Sequencer_get_connect_info__doc__},
-  {"receive_events",
-   (PyCFunction) Sequencer_receive_events,
-   METH_VARARGS | METH_KEYWORDS,
-   Sequencer_receive_events__doc__},
-  {"output_event",
-   (PyCFunction) Sequencer_output_event,
-   METH_VARARGS | METH_KEYWORDS,
-   Sequencer_output_event__doc__},
-  {"drain_output",
-   (PyCFunction) Sequencer_drain_output,
-   METH_VARARGS,
-   Sequencer_drain_output__doc__},
-  {"sync_output_queue",
-   (PyCFunction) Sequencer_sync_output_queue,
-   METH_VARARGS,
-   Sequencer_sync_output_queue__doc__},
-  {"parse_address",
-   (PyCFunction) Sequencer_parse_address,
-   METH_VARARGS,
-   Sequencer_parse_address__doc__},
-  {"create_queue",
-   (PyCFunction) Sequencer_create_queue,
-   METH_VARARGS | METH_KEYWORDS,
-   Sequencer_create_queue__doc__},
-  {"delete_queue",
-   (PyCFunction) Sequencer_delete_queue,
-   METH_VARARGS | METH_KEYWORDS,
-   Sequencer_delete_queue__doc__},
-  {"queue_tempo",
-   (PyCFunction) Sequencer_queue_tempo,
-   METH_VARARGS | METH_KEYWORDS,
-   Sequencer_queue_tempo__doc__},
-  {"start_queue",
-   (PyCFunction) Sequencer_start_queue,
-   METH_VARARGS | METH_KEYWORDS,
-   Sequencer_start_queue__doc__},
-  {"stop_queue",
-   (PyCFunction) Sequencer_stop_queue,
+/** alsaseq.EventTemplate sent attribute: tp_getset getter() */
+static PyObject *
+EventTemplate_get_sent(EventTemplateObject *self) {
+  return PyLong_FromUnsignedLongLong(self->sent);
+}
+
+/** alsaseq.EventTemplate tp_getset list */
+static PyGetSetDef EventTemplate_getset[] = {
+  {"event",
+   (getter) EventTemplate_get_event,
+   NULL,
+   "A SeqEvent copy of the template.",
+   NULL},
+  {"type",
+   (getter) EventTemplate_get_type,
+   NULL,
+   "The event type of the template.",
+   NULL},
+  {"sent",
+   (getter) EventTemplate_get_sent,
+   NULL,
+   "Number of events output by send() and send_many().",
+   NULL},
+  {NULL}
+};
+
+/** alsaseq.EventTemplate tp_methods */
+static PyMethodDef EventTemplate_methods[] = {
+  {"send",
+   (PyCFunction) EventTemplate_send,
    METH_VARARGS | METH_KEYWORDS,
-   Sequencer_stop_queue__doc__},
-  {"register_poll",
-   (PyCFunction) Sequencer_registerpoll,
+   EventTemplate_send__doc__},
+  {"send_many",
+   (PyCFunction) EventTemplate_send_many,
    METH_VARARGS | METH_KEYWORDS,
-   Sequencer_registerpoll__doc__},
+   EventTemplate_send_many__doc__},
   {NULL}
 };
 
-/** alsaseq.Sequencer type */
-static PyTypeObject SequencerType = {
+/** alsaseq.EventTemplate type */
+static PyTypeObject EventTemplateType = {
   PyVarObject_HEAD_INIT(NULL, 0)
-  tp_name: "alsaseq.Sequencer",
-  tp_basicsize: sizeof(SequencerObject),
-  tp_dealloc: (destructor) Sequencer_dealloc,
-  tp_flags: Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
-  tp_doc: Sequencer__doc__,
-  tp_init: (initproc) Sequencer_init,
+  tp_name: "alsaseq.EventTemplate",
+  tp_basicsize: sizeof(EventTemplateObject),
+  tp_dealloc: (destructor) EventTemplate_dealloc,
+  tp_flags: Py_TPFLAGS_DEFAULT,
+  tp_doc: EventTemplate__doc__,
+  tp_init: (initproc) EventTemplate_init,
   tp_new: PyType_GenericNew,
   tp_alloc: PyType_GenericAlloc,
   tp_free: PyObject_Del,
-  tp_repr: (reprfunc) Sequencer_repr,
-  tp_methods: Sequencer_methods,
-  tp_getset: Sequencer_getset
+  tp_methods: EventTemplate_methods,
+  tp_getset: EventTemplate_getset,
 };
 
 
 
-
-
 //////////////////////////////////////////////////////////////////////////////
 // alsaseq module implementation
 //////////////////////////////////////////////////////////////////////////////
 
+/** alsaseq module: atexit handler stopping the running dispatches */
+static PyObject *
+alsaseq__stop_dispatch(PyObject *module,
+		       PyObject *unused) {
+  PyObject *stats;
+
+  while (dispatch_list != NULL) {
+    stats = Sequencer_stop_dispatch(dispatch_list->seq, NULL);
+    if (stats == NULL) {
+      return NULL;
+    }
+    Py_DECREF(stats);
+  }
+  Py_RETURN_NONE;
+}
+
+static PyMethodDef alsaseq_stop_dispatch_def = {
+  "_stop_dispatch", (PyCFunction) alsaseq__stop_dispatch, METH_NOARGS, NULL
+};
+
 /** alsaseq module: __doc__ */
 char alsaseq__doc__ [] =
   "libasound alsaseq wrapper"
@@ -3270,6 +14537,10 @@ char alsaseq__doc__ [] =
 
 /** alsaseq module methods */
 static PyMethodDef alsaseq_methods[] = {
+  {"load_smf",
+   (PyCFunction) alsaseq_load_smf,
+   METH_VARARGS | METH_KEYWORDS,
+   alsaseq_load_smf__doc__},
   { NULL },
 };
 
@@ -3283,9 +14554,36 @@ MOD_INIT(alsaseq)
   if (PyType_Ready(&SeqEventType) < 0)
     return MOD_ERROR_VAL;
 
+  if (PyType_Ready(&SeqEventBufferType) < 0)
+    return MOD_ERROR_VAL;
+
   if (PyType_Ready(&SequencerType) < 0)
     return MOD_ERROR_VAL;
 
+  if (PyType_Ready(&SmfPlayerType) < 0)
+    return MOD_ERROR_VAL;
+
+  if (PyType_Ready(&SmfRecorderType) < 0)
+    return MOD_ERROR_VAL;
+
+  if (PyType_Ready(&EventLoggerType) < 0)
+    return MOD_ERROR_VAL;
+
+  if (PyType_Ready(&EventLogType) < 0)
+    return MOD_ERROR_VAL;
+
+  if (PyType_Ready(&SeqTopologyType) < 0)
+    return MOD_ERROR_VAL;
+
+  if (PyType_Ready(&QueueStatusType) < 0)
+    return MOD_ERROR_VAL;
+
+  if (PyType_Ready(&MidiCodecType) < 0)
+    return MOD_ERROR_VAL;
+
+  if (PyType_Ready(&EventTemplateType) < 0)
+    return MOD_ERROR_VAL;
+
   MOD_DEF(module, "alsaseq", alsaseq__doc__, alsaseq_methods);
 
   if (module == NULL)
@@ -3298,12 +14596,57 @@ MOD_INIT(alsaseq)
   Py_INCREF(SequencerError);
   PyModule_AddObject(module, "SequencerError", SequencerError);
 
+  /* the dispatcher threads must be gone before finalization */
+  {
+    PyObject *atexit, *func, *ret = NULL;
+
+    atexit = PyImport_ImportModule("atexit");
+    func = PyCFunction_New(&alsaseq_stop_dispatch_def, NULL);
+    if (atexit != NULL && func != NULL) {
+      ret = PyObject_CallMethod(atexit, "register", "O", func);
+    }
+    Py_XDECREF(atexit);
+    Py_XDECREF(func);
+    if (ret == NULL)
+      return MOD_ERROR_VAL;
+    Py_DECREF(ret);
+  }
+
   Py_INCREF(&SeqEventType);
   PyModule_AddObject(module, "SeqEvent", (PyObject *) &SeqEventType);
 
+  Py_INCREF(&SeqEventBufferType);
+  PyModule_AddObject(module, "SeqEventBuffer",
+		     (PyObject *) &SeqEventBufferType);
+
   Py_INCREF(&SequencerType);
   PyModule_AddObject(module, "Sequencer", (PyObject *) &SequencerType);
 
+  Py_INCREF(&SmfPlayerType);
+  PyModule_AddObject(module, "SmfPlayer", (PyObject *) &SmfPlayerType);
+
+  Py_INCREF(&SmfRecorderType);
+  PyModule_AddObject(module, "SmfRecorder", (PyObject *) &SmfRecorderType);
+
+  Py_INCREF(&EventLoggerType);
+  PyModule_AddObject(module, "EventLogger", (PyObject *) &EventLoggerType);
+
+  Py_INCREF(&EventLogType);
+  PyModule_AddObject(module, "EventLog", (PyObject *) &EventLogType);
+
+  Py_INCREF(&SeqTopologyType);
+  PyModule_AddObject(module, "SeqTopology", (PyObject *) &SeqTopologyType);
+
+  Py_INCREF(&QueueStatusType);
+  PyModule_AddObject(module, "QueueStatus", (PyObject *) &QueueStatusType);
+
+  Py_INCREF(&MidiCodecType);
+  PyModule_AddObject(module, "MidiCodec", (PyObject *) &MidiCodecType);
+
+  Py_INCREF(&EventTemplateType);
+  PyModule_AddObject(module, "EventTemplate",
+		     (PyObject *) &EventTemplateType);
+
   Py_INCREF(&ConstantType);
   PyModule_AddObject(module, "Constant", (PyObject *) &ConstantType);
 
@@ -3312,10 +14655,26 @@ MOD_INIT(alsaseq)
 			     "SEQ_LIB_VERSION_STR",
 			     SND_LIB_VERSION_STR);
 
+  /* UMP (MIDI 2.0) support: set_midi_version(), output_ump()... */
+  PyModule_AddIntConstant(module,
+			  "SEQ_UMP_SUPPORTED",
+			  SND_LIB_VERSION >= 0x01020a);
+
+  /* packed event records (receive_records) */
+  PyModule_AddStringConstant(module,
+			     "SEQ_RECORD_FORMAT",
+			     SEQ_RECORD_FORMAT);
+  PyModule_AddIntConstant(module,
+			  "SEQ_RECORD_SIZE",
+			  sizeof(seq_record_t));
+
   /* add Constant dictionaries to module */
   TCONSTDICTADD(module, STREAMS, "_dstreams");
   TCONSTDICTADD(module, MODE, "_dmode");
   TCONSTDICTADD(module, QUEUE, "_dqueue");
+  TCONSTDICTADD(module, QUEUE_TIMER, "_dqueuetimer");
+  TCONSTDICTADD(module, TIMER_GLOBAL, "_dtimerglobal");
+  TCONSTDICTADD(module, MIDI_VERSION, "_dmidiversion");
   TCONSTDICTADD(module, CLIENT_TYPE, "_dclienttype");
   TCONSTDICTADD(module, PORT_CAP, "_dportcap");
   TCONSTDICTADD(module, PORT_TYPE, "_dporttype");
@@ -3338,6 +14697,24 @@ MOD_INIT(alsaseq)
   /* Known queue id */
   TCONSTADD(module, QUEUE, SEQ_QUEUE_DIRECT);
 
+  /* queue timer types */
+  TCONSTADD(module, QUEUE_TIMER, SEQ_TIMER_ALSA);
+  TCONSTADD(module, QUEUE_TIMER, SEQ_TIMER_MIDI_CLOCK);
+  TCONSTADD(module, QUEUE_TIMER, SEQ_TIMER_MIDI_TICK);
+
+  /* global timers, for queue_timer() */
+  TCONSTADD(module, TIMER_GLOBAL, TIMER_GLOBAL_SYSTEM);
+  TCONSTADD(module, TIMER_GLOBAL, TIMER_GLOBAL_RTC);
+  TCONSTADD(module, TIMER_GLOBAL, TIMER_GLOBAL_HPET);
+  TCONSTADD(module, TIMER_GLOBAL, TIMER_GLOBAL_HRTIMER);
+
+  /* client MIDI versions (UMP) */
+#if SND_LIB_VERSION >= 0x01020a
+  TCONSTADD(module, MIDI_VERSION, SEQ_CLIENT_LEGACY_MIDI);
+  TCONSTADD(module, MIDI_VERSION, SEQ_CLIENT_UMP_MIDI_1_0);
+  TCONSTADD(module, MIDI_VERSION, SEQ_CLIENT_UMP_MIDI_2_0);
+#endif
+
   /* client types */
   TCONSTADD(module, CLIENT_TYPE, SEQ_USER_CLIENT);
   TCONSTADD(module, CLIENT_TYPE, SEQ_KERNEL_CLIENT);
@@ -3450,5 +14827,7 @@ MOD_INIT(alsaseq)
   TCONSTADD(module, ADDR_PORT, SEQ_ADDRESS_SUBSCRIBERS);
   TCONSTADD(module, ADDR_PORT, SEQ_ADDRESS_UNKNOWN);
 
+  main_interpreter = PyThreadState_Get()->interp;
+
   return MOD_SUCCESS_VAL(module);
 }
@@ -0,0 +1,270 @@
+#
+#  Python binding for the ALSA library - sequencer benchmarks
+#
+#   This library is free software; you can redistribute it and/or modify
+#   it under the terms of the GNU Lesser General Public License as
+#   published by the Free Software Foundation; either version 2.1 of
+#   the License, or (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU Lesser General Public License for more details.
+#
+#   You should have received a copy of the GNU Lesser General Public
+#   License along with this library; if not, write to the Free Software
+#   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+#
+
+"""Benchmarks of the pyalsa sequencer path.
+
+Usage: python -m pyalsa.bench seq-latency [options]
+
+Two sequencer clients are created and a port of one is connected to a
+port of the other; timestamped events (USR0 or ECHO) are sent through
+the connection and received back in the same process. Only the snd-seq
+kernel module is needed, no MIDI hardware.
+
+Each run reports the send to receive latency (percentiles and a log2
+histogram) and the throughput, for:
+  single -- output_event() + drain_output(), then receive_events(), one
+            event in flight at a time
+  batch  -- output_events(drain=True) of a batch, then receive_into() of
+            a SeqEventBuffer until the whole batch is received
+in blocking (SEQ_BLOCK) and non-blocking (SEQ_NONBLOCK) modes.
+
+The events of a connection are delivered in order, so the n-th received
+event is the n-th sent; its tag (n modulo 256) is checked.
+"""
+
+import argparse
+import json
+import sys
+import time
+
+from pyalsa import alsaseq
+
+MODES = {
+    'block': alsaseq.SEQ_BLOCK,
+    'nonblock': alsaseq.SEQ_NONBLOCK,
+}
+
+EVENTS = {
+    'usr': alsaseq.SEQ_EVENT_USR0,
+    'echo': alsaseq.SEQ_EVENT_ECHO,
+}
+
+APIS = ('single', 'batch')
+
+# receive timeout, in milliseconds: an event not received by then is lost
+TIMEOUT = 1000
+
+
+def percentile(values, fraction):
+    """ nearest-rank percentile of sorted values """
+    if not values:
+        return 0
+    index = int(round(fraction * len(values) + 0.5)) - 1
+    return values[min(max(index, 0), len(values) - 1)]
+
+
+def histogram(values):
+    """ log2 histogram of the latencies in microseconds:
+        list of (upper bound in us, count) """
+    buckets = {}
+    for value in values:
+        bound = 1
+        while bound < value / 1000.0:
+            bound *= 2
+        buckets[bound] = buckets.get(bound, 0) + 1
+    return sorted(buckets.items())
+
+
+class Loopback(object):
+    """ two sequencer clients, a port of the first one connected to a
+        port of the second one """
+
+    def __init__(self, mode, batch):
+        self.sender = alsaseq.Sequencer(clientname='pyalsa-bench-tx',
+                                        streams=alsaseq.SEQ_OPEN_OUTPUT,
+                                        mode=mode)
+        # room for a whole batch in the kernel input pool
+        self.receiver = alsaseq.Sequencer(clientname='pyalsa-bench-rx',
+                                          streams=alsaseq.SEQ_OPEN_INPUT,
+                                          mode=mode,
+                                          input_pool=max(200, 2 * batch))
+        self.src = self.sender.create_simple_port(
+            'tx', alsaseq.SEQ_PORT_TYPE_APPLICATION,
+            alsaseq.SEQ_PORT_CAP_READ | alsaseq.SEQ_PORT_CAP_SUBS_READ)
+        self.dst = self.receiver.create_simple_port(
+            'rx', alsaseq.SEQ_PORT_TYPE_APPLICATION,
+            alsaseq.SEQ_PORT_CAP_WRITE | alsaseq.SEQ_PORT_CAP_SUBS_WRITE)
+        self.sender.connect_ports((self.sender.client_id, self.src),
+                                  (self.receiver.client_id, self.dst))
+
+    def event(self, type, index):
+        event = alsaseq.SeqEvent(type)
+        event.source = (self.sender.client_id, self.src)
+        event.tag = index & 0xff
+        return event
+
+    def close(self):
+        self.sender.disconnect_ports((self.sender.client_id, self.src),
+                                     (self.receiver.client_id, self.dst))
+        del self.sender
+        del self.receiver
+
+
+def run_single(loop, type, count):
+    """ one event in flight: returns (latencies in ns, lost, mismatched) """
+    latencies = []
+    lost = mismatched = 0
+    events = [loop.event(type, i) for i in range(count)]
+    for i, event in enumerate(events):
+        start = time.perf_counter_ns()
+        loop.sender.output_event(event)
+        loop.sender.drain_output()
+        received = loop.receiver.receive_events(timeout=TIMEOUT, maxevents=1)
+        end = time.perf_counter_ns()
+        if not received:
+            lost += 1
+            continue
+        if received[0].tag != i & 0xff:
+            mismatched += 1
+        latencies.append(end - start)
+    return latencies, lost, mismatched
+
+
+def run_batch(loop, type, count, batch):
+    """ batches of events: returns (latencies in ns, lost, mismatched) """
+    latencies = []
+    lost = mismatched = 0
+    buffer = alsaseq.SeqEventBuffer(size=batch)
+    for first in range(0, count, batch):
+        events = [loop.event(type, i)
+                  for i in range(first, min(first + batch, count))]
+        start = time.perf_counter_ns()
+        loop.sender.output_events(events, drain=True)
+        index = first
+        while index < first + len(events):
+            received = loop.receiver.receive_into(buffer, timeout=TIMEOUT)
+            end = time.perf_counter_ns()
+            if received == 0:
+                break
+            for i in range(received):
+                if buffer[i].tag != (index + i) & 0xff:
+                    mismatched += 1
+                latencies.append(end - start)
+            index += received
+        lost += first + len(events) - index
+    return latencies, lost, mismatched
+
+
+def seq_latency(mode='nonblock', api='single', event='usr', count=10000,
+                batch=64, warmup=100):
+    """ runs one seq-latency benchmark; returns a dict of results, the
+        latencies in microseconds """
+    type = EVENTS[event]
+    loop = Loopback(MODES[mode], batch)
+    try:
+        if api == 'single':
+            run_single(loop, type, warmup)
+        else:
+            run_batch(loop, type, warmup, batch)
+        start = time.perf_counter_ns()
+        if api == 'single':
+            latencies, lost, mismatched = run_single(loop, type, count)
+        else:
+            latencies, lost, mismatched = run_batch(loop, type, count, batch)
+        elapsed = time.perf_counter_ns() - start
+    finally:
+        loop.close()
+
+    latencies.sort()
+    us = lambda ns: round(ns / 1000.0, 3)
+    return {
+        'benchmark': 'seq-latency',
+        'mode': mode,
+        'api': api,
+        'event': event,
+        'count': count,
+        'batch': batch if api == 'batch' else 1,
+        'received': len(latencies),
+        'lost': lost,
+        'mismatched': mismatched,
+        'p50_us': us(percentile(latencies, 0.50)),
+        'p99_us': us(percentile(latencies, 0.99)),
+        'p999_us': us(percentile(latencies, 0.999)),
+        'max_us': us(latencies[-1] if latencies else 0),
+        'mean_us': us(sum(latencies) / len(latencies) if latencies else 0),
+        'throughput_eps': round(len(latencies) * 1e9 / elapsed, 1),
+        'histogram_us': histogram(latencies),
+    }
+
+
+def print_result(result, show_histogram):
+    print("%(mode)-8s %(api)-6s %(event)-4s batch %(batch)4d: "
+          "p50 %(p50_us)9.1f us  p99 %(p99_us)9.1f us  "
+          "p999 %(p999_us)9.1f us  max %(max_us)9.1f us  "
+          "%(throughput_eps)10.0f ev/s" % result)
+    if result['lost'] or result['mismatched']:
+        print("    lost %(lost)d, out of order %(mismatched)d" % result)
+    if show_histogram:
+        total = float(result['received']) or 1
+        for bound, n in result['histogram_us']:
+            print("    <= %8d us %8d %s" % (bound, n,
+                                            '#' * int(50 * n / total + 0.5)))
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(
+        prog='python -m pyalsa.bench',
+        description='Benchmarks of the pyalsa sequencer path.')
+    parser.add_argument('benchmark', choices=['seq-latency'])
+    parser.add_argument('-n', '--count', type=int, default=10000,
+                        help='events per run (default 10000)')
+    parser.add_argument('-b', '--batch', type=int, default=64,
+                        help='events per batch of the batch API (default 64)')
+    parser.add_argument('-w', '--warmup', type=int, default=100,
+                        help='events sent before measuring (default 100)')
+    parser.add_argument('-m', '--mode', choices=['block', 'nonblock', 'all'],
+                        default='all')
+    parser.add_argument('-a', '--api', choices=['single', 'batch', 'all'],
+                        default='all')
+    parser.add_argument('-e', '--event', choices=sorted(EVENTS),
+                        default='usr')
+    parser.add_argument('-H', '--histogram', action='store_true',
+                        help='print the latency histograms')
+    parser.add_argument('-j', '--json', action='store_true',
+                        help='print the results as JSON')
+    parser.add_argument('--max-p99', type=float, default=None,
+                        help='exit with status 1 if a p99 latency is higher '
+                        '(microseconds)')
+    args = parser.parse_args(argv)
+    if args.count <= 0 or args.batch <= 0 or args.warmup < 0:
+        parser.error('count and batch must be > 0, warmup >= 0')
+
+    modes = sorted(MODES) if args.mode == 'all' else [args.mode]
+    apis = APIS if args.api == 'all' else [args.api]
+    results = []
+    for mode in modes:
+        for api in apis:
+            result = seq_latency(mode, api, args.event, args.count,
+                                 args.batch, args.warmup)
+            results.append(result)
+            if not args.json:
+                print_result(result, args.histogram)
+
+    if args.json:
+        json.dump({'lib_version': alsaseq.SEQ_LIB_VERSION_STR,
+                   'results': results}, sys.stdout, indent=2)
+        print()
+
+    failed = any(r['lost'] or r['mismatched'] for r in results)
+    if args.max_p99 is not None:
+        failed = failed or any(r['p99_us'] > args.max_p99 for r in results)
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
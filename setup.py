@@ -23,6 +23,16 @@ if ver != VERSION:
   fp.close()
 del fp
 
+# the sequencer bindings use Python 3.6 APIs; the other modules still
+# build with Python 2
+SEQ_MODULES = []
+if sys.version_info >= (3, 6):
+  SEQ_MODULES.append(Extension('pyalsa.alsaseq',
+    ['pyalsa/alsaseq.c'],
+    include_dirs=[],
+    library_dirs=[],
+    libraries=['asound', 'pthread']))
+
 setup(
   name='pyalsa',
   version=VERSION,
@@ -53,12 +63,7 @@ setup(
       include_dirs=[],
       library_dirs=[],
       libraries=['asound']),
-    Extension('pyalsa.alsaseq',
-      ['pyalsa/alsaseq.c'],
-      include_dirs=[],
-      library_dirs=[],
-      libraries=['asound']),
-  ],
+  ] + SEQ_MODULES,
   packages=['pyalsa'],
   scripts=[]
 )
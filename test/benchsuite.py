@@ -0,0 +1,266 @@
+#!/usr/bin/env python3
+# -*- Python -*-
+#
+# Microbenchmarks of the pyalsa modules: for each API call, the wall
+# time, the memory allocated (tracemalloc) and the references leaked.
+# Meant to be run on a box with the snd-dummy and snd-seq modules loaded
+# (modprobe snd-dummy; modprobe snd-seq); the cases needing a device that
+# cannot be opened are reported as skipped.
+#
+# The results are printed as JSON, to compare them between pyalsa
+# releases:
+#
+#   ./benchsuite.py -o pyalsa-$(git describe).json
+#
+# For each case:
+#   ns_per_call     -- best wall time of a call over the timing rounds
+#   blocks_per_call -- memory blocks allocated and still alive after a
+#                      round, per call, once warmed up (tracemalloc);
+#                      1 or more means a leak
+#   bytes_per_call  -- same, in bytes
+#   peak_bytes      -- peak of the traced memory during a round
+#   refs_per_call   -- growth of the total reference count per call, on
+#                      a debug build of Python only (null otherwise);
+#                      1 or more means a leak
+#
+# The pyalsa objects are not tracked by the gc, so a leaked SeqEvent or
+# Element only shows up in the traced memory blocks (and, on a debug
+# build, in the reference count); the exit status is 1 if a case leaks.
+
+import sys
+sys.path.insert(0, '..')
+import argparse
+import gc
+import json
+import time
+import tracemalloc
+from pyalsa import alsacard, alsahcontrol, alsamixer, alsaseq
+
+
+def total_refs():
+	gc.collect()
+	return sys.gettotalrefcount()
+
+
+def bench(name, fn, iterations, rounds=5):
+	for i in range(min(iterations, 100)):
+		fn()
+
+	best = None
+	for r in range(rounds):
+		start = time.perf_counter_ns()
+		for i in range(iterations):
+			fn()
+		elapsed = time.perf_counter_ns() - start
+		if best is None or elapsed < best:
+			best = elapsed
+
+	gc.collect()
+	tracemalloc.start()
+	before = tracemalloc.take_snapshot()
+	tracemalloc.reset_peak()
+	for i in range(iterations):
+		fn()
+	peak = tracemalloc.get_traced_memory()[1]
+	after = tracemalloc.take_snapshot()
+	tracemalloc.stop()
+	# the snapshot 'before' is alive in 'after': leave tracemalloc out
+	ignore = [tracemalloc.Filter(False, tracemalloc.__file__)]
+	stats = after.filter_traces(ignore).compare_to(
+		before.filter_traces(ignore), 'filename')
+	blocks = sum(s.count_diff for s in stats)
+	size = sum(s.size_diff for s in stats)
+
+	refs = None
+	if hasattr(sys, 'gettotalrefcount'):
+		refs = total_refs()
+		for i in range(iterations):
+			fn()
+		refs = round((total_refs() - refs) / float(iterations), 3)
+
+	return {
+		'name': name,
+		'iterations': iterations,
+		'ns_per_call': round(best / float(iterations), 1),
+		'blocks_per_call': round(blocks / float(iterations), 3),
+		'bytes_per_call': round(size / float(iterations), 1),
+		'peak_bytes': peak,
+		'refs_per_call': refs,
+	}
+
+
+def seq_cases():
+	""" SeqEvent and Sequencer loopback (needs /dev/snd/seq) """
+	note = {'note.channel': 0, 'note.note': 60, 'note.velocity': 64,
+		'note.off_velocity': 0, 'note.duration': 0}
+	event = alsaseq.SeqEvent(alsaseq.SEQ_EVENT_NOTEON)
+	event.set_data(note)
+	yield 'seq.SeqEvent()', lambda: alsaseq.SeqEvent(alsaseq.SEQ_EVENT_NOTEON)
+	yield 'seq.SeqEvent.set_data', lambda: event.set_data(note)
+	yield 'seq.SeqEvent.get_data', event.get_data
+
+	seq = alsaseq.Sequencer(clientname='benchsuite',
+				mode=alsaseq.SEQ_NONBLOCK)
+	src = seq.create_simple_port('src', alsaseq.SEQ_PORT_TYPE_APPLICATION,
+				     alsaseq.SEQ_PORT_CAP_READ |
+				     alsaseq.SEQ_PORT_CAP_SUBS_READ)
+	dst = seq.create_simple_port('dst', alsaseq.SEQ_PORT_TYPE_APPLICATION,
+				     alsaseq.SEQ_PORT_CAP_WRITE |
+				     alsaseq.SEQ_PORT_CAP_SUBS_WRITE)
+	seq.connect_ports((seq.client_id, src), (seq.client_id, dst))
+	event.source = (seq.client_id, src)
+	batch = [event] * 32
+	buffer = alsaseq.SeqEventBuffer(size=len(batch))
+
+	def output_receive():
+		seq.output_event(event)
+		seq.drain_output()
+		seq.receive_events(timeout=1000, maxevents=1)
+
+	def output_receive_batch():
+		seq.output_events(batch, drain=True)
+		received = 0
+		while received < len(batch):
+			count = seq.receive_into(buffer, timeout=1000)
+			if count == 0:
+				break
+			received += count
+
+	yield 'seq.output_event+receive_events', output_receive
+	yield 'seq.output_events+receive_into[32]', output_receive_batch
+	seq.disconnect_ports((seq.client_id, src), (seq.client_id, dst))
+
+
+def hctl_cases(card):
+	""" HControl and its Element/Info/Value """
+	hctl = alsahcontrol.HControl('hw:%d' % card)
+	ids = [l[1:] for l in hctl.list()]
+	element = alsahcontrol.Element(hctl, ids[0])
+	info = alsahcontrol.Info(element)
+	value = alsahcontrol.Value(element)
+
+	def elements():
+		for id in ids:
+			alsahcontrol.Element(hctl, id)
+
+	yield 'hctl.HControl.list', hctl.list
+	yield 'hctl.Element()', lambda: alsahcontrol.Element(hctl, ids[0])
+	yield 'hctl.Element()*%d' % len(ids), elements
+	yield 'hctl.Info()', lambda: alsahcontrol.Info(element)
+	yield 'hctl.Value()', lambda: alsahcontrol.Value(element)
+	yield 'hctl.Value.read', value.read
+	yield 'hctl.Value.get_tuple', lambda: value.get_tuple(info.type,
+							      info.count)
+
+
+def mixer_cases(card):
+	""" Mixer enumeration and volume of the first element having one """
+	mixer = alsamixer.Mixer()
+	mixer.attach('hw:%d' % card)
+	mixer.load()
+	names = mixer.list()
+	name = index = None
+	for n, i in names:
+		if alsamixer.Element(mixer, n, i).has_volume():
+			name, index = n, i
+			break
+
+	def elements():
+		for n, i in mixer.list():
+			alsamixer.Element(mixer, n, i)
+
+	yield 'mixer.Mixer.list', mixer.list
+	yield 'mixer.Element()*%d' % len(names), elements
+	if name is None:
+		return
+	element = alsamixer.Element(mixer, name, index)
+	saved = element.get_volume_tuple()
+	volume = element.get_volume()
+	yield 'mixer.Element.get_volume', element.get_volume
+	yield 'mixer.Element.get_volume_tuple', element.get_volume_tuple
+	yield 'mixer.Element.set_volume', lambda: element.set_volume(volume)
+	yield 'mixer.Element.set_volume_all', lambda: element.set_volume_all(volume)
+	element.set_volume_array(saved)
+
+
+def find_card(name):
+	for card in alsacard.card_list():
+		if alsacard.card_get_name(card) == name:
+			return card
+	return None
+
+
+def main(argv=None):
+	parser = argparse.ArgumentParser(description='pyalsa microbenchmarks')
+	parser.add_argument('-n', '--iterations', type=int, default=1000,
+			    help='calls per round (default 1000)')
+	parser.add_argument('-r', '--rounds', type=int, default=5,
+			    help='timing rounds, the best one is kept (default 5)')
+	parser.add_argument('-c', '--card', type=int, default=None,
+			    help='card index (default: the "Dummy" card)')
+	parser.add_argument('-k', '--filter', default='',
+			    help='only run the cases whose name contains this')
+	parser.add_argument('-o', '--output', default=None,
+			    help='write the JSON results to this file')
+	args = parser.parse_args(argv)
+
+	card = args.card
+	if card is None:
+		card = find_card('Dummy')
+	groups = [('seq', seq_cases, ())]
+	if card is not None:
+		groups.append(('hctl', hctl_cases, (card,)))
+		groups.append(('mixer', mixer_cases, (card,)))
+
+	if hasattr(sys, 'gettotalrefcount'):
+		leak_check = 'tracemalloc blocks and total refcount'
+	else:
+		leak_check = 'tracemalloc blocks (no refcount: not a debug build)'
+	print('leak check: %s' % leak_check, file=sys.stderr)
+
+	results = []
+	skipped = {}
+	if card is None:
+		skipped['hctl'] = skipped['mixer'] = 'no Dummy card (modprobe snd-dummy)'
+	for group, cases, cargs in groups:
+		try:
+			for name, fn in cases(*cargs):
+				if args.filter not in name:
+					continue
+				results.append(bench(name, fn, args.iterations,
+						     args.rounds))
+				print('%-40s %10.1f ns %8.3f blocks %8s refs' % (
+					name, results[-1]['ns_per_call'],
+					results[-1]['blocks_per_call'],
+					results[-1]['refs_per_call']),
+				      file=sys.stderr)
+		except Exception as e:
+			skipped[group] = str(e)
+			print('%s: skipped: %s' % (group, e), file=sys.stderr)
+
+	report = {
+		'python': sys.version.split()[0],
+		'asoundlib_version': alsacard.asoundlib_version(),
+		'seq_lib_version': alsaseq.SEQ_LIB_VERSION_STR,
+		'card': card,
+		'iterations': args.iterations,
+		'leak_check': leak_check,
+		'results': results,
+		'skipped': skipped,
+	}
+	if args.output:
+		with open(args.output, 'w') as f:
+			json.dump(report, f, indent=2)
+			f.write('\n')
+	else:
+		json.dump(report, sys.stdout, indent=2)
+		print()
+	leaks = [r['name'] for r in results
+		 if r['blocks_per_call'] >= 1 or (r['refs_per_call'] or 0) >= 1]
+	for name in leaks:
+		print('leak: %s' % name, file=sys.stderr)
+	return 1 if leaks else 0
+
+
+if __name__ == '__main__':
+	sys.exit(main())
@@ -0,0 +1,349 @@
+#! /usr/bin/python
+# Sample code for pyalsa Sequencer binding
+# Loopback test for the batched receive API (SeqEventBuffer).
+#
+# This code is in the public domain,
+# use it as base for creating your pyalsa
+# sequencer application.
+
+import os
+import sys
+import struct
+from array import array
+import tempfile
+import time
+sys.path.insert(0, '..')
+del sys
+from alsamemdebug import debuginit, debug, debugdone
+from pyalsa import alsaseq
+
+debuginit()
+
+print("01:Creating Sequencer and loopback ports ===========")
+seq = alsaseq.Sequencer(clientname='seqtest4', output_buffer_size=65536,
+                        output_pool=1000)
+print("    buffers: output=%d input=%d" % (seq.output_buffer_size,
+                                           seq.input_buffer_size))
+print("    pool: %s" % seq.pool_status())
+src = seq.create_simple_port('src', alsaseq.SEQ_PORT_TYPE_APPLICATION,
+                             alsaseq.SEQ_PORT_CAP_READ |
+                             alsaseq.SEQ_PORT_CAP_SUBS_READ)
+dst = seq.create_simple_port('dst', alsaseq.SEQ_PORT_TYPE_APPLICATION,
+                             alsaseq.SEQ_PORT_CAP_WRITE |
+                             alsaseq.SEQ_PORT_CAP_SUBS_WRITE)
+seq.connect_ports((seq.client_id, src), (seq.client_id, dst))
+print("    %d:%d -> %d:%d" % (seq.client_id, src, seq.client_id, dst))
+print()
+
+print("02:Sending notes and a sysex ========================")
+events = []
+for note in range(60, 72):
+    event = alsaseq.SeqEvent.note_on(0, note, 100)
+    event.source = (seq.client_id, src)
+    events.append(event)
+event = alsaseq.SeqEvent(alsaseq.SEQ_EVENT_SYSEX)
+event.source = (seq.client_id, src)
+event.ext = b'\xf0\x7e\x7f\x06\x01\xf7'
+print("    sysex: %s" % memoryview(event).hex())
+events.append(event)
+print("    queued: %d" % seq.output_events(events, drain=True))
+del events, event
+print()
+
+print("03:Receiving into a SeqEventBuffer ==================")
+buf = alsaseq.SeqEventBuffer(size=8, extsize=0)
+total = 0
+while total < 13:
+    count = seq.receive_into(buf, timeout=1000)
+    if count == 0:
+        break
+    for event in buf:
+        if event.is_note_type:
+            print("    %s note=%d velocity=%d" % (event, event.note,
+                                                  event.velocity))
+        else:
+            print("    %s %s" % (event, event.get_data()))
+    total += count
+print("    received: %d events, slab: %d bytes" % (total, buf.extsize))
+print()
+
+print("03b:Keeping views across a refill and a re-init =====")
+big = alsaseq.SeqEvent(alsaseq.SEQ_EVENT_SYSEX)
+big.source = (seq.client_id, src)
+big.ext = b'\xf0' + b'\x01' * 1000 + b'\xf7'
+seq.output_events([big, big], drain=True)
+vbuf = alsaseq.SeqEventBuffer(size=4, extsize=16)
+seq.receive_into(vbuf, timeout=1000)
+last = vbuf[len(vbuf) - 1]
+seq.output_events([big] * 3, drain=True)
+seq.receive_into(vbuf, timeout=1000)
+print("    kept view after refill: %d bytes" % len(last.ext))
+try:
+    vbuf.__init__(size=4)
+except BufferError as e:
+    print("    re-init refused: %s" % e)
+del last
+vbuf.__init__(size=4)
+print("    re-init without views: ok")
+del big, vbuf
+print()
+
+print("04:Sending back a SeqEventBuffer ====================")
+for event in buf:
+    event.source = (seq.client_id, src)
+    event.dest = (alsaseq.SEQ_ADDRESS_SUBSCRIBERS, 0)
+del event
+print("    queued: %d" % seq.output_events(buf, drain=True))
+print("    received: %d" % seq.receive_into(buf, timeout=1000))
+print()
+
+print("05:Receiving packed records =========================")
+seq.output_events(buf, drain=True)
+records = bytearray(alsaseq.SEQ_RECORD_SIZE * 16)
+count = seq.receive_records(records, timeout=1000)
+for rec in struct.iter_unpack(alsaseq.SEQ_RECORD_FORMAT,
+                              records[:count * alsaseq.SEQ_RECORD_SIZE]):
+    print("    %s" % (rec,))
+print("    received: %d records" % count)
+del records
+print()
+
+print("06:Native dispatch thread ==========================")
+batches = []
+seq.start_dispatch(batches.append, batch=8, max_latency_us=2000)
+seq.output_events(buf, drain=True)
+time.sleep(0.5)
+try:
+    seq.__init__()
+    assert False, "re-init accepted while dispatching"
+except RuntimeError as e:
+    print("    re-init refused: %s" % e)
+print("    stats: %s" % seq.stop_dispatch())
+for batch in batches:
+    print("    batch: %d events" % len(batch))
+del batches
+print()
+
+print("07:Recording a SMF and loading it back =============")
+path = os.path.join(tempfile.gettempdir(), 'seqtest4.mid')
+rec = alsaseq.SmfRecorder(seq, path, [(seq.client_id, src)], format=0)
+rec.start()
+seq.output_events(buf, drain=True)
+time.sleep(0.5)
+print("    stats: %s" % rec.stop())
+player = alsaseq.load_smf(path)
+print("    %s" % player)
+del rec, player
+os.unlink(path)
+print()
+
+print("07b:Playing a SMF through the loopback ==============")
+# running status, a meta event cancelling it, then an explicit status
+track = bytes([0x00, 0x90, 60, 100, 0x00, 62, 100,
+               0x00, 0xff, 0x06, 0x01, 0x41,
+               0x00, 0x91, 64, 100,
+               0x18, 0x80, 60, 0,
+               0x00, 0xff, 0x2f, 0x00])
+
+
+def smf_file(track):
+    return b'MThd' + struct.pack('>IHHH', 6, 0, 1, 96) + \
+        b'MTrk' + struct.pack('>I', len(track)) + track
+
+
+smf = smf_file(track)
+queue = seq.create_queue()
+for preload in (True, False):
+    player = alsaseq.SmfPlayer(smf, preload=preload)
+    seq.queue_tempo(queue, player.tempo, player.ppq)
+    seq.start_queue(queue)
+    seq.drain_output()
+    if preload:
+        count = player.play(seq, queue, [(seq.client_id, dst)],
+                            source_port=src)
+        seq.drain_output()
+    else:
+        count = player.stream(seq, queue, [(seq.client_id, dst)],
+                              lookahead_ms=100, source_port=src)
+    notes = []
+    while len(notes) < count:
+        events = seq.receive_events(timeout=1000)
+        if not events:
+            break
+        notes += [(e.type, e.channel, e.note) for e in events
+                  if e.source == (seq.client_id, src)]
+    print("    %s: %d events, received %s" % (
+        'play' if preload else 'stream', count, notes))
+    assert notes == [(alsaseq.SEQ_EVENT_NOTEON, 0, 60),
+                     (alsaseq.SEQ_EVENT_NOTEON, 0, 62),
+                     (alsaseq.SEQ_EVENT_NOTEON, 1, 64),
+                     (alsaseq.SEQ_EVENT_NOTEOFF, 0, 60)]
+    seq.stop_queue(queue)
+    seq.drain_output()
+seq.delete_queue(queue)
+try:
+    # no running status after a meta event
+    alsaseq.SmfPlayer(smf_file(track.replace(bytes([0x00, 0x91]),
+                                             bytes([0x00]))))
+except ValueError as e:
+    print("    data after a meta event: %s" % e)
+del player, events, notes
+print()
+
+print("08:Binary event log ================================")
+path = os.path.join(tempfile.gettempdir(), 'seqtest4.log')
+logger = alsaseq.EventLogger(seq, path, flush_ms=0)
+logger.start()
+seq.output_events(buf, drain=True)
+time.sleep(0.5)
+print("    stats: %s" % logger.stop())
+try:
+    logger.start()
+except alsaseq.SequencerError as e:
+    print("    restart refused: %s" % e)
+log = alsaseq.EventLog(path)
+print("    events: %d, first: %s, last: %s" % (len(log), log[0], log[-1]))
+print("    records: %d bytes" % len(log.records()))
+assert log.records(5, 2) == b'' and log.times(-1, 0) == b''
+del logger, log
+os.unlink(path)
+print()
+
+print("09:Event filters ===================================")
+seq.set_event_filter([alsaseq.SEQ_EVENT_NOTEON, alsaseq.SEQ_EVENT_SYSEX])
+print("    client filter: %r" % seq.get_client_info()['event_filter'][:4])
+seq.set_receive_filter(types=[alsaseq.SEQ_EVENT_NOTEON], channels=[0],
+                       sources=[seq.client_id])
+seq.output_events(buf, drain=True)
+events = seq.receive_events(timeout=1000, maxevents=32)
+print("    received: %d notes, filter: %s" % (len(events),
+                                             seq.get_receive_filter()))
+seq.clear_receive_filter()
+seq.clear_event_filter()
+del events
+print()
+
+print("10:Creating ports in bulk ==========================")
+queue = seq.create_queue()
+ports = seq.create_ports([{'name': 'bulk%d' % i,
+                           'caps': alsaseq.SEQ_PORT_CAP_WRITE |
+                           alsaseq.SEQ_PORT_CAP_SUBS_WRITE,
+                           'midi_channels': 16,
+                           'timestamping': True,
+                           'timestamp_queue': queue} for i in range(4)])
+print("    ports: %s" % ports)
+seq.delete_queue(queue)
+print()
+
+print("11:Topology cache ==================================")
+topo = alsaseq.SeqTopology()
+generation = topo.generation
+port = seq.create_simple_port('topology', alsaseq.SEQ_PORT_TYPE_APPLICATION,
+                              alsaseq.SEQ_PORT_CAP_READ |
+                              alsaseq.SEQ_PORT_CAP_SUBS_READ)
+seq.connect_ports((seq.client_id, port), (seq.client_id, ports[0]))
+print("    generation: %d -> %d" % (generation, topo.generation))
+print("    port: %s" % topo.get_port(seq.client_id, port))
+print("    client: %s" % topo.get_client(seq.client_id))
+print("    clients: %d cached, %d walked" % (len(topo.connection_list()),
+                                              len(seq.connection_list())))
+name = topo.get_client(seq.client_id)['name']
+print("    resolve: %s" % (topo.resolve('%s:topology' % name),))
+print("    resolve_many: %s" % topo.resolve_many(['%s:%d' % (name, port),
+                                                  'System:0', 'nothere:0'],
+                                                 strict=False))
+print("    find: %s" % topo.find('^%s:bulk[0-3]$' % name, regex=True))
+print("    stats: %s" % topo.stats)
+del topo
+print()
+
+print("12:Applying subscriptions in bulk ==================")
+links = [((seq.client_id, port), (seq.client_id, p)) for p in ports]
+print("    add: %s" % (seq.apply_subscriptions(add=links),))
+try:
+    seq.apply_subscriptions(add=[((seq.client_id, port), (250, 0))],
+                            remove=links[:2])
+except alsaseq.SequencerError as e:
+    print("    atomic failure: %s" % e)
+print("    remove: %s" % (seq.apply_subscriptions(remove=links,
+                                                  atomic=False),))
+print()
+
+print("13:Queue clock ===================================")
+queue = seq.create_queue()
+print("    timer: %s" % seq.queue_timer(queue))
+print("    hrtimer: %s" % seq.queue_timer(queue,
+                                          alsaseq.TIMER_GLOBAL_HRTIMER))
+print("    skew: %s" % (seq.queue_skew(queue, 0x10000 * 101 // 100),))
+seq.start_queue(queue)
+seq.drain_output()
+status = alsaseq.QueueStatus(seq, queue)
+for i in range(3):
+    time.sleep(0.01)
+    print("    tick %d, times %s" % (status.tick(), status.times()))
+print("    running: %s, reads: %d" % (status.running, status.reads))
+seq.stop_queue(queue)
+seq.drain_output()
+del status
+seq.delete_queue(queue)
+print()
+
+print("14:MIDI byte stream codec ========================")
+codec = alsaseq.MidiCodec(bufsize=32)
+stream = bytes([0x90, 60, 100, 62, 100, 0x80, 60, 0]) + \
+    bytes([0xf0] + [0x11] * 40 + [0xf7])
+events = codec.from_bytes(stream[:4]) + codec.from_bytes(stream[4:])
+print("    events: %s" % [e.type for e in events])
+data = codec.to_bytes(events)
+print("    round trip: %s" % (data == stream))
+mbuf = alsaseq.SeqEventBuffer(size=2)
+print("    into buffer: %d bytes, %d events" % (codec.from_bytes(stream, mbuf),
+                                                len(mbuf)))
+print("    stats: %s" % codec.stats)
+del codec, events, mbuf
+print()
+
+print("15:Event templates ================================")
+event = alsaseq.SeqEvent.note_on(0, 60, 100)
+event.source = (seq.client_id, src)
+tmpl = alsaseq.EventTemplate(event, channel=9)
+tmpl.send(seq, note=36, velocity=127)
+tmpl.send_many(seq, note=array('B', [38, 42, 46]), velocity=80, drain=True)
+received = seq.receive_into(buf, timeout=1000)
+print("    received: %s" % [(buf[i].channel, buf[i].note, buf[i].velocity)
+                            for i in range(received)])
+print("    type: %s, sent: %d" % (tmpl.type, tmpl.sent))
+for bad in (memoryview(bytearray(9))[1:].cast('I'), array('Q', [1 << 32])):
+    try:
+        tmpl.send_many(seq, time=bad)
+        assert False, "send_many() accepted %r" % bad
+    except ValueError as err:
+        print("    rejected: %s" % err)
+del tmpl, event
+print()
+
+print("16:Input poll counters ============================")
+seq.poll_stats(reset=True)
+print("    timed out: %d" % len(seq.receive_events(timeout=10)))
+event = alsaseq.SeqEvent.note_on(0, 60, 100)
+event.source = (seq.client_id, src)
+seq.output_event(event)
+seq.drain_output()
+print("    received: %d" % len(seq.receive_events(timeout=1000)))
+stats = seq.poll_stats(reset=True)
+print("    stats: %s" % stats)
+assert stats['polls'] >= 2 and stats['wakeups'] >= 1
+assert stats['polls'] >= stats['wakeups'] >= stats['empty_wakeups']
+stats = seq.poll_stats()
+assert stats == {'polls': 0, 'wakeups': 0, 'empty_wakeups': 0}
+print("    after reset: %s" % stats)
+del event
+print()
+
+print("98:Removing sequencer ==============================")
+debug([seq, buf])
+del seq, buf
+print()
+
+debugdone()
+print("seqtest4.py done.")
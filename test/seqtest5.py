@@ -0,0 +1,67 @@
+#! /usr/bin/python
+# Sample code for pyalsa Sequencer binding
+# Loopback test for the asyncio support (areceive, async for,
+# aoutput_event, adrain_output).
+#
+# This code is in the public domain,
+# use it as base for creating your pyalsa
+# sequencer application.
+
+import sys
+sys.path.insert(0, '..')
+del sys
+import asyncio
+from alsamemdebug import debuginit, debug, debugdone
+from pyalsa import alsaseq
+
+debuginit()
+
+print("01:Creating Sequencer and loopback ports ===========")
+seq = alsaseq.Sequencer(clientname='seqtest5')
+src = seq.create_simple_port('src', alsaseq.SEQ_PORT_TYPE_APPLICATION,
+                             alsaseq.SEQ_PORT_CAP_READ |
+                             alsaseq.SEQ_PORT_CAP_SUBS_READ)
+dst = seq.create_simple_port('dst', alsaseq.SEQ_PORT_TYPE_APPLICATION,
+                             alsaseq.SEQ_PORT_CAP_WRITE |
+                             alsaseq.SEQ_PORT_CAP_SUBS_WRITE)
+seq.connect_ports((seq.client_id, src), (seq.client_id, dst))
+print("    %d:%d -> %d:%d" % (seq.client_id, src, seq.client_id, dst))
+print()
+
+
+async def send(count):
+    for note in range(60, 60 + count):
+        event = alsaseq.SeqEvent.note_on(0, note, 100)
+        event.source = (seq.client_id, src)
+        await seq.aoutput_event(event)
+    await seq.adrain_output()
+    print("    sent: %d" % count)
+
+
+async def receive(count):
+    events = await seq.areceive(maxevents=4)
+    print("    areceive: %d events" % len(events))
+    received = len(events)
+    async for event in seq:
+        print("    %s note=%d" % (event, event.note))
+        received += 1
+        if received == count:
+            break
+    return received
+
+
+async def main():
+    result = await asyncio.gather(receive(16), send(16))
+    print("    received: %d" % result[0])
+
+print("02:Loopback with asyncio ===========================")
+asyncio.run(asyncio.wait_for(main(), 5))
+print()
+
+print("98:Removing sequencer ==============================")
+debug([seq])
+del seq
+print()
+
+debugdone()
+print("seqtest5.py done.")
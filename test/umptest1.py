@@ -0,0 +1,105 @@
+#! /usr/bin/python
+# Sample code for pyalsa Sequencer binding
+# UMP (MIDI 2.0) packets: local loopback, then through the virtual UMP
+# endpoint of snd-seq-dummy when loaded with ump=1
+# (modprobe snd-seq-dummy ump=1); no hardware is needed.
+#
+# This code is in the public domain,
+# use it as base for creating your pyalsa
+# sequencer application.
+
+import sys
+sys.path.insert(0, '..')
+del sys
+from array import array
+from alsamemdebug import debuginit, debug, debugdone
+from pyalsa import alsaseq
+
+debuginit()
+
+
+def note_on(channel, note, velocity, group=0):
+    # MIDI 2.0 channel voice message, 64 bits: velocity is 16 bits
+    return [0x40900000 | group << 24 | channel << 16 | note << 8,
+            velocity << 16]
+
+
+def note_off(channel, note, velocity, group=0):
+    return [0x40800000 | group << 24 | channel << 16 | note << 8,
+            velocity << 16]
+
+
+def per_note_controller(channel, note, index, value, group=0):
+    # registered per-note controller: 32-bit value
+    return [0x40000000 | group << 24 | channel << 16 | note << 8 | index,
+            value]
+
+
+def receive_all(seq, expected):
+    words = array('I', [0] * 64)
+    sources = array('H', [0] * 16)
+    received = []
+    while len(received) < expected:
+        count = seq.receive_ump(words, timeout=1000, sources=sources)
+        if count == 0:
+            break
+        received.extend(words[:count])
+    return received
+
+if not alsaseq.SEQ_UMP_SUPPORTED:
+    print("alsa-lib without UMP support (1.2.10 or later needed)")
+    raise SystemExit(0)
+
+print("01:Creating UMP Sequencer and loopback ports =======")
+seq = alsaseq.Sequencer(clientname='umptest1')
+seq.set_midi_version(alsaseq.SEQ_CLIENT_UMP_MIDI_2_0)
+print("    midi_version: %s" % seq.get_client_info()['midi_version'])
+src = seq.create_simple_port('src', alsaseq.SEQ_PORT_TYPE_APPLICATION,
+                             alsaseq.SEQ_PORT_CAP_READ |
+                             alsaseq.SEQ_PORT_CAP_SUBS_READ)
+dst = seq.create_simple_port('dst', alsaseq.SEQ_PORT_TYPE_APPLICATION,
+                             alsaseq.SEQ_PORT_CAP_WRITE |
+                             alsaseq.SEQ_PORT_CAP_SUBS_WRITE)
+print()
+
+packets = array('I', note_on(0, 60, 0xc000) +
+                per_note_controller(0, 60, 7, 0x80000000) +
+                note_off(0, 60, 0))
+
+print("02:Local loopback =================================")
+seq.connect_ports((seq.client_id, src), (seq.client_id, dst))
+print("    sent: %d packets" % seq.output_ump(packets, port=src, drain=True))
+received = receive_all(seq, len(packets))
+print("    received: %s" % ['%08x' % w for w in received])
+print("    same: %s" % (array('I', received) == packets))
+seq.disconnect_ports((seq.client_id, src), (seq.client_id, dst))
+print()
+
+print("03:Through the snd-seq-dummy UMP endpoint =========")
+topo = alsaseq.SeqTopology()
+through = [addr for addr in topo.find('Midi Through')
+           if topo.get_client(addr[0])['type'] == alsaseq.SEQ_KERNEL_CLIENT]
+del topo
+if not through:
+    print("    snd-seq-dummy not loaded, skipped")
+else:
+    info = seq.get_client_info(through[0][0])
+    print("    endpoint: %d:%d, midi_version %s" % (through[0][0],
+                                                   through[0][1],
+                                                   info['midi_version']))
+    seq.connect_ports((seq.client_id, src), through[0])
+    seq.connect_ports(through[0], (seq.client_id, dst))
+    seq.output_ump(packets, port=src, drain=True)
+    received = receive_all(seq, len(packets))
+    print("    received: %s" % ['%08x' % w for w in received])
+    seq.disconnect_ports((seq.client_id, src), through[0])
+    seq.disconnect_ports(through[0], (seq.client_id, dst))
+print()
+
+print("98:Removing sequencer ==============================")
+debug([seq])
+del seq
+print()
+
+debugdone()
+print("umptest1.py done.")
@@ -1,4 +1,4 @@
-#! /usr/bin/python
+#! /usr/bin/python3
 
 # aconnect.py -- python port of aconnect
 # Copyright (C) 2008 Aldrin Martoq <amartoq@dcc.uchile.cl>
@@ -24,6 +24,7 @@ import sys
 sys.path.insert(0, '../pyalsa')
 
 import getopt
+import traceback
 import os
 from alsaseq import *
 
@@ -49,31 +50,30 @@ def init_seq():
                               streams = SEQ_OPEN_DUPLEX,
                               mode = SEQ_BLOCK)
         return sequencer
-    except SequencerError, e:
+    except SequencerError as e:
         fatal("open sequencer: %e", e)
 
 
 def usage():
-    print  \
-        "aconnect - python ALSA sequencer connection manager\n" \
-        "Copyright (C) 1999-2000 Takashi Iwai\n" \
-        "Copyright (C) 2008 Aldrin Martoq <amartoq@dcc.uchile.cl>\n" \
-        "Usage: \n" \
-        " * Connection/disconnection between ports\n" \
-        "   %s [-options] sender receiver\n" \
-        "     sender, receiver = client:port pair\n" \
-        "     -d,--disconnect     disconnect\n" \
-        "     -e,--exclusive      exclusive connection\n" \
-        "     -r,--real #         convert real-time-stamp on queue\n" \
-        "     -t,--tick #         convert tick-time-stamp on queue\n" \
-        " * List connected ports (no subscription action)\n" \
-        "   %s -i|-o [-options]\n" \
-        "     -i,--input          list input (readable) ports\n" \
-        "     -o,--output         list output (writable) ports\n" \
-        "     -l,--list           list current connections of each port\n" \
-        " * Remove all exported connections\n" \
-        "     -x,--removeall" \
-        % (sys.argv[0], sys.argv[0])
+    print("aconnect - python ALSA sequencer connection manager\n"
+        "Copyright (C) 1999-2000 Takashi Iwai\n"
+        "Copyright (C) 2008 Aldrin Martoq <amartoq@dcc.uchile.cl>\n"
+        "Usage: \n"
+        " * Connection/disconnection between ports\n"
+        "   %s [-options] sender receiver\n"
+        "     sender, receiver = client:port pair\n"
+        "     -d,--disconnect     disconnect\n"
+        "     -e,--exclusive      exclusive connection\n"
+        "     -r,--real #         convert real-time-stamp on queue\n"
+        "     -t,--tick #         convert tick-time-stamp on queue\n"
+        " * List connected ports (no subscription action)\n"
+        "   %s -i|-o [-options]\n"
+        "     -i,--input          list input (readable) ports\n"
+        "     -o,--output         list output (writable) ports\n"
+        "     -l,--list           list current connections of each port\n"
+        " * Remove all exported connections\n"
+        "     -x,--removeall"
+        % (sys.argv[0], sys.argv[0]))
 
 def do_list_subs(conn, text):
     l = []
@@ -89,7 +89,7 @@ def do_list_subs(conn, text):
         s = "%d:%d%s" % (c, p, s)
         l.append(s)
     if len(l):
-        print "\t%s: %s" % (text, ', '.join(l))
+        print("\t%s: %s" % (text, ', '.join(l)))
 
 
 def do_list_ports(sequencer, list_perm, list_subs):
@@ -115,10 +115,10 @@ def do_list_ports(sequencer, list_perm, list_subs):
                 elif (list_perm & LIST_OUTPUT) and (caps & write == write):
                     count.append(port)
         if len(count) > 0:
-            print "client %d: '%s' [type=%s]" % (clientid, clientname, type)
+            print("client %d: '%s' [type=%s]" % (clientid, clientname, type))
             for port in count:
                 portname, portid, portconns = port
-                print "  %3d '%-16s'" % (portid, portname)
+                print("  %3d '%-16s'" % (portid, portname))
                 if list_subs:
                     readconn, writeconn = portconns
                     do_list_subs(readconn, "Connecting To")
@@ -130,11 +130,11 @@ def do_unsubscribe(sequencer, args):
     try:
         sequencer.get_connect_info(sender, dest)
     except SequencerError:
-        print 'No subscription is found'
+        print('No subscription is found')
         return
     try:
         sequencer.disconnect_ports(sender, dest)
-    except SequencerError, e:
+    except SequencerError as e:
         fatal("Failed to disconnect ports %s->%s - %s", sender, dest, e)
 
 def do_subscribe(sequencer, args, queue, exclusive, convert_time, convert_real):
@@ -142,12 +142,24 @@ def do_subscribe(sequencer, args, queue, exclusive, convert_time, convert_real):
     dest = sequencer.parse_address(args[1])
     try:
         sequencer.get_connect_info(sender, dest)
-        print "Connection is already subscribed"
+        print("Connection is already subscribed")
         return
     except SequencerError:
         pass
     sequencer.connect_ports(sender, dest, queue, exclusive, convert_time, convert_real)
 
+def do_removeall(sequencer):
+    remove = []
+    for clientname, clientid, connectedports in sequencer.connection_list():
+        for portname, portid, portconns in connectedports:
+            portinfo = sequencer.get_port_info(portid, clientid)
+            if portinfo['capability'] & SEQ_PORT_CAP_NO_EXPORT:
+                continue
+            readconn, writeconn = portconns
+            for c, p, i in readconn:
+                remove.append(((clientid, portid), (c, p)))
+    sequencer.apply_subscriptions(remove=remove, atomic=False)
+
 def main():
     sequencer = init_seq()
     command = 'subscribe'
@@ -191,6 +203,10 @@ def main():
         do_list_ports(sequencer, list_perm, list_subs)
         return
 
+    if command == 'removeall':
+        do_removeall(sequencer)
+        return
+
     if len(args) != 2:
         usage()
         sys.exit(2)
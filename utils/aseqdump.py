@@ -1,4 +1,4 @@
-#! /usr/bin/python
+#! /usr/bin/python3
 
 # aseqdump.py -- python port of aplaymidi
 # Copyright (C) 2008 Aldrin Martoq <amartoq@dcc.uchile.cl>
@@ -54,7 +54,7 @@ def init_seq():
                               streams = SEQ_OPEN_DUPLEX,
                               mode = SEQ_BLOCK)
         return sequencer
-    except SequencerError, e:
+    except SequencerError as e:
         fatal("open sequencer: %e", e)
 
 
@@ -70,7 +70,7 @@ def parse_ports(sequencer, portspec):
         try:
             client, port = sequencer.parse_address(port)
             portlist.append((client, port))
-        except SequencerError, e:
+        except SequencerError as e:
             fatal("Failed to parse port %s - %s", port, e)
     return portlist
 
@@ -83,7 +83,7 @@ def create_source_port(sequencer):
                                             caps = SEQ_PORT_CAP_WRITE
                                             | SEQ_PORT_CAP_SUBS_WRITE)
         return port
-    except SequencerError, e:
+    except SequencerError as e:
         fatal("Failed to create port - %s", e)
 
 
@@ -93,30 +93,62 @@ def connect_ports(sequencer, port_id, ports):
         sequencer.connect_ports((client, port),(client_id, port_id))
 
 def dump_event(event):
-    print "%3d:%-3d" % ((event.source)[0], (event.source)[1]),
+    print("%3d:%-3d" % ((event.source)[0], (event.source)[1]), end=' ')
     type = event.type
     data = event.get_data()
     if type == SEQ_EVENT_NOTEON:
-        print "Note on                %2d %3d %3d" % \
-            (data['note.channel'], data['note.note'], data['note.velocity'])
+        print("Note on                %2d %3d %3d" %
+            (data['note.channel'], data['note.note'], data['note.velocity']))
     elif type == SEQ_EVENT_NOTEOFF:
-        print "Note off               %2d %3d %3d" % \
-            (data['note.channel'], data['note.note'], data['note.velocity'])
+        print("Note off               %2d %3d %3d" %
+            (data['note.channel'], data['note.note'], data['note.velocity']))
     elif type == SEQ_EVENT_KEYPRESS:
-        print "Polyphonic aftertouch  %2d %3d %3d" % \
-            (data['note.channel'], data['note.note'], data['note.velocity'])
+        print("Polyphonic aftertouch  %2d %3d %3d" %
+            (data['note.channel'], data['note.note'], data['note.velocity']))
     elif type == SEQ_EVENT_CONTROLLER:
-        print "Control change         %2d %3d %3d" % \
-            (data['control.channel'], data['control.param'], data['control.value'])
+        print("Control change         %2d %3d %3d" %
+            (data['control.channel'], data['control.param'], data['control.value']))
     elif type == SEQ_EVENT_PGMCHANGE:
-        print "Program change         %2d %3d" % \
-            (data['control.channel'], data['control.value'])
+        print("Program change         %2d %3d" %
+            (data['control.channel'], data['control.value']))
     else:
-        print "Event type %d" % type
+        print("Event type %d" % type)
+
+def log_events(sequencer, filename):
+    """ logs the events to a binary file until Ctrl+C """
+    try:
+        logger = EventLogger(sequencer, filename)
+        logger.start()
+    except (SequencerError, IOError, OSError) as e:
+        fatal("Failed to log to %s - %s", filename, e)
+    while True:
+        try:
+            time.sleep(1)
+        except KeyboardInterrupt:
+            break
+    stats = logger.stop()
+    print("%d events logged, %d overruns, %d bytes" %
+        (stats['logged'], stats['overruns'], stats['bytes']))
+
+
+def read_log(filename):
+    """ dumps the events of a binary log """
+    try:
+        log = EventLog(filename)
+    except (ValueError, IOError, OSError) as e:
+        fatal("Failed to read %s - %s", filename, e)
+    times = struct.unpack('%dQ' % len(log), log.times())
+    print("Time_____ Source_ Event_________________ Ch _Data__")
+    for i in range(len(log)):
+        print("%9.6f" % (times[i] / 1e9), end=' ')
+        dump_event(log[i])
+    if log.truncated:
+        print("(log truncated)")
+
 
 def list_ports():
     sequencer = init_seq()
-    print " Port    Client name                      Port name";
+    print(" Port    Client name                      Port name")
     clientports = sequencer.connection_list()
     for connections in clientports:
         clientname, clientid, connectedports = connections
@@ -125,28 +157,31 @@ def list_ports():
             portinfo = sequencer.get_port_info(portid, clientid)
             caps = portinfo['capability']
             if caps & (SEQ_PORT_CAP_READ | SEQ_PORT_CAP_SUBS_READ):
-                print "%3d:%-3d  %-32.32s %s" % (clientid, portid, clientname, portname)
+                print("%3d:%-3d  %-32.32s %s" % (clientid, portid, clientname, portname))
 
 def usage():
-    print "Usage: %s [options]\n" \
-        "\nAvailable options:\n" \
-        "-h, --help                  this help\n" \
-        "-V, --version               show version\n" \
-        "-l, --list                  list input ports\n" \
-        "-p, --port=client:port,...  source port(s)\n" \
-        % (sys.argv[0])
+    print("Usage: %s [options]\n"
+        "\nAvailable options:\n"
+        "-h, --help                  this help\n"
+        "-V, --version               show version\n"
+        "-l, --list                  list input ports\n"
+        "-p, --port=client:port,...  source port(s)\n"
+        "-b, --binary=file           log the events to a binary file\n"
+        "-r, --read=file             dump the events of a binary file\n"
+        % (sys.argv[0]))
 
 def version():
-    print "aseqdump.py asoundlib version %s" % (SEQ_LIB_VERSION_STR)
+    print("aseqdump.py asoundlib version %s" % (SEQ_LIB_VERSION_STR))
 
 
 def main():
     sequencer = init_seq()
     ports = []
     end_delay = 2
+    binary = None
 
     try:
-        opts, args = getopt.getopt(sys.argv[1:], "hVlp:", ["help", "version", "list", "port="])
+        opts, args = getopt.getopt(sys.argv[1:], "hVlp:b:r:", ["help", "version", "list", "port=", "binary=", "read="])
     except getopt.GetoptError:
         usage()
         sys.exit(2)
@@ -164,6 +199,11 @@ def main():
             ports = parse_ports(sequencer, a)
         elif o in ("-d", "--delay"):
             end_delay = int(a)
+        elif o in ("-b", "--binary"):
+            binary = a
+        elif o in ("-r", "--read"):
+            read_log(a)
+            sys.exit(0)
 
     source_port = create_source_port(sequencer)
     connect_ports(sequencer, source_port, ports)
@@ -171,12 +211,15 @@ def main():
     sequencer.mode = SEQ_NONBLOCK
 
     if len(ports) > 0:
-        print "Waiting for data.",
+        print("Waiting for data.", end=' ')
     else:
-        print "Waiting for data at port %d:0." % sequencer.client_id,
+        print("Waiting for data at port %d:0." % sequencer.client_id, end=' ')
 
-    print "Press Ctrl+C to end."
-    print "Source_ Event_________________ Ch _Data__"
+    print("Press Ctrl+C to end.")
+    if binary is not None:
+        log_events(sequencer, binary)
+        return
+    print("Source_ Event_________________ Ch _Data__")
 
     while True:
         try:
@@ -9,5 +9,5 @@ for id in list:
 	elem = Element(hctl, id[1:])
 	info = Info(elem)
 	if info.is_user:
-		print 'Removing element %s' % repr(id)
+		print('Removing element %s' % repr(id))
 		hctl.element_remove(id[1:])